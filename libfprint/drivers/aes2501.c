@@ -93,7 +93,6 @@ struct aes2501_read_regs
 {
   FpImageDevice       *dev;
   aes2501_read_regs_cb callback;
-  struct aes_regwrite *regwrite;
   void                *user_data;
 };
 
@@ -113,7 +112,6 @@ read_regs_rq_cb (FpImageDevice *dev, GError *error, void *user_data)
   struct aes2501_read_regs *rdata = user_data;
   FpiUsbTransfer *transfer;
 
-  g_free (rdata->regwrite);
   if (error)
     {
       rdata->callback (dev, error, NULL, rdata->user_data);
@@ -128,24 +126,22 @@ read_regs_rq_cb (FpImageDevice *dev, GError *error, void *user_data)
                            read_regs_data_cb, rdata);
 }
 
+static const struct aes_regwrite read_regs_req[] = {
+  { AES2501_REG_CTRL2, AES2501_CTRL2_READ_REGS },
+};
+
 static void
 read_regs (FpImageDevice *dev, aes2501_read_regs_cb callback,
            void *user_data)
 {
-  /* FIXME: regwrite is dynamic because of asynchronity. is this really
-   * required? */
-  struct aes_regwrite *regwrite = g_malloc (sizeof (*regwrite));
   struct aes2501_read_regs *rdata = g_malloc (sizeof (*rdata));
 
   G_DEBUG_HERE ();
-  regwrite->reg = AES2501_REG_CTRL2;
-  regwrite->value = AES2501_CTRL2_READ_REGS;
   rdata->dev = dev;
   rdata->callback = callback;
   rdata->user_data = user_data;
-  rdata->regwrite = regwrite;
 
-  aes_write_regv (dev, (const struct aes_regwrite *) regwrite, 1,
+  aes_write_regv (dev, read_regs_req, G_N_ELEMENTS (read_regs_req),
                   read_regs_rq_cb, rdata);
 }
 
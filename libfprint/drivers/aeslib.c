@@ -34,123 +34,63 @@
 
 struct write_regv_data
 {
-  unsigned int               num_regs;
-  const struct aes_regwrite *regs;
-  unsigned int               offset;
-  aes_write_regv_cb          callback;
-  void                      *user_data;
+  aes_write_regv_cb callback;
+  void             *user_data;
 };
 
-static void continue_write_regv (FpImageDevice          *dev,
-                                 struct write_regv_data *wdata);
-
-/* libusb bulk callback for regv write completion transfer. continues the
- * transaction */
-static void
-write_regv_trf_complete (FpiUsbTransfer *transfer, FpDevice *device,
-                         gpointer user_data, GError *error)
-{
-  struct write_regv_data *wdata = user_data;
-
-  if (error)
-    {
-      wdata->callback (FP_IMAGE_DEVICE (device), error, wdata->user_data);
-      g_free (wdata);
-    }
-  else
-    {
-      continue_write_regv (FP_IMAGE_DEVICE (device), wdata);
-    }
-}
-
-/* write from wdata->offset to upper_bound (inclusive) of wdata->regs */
-static void
-do_write_regv (FpImageDevice *dev, struct write_regv_data *wdata, int upper_bound)
+/* combine multiple writes in a single URB up to a limit, writes to the
+ * non-existent register 0 separate groups of writes into different URBs. */
+static FpiUsbRegSequence *
+compile_regv (gconstpointer table, guint num_regs)
 {
-  unsigned int offset = wdata->offset;
-  unsigned int num = upper_bound - offset + 1;
-  size_t alloc_size = num * 2;
+  const struct aes_regwrite *regs = table;
+  FpiUsbRegSequence *sequence;
   unsigned int i;
-  size_t data_offset = 0;
-  FpiUsbTransfer *transfer = fpi_usb_transfer_new (FP_DEVICE (dev));
-
-  fpi_usb_transfer_fill_bulk (transfer, EP_OUT, alloc_size);
 
-  for (i = offset; i < offset + num; i++)
+  sequence = fpi_usb_reg_sequence_new_bulk (EP_OUT, MAX_REGWRITES_PER_REQUEST);
+  for (i = 0; i < num_regs; i++)
     {
-      const struct aes_regwrite *regwrite = &wdata->regs[i];
-      transfer->buffer[data_offset++] = regwrite->reg;
-      transfer->buffer[data_offset++] = regwrite->value;
+      if (regs[i].reg)
+        fpi_usb_reg_sequence_add (sequence, regs[i].reg, regs[i].value);
+      else
+        fpi_usb_reg_sequence_add_break (sequence);
     }
 
-  transfer->short_is_error = TRUE;
-  fpi_usb_transfer_submit (transfer, BULK_TIMEOUT, NULL,
-                           write_regv_trf_complete, wdata);
+  return sequence;
 }
 
-/* write the next batch of registers to be written, or if there are no more,
- * indicate completion to the caller */
 static void
-continue_write_regv (FpImageDevice *dev, struct write_regv_data *wdata)
+write_regv_done (FpiUsbRegSequence *sequence, FpDevice *device,
+                 gpointer user_data, GError *error)
 {
-  unsigned int offset = wdata->offset;
-  unsigned int regs_remaining;
-  unsigned int limit;
-  unsigned int upper_bound;
-  int i;
-
-  /* skip all zeros and ensure there is still work to do */
-  while (TRUE)
-    {
-      if (offset >= wdata->num_regs)
-        {
-          fp_dbg ("all registers written");
-          wdata->callback (dev, 0, wdata->user_data);
-          g_free (wdata);
-          return;
-        }
-      if (wdata->regs[offset].reg)
-        break;
-      offset++;
-    }
-
-  wdata->offset = offset;
-  regs_remaining = wdata->num_regs - offset;
-  limit = MIN (regs_remaining, MAX_REGWRITES_PER_REQUEST);
-  upper_bound = offset + limit - 1;
-
-  /* determine if we can write the entire of the regs at once, or if there
-   * is a zero dividing things up */
-  for (i = offset; i <= upper_bound; i++)
-    if (!wdata->regs[i].reg)
-      {
-        upper_bound = i - 1;
-        break;
-      }
-
-  do_write_regv (dev, wdata, upper_bound);
+  struct write_regv_data *wdata = user_data;
 
-  wdata->offset = upper_bound + 1;
+  wdata->callback (FP_IMAGE_DEVICE (device), error, wdata->user_data);
+  g_free (wdata);
 }
 
 /* write a load of registers to the device, combining multiple writes in a
  * single URB up to a limit. insert writes to non-existent register 0 to force
- * specific groups of writes to be separated by different URBs. */
+ * specific groups of writes to be separated by different URBs. The transfers
+ * for a table are only built once per device, as long as it is unchanged. */
 void
 aes_write_regv (FpImageDevice *dev, const struct aes_regwrite *regs,
                 unsigned int num_regs, aes_write_regv_cb callback,
                 void *user_data)
 {
+  g_autoptr(FpiUsbRegSequence) sequence = NULL;
   struct write_regv_data *wdata;
 
   fp_dbg ("write %d regs", num_regs);
-  wdata = g_malloc (sizeof (*wdata));
-  wdata->num_regs = num_regs;
-  wdata->regs = regs;
-  wdata->offset = 0;
+  sequence = fpi_usb_reg_sequence_get_cached (FP_DEVICE (dev), regs,
+                                              num_regs * sizeof (*regs),
+                                              compile_regv, num_regs);
+
+  wdata = g_new (struct write_regv_data, 1);
   wdata->callback = callback;
   wdata->user_data = user_data;
-  continue_write_regv (dev, wdata);
+  fpi_usb_reg_sequence_write (sequence, FP_DEVICE (dev), BULK_TIMEOUT, NULL,
+                              write_regv_done, wdata);
 }
 
 unsigned char
@@ -88,12 +88,6 @@ struct _FpiDeviceElan
 };
 G_DEFINE_TYPE (FpiDeviceElan, fpi_device_elan, FP_TYPE_IMAGE_DEVICE);
 
-static int
-cmp_short (const void *a, const void *b)
-{
-  return (int) (*(short *) a - *(short *) b);
-}
-
 static void
 elan_dev_reset_state (FpiDeviceElan *elandev)
 {
@@ -206,18 +200,8 @@ elan_save_img_frame (FpiDeviceElan *elandev)
   unsigned short *frame = g_malloc (frame_size * sizeof (short));
 
   elan_save_frame (elandev, frame);
-  unsigned int sum = 0;
-
-  for (int i = 0; i < frame_size; i++)
-    {
-      if (elandev->background[i] > frame[i])
-        frame[i] = 0;
-      else
-        frame[i] -= elandev->background[i];
-      sum += frame[i];
-    }
 
-  if (sum == 0)
+  if (fpi_image_u16_subtract (frame, elandev->background, frame_size, NULL) == 0)
     {
       fp_dbg
         ("frame darker than background; finger present during calibration?");
@@ -241,26 +225,14 @@ elan_process_frame_linear (unsigned short *raw_frame,
 
   G_DEBUG_HERE ();
 
-  unsigned short min = 0xffff, max = 0;
+  static const guint8 values[] = { 0, 0xff };
+  guint16 levels[2];
 
-  for (int i = 0; i < frame_size; i++)
-    {
-      if (raw_frame[i] < min)
-        min = raw_frame[i];
-      if (raw_frame[i] > max)
-        max = raw_frame[i];
-    }
+  fpi_image_u16_min_max (raw_frame, frame_size, &levels[0], &levels[1]);
+  g_assert (levels[0] != levels[1]);
 
-  g_assert (max != min);
-
-  unsigned short px;
-
-  for (int i = 0; i < frame_size; i++)
-    {
-      px = raw_frame[i];
-      px = (px - min) * 0xff / (max - min);
-      frame->data[i] = (unsigned char) px;
-    }
+  fpi_image_u16_map_levels (raw_frame, frame->data, frame_size,
+                            levels, values, G_N_ELEMENTS (levels));
 
   *frames = g_slist_prepend (*frames, frame);
 }
@@ -276,30 +248,18 @@ elan_process_frame_thirds (unsigned short *raw_frame,
   struct fpi_frame *frame =
     g_malloc (frame_size + sizeof (struct fpi_frame));
 
-  unsigned short lvl0, lvl1, lvl2, lvl3;
-  unsigned short *sorted = g_malloc (frame_size * sizeof (short));
-
-  memcpy (sorted, raw_frame, frame_size * sizeof (short));
-  qsort (sorted, frame_size, sizeof (short), cmp_short);
-  lvl0 = sorted[0];
-  lvl1 = sorted[frame_size * 3 / 10];
-  lvl2 = sorted[frame_size * 65 / 100];
-  lvl3 = sorted[frame_size - 1];
-  g_free (sorted);
-
-  unsigned short px;
-
-  for (int i = 0; i < frame_size; i++)
-    {
-      px = raw_frame[i];
-      if (lvl0 <= px && px < lvl1)
-        px = (px - lvl0) * 99 / (lvl1 - lvl0);
-      else if (lvl1 <= px && px < lvl2)
-        px = 99 + ((px - lvl1) * 56 / (lvl2 - lvl1));
-      else                      // (lvl2 <= px && px <= lvl3)
-        px = 155 + ((px - lvl2) * 100 / (lvl3 - lvl2));
-      frame->data[i] = (unsigned char) px;
-    }
+  /* Pixels up to the 30th percentile are mapped onto 0..99, up to the
+   * 65th percentile onto 99..155 and the rest onto 155..255 */
+  static const guint8 values[] = { 0, 99, 155, 255 };
+  const gsize ranks[] = {
+    0, frame_size * 3 / 10, frame_size * 65 / 100, frame_size - 1
+  };
+  guint16 levels[G_N_ELEMENTS (ranks)];
+
+  fpi_image_u16_percentiles (raw_frame, frame_size, ranks, levels,
+                             G_N_ELEMENTS (ranks));
+  fpi_image_u16_map_levels (raw_frame, frame->data, frame_size,
+                            levels, values, G_N_ELEMENTS (levels));
 
   *frames = g_slist_prepend (*frames, frame);
 }
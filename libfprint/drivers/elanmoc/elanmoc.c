@@ -990,6 +990,7 @@ static void fpi_device_elanmoc_class_init(FpiDeviceElanmocClass *klass) {
   dev_class->id_table = id_table;
   dev_class->nr_enroll_stages = ELAN_MOC_ENROLL_TIMES;
   dev_class->temp_hot_seconds = -1;
+  dev_class->cache_storage = TRUE;
 
   dev_class->open = elanmoc_open;
   dev_class->close = elanmoc_close;
@@ -1153,20 +1153,10 @@ enum elanspi_guess_result {
 static gint
 elanspi_correct_with_bg (FpiDeviceElanSpi *self, guint16 *raw_image)
 {
-  gint count = 0;
+  gsize count;
 
-  for (int i = 0; i < self->sensor_width * self->sensor_height; i += 1)
-    {
-      if (raw_image[i] < self->bg_image[i])
-        {
-          count += 1;
-          raw_image[i] = 0;
-        }
-      else
-        {
-          raw_image[i] -= self->bg_image[i];
-        }
-    }
+  fpi_image_u16_subtract (raw_image, self->bg_image,
+                          self->sensor_width * self->sensor_height, &count);
 
   return count;
 }
@@ -1269,58 +1259,30 @@ elanspi_check_waitupdown_done (FpiDeviceElanSpi *self, enum elanspi_guess_result
     }
 }
 
-static int
-cmp_u16 (const void *a, const void *b)
-{
-  return (int) (*(guint16 *) a - *(guint16 *) b);
-}
-
 static void
 elanspi_process_frame (FpiDeviceElanSpi *self, const guint16 *data_in, guint8 *data_out)
 {
+  static const guint8 values[] = { 0, 99, 155, 255 };
   size_t frame_size = self->frame_width * self->frame_height;
-  guint16 data_in_sorted[frame_size];
+  const gsize ranks[] = {
+    0, frame_size * 3 / 10, frame_size * 65 / 100, frame_size - 1
+  };
+  guint16 levels[G_N_ELEMENTS (ranks)];
+  guint16 data_in_rotated[frame_size];
 
   for (int i = 0, offset = 0; i < self->frame_height; i += 1)
     for (int j = 0; j < self->frame_width; j += 1)
-      data_in_sorted[offset++] = elanspi_lookup_pixel_with_rotation (self, data_in, i, j);
+      data_in_rotated[offset++] = elanspi_lookup_pixel_with_rotation (self, data_in, i, j);
 
-  qsort (data_in_sorted, frame_size, 2, cmp_u16);
-  guint16 lvl0 = data_in_sorted[0];
-  guint16 lvl1 = data_in_sorted[frame_size * 3 / 10];
-  guint16 lvl2 = data_in_sorted[frame_size * 65 / 100];
-  guint16 lvl3 = data_in_sorted[frame_size - 1];
+  fpi_image_u16_percentiles (data_in_rotated, frame_size, ranks, levels,
+                             G_N_ELEMENTS (ranks));
 
-  lvl1 = MAX (lvl1, lvl0 + 1);
-  lvl2 = MAX (lvl2, lvl1 + 1);
-  lvl3 = MAX (lvl3, lvl2 + 1);
+  levels[1] = MAX (levels[1], levels[0] + 1);
+  levels[2] = MAX (levels[2], levels[1] + 1);
+  levels[3] = MAX (levels[3], levels[2] + 1);
 
-  for (int i = 0; i < self->frame_height; i += 1)
-    {
-      for (int j = 0; j < self->frame_width; j += 1)
-        {
-          guint16 px = elanspi_lookup_pixel_with_rotation (self, data_in, i, j);
-          if (px < lvl0)
-            {
-              px = 0;
-            }
-          else if (px > lvl3)
-            {
-              px = 255;
-            }
-          else
-            {
-              if (lvl0 <= px && px < lvl1)
-                px = (px - lvl0) * 99 / (lvl1 - lvl0);
-              else if (lvl1 <= px && px < lvl2)
-                px = 99 + ((px - lvl1) * 56 / (lvl2 - lvl1));
-              else /* (lvl2 <= px && px <= lvl3) */
-                px = 155 + ((px - lvl2) * 100 / (lvl3 - lvl2));
-            }
-          *data_out = px;
-          data_out += 1;
-        }
-    }
+  fpi_image_u16_map_levels (data_in_rotated, data_out, frame_size,
+                            levels, values, G_N_ELEMENTS (levels));
 }
 
 static unsigned char
@@ -1702,6 +1664,9 @@ fpi_device_elanspi_class_init (FpiDeviceElanSpiClass *klass)
   dev_class->nr_enroll_stages = 7;       /* these sensors are very hit or miss, may as well record a few extras */
 
   img_class->bz3_threshold = 24;
+  /* Partial swipes only cover part of the finger, the merged template
+   * covers the union of all stages that could be aligned. */
+  img_class->nbis_consolidate = FPI_PRINT_CONSOLIDATE_KEEP_STAGES;
   img_class->img_open = elanspi_open;
   img_class->activate = elanspi_activate;
   img_class->deactivate = elanspi_deactivate;
@@ -1866,6 +1866,7 @@ fpi_device_fpcmoc_class_init (FpiDeviceFpcMocClass *klass)
   dev_class->id_table =         id_table;
   dev_class->nr_enroll_stages = MAX_ENROLL_SAMPLES;
   dev_class->temp_hot_seconds = -1;
+  dev_class->cache_storage =    TRUE;
 
   dev_class->open   =           fpc_dev_open;
   dev_class->close  =           fpc_dev_close;
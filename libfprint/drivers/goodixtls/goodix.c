@@ -26,7 +26,6 @@
 #include <glib.h>
 #include <gusb.h>
 #include <openssl/ssl.h>
-#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -49,8 +48,13 @@ typedef struct
   GoodixCmdCallback   callback;
   gpointer            user_data;
 
-  guint8             *data;
-  guint32             length;
+  GoodixPackAssembler assembler;
+  FpiUsbTransfer     *read_transfer;
+  gboolean            reading;
+
+  // Decrypted image, reused for every capture
+  guint8             *image_buffer;
+  GoodixCallbackInfo  image_callback;
 
   GoodixCallbackInfo *tls_ready_callback;
 
@@ -331,7 +335,7 @@ goodix_receive_protocol (FpDevice *dev, guint8 *data, guint32 length)
   FpiDeviceGoodixTlsPrivate *priv =
     fpi_device_goodixtls_get_instance_private (self);
   guint8 cmd;
-  g_autofree guint8 *payload = NULL;
+  guint8 *payload;
   guint16 payload_len;
   gboolean valid_checksum, valid_null_checksum; // TODO implement checksum.
 
@@ -376,16 +380,12 @@ goodix_receive_pack (FpDevice *dev, guint8 *data, guint32 length)
   FpiDeviceGoodixTlsPrivate *priv =
     fpi_device_goodixtls_get_instance_private (self);
   guint8 flags;
-  g_autofree guint8 *payload = NULL;
+  guint8 *payload;
   guint16 payload_len;
   gboolean valid_checksum; // TODO implement checksum.
 
-  priv->data = g_realloc (priv->data, priv->length + length);
-  memcpy (priv->data + priv->length, data, length);
-  priv->length += length;
-
-  if (!goodix_decode_pack (priv->data, priv->length, &flags, &payload,
-                           &payload_len, &valid_checksum))
+  if (!goodix_pack_assembler_feed (&priv->assembler, data, length, &flags,
+                                   &payload, &payload_len, &valid_checksum))
     {
       // Packet is not full, we still need data.
       fp_dbg ("not full packet");
@@ -417,9 +417,6 @@ goodix_receive_pack (FpDevice *dev, guint8 *data, guint32 length)
       fp_warn ("Unknown flags: 0x%02x", flags);
       break;
     }
-
-  g_clear_pointer (&priv->data, g_free);
-  priv->length = 0;
 }
 
 void
@@ -430,9 +427,12 @@ goodix_receive_data_cb (FpiUsbTransfer *transfer, FpDevice *dev,
   FpiDeviceGoodixTlsPrivate *priv =
     fpi_device_goodixtls_get_instance_private (self);
 
-  if (g_cancellable_is_cancelled (priv->transfer_cancel_tkn))
+  priv->reading = FALSE;
+
+  if (!priv->inited)
     {
       fp_dbg ("transfer cancelled, aborting read loop...");
+      g_clear_error (&error);
       return;
     }
   if (error)
@@ -476,8 +476,11 @@ goodix_start_read_loop (FpDevice *dev)
     return;
   else
     priv->inited = TRUE;
-  if (g_cancellable_is_cancelled (priv->transfer_cancel_tkn))
-    g_cancellable_reset (priv->transfer_cancel_tkn);
+
+  // A read cancelled by a close is still pending, it resubmits once it
+  // returned.
+  if (priv->reading)
+    return;
 
   goodix_receive_data (dev);
 }
@@ -487,16 +490,25 @@ goodix_receive_data (FpDevice *dev)
 {
   FpiDeviceGoodixTls *self = FPI_DEVICE_GOODIXTLS (dev);
   FpiDeviceGoodixTlsClass *class = FPI_DEVICE_GOODIXTLS_GET_CLASS (self);
-  FpiUsbTransfer *transfer = fpi_usb_transfer_new (dev);
   FpiDeviceGoodixTlsPrivate *priv =
     fpi_device_goodixtls_get_instance_private (self);
 
-  transfer->short_is_error = FALSE;
+  if (g_cancellable_is_cancelled (priv->transfer_cancel_tkn))
+    g_cancellable_reset (priv->transfer_cancel_tkn);
 
-  fpi_usb_transfer_fill_bulk (transfer, class->ep_in,
-                              GOODIX_EP_IN_MAX_BUF_SIZE);
+  // Only one read is outstanding at any time, the transfer and its buffer
+  // are recycled for every packet.
+  if (!priv->read_transfer)
+    {
+      priv->read_transfer = fpi_usb_transfer_new (dev);
+      priv->read_transfer->short_is_error = FALSE;
+      fpi_usb_transfer_fill_bulk (priv->read_transfer, class->ep_in,
+                                  GOODIX_EP_IN_MAX_BUF_SIZE);
+    }
 
-  fpi_usb_transfer_submit (transfer, 0, priv->transfer_cancel_tkn,
+  priv->reading = TRUE;
+  fpi_usb_transfer_submit (fpi_usb_transfer_ref (priv->read_transfer), 0,
+                           priv->transfer_cancel_tkn,
                            goodix_receive_data_cb, NULL);
 }
 
@@ -1255,9 +1267,9 @@ goodix_dev_init (FpDevice *dev, GError **error)
   priv->reply = FALSE;
   priv->callback = NULL;
   priv->user_data = NULL;
-  priv->data = NULL;
-  priv->length = 0;
-  priv->transfer_cancel_tkn = g_cancellable_new ();
+  goodix_pack_assembler_init (&priv->assembler);
+  if (!priv->transfer_cancel_tkn)
+    priv->transfer_cancel_tkn = g_cancellable_new ();
 
   return g_usb_device_claim_interface (fpi_device_get_usb_device (dev),
                                        class->interface, 0, error);
@@ -1287,13 +1299,18 @@ goodix_dev_deinit (FpDevice *dev, GError **error)
 
   if (priv->timeout)
     g_source_destroy (priv->timeout);
-  g_free (priv->data);
   g_cancellable_cancel (priv->transfer_cancel_tkn);
   goodix_shutdown_tls (dev, error);
 
   goodix_reset_state (dev);
   priv->inited = FALSE;
 
+  // A pending read keeps its own reference until it returned
+  g_clear_pointer (&priv->read_transfer, fpi_usb_transfer_unref);
+
+  goodix_pack_assembler_clear (&priv->assembler);
+  g_clear_pointer (&priv->image_buffer, g_free);
+
   return g_usb_device_release_interface (fpi_device_get_usb_device (dev),
                                          class->interface, 0, error);
 }
@@ -1512,7 +1529,7 @@ goodix_tls (FpDevice *dev, GoodixNoneCallback callback, gpointer user_data)
   FpiDeviceGoodixTlsPrivate *priv =
     fpi_device_goodixtls_get_instance_private (self);
   g_assert (priv->tls_hop == NULL);
-  priv->tls_hop = malloc (sizeof (GoodixTlsServer));
+  priv->tls_hop = g_new0 (GoodixTlsServer, 1);
 
   if (!priv->tls_ready_callback)
     priv->tls_ready_callback = malloc (sizeof (GoodixCallbackInfo));
@@ -1526,6 +1543,8 @@ goodix_tls (FpDevice *dev, GoodixNoneCallback callback, gpointer user_data)
     {
       fp_err ("failed to init tls server, error: %s, code: %d", err->message,
               err->code);
+      g_clear_pointer (&priv->tls_hop, g_free);
+      g_error_free (err);
       return;
     }
 
@@ -1553,47 +1572,53 @@ goodix_tls_ready_image_handler (FpDevice *dev, guint8 *data,
                                 guint16 length, gpointer user_data,
                                 GError *error)
 {
-  
-    GoodixCallbackInfo* cb_info = user_data;
-    GoodixImageCallback callback = (GoodixImageCallback) cb_info->callback;
-    if (error) {
-        callback(dev, NULL, 0, cb_info->user_data, error);
-        g_free(cb_info);
-        return;
+  FpiDeviceGoodixTls *self = FPI_DEVICE_GOODIXTLS (dev);
+  FpiDeviceGoodixTlsPrivate *priv =
+    fpi_device_goodixtls_get_instance_private (self);
+  GoodixCallbackInfo *cb_info = user_data;
+  GoodixImageCallback callback = (GoodixImageCallback) cb_info->callback;
+
+  if (error)
+    {
+      callback (dev, NULL, 0, cb_info->user_data, error);
+      return;
     }
-    FpiDeviceGoodixTls* self = FPI_DEVICE_GOODIXTLS(dev);
-    FpiDeviceGoodixTlsPrivate* priv =
-        fpi_device_goodixtls_get_instance_private(self);
-    goodix_tls_client_send(priv->tls_hop, data, length);
+  goodix_tls_client_send (priv->tls_hop, data, length);
 
-  const guint16 size = -1;
-  guint8 *buff = malloc (size);
   GError *err = NULL;
-  int read_size = goodix_tls_server_receive (priv->tls_hop, buff, size, &err);
+  int read_size = goodix_tls_server_receive (priv->tls_hop, priv->image_buffer,
+                                             G_MAXUINT16, &err);
 
   if (read_size <= 0)
     {
       callback (dev, NULL, 0, cb_info->user_data, err);
-      g_free (cb_info);
       return;
     }
 
-  callback (dev, buff, read_size, cb_info->user_data, NULL);
-  free (buff);
-  g_free (cb_info);
+  // The buffer is only lent to the callback until the next capture
+  callback (dev, priv->image_buffer, read_size, cb_info->user_data, NULL);
 }
 
 void
 goodix_tls_read_image (FpDevice *dev, GoodixImageCallback callback,
                        gpointer user_data)
 {
+  FpiDeviceGoodixTls *self = FPI_DEVICE_GOODIXTLS (dev);
+  FpiDeviceGoodixTlsPrivate *priv =
+    fpi_device_goodixtls_get_instance_private (self);
+  GoodixDefault payload = {.unused_flags = 0x01};
+
   g_assert (callback);
-  GoodixCallbackInfo *cb_info = malloc (sizeof (GoodixCallbackInfo));
 
-  cb_info->callback = G_CALLBACK (callback);
-  cb_info->user_data = user_data;
+  if (!priv->image_buffer)
+    priv->image_buffer = g_malloc (G_MAXUINT16);
 
-  goodix_send_mcu_get_image (dev, goodix_tls_ready_image_handler, cb_info);
+  priv->image_callback.callback = G_CALLBACK (callback);
+  priv->image_callback.user_data = user_data;
+
+  goodix_send_protocol (dev, GOODIX_CMD_MCU_GET_IMAGE, (guint8 *) &payload,
+                        sizeof (payload), NULL, TRUE, GOODIX_TIMEOUT, TRUE,
+                        goodix_tls_ready_image_handler, &priv->image_callback);
 }
 
 // ---- TLS SECTION END ----
@@ -408,74 +408,21 @@ static void check_none_cmd(FpDevice *dev, guint8 *data, guint16 len,
   fpi_ssm_next_state(ssm);
 }
 
-static void decode_frame(Goodix511Pix frame[GOODIX511_FRAME_SIZE],
+// Unpacks, crops and stretches a frame to 8 bit without intermediate buffers
+static void decode_frame(guint8 frame[GOODIX511_FRAME_SIZE],
                          const guint8 *raw_frame) {
-
-  Goodix511Pix uncropped[GOODIX511_SCAN_WIDTH * GOODIX511_HEIGHT];
-  Goodix511Pix *pix = uncropped;
-
-  for (int i = 8; i != GOODIX511_RAW_FRAME_SIZE - 5; i += 6) {
-    const guint8 *chunk = raw_frame + i;
-    *pix++ = ((chunk[0] & 0xf) << 8) + chunk[1];
-    *pix++ = (chunk[3] << 4) + (chunk[0] >> 4);
-    *pix++ = ((chunk[5] & 0xf) << 8) + chunk[2];
-    *pix++ = (chunk[4] << 4) + (chunk[5] >> 4);
-  }
-  for (int y = 0; y != GOODIX511_HEIGHT; ++y) {
-    for (int x = 0; x != GOODIX511_WIDTH; ++x) {
-      const int idx = x + y * GOODIX511_SCAN_WIDTH;
-      frame[x + y * GOODIX511_WIDTH] = uncropped[idx];
-    }
-  }
-}
-
-/**
- * @brief Squashes the 12 bit pixels of a raw frame into the 4 bit pixels used
- * by libfprint.
- * @details Borrowed from the elan driver. We reduce frames to
- * within the max and min.
- *
- * @param frame
- * @param squashed
- */
-static void squash_frame_linear(Goodix511Pix *frame, guint8 *squashed) {
-  Goodix511Pix min = 0xffff;
-  Goodix511Pix max = 0;
-
-  for (int i = 0; i != GOODIX511_FRAME_SIZE; ++i) {
-    const Goodix511Pix pix = frame[i];
-    if (pix < min)
-      min = pix;
-    if (pix > max)
-      max = pix;
-  }
-
-  for (int i = 0; i != GOODIX511_FRAME_SIZE; ++i) {
-    const Goodix511Pix pix = frame[i];
-    if (pix - min == 0 || max - min == 0)
-      squashed[i] = 0;
-    else
-      squashed[i] = (pix - min) * 0xff / (max - min);
-  }
-}
-
-typedef struct _frame_processing_info {
-  FpiDeviceGoodixTls511 *dev;
-  GSList **frames;
-
-} frame_processing_info;
-
-static void process_frame(Goodix511Pix *raw_frame,
-                          frame_processing_info *info) {
-  unsigned char *frame = g_malloc(GOODIX511_FRAME_SIZE);
-
-  squash_frame_linear(raw_frame, frame);
-
-  *(info->frames) = g_slist_append(*(info->frames), frame);
+  static const guint8 values[] = {0, 0xff};
+  Goodix511Pix pix[GOODIX511_FRAME_SIZE];
+  guint16 levels[2];
+
+  goodix_decode_frame(raw_frame + 8, GOODIX511_SCAN_WIDTH, GOODIX511_WIDTH,
+                      GOODIX511_HEIGHT, NULL, pix, &levels[0], &levels[1]);
+  fpi_image_u16_map_levels(pix, frame, GOODIX511_FRAME_SIZE, levels, values,
+                           G_N_ELEMENTS(levels));
 }
 
 static void save_frame(FpiDeviceGoodixTls511 *self, guint8 *raw) {
-  Goodix511Pix *frame = malloc(GOODIX511_FRAME_SIZE * sizeof(Goodix511Pix));
+  guint8 *frame = g_malloc(GOODIX511_FRAME_SIZE);
 
   decode_frame(frame, raw);
   self->frames = g_slist_append(self->frames, frame);
@@ -493,15 +440,10 @@ static void scan_on_read_img(FpDevice *dev, guint8 *data, guint16 len,
   if (g_slist_length(self->frames) <= GOODIX511_CAP_FRAMES) {
     fpi_ssm_jump_to_state(ssm, SCAN_STAGE_SWITCH_TO_FDT_MODE);
   } else {
-    GSList *raw_frames = g_slist_nth(self->frames, 1);
+    GSList *frames = g_slist_nth(self->frames, 1);
 
     FpImageDevice *img_dev = FP_IMAGE_DEVICE(dev);
 
-    GSList *frames = NULL;
-    frame_processing_info pinfo = {.dev = self, .frames = &frames};
-
-    // process_frame(g_slist_nth_data(raw_frames, 0), &pinfo);
-    g_slist_foreach(raw_frames, (GFunc)process_frame, &pinfo);
     // frames = g_slist_reverse(frames);
 
     // fpi_do_movement_estimation(&assembly_ctx, frames);
@@ -516,7 +458,6 @@ static void scan_on_read_img(FpDevice *dev, guint8 *data, guint16 len,
     save_image_to_pgm(img, buff);
 #endif
 
-    g_slist_free_full(frames, g_free);
     g_slist_free_full(self->frames, g_free);
     self->frames = g_slist_alloc();
 
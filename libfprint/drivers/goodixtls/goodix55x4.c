@@ -52,6 +52,10 @@
 #define GOODIX55X4_RAW_FRAME_SIZE                                              \
   (GOODIX55X4_HEIGHT * GOODIX55X4_SCAN_WIDTH) / 4 * 6
 #define GOODIX55X4_CAP_FRAMES 1 // Number of frames we capture per swipe
+// Layout of the cached background, bump when it changes
+#define GOODIX55X4_CALIBRATION_VERSION 1
+// The background drifts with the temperature of the sensor
+#define GOODIX55X4_CALIBRATION_MAX_AGE (10 * G_TIME_SPAN_MINUTE)
 
 typedef unsigned short Goodix55X4Pix;
 
@@ -59,6 +63,7 @@ struct _FpiDeviceGoodixTls55X4 {
   FpiDeviceGoodixTls parent;
 
   guint8 *otp;
+  gchar *firmware;
 
   GSList *frames;
 
@@ -103,6 +108,10 @@ static void check_firmware_version(FpDevice *dev, gchar *firmware,
   fp_dbg("Device firmware: \"%s\"", firmware);
   g_print("%s\n", firmware);
 
+  FpiDeviceGoodixTls55X4 *self = FPI_DEVICE_GOODIXTLS55X4(dev);
+  g_free(self->firmware);
+  self->firmware = g_strdup(firmware);
+
   if (!(strcmp(firmware, GOODIX_55X4_FIRMWARE_VERSION) ||
 	  strcmp(firmware, GOODIX_55X4_FIRMWARE_VERSION2))) {
     g_set_error(&error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
@@ -357,26 +366,8 @@ static unsigned char squash(int v) { return v / 16; }
 
 static void decode_frame(Goodix55X4Pix frame[GOODIX55X4_FRAME_SIZE],
                          const guint8 *raw_frame) {
-
-  Goodix55X4Pix uncropped[GOODIX55X4_SCAN_WIDTH * GOODIX55X4_HEIGHT];
-  Goodix55X4Pix *pix = uncropped;
-  for (int i = 0; i < GOODIX55X4_RAW_FRAME_SIZE; i += 6) {
-    const guint8 *chunk = raw_frame + i;
-    *pix++ = ((chunk[0] & 0xf) << 8) + chunk[1];
-    *pix++ = (chunk[3] << 4) + (chunk[0] >> 4);
-    *pix++ = ((chunk[5] & 0xf) << 8) + chunk[2];
-    *pix++ = (chunk[4] << 4) + (chunk[5] >> 4);
-  }
-
-  for (int y = 0; y != GOODIX55X4_HEIGHT; ++y) {
-    for (int x = 0; x != GOODIX55X4_WIDTH; ++x) {
-      const int idx = x + y * GOODIX55X4_SCAN_WIDTH;
-      frame[x + y * GOODIX55X4_WIDTH] = uncropped[idx];
-    }
-  }
-}
-static int goodix_cmp_short(const void *a, const void *b) {
-  return (int)(*(short *)a - *(short *)b);
+  goodix_decode_frame(raw_frame, GOODIX55X4_SCAN_WIDTH, GOODIX55X4_WIDTH,
+                      GOODIX55X4_HEIGHT, NULL, frame, NULL, NULL);
 }
 
 static void rotate_frame(Goodix55X4Pix frame[GOODIX55X4_FRAME_SIZE]) {
@@ -395,86 +386,38 @@ static void squash_frame(Goodix55X4Pix *frame, guint8 *squashed) {
   }
 }
 /**
- * @brief Squashes the 12 bit pixels of a raw frame into the 4 bit pixels used
- * by libfprint.
- * @details Borrowed from the elan driver. We reduce frames to
- * within the max and min.
+ * @brief Unpacks a frame, subtracts the background and stretches it to 8 bit
  *
- * @param frame
- * @param squashed
- */
-static void squash_frame_linear(Goodix55X4Pix *frame, guint8 *squashed) {
-  Goodix55X4Pix min = 0xffff;
-  Goodix55X4Pix max = 0;
-
-  for (int i = 0; i != GOODIX55X4_FRAME_SIZE; ++i) {
-    const Goodix55X4Pix pix = frame[i];
-    if (pix < min) {
-      min = pix;
-    }
-    if (pix > max) {
-      max = pix;
-    }
-  }
-
-  for (int i = 0; i != GOODIX55X4_FRAME_SIZE; ++i) {
-    const Goodix55X4Pix pix = frame[i];
-    if (pix - min == 0 || max - min == 0) {
-      squashed[i] = 0;
-    } else {
-      squashed[i] = (pix - min) * 0xff / (max - min);
-    }
-  }
-}
-
-/**
- * @brief Subtracts the background from the frame
+ * All steps but the final tone mapping happen in a single pass over the raw
+ * data, without intermediate frames.
  *
- * @param frame
- * @param background
+ * @param self
+ * @param raw_frame
  */
-static gboolean
-postprocess_frame(Goodix55X4Pix frame[GOODIX55X4_FRAME_SIZE],
-                  Goodix55X4Pix background[GOODIX55X4_FRAME_SIZE]) {
-  int sum = 0;
-  for (int i = 0; i != GOODIX55X4_FRAME_SIZE; ++i) {
-    Goodix55X4Pix *og_px = frame + i;
-    Goodix55X4Pix bg_px = background[i];
-    if (bg_px > *og_px) {
-      *og_px = bg_px - *og_px;
-    } else {
-      *og_px -= bg_px;
-    }
+static struct fpi_frame *process_frame(FpiDeviceGoodixTls55X4 *self,
+                                       const guint8 *raw_frame) {
+  static const guint8 values[] = {0, 0xff};
+  struct fpi_frame *frame =
+      g_malloc(GOODIX55X4_FRAME_SIZE + sizeof(struct fpi_frame));
+  Goodix55X4Pix pix[GOODIX55X4_FRAME_SIZE];
+  guint16 levels[2];
 
-    sum += *og_px;
-  }
-  if (sum == 0) {
+  if (goodix_decode_frame(raw_frame, GOODIX55X4_SCAN_WIDTH, GOODIX55X4_WIDTH,
+                          GOODIX55X4_HEIGHT, self->empty_img, pix, &levels[0],
+                          &levels[1]) == 0) {
     fp_warn("frame darker than background, finger on scanner during "
             "calibration?");
+    // Take a new background on the next scan
+    fpi_device_calibration_drop(FP_DEVICE(self));
   }
-  return sum != 0;
-}
+  fpi_image_u16_map_levels(pix, frame->data, GOODIX55X4_FRAME_SIZE, levels,
+                           values, G_N_ELEMENTS(levels));
 
-typedef struct _frame_processing_info {
-  FpiDeviceGoodixTls55X4 *dev;
-  GSList **frames;
-
-} frame_processing_info;
-
-static void process_frame(Goodix55X4Pix *raw_frame,
-                          frame_processing_info *info) {
-  struct fpi_frame *frame =
-      g_malloc(GOODIX55X4_FRAME_SIZE + sizeof(struct fpi_frame));
-  postprocess_frame(raw_frame, info->dev->empty_img);
-  squash_frame_linear(raw_frame, frame->data);
-
-  *(info->frames) = g_slist_append(*(info->frames), frame);
+  return frame;
 }
 
 static void save_frame(FpiDeviceGoodixTls55X4 *self, guint8 *raw) {
-  Goodix55X4Pix *frame = malloc(GOODIX55X4_FRAME_SIZE * sizeof(Goodix55X4Pix));
-  decode_frame(frame, raw);
-  self->frames = g_slist_append(self->frames, frame);
+  self->frames = g_slist_append(self->frames, process_frame(self, raw));
 }
 
 static void scan_on_read_img(FpDevice *dev, guint8 *data, guint16 len,
@@ -490,7 +433,7 @@ static void scan_on_read_img(FpDevice *dev, guint8 *data, guint16 len,
   if (g_slist_length(self->frames) <= GOODIX55X4_CAP_FRAMES) {
     fpi_ssm_jump_to_state(ssm, SCAN_STAGE_SWITCH_TO_FDT_MODE);
   } else {
-    GSList *raw_frames = g_slist_nth(self->frames, 1);
+    GSList *captured = g_slist_nth(self->frames, 1);
 
     FpImageDevice *img_dev = FP_IMAGE_DEVICE(dev);
     struct fpi_frame_asmbl_ctx assembly_ctx;
@@ -499,18 +442,14 @@ static void scan_on_read_img(FpDevice *dev, guint8 *data, guint16 len,
     assembly_ctx.image_width = GOODIX55X4_WIDTH * 1;
     assembly_ctx.get_pixel = get_pix;
 
-    GSList *frames = NULL;
-    frame_processing_info pinfo = {.dev = self, .frames = &frames};
-
-    g_slist_foreach(raw_frames, (GFunc)process_frame, &pinfo);
-    frames = g_slist_reverse(frames);
+    GSList *frames = g_slist_reverse(g_slist_copy(captured));
 
     g_print("MOVEMENT EST\n");
     fpi_do_movement_estimation(&assembly_ctx, frames);
     g_print("MOVEMENT EST DOOONEE\n");
     FpImage *img = fpi_assemble_frames(&assembly_ctx, frames);
 
-    g_slist_free_full(frames, g_free);
+    g_slist_free(frames);
     g_slist_free_full(self->frames, g_free);
     self->frames = g_slist_alloc();
 
@@ -595,6 +534,11 @@ static void on_scan_empty_img(FpDevice *dev, guint8 *data, guint16 length,
   }
   FpiDeviceGoodixTls55X4 *self = FPI_DEVICE_GOODIXTLS55X4(dev);
   decode_frame(self->empty_img, data);
+
+  g_autoptr(GBytes) background =
+      g_bytes_new(self->empty_img, sizeof(self->empty_img));
+  fpi_device_calibration_store(dev, self->firmware,
+                               GOODIX55X4_CALIBRATION_VERSION, background);
   // FpImage *bgk = fp_image_new(GOODIX55X4_WIDTH, GOODIX55X4_HEIGHT);
   // squash_frame(self->empty_img, bgk->data);
   // save_image_to_pgm(bgk, "./background.pgm");
@@ -614,6 +558,26 @@ static void scan_empty_img(FpDevice *dev, FpiSsm *ssm) {
   fpi_ssm_start_subsm(ssm, fpi_ssm_new(dev, scan_empty_run, SCAN_EMPTY_NUM));
 }
 
+// Reuses a recent background instead of taking a new one on every scan
+static gboolean load_empty_img(FpiDeviceGoodixTls55X4 *self) {
+  g_autoptr(GBytes) data = NULL;
+
+  data = fpi_device_calibration_lookup(FP_DEVICE(self), self->firmware,
+                                       GOODIX55X4_CALIBRATION_VERSION,
+                                       GOODIX55X4_CALIBRATION_MAX_AGE);
+  if (!data)
+    return FALSE;
+
+  if (g_bytes_get_size(data) != sizeof(self->empty_img)) {
+    fpi_device_calibration_drop(FP_DEVICE(self));
+    return FALSE;
+  }
+
+  memcpy(self->empty_img, g_bytes_get_data(data, NULL),
+         sizeof(self->empty_img));
+  return TRUE;
+}
+
 static void scan_get_img(FpDevice *dev, FpiSsm *ssm) {
   goodix_tls_read_image(dev, scan_on_read_img, ssm);
 }
@@ -652,7 +616,10 @@ static void scan_run_state(FpiSsm *ssm, FpDevice *dev) {
     goodix_send_query_mcu_state(dev, (guint8 *)&payload, sizeof(payload), check_none_cmd, ssm);
     break;
   case SCAN_STAGE_CALIBRATE:
-    scan_empty_img(dev, ssm);
+    if (load_empty_img(FPI_DEVICE_GOODIXTLS55X4(dev)))
+      fpi_ssm_next_state(ssm);
+    else
+      scan_empty_img(dev, ssm);
     break;
   case SCAN_STAGE_SWITCH_TO_FDT_MODE:
     g_print("SWITCH TO FDT MODE\n");
@@ -757,6 +724,8 @@ static void dev_deinit(FpImageDevice *img_dev) {
   FpDevice *dev = FP_DEVICE(img_dev);
   GError *error = NULL;
 
+  g_clear_pointer(&FPI_DEVICE_GOODIXTLS55X4(img_dev)->firmware, g_free);
+
   if (goodix_dev_deinit(dev, &error)) {
     fpi_image_device_close_complete(img_dev, error);
     return;
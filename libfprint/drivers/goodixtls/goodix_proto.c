@@ -85,6 +85,13 @@ goodix_encode_protocol (guint8 cmd, guint8 *payload, guint16 payload_len,
     (*data)[sizeof (GoodixProtocol) + payload_len] = GOODIX_NULL_CHECKSUM;
 }
 
+static gboolean
+goodix_pack_header_valid (guint8 *data)
+{
+  return goodix_calc_checksum (data, sizeof (GoodixPack)) ==
+         data[sizeof (GoodixPack)];
+}
+
 gboolean
 goodix_decode_pack (guint8 *data, guint32 data_len, guint8 *flags,
                     guint8 **payload, guint16 *payload_len,
@@ -102,7 +109,7 @@ goodix_decode_pack (guint8 *data, guint32 data_len, guint8 *flags,
     return FALSE;
 
   *flags = pack->flags;
-  *payload = g_memdup (data + sizeof (GoodixPack) + sizeof (guint8), length);
+  *payload = data + sizeof (GoodixPack) + sizeof (guint8);
   *payload_len = length;
   *valid_checksum = goodix_calc_checksum (data, sizeof (GoodixPack)) ==
                     data[sizeof (GoodixPack)];
@@ -128,7 +135,7 @@ goodix_decode_protocol (guint8 *data, guint32 data_len, guint8 *cmd,
     return FALSE;
 
   *cmd = protocol->cmd;
-  *payload = g_memdup (data + sizeof (GoodixProtocol), length);
+  *payload = data + sizeof (GoodixProtocol);
   *payload_len = length;
   *valid_checksum =
     0xaa - goodix_calc_checksum (data, sizeof (GoodixProtocol) + length) ==
@@ -138,3 +145,126 @@ goodix_decode_protocol (guint8 *data, guint32 data_len, guint8 *cmd,
 
   return TRUE;
 }
+
+void
+goodix_pack_assembler_init (GoodixPackAssembler *self)
+{
+  self->data = g_malloc (GOODIX_PACK_MAX_SIZE);
+  self->length = 0;
+}
+
+void
+goodix_pack_assembler_clear (GoodixPackAssembler *self)
+{
+  g_clear_pointer (&self->data, g_free);
+  self->length = 0;
+}
+
+// Drops the data in front of the first valid header. A partial header at
+// the end is kept as it cannot be checked yet.
+static void
+goodix_pack_assembler_resync (GoodixPackAssembler *self)
+{
+  const guint32 header_len = sizeof (GoodixPack) + sizeof (guint8);
+  guint32 start = 0;
+
+  while (start + header_len <= self->length &&
+         !goodix_pack_header_valid (self->data + start))
+    start++;
+
+  if (start == 0)
+    return;
+
+  g_debug ("Dropping %u bytes of invalid pack data", start);
+  memmove (self->data, self->data + start, self->length - start);
+  self->length -= start;
+}
+
+// Feeds the data of a bulk-in transfer. Returns TRUE once a whole pack was
+// received, the payload then points either into data or into the
+// assembler and is valid until the next call. Anything following the pack
+// in the same transfer is padding and gets dropped.
+gboolean
+goodix_pack_assembler_feed (GoodixPackAssembler *self, guint8 *data,
+                            guint32 data_len, guint8 *flags,
+                            guint8 **payload, guint16 *payload_len,
+                            gboolean *valid_checksum)
+{
+  guint32 copy_len;
+
+  // Common case, the whole pack is in one transfer. A bad header is
+  // handed to the assembler below, which skips to the next valid one.
+  if (self->length == 0 &&
+      data_len >= sizeof (GoodixPack) + sizeof (guint8) &&
+      goodix_pack_header_valid (data) &&
+      goodix_decode_pack (data, data_len, flags, payload, payload_len,
+                          valid_checksum))
+    return TRUE;
+
+  copy_len = MIN (data_len, GOODIX_PACK_MAX_SIZE - self->length);
+  memcpy (self->data + self->length, data, copy_len);
+  self->length += copy_len;
+
+  // A corrupted header could announce a pack that never arrives, drop
+  // everything up to the next valid header instead of waiting for it.
+  goodix_pack_assembler_resync (self);
+
+  if (!goodix_decode_pack (self->data, self->length, flags, payload,
+                           payload_len, valid_checksum))
+    return FALSE;
+
+  self->length = 0;
+  return TRUE;
+}
+
+// Unpacks, crops and background corrects a frame in one pass. Every 6 bytes
+// hold 4 pixels of 12 bit, rows are scan_width pixels wide of which only the
+// first width are kept. The per pixel work is branch free so the compiler can
+// vectorize it.
+guint64
+goodix_decode_frame (const guint8 *raw_frame, guint scan_width, guint width,
+                     guint height, const guint16 *background, guint16 *frame,
+                     guint16 *min, guint16 *max)
+{
+  guint64 sum = 0;
+  guint16 lo = G_MAXUINT16;
+  guint16 hi = 0;
+
+  g_return_val_if_fail (scan_width % 4 == 0, 0);
+  g_return_val_if_fail (width % 4 == 0 && width <= scan_width, 0);
+
+  for (guint y = 0; y < height; y++)
+    {
+      const guint8 *chunk = raw_frame + y * (scan_width / 4 * 6);
+      guint16 *row = frame + y * width;
+      const guint16 *bg_row = background ? background + y * width : NULL;
+
+      for (guint x = 0; x < width; x += 4, chunk += 6)
+        {
+          guint16 px[4];
+
+          px[0] = ((chunk[0] & 0xf) << 8) + chunk[1];
+          px[1] = (chunk[3] << 4) + (chunk[0] >> 4);
+          px[2] = ((chunk[5] & 0xf) << 8) + chunk[2];
+          px[3] = (chunk[4] << 4) + (chunk[5] >> 4);
+
+          for (guint i = 0; i < 4; i++)
+            {
+              guint16 bg = bg_row ? bg_row[x + i] : 0;
+              guint16 res = px[i] > bg ? px[i] - bg : bg - px[i];
+
+              row[x + i] = res;
+              sum += res;
+              lo = MIN (lo, res);
+              hi = MAX (hi, res);
+            }
+        }
+    }
+
+  if (min)
+    *min = lo;
+  if (max)
+    *max = hi;
+
+  return sum;
+}
@@ -22,6 +22,9 @@
 #define GOODIX_EP_IN_MAX_BUF_SIZE (0x10000)
 #define GOODIX_EP_OUT_MAX_BUF_SIZE (0x40)
 
+// The largest pack the device can send, header and checksum included
+#define GOODIX_PACK_MAX_SIZE (sizeof (GoodixPack) + sizeof (guint8) + G_MAXUINT16)
+
 #define GOODIX_NULL_CHECKSUM (0x88)
 
 #define GOODIX_FLAGS_MSG_PROTOCOL (0xa0)
@@ -161,6 +164,14 @@ typedef struct __attribute__((__packed__)) _GoodixNone
   guint16 : 16;
 } GoodixNone;
 
+// Reassembles packs spanning several bulk-in transfers. The buffer is
+// allocated once and reused for every pack.
+typedef struct _GoodixPackAssembler
+{
+  guint8 *data;
+  guint32 length;
+} GoodixPackAssembler;
+
 guint8 goodix_calc_checksum (guint8 *data,
                              guint16 length);
 
@@ -193,3 +204,28 @@ gboolean goodix_decode_protocol (guint8   *data,
                                  guint16  *payload_len,
                                  gboolean *valid_checksum,
                                  gboolean *valid_null_checksum);
+
+void goodix_pack_assembler_init (GoodixPackAssembler *self);
+
+void goodix_pack_assembler_clear (GoodixPackAssembler *self);
+
+gboolean goodix_pack_assembler_feed (GoodixPackAssembler *self,
+                                     guint8              *data,
+                                     guint32              data_len,
+                                     guint8              *flags,
+                                     guint8             **payload,
+                                     guint16             *payload_len,
+                                     gboolean            *valid_checksum);
+
+// Decodes the packed 12 bit pixels of a raw frame into frame, keeping the
+// first width of every scan_width pixels per row. If background is given, the
+// absolute difference to it is stored instead. Returns the sum of the stored
+// pixels, min and max receive their range.
+guint64 goodix_decode_frame (const guint8  *raw_frame,
+                             guint          scan_width,
+                             guint          width,
+                             guint          height,
+                             const guint16 *background,
+                             guint16       *frame,
+                             guint16       *min,
+                             guint16       *max);
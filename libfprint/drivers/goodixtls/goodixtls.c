@@ -17,39 +17,26 @@
 // License along with this library; if not, write to the Free Software
 // Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
 
-#include <arpa/inet.h>
-#include <errno.h>
 #include <glib.h>
-#include <netinet/in.h>
 #include <openssl/crypto.h>
 #include <openssl/err.h>
 #include <openssl/ssl.h>
 #include <openssl/tls1.h>
-#include <poll.h>
-#include <pthread.h>
-#include <signal.h>
 #include <string.h>
-#include <sys/socket.h>
 
 #include "drivers_api.h"
-#include "fp-device.h"
-#include "fpi-device.h"
-#include "glibconfig.h"
-#include "goodix.h"
 #include "goodixtls.h"
 
 static GError *
-err_from_ssl (void)
+err_from_ssl (const char *what)
 {
-  GError *err = malloc (sizeof (GError));
   unsigned long code = ERR_get_error ();
+  const char *reason = code ? ERR_reason_error_string (code) : NULL;
 
-  err->code = code;
-  const char *msg = ERR_reason_error_string (code);
+  ERR_clear_error ();
 
-  err->message = malloc (strlen (msg));
-  strcpy (err->message, msg);
-  return err;
+  return fpi_device_error_new_msg (FP_DEVICE_ERROR_PROTO, "%s: %s", what,
+                                   reason ? reason : "unknown error");
 }
 
 static unsigned int
@@ -98,22 +85,76 @@ static void tls_server_config_ctx(SSL_CTX* ctx)
     SSL_CTX_set_psk_server_callback(ctx, tls_server_psk_server_callback);
 }
 
+static void
+goodix_tls_server_handshake (GoodixTlsServer *self)
+{
+  int retr;
+
+  if (self->established || self->failed)
+    return;
+
+  retr = SSL_do_handshake (self->ssl_layer);
+  if (retr == 1)
+    {
+      fp_dbg ("TLS server accept done");
+      self->established = TRUE;
+      self->connection_callback (self, NULL, self->user_data);
+      return;
+    }
+
+  switch (SSL_get_error (self->ssl_layer, retr))
+    {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+      // Waiting for the next flight from the device
+      break;
+
+    default:
+      {
+        g_autoptr(GError) error = err_from_ssl ("TLS handshake failed");
+
+        // Records arriving afterwards must not report the failure again
+        self->failed = TRUE;
+        self->connection_callback (self, error, self->user_data);
+      }
+    }
+}
+
 int goodix_tls_client_send(GoodixTlsServer* self, guint8* data, guint16 length)
 {
-    return write(self->client_fd, data, length * sizeof(guint8));
+    int written = BIO_write(self->in_bio, data, length * sizeof(guint8));
+
+    goodix_tls_server_handshake(self);
+
+    return written;
 }
 int goodix_tls_client_recv(GoodixTlsServer* self, guint8* data, guint16 length) {
-    return read(self->client_fd, data, length * sizeof(guint8));
+    goodix_tls_server_handshake(self);
+
+    return BIO_read(self->out_bio, data, length * sizeof(guint8));
 }
 
 int goodix_tls_server_receive(GoodixTlsServer* self, guint8* data,
                               guint32 length, GError** error)
 {
-    int retr = SSL_read(self->ssl_layer, data, length * sizeof(guint8));
-    if (retr <= 0) {
-        *error = err_from_ssl();
+    guint32 total = 0;
+
+    // A single packet from the device may carry several records
+    while (total < length) {
+        int retr = SSL_read(self->ssl_layer, data + total,
+                            (length - total) * sizeof(guint8));
+        if (retr <= 0) {
+            if (total == 0 ||
+                SSL_get_error(self->ssl_layer, retr) != SSL_ERROR_WANT_READ) {
+                g_propagate_error(error,
+                                  err_from_ssl("TLS server failed to decrypt"));
+                return -1;
+            }
+            break;
+        }
+        total += retr;
     }
-    return retr;
+    return total;
 }
 
 static void tls_config_ssl(SSL* ssl)
@@ -124,33 +165,17 @@ static void tls_config_ssl(SSL* ssl)
     SSL_set_cipher_list(ssl, "ALL");
 }
 
-
-static void *
-goodix_tls_init_serve (void *me)
-{
-  GoodixTlsServer *self = me;
-
-  fp_dbg ("TLS server waiting to accept...");
-  int retr = SSL_accept (self->ssl_layer);
-
-  fp_dbg ("TLS server accept done");
-  if (retr <= 0)
-    self->connection_callback (self, err_from_ssl (), self->user_data);
-  else
-    self->connection_callback (self, NULL, self->user_data);
-  return NULL;
-}
-
 gboolean
 goodix_tls_server_deinit (GoodixTlsServer *self, GError **error)
 {
-  SSL_shutdown (self->ssl_layer);
-  SSL_free (self->ssl_layer);
+  // Also frees the BIOs
+  g_clear_pointer (&self->ssl_layer, SSL_free);
+  g_clear_pointer (&self->ssl_ctx, SSL_CTX_free);
 
-  close (self->client_fd);
-  close (self->sock_fd);
-
-  SSL_CTX_free (self->ssl_ctx);
+  self->in_bio = NULL;
+  self->out_bio = NULL;
+  self->established = FALSE;
+  self->failed = FALSE;
 
   return TRUE;
 }
@@ -159,36 +184,37 @@ gboolean
 goodix_tls_server_init (GoodixTlsServer *self, GError **error)
 {
   g_assert (self->connection_callback);
-  SSL_load_error_strings ();
-  OpenSSL_add_ssl_algorithms ();
-  SSL_library_init ();
   self->ssl_ctx = tls_server_create_ctx ();
-  tls_server_config_ctx (self->ssl_ctx);
 
-  int socks[2] = {0, 0};
-  if (socketpair (AF_UNIX, SOCK_STREAM, 0, socks) != 0)
+  if (self->ssl_ctx == NULL)
     {
-      g_set_error (error, G_FILE_ERROR, errno,
-                   "failed to create socket pair: %s", strerror (errno));
+      fp_dbg ("Unable to create TLS server context\n");
+      g_propagate_error (error,
+                         fpi_device_error_new_msg (FP_DEVICE_ERROR_GENERAL,
+                                                   "Unable to create TLS server context"));
       return FALSE;
     }
-  self->sock_fd = socks[0];
-  self->client_fd = socks[1];
+  tls_server_config_ctx (self->ssl_ctx);
 
-  if (self->ssl_ctx == NULL)
+  self->ssl_layer = SSL_new (self->ssl_ctx);
+  self->in_bio = BIO_new (BIO_s_mem ());
+  self->out_bio = BIO_new (BIO_s_mem ());
+  self->established = FALSE;
+  self->failed = FALSE;
+  if (!self->ssl_layer || !self->in_bio || !self->out_bio)
     {
-      fp_dbg ("Unable to create TLS server context\n");
-      *error = fpi_device_error_new_msg (FP_DEVICE_ERROR_GENERAL, "Unable to "
-                                                                  "create TLS "
-                                                                  "server "
-                                                                  "context");
+      g_clear_pointer (&self->in_bio, BIO_free);
+      g_clear_pointer (&self->out_bio, BIO_free);
+      goodix_tls_server_deinit (self, NULL);
+      g_propagate_error (error, err_from_ssl ("Unable to create TLS server"));
       return FALSE;
     }
-  self->ssl_layer = SSL_new (self->ssl_ctx);
+
   tls_config_ssl (self->ssl_layer);
-  SSL_set_fd (self->ssl_layer, self->sock_fd);
+  SSL_set_bio (self->ssl_layer, self->in_bio, self->out_bio);
+  SSL_set_accept_state (self->ssl_layer);
 
-  pthread_create (&self->serve_thread, 0, goodix_tls_init_serve, self);
+  fp_dbg ("TLS server waiting to accept...");
 
   return TRUE;
 }
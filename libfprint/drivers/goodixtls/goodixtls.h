@@ -20,8 +20,7 @@
 #pragma once
 
 #include <glib.h>
-
-#include <stdatomic.h>
+#include <openssl/ssl.h>
 
 #define GOODIX_TLS_SERVER_PORT 4433
 
@@ -60,6 +59,9 @@ typedef struct _GoodixTlsServer
   // This callback should be called when the connection is established. The
   // error should be NULL. It can also be called when the connection fail. In
   // this case, the error should not be NULL.
+  // It is called from goodix_tls_client_send() once the records completing
+  // the handshake were handed over. The error stays owned by the server.
+  // It is called at most once per goodix_tls_server_init().
   GoodixTlsServerConnectionCallback connection_callback;
 
   // This callback should be called when a TLS packet is decoded. The error
@@ -71,11 +73,16 @@ typedef struct _GoodixTlsServer
   // Put what you need here.
   gpointer  user_data;  // Passed to all callbacks
   SSL_CTX  *ssl_ctx;
-  int       sock_fd;
   SSL      *ssl_layer;
-  // SSL* cli_ssl_layer;
-  int       client_fd;
-  pthread_t serve_thread;
+  // Memory BIOs standing in for the connection to the device. Records
+  // received from the device are written to in_bio, records the server
+  // wants to send to the device are read from out_bio. Both are owned by
+  // ssl_layer.
+  BIO      *in_bio;
+  BIO      *out_bio;
+  gboolean  established;
+  // Set once the handshake failed, connection_callback is not called again
+  gboolean  failed;
 } GoodixTlsServer;
 
 // This is called only once to init the TLS server.
@@ -83,20 +90,22 @@ typedef struct _GoodixTlsServer
 gboolean goodix_tls_server_init (GoodixTlsServer *self,
                                  GError         **error);
 
-gboolean goodix_tls_init_cli (GoodixTlsServer *self,
-                              GError         **err);
-
 // This can be called multiple times. It is called when the device send a TLS
-// packet.
+// packet. It returns the length of the decrypted data that was available,
+// which is at most length, or -1 with error set if nothing could be decrypted.
 int goodix_tls_server_receive (GoodixTlsServer *self,
                                guint8          *data,
                                guint32          length,
                                GError         **error);
 
+// Hands TLS records received from the device to the server, advancing the
+// handshake as far as possible. Returns the number of bytes consumed or -1.
 int goodix_tls_client_send (GoodixTlsServer *self,
                             guint8          *data,
                             guint16          length);
 
+// Fetches the TLS records the server has queued for the device. Returns the
+// number of bytes copied to data or -1 if nothing is pending.
 int goodix_tls_client_recv (GoodixTlsServer *self,
                             guint8          *data,
                             guint16          length);
@@ -800,9 +800,10 @@ compose_and_send_identify_msg (FpDevice *device)
   guint8 finger;
   const guint8 *user_id;
   gsize user_id_len = 0;
-  g_autofree guint8 *payload = NULL;
-  guint8 payload_len = 0;
+  /* Total and per message count, ID length and the ID itself */
+  guint8 payload[3 + BMKT_MAX_USER_ID_LEN];
   guint8 payloadOffset = 0;
+  gboolean first_msg = self->id_idx == 0;
 
   fpi_device_get_identify_data (device, &prints);
   if (prints->len > UINT8_MAX)
@@ -821,55 +822,43 @@ compose_and_send_identify_msg (FpDevice *device)
     }
   print = g_ptr_array_index (prints, self->id_idx);
   g_object_get (print, "fpi-data", &data, NULL);
-  g_debug ("data is %p", data);
   if (!parse_print_data (data, &finger, &user_id, &user_id_len))
     {
       fpi_device_identify_complete (device,
                                     fpi_device_error_new (FP_DEVICE_ERROR_DATA_INVALID));
       return;
     }
-  if(self->id_idx == 0)
-    {
-      /*
-       * Construct payload.
-       * 1st byte is total number of IDs in list.
-       * 2nd byte is number of IDs in list.
-       * 1 byte for each ID length, maximum id length is 100.
-       * user_id_len bytes of each ID
-       */
-      payload_len = 2 + 1 + user_id_len;
-      payload = g_malloc0 (payload_len);
-      payload[payloadOffset] = prints->len;
-      payloadOffset += 1;
-      payload[payloadOffset] = 1; /* send one id per message */
-      payloadOffset += 1;
-      payload[payloadOffset] = user_id_len;
-      payloadOffset += 1;
-      memcpy (&payload[payloadOffset], user_id, user_id_len);
-      payloadOffset += user_id_len;
 
+  /*
+   * Construct payload.
+   * The first message starts with the total number of IDs in the list.
+   * Then the number of IDs in this message.
+   * 1 byte for each ID length, maximum id length is 100.
+   * user_id_len bytes of each ID
+   *
+   * Only one ID is sent per message, the sensor asks for the next one
+   * once it has processed it. That is the only mode the driver has been
+   * tested with.
+   */
+  if (first_msg)
+    payload[payloadOffset++] = prints->len;
+  payload[payloadOffset++] = 1; /* send one id per message */
+  payload[payloadOffset++] = user_id_len;
+  memcpy (&payload[payloadOffset], user_id, user_id_len);
+  payloadOffset += user_id_len;
+
+  self->id_idx++;
+
+  if (first_msg)
+    {
       G_DEBUG_HERE ();
 
       synaptics_sensor_cmd (self, 0, BMKT_CMD_ID_USER_IN_ORDER, payload, payloadOffset, identify_msg_cb);
     }
   else
     {
-      /*
-       * 1st byte is the number of IDs
-       * 1 byte for each ID length
-       * id_length bytes for each ID
-       */
-      payload_len = 1 + 1 + user_id_len;
-      payload = g_malloc0 (payload_len);
-      payload[payloadOffset] = 1; /* send one id per message */
-      payloadOffset += 1;
-      payload[payloadOffset] = user_id_len;
-      payloadOffset += 1;
-      memcpy (&payload[payloadOffset], user_id, user_id_len);
-      payloadOffset += user_id_len;
       synaptics_sensor_cmd (self, self->cmd_seq_num, BMKT_CMD_ID_NEXT_USER, payload, payloadOffset, NULL);
     }
-  self->id_idx++;
 }
 static void
 enroll_msg_cb (FpiDeviceSynaptics *self,
@@ -565,74 +565,32 @@ img_data_cb (FpiUsbTransfer *transfer, FpDevice *device,
 
 /***** STATE MACHINE HELPERS *****/
 
-struct write_regs_data
+static FpiUsbRegSequence *
+build_reg_sequence (gconstpointer table, guint num_regs)
 {
-  FpDevice                    *dev;
-  FpiSsm                      *ssm;
-  FpiUsbTransfer              *transfer;
-  const struct sonly_regwrite *regs;
-  size_t                       num_regs;
-  size_t                       regs_written;
-};
+  const struct sonly_regwrite *regs = table;
+  FpiUsbRegSequence *sequence;
+  guint i;
 
-static void
-write_regs_finished (struct write_regs_data *wrdata, GError *error)
-{
-  if (!error)
-    fpi_ssm_next_state (wrdata->ssm);
-  else
-    fpi_ssm_mark_failed (wrdata->ssm, error);
+  sequence = fpi_usb_reg_sequence_new_control (G_USB_DEVICE_REQUEST_TYPE_VENDOR,
+                                               G_USB_DEVICE_RECIPIENT_DEVICE,
+                                               0x0c);
+  for (i = 0; i < num_regs; i++)
+    fpi_usb_reg_sequence_add (sequence, regs[i].reg, regs[i].value);
 
-  g_free (wrdata);
+  return sequence;
 }
 
-static void write_regs_iterate (struct write_regs_data *wrdata);
-
 static void
-write_regs_cb (FpiUsbTransfer *transfer, FpDevice *device,
+write_regs_cb (FpiUsbRegSequence *sequence, FpDevice *device,
                gpointer user_data, GError *error)
 {
-  struct write_regs_data *wrdata = user_data;
-
-  if (error)
-    {
-      write_regs_finished (wrdata, error);
-      return;
-    }
-
-  wrdata->regs_written++;
-  write_regs_iterate (wrdata);
-}
-
-static void
-write_regs_iterate (struct write_regs_data *wrdata)
-{
-  FpiUsbTransfer *transfer;
-  const struct sonly_regwrite *regwrite;
-
-  if (wrdata->regs_written >= wrdata->num_regs)
-    {
-      write_regs_finished (wrdata, NULL);
-      return;
-    }
+  FpiSsm *ssm = user_data;
 
-  regwrite = &wrdata->regs[wrdata->regs_written];
-  fp_dbg ("set %02x=%02x", regwrite->reg, regwrite->value);
-
-  transfer = fpi_usb_transfer_new (wrdata->dev);
-  fpi_usb_transfer_fill_control (transfer,
-                                 G_USB_DEVICE_DIRECTION_HOST_TO_DEVICE,
-                                 G_USB_DEVICE_REQUEST_TYPE_VENDOR,
-                                 G_USB_DEVICE_RECIPIENT_DEVICE,
-                                 0x0c,
-                                 0,
-                                 regwrite->reg,
-                                 1);
-  transfer->short_is_error = TRUE;
-  transfer->ssm = wrdata->ssm;
-  transfer->buffer[0] = regwrite->value;
-
-  fpi_usb_transfer_submit (transfer, CTRL_TIMEOUT, NULL, write_regs_cb, wrdata);
+  if (!error)
+    fpi_ssm_next_state (ssm);
+  else
+    fpi_ssm_mark_failed (ssm, error);
 }
 
 static void
@@ -641,15 +599,13 @@ sm_write_regs (FpiSsm                      *ssm,
                const struct sonly_regwrite *regs,
                size_t                       num_regs)
 {
-  struct write_regs_data *wrdata = g_malloc (sizeof (*wrdata));
+  g_autoptr(FpiUsbRegSequence) sequence = NULL;
 
-  wrdata->ssm = ssm;
-  wrdata->regs = regs;
-  wrdata->num_regs = num_regs;
-  wrdata->regs_written = 0;
-  wrdata->dev = dev;
-
-  write_regs_iterate (wrdata);
+  /* The register tables are static, their transfers are built once */
+  sequence = fpi_usb_reg_sequence_get_cached (dev, regs, num_regs * sizeof (*regs),
+                                              build_reg_sequence, num_regs);
+  fpi_usb_reg_sequence_write (sequence, dev, CTRL_TIMEOUT, NULL,
+                              write_regs_cb, ssm);
 }
 
 static void
@@ -1392,7 +1348,6 @@ dev_activate (FpImageDevice *dev)
 {
   FpiDeviceUpeksonly *self = FPI_DEVICE_UPEKSONLY (dev);
   FpiSsm *ssm = NULL;
-  int i;
 
   self->deactivating = FALSE;
   self->capturing = FALSE;
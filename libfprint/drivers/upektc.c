@@ -261,6 +261,7 @@ capture_read_data_cb (FpiUsbTransfer *transfer, FpDevice *device,
                       gpointer user_data, GError *error)
 {
   FpImageDevice *dev = FP_IMAGE_DEVICE (device);
+  g_autoptr(GBytes) buffer = NULL;
   FpImage *img;
 
   if (error)
@@ -270,8 +271,9 @@ capture_read_data_cb (FpiUsbTransfer *transfer, FpDevice *device,
       return;
     }
 
-  img = fp_image_new (IMAGE_WIDTH, IMAGE_HEIGHT);
-  memcpy (img->data, transfer->buffer, IMAGE_SIZE);
+  /* Each capture reads into a new transfer, hand its buffer to the image */
+  buffer = g_bytes_new_take (g_steal_pointer (&transfer->buffer), IMAGE_SIZE);
+  img = fpi_image_new_view (buffer, 0, IMAGE_WIDTH, IMAGE_WIDTH, IMAGE_HEIGHT, 0);
   fpi_image_device_image_captured (dev, img);
   fpi_image_device_report_finger_status (dev, FALSE);
   fpi_ssm_mark_completed (transfer->ssm);
@@ -166,21 +166,24 @@ async_abort (FpDevice *dev, FpiSsm *ssm, int ep)
 
 /* Image processing functions */
 
-/* Pixel getter for fpi_assemble_lines */
+/* Pixel getter for fpi_assemble_lines_array */
 static unsigned char
 vfs0050_get_pixel (struct fpi_line_asmbl_ctx *ctx,
-                   GSList * line, unsigned int x)
+                   const guint8 *lines, gsize stride,
+                   size_t line, unsigned int x)
 {
-  return ((struct vfs_line *) line->data)->data[x];
+  const struct vfs_line *vfs_line = (const void *) (lines + line * stride);
+
+  return vfs_line->data[x];
 }
 
-/* Deviation getter for fpi_assemble_lines */
+/* Deviation getter for fpi_assemble_lines_array */
 static int
 vfs0050_get_difference (struct fpi_line_asmbl_ctx *ctx,
-                        GSList * line_list_1, GSList * line_list_2)
+                        const guint8 *line_buf_1, const guint8 *line_buf_2)
 {
-  struct vfs_line *line1 = line_list_1->data;
-  struct vfs_line *line2 = line_list_2->data;
+  const struct vfs_line *line1 = (const void *) line_buf_1;
+  const struct vfs_line *line2 = (const void *) line_buf_2;
   const int shift = (VFS_IMAGE_WIDTH - VFS_NEXT_LINE_WIDTH) / 2 - 1;
   int res = 0;
 
@@ -209,15 +212,15 @@ is_noise (struct vfs_line *line)
   return 0;
 }
 
-/* Parameters for fpi_assemble_lines */
+/* Parameters for fpi_assemble_lines_array */
 static struct fpi_line_asmbl_ctx assembling_ctx = {
   .line_width = VFS_IMAGE_WIDTH,
   .max_height = VFS_MAX_HEIGHT,
   .resolution = 10,
   .median_filter_size = 25,
   .max_search_offset = 100,
-  .get_deviation = vfs0050_get_difference,
-  .get_pixel = vfs0050_get_pixel,
+  .get_deviation_array = vfs0050_get_difference,
+  .get_pixel_array = vfs0050_get_pixel,
 };
 
 /* Processes image before submitting */
@@ -242,17 +245,10 @@ prepare_image (FpDeviceVfs0050 *vdev)
   if (height < VFS_IMAGE_WIDTH)
     return NULL;
 
-  /* Building GSList */
-  GSList *lines = NULL;
-
-  for (int i = height - 1; i >= 0; --i)
-    lines = g_slist_prepend (lines, vdev->lines_buffer + i);
-
   /* Perform line assembling */
-  FpImage *img = fpi_assemble_lines (&assembling_ctx, lines, height);
-
-  g_slist_free (lines);
-  return img;
+  return fpi_assemble_lines_array (&assembling_ctx,
+                                   (const guint8 *) vdev->lines_buffer,
+                                   sizeof (struct vfs_line), height);
 }
 
 /* Processes and submits image after fingerprint received */
@@ -654,13 +654,11 @@ img_extract (FpiSsm        *ssm,
       return;
     }
 
-  /* Create new image */
-  img = fp_image_new (self->height, VFS_IMG_WIDTH);
-  img->width = VFS_IMG_WIDTH;
-  img->height = self->height;
+  /* Copy the image lines only, the reader buffer is about 7 times the
+   * size of the largest image and is reused for the next capture. The
+   * flip is done when the minutiae are detected. */
+  img = fp_image_new (VFS_IMG_WIDTH, self->height);
   img->flags = FPI_IMAGE_V_FLIPPED;
-
-  /* Copy data into image */
   img_copy (self, img);
 
   /* Notify image captured */
@@ -37,6 +37,7 @@
 #include "fpi-usb-transfer.h"
 #include "vfs301.h"
 #include "vfs301_proto_fragments.h"
+#include "vfs301_proto_fragments_data.h"
 
 /************************** USB STUFF *****************************************/
 
@@ -106,7 +107,9 @@ usb_send (FpDeviceVfs301 *dev, const guint8 *data, gssize length, GError **error
 
   transfer = fpi_usb_transfer_new (FP_DEVICE (dev));
   transfer->short_is_error = TRUE;
-  fpi_usb_transfer_fill_bulk_full (transfer, VFS301_SEND_ENDPOINT, (guint8 *) data, length, g_free);
+  /* The transfer is synchronous, so the data only needs to stay around
+   * for this call */
+  fpi_usb_transfer_fill_bulk_full (transfer, VFS301_SEND_ENDPOINT, (guint8 *) data, length, NULL);
 
   fpi_usb_transfer_submit_sync (transfer, VFS301_DEFAULT_WAIT_TIMEOUT, &err);
 
@@ -123,12 +126,16 @@ usb_send (FpDeviceVfs301 *dev, const guint8 *data, gssize length, GError **error
 
 /************************** OUT MESSAGES GENERATION ***************************/
 
-static guint8 *
-vfs301_proto_generate_0B (int subtype, gssize *len)
+/* Large enough for all generated messages */
+#define VFS301_PROTO_GENERATED_MAX_LEN 39
+
+static void
+vfs301_proto_generate_0B (int subtype, guint8 *res, gssize *len)
 {
-  guint8 *res = g_malloc0 (39);
   guint8 *data = res;
 
+  memset (res, 0, 39);
+
   *data = 0x0B;
   *len = 1;
   data++;
@@ -152,46 +159,14 @@ vfs301_proto_generate_0B (int subtype, gssize *len)
       g_assert_not_reached ();
       break;
     }
-
-  return res;
 }
 
-#define HEX_TO_INT(c) \
-        (((c) >= '0' && (c) <= '9') ? ((c) - '0') : ((c) - 'A' + 10))
-
-static guint8 *
-translate_str (const char **srcL, gssize *len)
-{
-  guint8 *res = NULL;
-  guint8 *dst;
-  const char **src_pos;
-  const char *src;
-  gssize src_len = 0;
-
-  for (src_pos = srcL; *src_pos; src_pos++)
-    {
-      gint tmp;
-
-      src = *src_pos;
-      tmp = strlen (src);
-      g_assert (tmp % 2 == 0);
-      src_len += tmp;
-    }
-
-  g_assert (src_len >= 2);
-  *len = src_len / 2;
-  res = g_malloc0 (*len);
-  dst = res;
-
-  for (src_pos = srcL; *src_pos; src_pos++)
-    for (src = *src_pos; *src; src += 2, dst += 1)
-      *dst = (guint8) ((HEX_TO_INT (src[0]) << 4) | (HEX_TO_INT (src[1])));
-
-  return res;
-}
+#define STATIC_DATA(x) (*len = sizeof (x), x)
 
-static guint8 *
-vfs301_proto_generate (int type, int subtype, gssize *len)
+/* Returns either one of the static fragments or the message generated into
+ * buf, which needs to hold VFS301_PROTO_GENERATED_MAX_LEN bytes. */
+static const guint8 *
+vfs301_proto_generate (int type, int subtype, guint8 *buf, gssize *len)
 {
   switch (type)
     {
@@ -207,65 +182,64 @@ vfs301_proto_generate (int type, int subtype, gssize *len)
     case 0x17:
     case 0x19:
     case 0x1A:
-      {
-        guint8 *data = g_malloc0 (1);
-        *data = type;
-        *len = 1;
-        return data;
-      }
+      *buf = type;
+      *len = 1;
+      return buf;
 
     case 0x0B:
-      return vfs301_proto_generate_0B (subtype, len);
+      vfs301_proto_generate_0B (subtype, buf, len);
+      return buf;
 
     case 0x02D0:
-      {
-        const char **dataLs[] = {
-          vfs301_02D0_01,
-          vfs301_02D0_02,
-          vfs301_02D0_03,
-          vfs301_02D0_04,
-          vfs301_02D0_05,
-          vfs301_02D0_06,
-          vfs301_02D0_07,
-        };
-        g_assert ((int) subtype <= G_N_ELEMENTS (dataLs));
-        return translate_str (dataLs[subtype - 1], len);
-      }
+      switch (subtype)
+        {
+        case 1:
+          return STATIC_DATA (vfs301_02D0_01);
+
+        case 2:
+          return STATIC_DATA (vfs301_02D0_02);
+
+        case 3:
+          return STATIC_DATA (vfs301_02D0_03);
+
+        case 4:
+          return STATIC_DATA (vfs301_02D0_04);
+
+        case 5:
+          return STATIC_DATA (vfs301_02D0_05);
+
+        case 6:
+          return STATIC_DATA (vfs301_02D0_06);
+
+        case 7:
+          return STATIC_DATA (vfs301_02D0_07);
+
+        default:
+          g_assert_not_reached ();
+          break;
+        }
+      break;
 
     case 0x0220:
       switch (subtype)
         {
         case 1:
-          return translate_str (vfs301_0220_01, len);
+          return STATIC_DATA (vfs301_0220_01);
 
         case 2:
-          return translate_str (vfs301_0220_02, len);
+          return STATIC_DATA (vfs301_0220_02);
 
         case 3:
-          return translate_str (vfs301_0220_03, len);
+          return STATIC_DATA (vfs301_0220_03);
 
         case 0xFA00:
-        case 0x2C01:
-        case 0x5E01: {
-            guint8 *data;
-            guint8 *field;
-
-            data = translate_str (vfs301_next_scan_template, len);
-            field = data + *len - (sizeof (S4_TAIL) - 1) / 2 - 4;
+          return STATIC_DATA (vfs301_next_scan_FA00);
 
-            g_assert (field >= data && field < data + *len);
-            g_assert (field[0] == 0xDE);
-            g_assert (field[1] == 0xAD);
-            g_assert (field[2] == 0xDE);
-            g_assert (field[3] == 0xAD);
-
-            field[0] = (guint8) ((subtype >> 8) & 0xFF);
-            field[1] = (guint8) (subtype & 0xFF);
-            field[2] = field[0];
-            field[3] = field[1];
+        case 0x2C01:
+          return STATIC_DATA (vfs301_next_scan_2C01);
 
-            return data;
-          }
+        case 0x5E01:
+          return STATIC_DATA (vfs301_next_scan_5E01);
 
         default:
           g_assert_not_reached ();
@@ -426,13 +400,14 @@ img_process_data (int first_block, FpDeviceVfs301 *dev, const guint8 *buf, int l
 
 #define USB_SEND(type, subtype) \
         { \
+          guint8 buf[VFS301_PROTO_GENERATED_MAX_LEN]; \
           const guint8 *data; \
           gssize len; \
-          data = vfs301_proto_generate (type, subtype, &len); \
+          data = vfs301_proto_generate (type, subtype, buf, &len); \
           usb_send (dev, data, len, NULL); \
         }
 
-#define RAW_DATA(x) g_memdup2 (x, sizeof (x)), sizeof (x)
+#define RAW_DATA(x) x, sizeof (x)
 
 #define IS_VFS301_FP_SEQ_START(b) ((b[0] == 0x01) && (b[1] == 0xfe))
 
@@ -28,6 +28,8 @@
  * I missed some block start, or split data that should be together.
  * It's quite challenging, this reverse engineering... :-) */
 
+#ifndef VFS301_PROTO_FRAGMENTS_GEN
+
 #define __01 0x88   /* sometimes also 0x87? depending on what? */
 
 static const unsigned char vfs301_06_1[] = { /* 2401 B */
@@ -1114,6 +1116,12 @@ static const unsigned char vfs301_24[] = { /* 119 B */
    * 0x00, 0xF4, 0x01, 0xF4, 0x01, 0x00, 0xB4, */
 };
 
+#else /* VFS301_PROTO_FRAGMENTS_GEN */
+
+/* The fragments below are easier to read and annotate as hex strings.
+ * vfs301_proto_fragments_gen.c turns them into byte arrays at build time,
+ * the driver includes those from vfs301_proto_fragments_data.h. */
+
 #define PACKET(cmd, length, payload) \
   cmd length payload
 
@@ -2631,3 +2639,5 @@ const char *vfs301_02D0_07[] = {
 
   NULL
 };
+
+#endif /* VFS301_PROTO_FRAGMENTS_GEN */
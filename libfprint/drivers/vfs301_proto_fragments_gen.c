@@ -0,0 +1,157 @@
+/*
+ * vfs301/vfs300 fingerprint reader driver
+ * Build time conversion of the protocol fragments
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* Runs on the build machine and turns the hex string fragments of
+ * vfs301_proto_fragments.h into the byte arrays the driver sends. Only uses
+ * the C library, GLib may not be available for the build machine. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define VFS301_PROTO_FRAGMENTS_GEN
+#include "vfs301_proto_fragments.h"
+
+#define HEX_TO_INT(c) \
+        (((c) >= '0' && (c) <= '9') ? ((c) - '0') : ((c) - 'A' + 10))
+
+static unsigned char *
+translate_str (const char **srcL, size_t *len)
+{
+  unsigned char *res, *dst;
+  const char **src_pos;
+  const char *src;
+  size_t src_len = 0;
+
+  for (src_pos = srcL; *src_pos; src_pos++)
+    {
+      size_t tmp = strlen (*src_pos);
+
+      if (tmp % 2 != 0)
+        {
+          fprintf (stderr, "Odd number of hex digits in \"%s\"\n", *src_pos);
+          exit (EXIT_FAILURE);
+        }
+      src_len += tmp;
+    }
+
+  *len = src_len / 2;
+  res = calloc (*len, 1);
+  dst = res;
+
+  for (src_pos = srcL; *src_pos; src_pos++)
+    for (src = *src_pos; *src; src += 2, dst += 1)
+      *dst = (unsigned char) ((HEX_TO_INT (src[0]) << 4) | (HEX_TO_INT (src[1])));
+
+  return res;
+}
+
+static void
+write_array (FILE *out, const char *name, const unsigned char *data, size_t len)
+{
+  size_t i;
+
+  fprintf (out, "static const unsigned char %s[] = { /* %zu B */", name, len);
+  for (i = 0; i < len; i++)
+    fprintf (out, "%s0x%02X,", i % 12 == 0 ? "\n  " : " ", data[i]);
+  fprintf (out, "\n};\n\n");
+}
+
+static void
+write_fragment (FILE *out, const char *name, const char **srcL)
+{
+  unsigned char *data;
+  size_t len;
+
+  data = translate_str (srcL, &len);
+  write_array (out, name, data, len);
+  free (data);
+}
+
+/* The next scan packets only differ in the two byte field at the end */
+static void
+write_next_scan (FILE *out, const char *name, unsigned int subtype)
+{
+  unsigned char *data;
+  unsigned char *field;
+  size_t len;
+
+  data = translate_str (vfs301_next_scan_template, &len);
+  field = data + len - (sizeof (S4_TAIL) - 1) / 2 - 4;
+
+  if (field[0] != 0xDE || field[1] != 0xAD || field[2] != 0xDE || field[3] != 0xAD)
+    {
+      fprintf (stderr, "Next scan field not found\n");
+      exit (EXIT_FAILURE);
+    }
+
+  field[0] = (unsigned char) ((subtype >> 8) & 0xFF);
+  field[1] = (unsigned char) (subtype & 0xFF);
+  field[2] = field[0];
+  field[3] = field[1];
+
+  write_array (out, name, data, len);
+  free (data);
+}
+
+int
+main (int argc, char *argv[])
+{
+  FILE *out;
+
+  if (argc != 2)
+    {
+      fprintf (stderr, "Usage: %s OUTPUT\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  out = fopen (argv[1], "w");
+  if (!out)
+    {
+      perror (argv[1]);
+      return EXIT_FAILURE;
+    }
+
+  fprintf (out, "/* Generated from vfs301_proto_fragments.h, do not edit */\n\n");
+  fprintf (out, "/* *INDENT-OFF* */\n\n");
+
+  write_fragment (out, "vfs301_0220_01", vfs301_0220_01);
+  write_fragment (out, "vfs301_0220_02", vfs301_0220_02);
+  write_fragment (out, "vfs301_0220_03", vfs301_0220_03);
+  write_next_scan (out, "vfs301_next_scan_FA00", 0xFA00);
+  write_next_scan (out, "vfs301_next_scan_2C01", 0x2C01);
+  write_next_scan (out, "vfs301_next_scan_5E01", 0x5E01);
+
+  write_fragment (out, "vfs301_02D0_01", vfs301_02D0_01);
+  write_fragment (out, "vfs301_02D0_02", vfs301_02D0_02);
+  write_fragment (out, "vfs301_02D0_03", vfs301_02D0_03);
+  write_fragment (out, "vfs301_02D0_04", vfs301_02D0_04);
+  write_fragment (out, "vfs301_02D0_05", vfs301_02D0_05);
+  write_fragment (out, "vfs301_02D0_06", vfs301_02D0_06);
+  write_fragment (out, "vfs301_02D0_07", vfs301_02D0_07);
+
+  if (fclose (out) != 0)
+    {
+      perror (argv[1]);
+      return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -207,14 +207,15 @@ usb_exchange_async (FpiSsm                  *ssm,
 
 /* Calculade squared standand deviation of sum of two lines */
 static int
-vfs5011_get_deviation2 (struct fpi_line_asmbl_ctx *ctx, GSList *row1, GSList *row2)
+vfs5011_get_deviation2 (struct fpi_line_asmbl_ctx *ctx,
+                        const guint8 *row1, const guint8 *row2)
 {
-  unsigned char *buf1, *buf2;
+  const unsigned char *buf1, *buf2;
   int res = 0, mean = 0, i;
   const int size = 64;
 
-  buf1 = (unsigned char *) row1->data + 56;
-  buf2 = (unsigned char *) row2->data + 168;
+  buf1 = row1 + 56;
+  buf2 = row2 + 168;
 
   for (i = 0; i < size; i++)
     mean += (int) buf1[i] + (int) buf2[i];
@@ -232,10 +233,12 @@ vfs5011_get_deviation2 (struct fpi_line_asmbl_ctx *ctx, GSList *row1, GSList *ro
 
 static unsigned char
 vfs5011_get_pixel (struct fpi_line_asmbl_ctx *ctx,
-                   GSList                    *row,
+                   const guint8              *rows,
+                   gsize                      stride,
+                   size_t                     row,
                    unsigned                   x)
 {
-  unsigned char *data = (unsigned char *) row->data + 8;
+  const unsigned char *data = rows + row * stride + 8;
 
   return data[x];
 }
@@ -254,8 +257,8 @@ static struct fpi_line_asmbl_ctx assembling_ctx = {
   .resolution = 10,
   .median_filter_size = 25,
   .max_search_offset = 30,
-  .get_deviation = vfs5011_get_deviation2,
-  .get_pixel = vfs5011_get_pixel,
+  .get_deviation_array = vfs5011_get_deviation2,
+  .get_pixel_array = vfs5011_get_pixel,
 };
 
 struct _FpDeviceVfs5011
@@ -266,7 +269,7 @@ struct _FpDeviceVfs5011
   unsigned char          *capture_buffer;
   unsigned char          *row_buffer;
   unsigned char          *lastline;
-  GSList                 *rows;
+  unsigned char          *rows;
   int                     lines_captured, lines_recorded, empty_lines;
   int                     max_lines_captured, max_lines_recorded;
   int                     lines_total, lines_total_allocated;
@@ -298,6 +301,7 @@ capture_init (FpDeviceVfs5011 *self, int max_captured,
               int max_recorded)
 {
   fp_dbg ("capture_init");
+  g_assert (max_recorded <= MAXLINES);
   self->lastline = NULL;
   self->lines_captured = 0;
   self->lines_recorded = 0;
@@ -310,7 +314,8 @@ capture_init (FpDeviceVfs5011 *self, int max_captured,
 }
 
 static int
-process_chunk (FpDeviceVfs5011 *self, int transferred)
+process_chunk (FpDeviceVfs5011 *self, const unsigned char *buffer,
+               int transferred)
 {
   enum {
     DEVIATION_THRESHOLD = 15 * 15,
@@ -324,8 +329,7 @@ process_chunk (FpDeviceVfs5011 *self, int transferred)
 
   for (i = 0; i < lines_captured; i++)
     {
-      unsigned char *linebuf = self->capture_buffer
-                               + i * VFS5011_LINE_SIZE;
+      const unsigned char *linebuf = buffer + i * VFS5011_LINE_SIZE;
 
       if (fpi_std_sq_dev (linebuf + 8, VFS5011_IMAGE_WIDTH)
           < DEVIATION_THRESHOLD)
@@ -359,9 +363,7 @@ process_chunk (FpDeviceVfs5011 *self, int transferred)
                                   linebuf + 8,
                                   VFS5011_IMAGE_WIDTH) >= DIFFERENCE_THRESHOLD))
         {
-          self->lastline = g_malloc (VFS5011_LINE_SIZE);
-          self->rows = g_slist_prepend (self->rows,
-                                        self->lastline);
+          self->lastline = self->rows + self->lines_recorded * VFS5011_LINE_SIZE;
           memmove (self->lastline, linebuf, VFS5011_LINE_SIZE);
           self->lines_recorded++;
           if (self->lines_recorded >= self->max_lines_recorded)
@@ -388,15 +390,9 @@ submit_image (FpiSsm          *ssm,
       return;
     }
 
-  g_assert (self->rows != NULL);
-
-  self->rows = g_slist_reverse (self->rows);
-
-  img = fpi_assemble_lines (&assembling_ctx, self->rows,
-                            self->lines_recorded);
-
-  g_slist_free_full (self->rows, g_free);
-  self->rows = NULL;
+  img = fpi_assemble_lines_array (&assembling_ctx, self->rows,
+                                  VFS5011_LINE_SIZE,
+                                  self->lines_recorded);
 
   fp_dbg ("Image captured, committing");
 
@@ -421,7 +417,7 @@ chunk_capture_callback (FpiUsbTransfer *transfer, FpDevice *device,
       if (transfer->actual_length > 0)
         fpi_image_device_report_finger_status (dev, TRUE);
 
-      if (process_chunk (self, transfer->actual_length))
+      if (process_chunk (self, transfer->buffer, transfer->actual_length))
         fpi_ssm_jump_to_state (transfer->ssm,
                                DEV_ACTIVATE_DATA_COMPLETE);
       else
@@ -452,11 +448,6 @@ capture_chunk_async (FpDeviceVfs5011 *self,
 
   fp_dbg ("capture_chunk_async: capture %d lines, already have %d",
           nline, self->lines_recorded);
-  enum {
-    DEVIATION_THRESHOLD = 15 * 15,
-    DIFFERENCE_THRESHOLD = 600,
-    STOP_CHECK_LINES = 50
-  };
 
   transfer = fpi_usb_transfer_new (FP_DEVICE (self));
   fpi_usb_transfer_fill_bulk_full (transfer,
@@ -798,7 +789,6 @@ dev_open (FpImageDevice *dev)
   FpDeviceVfs5011 *self;
 
   self = FPI_DEVICE_VFS5011 (dev);
-  self->capture_buffer = g_new0 (unsigned char, CAPTURE_LINES * VFS5011_LINE_SIZE);
 
   if (!g_usb_device_claim_interface (fpi_device_get_usb_device (FP_DEVICE (dev)), 0, 0, &error))
     {
@@ -806,6 +796,9 @@ dev_open (FpImageDevice *dev)
       return;
     }
 
+  self->capture_buffer = g_new0 (unsigned char, CAPTURE_LINES * VFS5011_LINE_SIZE);
+  self->rows = g_malloc (MAXLINES * VFS5011_LINE_SIZE);
+
   ssm = fpi_ssm_new (FP_DEVICE (dev), open_loop, DEV_OPEN_NUM_STATES);
   fpi_ssm_start (ssm, open_loop_complete);
 }
@@ -819,8 +812,8 @@ dev_close (FpImageDevice *dev)
   g_usb_device_release_interface (fpi_device_get_usb_device (FP_DEVICE (dev)),
                                   0, 0, &error);
 
-  g_free (self->capture_buffer);
-  g_slist_free_full (g_steal_pointer (&self->rows), g_free);
+  g_clear_pointer (&self->capture_buffer, g_free);
+  g_clear_pointer (&self->rows, g_free);
 
   fpi_image_device_close_complete (dev, error);
 }
@@ -895,6 +888,9 @@ fpi_device_vfs5011_class_init (FpDeviceVfs5011Class *klass)
   img_class->deactivate = dev_deactivate;
 
   img_class->bz3_threshold = 20;
+  /* Ridges cover 98% of the blocks of the recorded capture, ask for a
+   * retry on swipes that barely touched the sensor. */
+  img_class->min_quality = 25;
 
   img_class->img_width = VFS5011_IMAGE_WIDTH;
   img_class->img_height = -1;
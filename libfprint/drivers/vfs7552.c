@@ -109,7 +109,7 @@ struct _FpDeviceVfs7552
   gboolean                deactivating;
   gboolean                loop_running;
   struct usbexchange_data init_sequence;
-  FpiUsbTransfer         *flying_transfer;
+  FpiUsbTransfer         *chunk_transfer;
 };
 
 G_DECLARE_FINAL_TYPE (FpDeviceVfs7552, fpi_device_vfs7552, FPI, DEVICE_VFS7552,
@@ -346,23 +346,9 @@ static int
 clean_image (FpDeviceVfs7552 *self)
 {
   fp_dbg ("Cleaning image");
-  unsigned int sum = 0;
 
-  for (int i = 0; i < VFS7552_IMAGE_SIZE; i++)
-    {
-      if (self->background[i] < self->image[i])
-        self->image[i] = 0;
-      else
-        self->image[i] = self->background[i] - self->image[i];
-      if ((int) (self->image[i]) * 4 > 255)
-        self->image[i] = 255;
-      else
-        self->image[i] *= 4;
-
-      sum += self->image[i];
-    }
-
-  if (sum == 0)
+  if (fpi_image_u8_subtract_from (self->image, self->background,
+                                  VFS7552_IMAGE_SIZE, 4) == 0)
     {
       fp_dbg ("frame darker than background; finger present during calibration?");
       // Retake an image of the background at the next opportunity.
@@ -457,15 +443,14 @@ chunk_capture_callback (FpiUsbTransfer *transfer, FpDevice *device,
 static void
 capture_chunk_async (FpiSsm *ssm, FpDevice *_dev, guint timeout)
 {
-  FpiUsbTransfer *transfer;
-
-  transfer = fpi_usb_transfer_new (_dev);
-
-  fpi_usb_transfer_fill_bulk (transfer, VFS7552_IN_ENDPOINT,
-                              VFS7552_RECEIVE_BUF_SIZE);
+  FpDeviceVfs7552 *self = FPI_DEVICE_VFS7552 (_dev);
 
-  transfer->ssm = ssm;
-  fpi_usb_transfer_submit (transfer, timeout, NULL,
+  /* Every chunk has to be requested explicitly and the replies share the
+   * endpoint with the command responses, so the chunks cannot be streamed.
+   * Recycle the same transfer and buffer for each of them instead. */
+  self->chunk_transfer->ssm = ssm;
+  fpi_usb_transfer_submit (fpi_usb_transfer_ref (self->chunk_transfer),
+                           timeout, NULL,
                            chunk_capture_callback, NULL);
 }
 
@@ -933,8 +918,11 @@ open_complete (FpiSsm *ssm, FpDevice *_dev, GError *error)
 static void
 dev_close (FpImageDevice *dev)
 {
+  FpDeviceVfs7552 *self = FPI_DEVICE_VFS7552 (dev);
   GError *error = NULL;
 
+  g_clear_pointer (&self->chunk_transfer, fpi_usb_transfer_unref);
+
   g_usb_device_release_interface (fpi_device_get_usb_device (FP_DEVICE (dev)),
                                   0, 0, &error);
 
@@ -1016,6 +1004,7 @@ dev_activate (FpImageDevice *dev)
 static void
 dev_open (FpImageDevice *dev)
 {
+  FpDeviceVfs7552 *self = FPI_DEVICE_VFS7552 (dev);
   FpiSsm *ssm;
   GError *error = NULL;
 
@@ -1032,6 +1021,10 @@ dev_open (FpImageDevice *dev)
       return;
     }
 
+  self->chunk_transfer = fpi_usb_transfer_new (FP_DEVICE (dev));
+  fpi_usb_transfer_fill_bulk (self->chunk_transfer, VFS7552_IN_ENDPOINT,
+                              VFS7552_RECEIVE_BUF_SIZE);
+
   ssm = fpi_ssm_new (FP_DEVICE (dev), open_run_state, DEV_OPEN_NUM_STATES);
   fpi_ssm_start (ssm, open_complete);
 }
@@ -33,8 +33,6 @@
 
 G_DEFINE_TYPE (FpDeviceVirtualDeviceStorage, fpi_device_virtual_device_storage, fpi_device_virtual_device_get_type ())
 
-static GPtrArray * get_stored_prints (FpDeviceVirtualDevice * self);
-
 static void
 dev_identify (FpDevice *dev)
 {
@@ -47,7 +45,6 @@ dev_identify (FpDevice *dev)
 
   if (scan_id)
     {
-      g_autoptr(GPtrArray) stored = get_stored_prints (self);
       GPtrArray *prints;
       GVariant *data = NULL;
       FpPrint *new_scan;
@@ -63,10 +60,10 @@ dev_identify (FpDevice *dev)
       fpi_device_get_identify_data (dev, &prints);
       g_debug ("Trying to identify print '%s' against a gallery of %u prints", scan_id, prints->len);
 
-      if (!g_ptr_array_find_with_equal_func (stored,
-                                             new_scan,
-                                             (GEqualFunc) fp_print_equal,
-                                             NULL))
+      /* Stored prints are keyed by their ID and share the driver and
+       * device ID of new_scan, so a lookup is equivalent to comparing the
+       * prints and avoids creating a print for every stored ID. */
+      if (!g_hash_table_contains (self->prints_storage, scan_id))
         {
           match = FALSE;
           g_clear_object (&new_scan);
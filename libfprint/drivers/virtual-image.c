@@ -268,12 +268,30 @@ dev_deactivate (FpImageDevice *dev)
   fpi_image_device_deactivate_complete (dev, NULL);
 }
 
+static void dev_notify_removed_cb (FpDevice *dev);
+
+static gboolean
+dev_removed_in_driver_thread_cb (gpointer user_data)
+{
+  dev_notify_removed_cb (FP_DEVICE (user_data));
+
+  return G_SOURCE_REMOVE;
+}
+
 static void
 dev_notify_removed_cb (FpDevice *dev)
 {
   FpiImageDeviceState state;
   gboolean removed;
 
+  /* With a worker thread, notifications arrive in the main context */
+  if (!fpi_device_in_driver_thread (dev))
+    {
+      fpi_device_worker_invoke (dev, dev_removed_in_driver_thread_cb,
+                                g_object_ref (dev), g_object_unref);
+      return;
+    }
+
   g_object_get (dev,
                 "fpi-image-device-state", &state,
                 "removed", &removed,
@@ -26,8 +26,10 @@
 #include "fpi-device.h"
 #include "fpi-image-device.h"
 #include "fpi-image.h"
+#include "fpi-image-ops.h"
 #include "fpi-log.h"
 #include "fpi-print.h"
 #include "fpi-usb-transfer.h"
+#include "fpi-usb-reg-sequence.h"
 #include "fpi-spi-transfer.h"
 #include "fpi-ssm.h"
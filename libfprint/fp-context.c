@@ -49,16 +49,26 @@ typedef struct
   GCancellable *cancellable;
 
   GSList       *sources;
+  gboolean      device_threads;
 
   gint          pending_devices;
   gboolean      enumerated;
 
-  GArray       *drivers;
-  GPtrArray    *devices;
+  GArray            *drivers;
+  FpiUsbDriverIndex *usb_drivers;
+  GPtrArray         *devices;
 } FpContextPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (FpContext, fp_context, G_TYPE_OBJECT)
 
+enum {
+  PROP_0,
+  PROP_DEVICE_THREADS,
+  N_PROPS
+};
+
+static GParamSpec *properties[N_PROPS];
+
 enum {
   DEVICE_ADDED_SIGNAL,
   DEVICE_REMOVED_SIGNAL,
@@ -209,44 +219,16 @@ static void
 usb_device_added_cb (FpContext *self, GUsbDevice *device, GUsbContext *usb_ctx)
 {
   FpContextPrivate *priv = fp_context_get_instance_private (self);
-  GType found_driver = G_TYPE_NONE;
-  const FpIdEntry *found_entry = NULL;
-  gint found_score = 0;
-  gint i;
+  GType found_driver;
+  const FpIdEntry *found_entry;
   guint16 pid, vid;
 
   pid = g_usb_device_get_pid (device);
   vid = g_usb_device_get_vid (device);
 
   /* Find the best driver to handle this USB device. */
-  for (i = 0; i < priv->drivers->len; i++)
-    {
-      GType driver = g_array_index (priv->drivers, GType, i);
-      g_autoptr(FpDeviceClass) cls = g_type_class_ref (driver);
-      const FpIdEntry *entry;
-
-      if (cls->type != FP_DEVICE_TYPE_USB)
-        continue;
-
-      for (entry = cls->id_table; entry->pid; entry++)
-        {
-          gint driver_score = 50;
-
-          if (entry->pid != pid || entry->vid != vid)
-            continue;
-
-          if (cls->usb_discover)
-            driver_score = cls->usb_discover (device);
-
-          /* Is this driver better than the one we had? */
-          if (driver_score <= found_score)
-            continue;
-
-          found_score = driver_score;
-          found_driver = driver;
-          found_entry = entry;
-        }
-    }
+  found_driver = fpi_usb_driver_index_lookup (priv->usb_drivers, device,
+                                              vid, pid, &found_entry);
 
   if (found_driver == G_TYPE_NONE)
     {
@@ -262,6 +244,7 @@ usb_device_added_cb (FpContext *self, GUsbDevice *device, GUsbContext *usb_ctx)
                               self,
                               "fpi-usb-device", device,
                               "fpi-driver-data", found_entry->driver_data,
+                              "fpi-worker-thread", priv->device_threads,
                               NULL);
 }
 
@@ -293,6 +276,7 @@ fp_context_finalize (GObject *object)
 
   g_cancellable_cancel (priv->cancellable);
   g_clear_object (&priv->cancellable);
+  g_clear_pointer (&priv->usb_drivers, fpi_usb_driver_index_free);
   g_clear_pointer (&priv->drivers, g_array_unref);
   g_clear_pointer (&priv->devices, g_ptr_array_unref);
 
@@ -305,12 +289,80 @@ fp_context_finalize (GObject *object)
   G_OBJECT_CLASS (fp_context_parent_class)->finalize (object);
 }
 
+static void
+fp_context_get_property (GObject    *object,
+                         guint       prop_id,
+                         GValue     *value,
+                         GParamSpec *pspec)
+{
+  FpContext *self = FP_CONTEXT (object);
+  FpContextPrivate *priv = fp_context_get_instance_private (self);
+
+  switch (prop_id)
+    {
+    case PROP_DEVICE_THREADS:
+      g_value_set_boolean (value, priv->device_threads);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+fp_context_set_property (GObject      *object,
+                         guint         prop_id,
+                         const GValue *value,
+                         GParamSpec   *pspec)
+{
+  FpContext *self = FP_CONTEXT (object);
+  FpContextPrivate *priv = fp_context_get_instance_private (self);
+
+  switch (prop_id)
+    {
+    case PROP_DEVICE_THREADS:
+      priv->device_threads = g_value_get_boolean (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
 static void
 fp_context_class_init (FpContextClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
   object_class->finalize = fp_context_finalize;
+  object_class->get_property = fp_context_get_property;
+  object_class->set_property = fp_context_set_property;
+
+  /**
+   * FpContext:device-threads:
+   *
+   * Whether devices discovered from now on are driven from a thread of
+   * their own. This allows several devices to be used at the same time
+   * without their drivers competing for the main context.
+   *
+   * Results of the asynchronous #FpDevice operations are still delivered
+   * to the thread default main context of the caller. Property change
+   * notifications and the #FpDevice::removed signal are emitted in the
+   * thread default main context at the time the device was created.
+   * The getters and properties of #FpDevice return its state as of the
+   * last notification emitted there, so use them from that main context to
+   * see a state consistent with the notifications.
+   *
+   * Set this before calling fp_context_enumerate().
+   */
+  properties[PROP_DEVICE_THREADS] =
+    g_param_spec_boolean ("device-threads",
+                          "Device threads",
+                          "Whether each device is driven from its own thread",
+                          FALSE,
+                          G_PARAM_STATIC_STRINGS | G_PARAM_READWRITE);
+
+  g_object_class_install_properties (object_class, N_PROPS, properties);
 
   /**
    * FpContext::device-added:
@@ -378,6 +430,7 @@ fp_context_init (FpContext *self)
         }
     }
 
+  priv->usb_drivers = fpi_usb_driver_index_new (priv->drivers);
   priv->devices = g_ptr_array_new_with_free_func (g_object_unref);
 
   priv->cancellable = g_cancellable_new ();
@@ -468,6 +521,7 @@ fp_context_enumerate (FpContext *context)
                                       context,
                                       "fpi-environ", val,
                                       "fpi-driver-data", entry->driver_data,
+                                      "fpi-worker-thread", priv->device_threads,
                                       NULL);
           g_debug ("created");
         }
@@ -545,6 +599,7 @@ fp_context_enumerate (FpContext *context)
                                         "fpi-driver-data", entry->driver_data,
                                         "fpi-udev-data-spidev", (matched_spidev ? g_udev_device_get_device_file (matched_spidev->data) : NULL),
                                         "fpi-udev-data-hidraw", (matched_hidraw ? g_udev_device_get_device_file (matched_hidraw->data) : NULL),
+                                        "fpi-worker-thread", priv->device_threads,
                                         NULL);
             /* remove entries from list to avoid conflicts */
             if (matched_spidev)
@@ -39,6 +39,17 @@
 #define DEFAULT_TEMP_HOT_SECONDS (3 * 60)
 #define DEFAULT_TEMP_COLD_SECONDS (9 * 60)
 
+/* The part of the device state that the public getters return */
+typedef struct
+{
+  gboolean            is_removed;
+  gboolean            is_open;
+  FpScanType          scan_type;
+  gint                nr_enroll_stages;
+  FpFingerStatusFlags finger_status;
+  FpTemperature       temp_current;
+} FpDeviceState;
+
 typedef struct
 {
   FpDeviceType type;
@@ -65,6 +76,22 @@ typedef struct
   gint            nr_enroll_stages;
   GSList         *sources;
 
+  /* Worker thread driving the device, see "fpi-worker-thread". The lock
+   * protects the thread, its context and loop. */
+  gboolean      use_worker;
+  GMutex        worker_lock;
+  GThread      *worker_thread;
+  GMainContext *worker_context;
+  GMainLoop    *worker_loop;
+  /* Where notifications from the worker thread are emitted */
+  GMainContext *main_context;
+  /* The state as of the last notification emitted there, which is what
+   * threads other than the worker read */
+  FpDeviceState main_state;
+
+  /* Prints known to be stored on the device, NULL if unknown */
+  GPtrArray      *storage_cache;
+
   /* We always make sure that only one task is run at a time. */
   FpiDeviceAction     current_action;
   GTask              *current_task;
@@ -99,6 +126,16 @@ typedef struct
   gint64        temp_last_update;
   gboolean      temp_last_active;
   gdouble       temp_current_ratio;
+  gint64        temp_active_since;
+  gint64        temp_last_active_end;
+  gdouble       temp_last_active_seconds;
+  gdouble       temp_active_estimate;
+  gdouble       temp_duty_cycle;
+
+  /* Operations waiting for the temperature model to admit them */
+  gboolean      throttle;
+  GSource      *throttle_source;
+  void          (*throttle_start) (FpDevice *device);
 } FpDevicePrivate;
 
 
@@ -134,3 +171,19 @@ void fpi_device_configure_wakeup (FpDevice *device,
                                   gboolean  enabled);
 void fpi_device_update_temp (FpDevice *device,
                              gboolean  is_active);
+gint64 fpi_device_get_throttle_delay (FpDevice *device);
+void fpi_device_start_throttled (FpDevice *device,
+                                 void (*start) (FpDevice *device));
+
+GPtrArray *fpi_device_copy_storage_cache (FpDevice *device);
+
+void     fpi_device_worker_stop (FpDevice *device);
+gboolean fpi_device_in_worker_thread (FpDevice *device);
+void     fpi_device_main_context_invoke (FpDevice      *device,
+                                         GSourceFunc    func,
+                                         gpointer       data,
+                                         GDestroyNotify notify);
+
+void fpi_device_calibration_clear_memory (void);
+
+FpDevicePrivate *fpi_device_get_private (FpDevice *device);
@@ -49,11 +49,13 @@ enum {
   PROP_SCAN_TYPE,
   PROP_FINGER_STATUS,
   PROP_TEMPERATURE,
+  PROP_THROTTLE,
   PROP_FPI_ENVIRON,
   PROP_FPI_USB_DEVICE,
   PROP_FPI_UDEV_DATA_SPIDEV,
   PROP_FPI_UDEV_DATA_HIDRAW,
   PROP_FPI_DRIVER_DATA,
+  PROP_FPI_WORKER_THREAD,
   N_PROPS
 };
 
@@ -94,6 +96,17 @@ fp_device_cancel_in_idle_cb (gpointer user_data)
 
   priv->current_idle_cancel_source = NULL;
 
+  /* The driver has not been started yet if the action is being throttled */
+  if (priv->throttle_source)
+    {
+      g_clear_pointer (&priv->throttle_source, g_source_destroy);
+      fpi_device_action_error (self,
+                               g_error_new_literal (G_IO_ERROR,
+                                                    G_IO_ERROR_CANCELLED,
+                                                    "Operation was cancelled"));
+      return G_SOURCE_REMOVE;
+    }
+
   if (priv->critical_section)
     priv->cancel_queued = TRUE;
   else
@@ -158,6 +171,345 @@ setup_task_cancellable (FpDevice *device)
     }
 }
 
+/* Devices created with "fpi-worker-thread" set run the driver on a thread
+ * of their own. Public calls made from any other thread are forwarded to it,
+ * and their results and reports are handed back to the main context that was
+ * the thread default when the call was made, as GTask would do. */
+
+typedef enum {
+  FP_DEVICE_CALL_OPEN,
+  FP_DEVICE_CALL_CLOSE,
+  FP_DEVICE_CALL_SUSPEND,
+  FP_DEVICE_CALL_RESUME,
+  FP_DEVICE_CALL_ENROLL,
+  FP_DEVICE_CALL_VERIFY,
+  FP_DEVICE_CALL_IDENTIFY,
+  FP_DEVICE_CALL_CAPTURE,
+  FP_DEVICE_CALL_DELETE_PRINT,
+  FP_DEVICE_CALL_LIST_PRINTS,
+  FP_DEVICE_CALL_CLEAR_STORAGE,
+} FpDeviceCallType;
+
+typedef struct
+{
+  gint                ref_count;
+  FpDeviceCallType    type;
+  FpDevice           *device;
+  GMainContext       *context;
+  GCancellable       *cancellable;
+
+  /* Arguments */
+  FpPrint            *print;
+  GPtrArray          *prints;
+  gboolean            wait_for_finger;
+
+  /* Enroll progress or match reporting */
+  GCallback           report_cb;
+  gpointer            report_data;
+  GDestroyNotify      report_destroy;
+
+  GAsyncReadyCallback callback;
+  gpointer            user_data;
+  GAsyncResult       *result;
+} FpDeviceCall;
+
+typedef struct
+{
+  FpDeviceCall *call;
+  gint          completed_stages;
+  FpPrint      *match;
+  FpPrint      *print;
+  GError       *error;
+} FpDeviceCallReport;
+
+static void
+attach_idle (GMainContext  *context,
+             GSourceFunc    func,
+             gpointer       data,
+             GDestroyNotify notify)
+{
+  g_autoptr(GSource) source = g_idle_source_new ();
+
+  g_source_set_callback (source, func, data, notify);
+  g_source_attach (source, context);
+}
+
+static gboolean
+fp_device_use_worker (FpDevice *device)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+
+  return priv->use_worker && !fpi_device_in_worker_thread (device);
+}
+
+/* Needs to be called from the thread the driver runs on */
+static void
+fp_device_copy_state (FpDevice *device, FpDeviceState *state)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+
+  state->is_removed = priv->is_removed;
+  state->is_open = priv->is_open;
+  state->scan_type = priv->scan_type;
+  state->nr_enroll_stages = priv->nr_enroll_stages;
+  state->finger_status = priv->finger_status;
+  state->temp_current = priv->temp_current;
+}
+
+/* The state the getters return. With a worker thread, other threads get it
+ * as of the last notification emitted in the main context, as the worker
+ * may be changing it. */
+static FpDeviceState
+fp_device_get_state (FpDevice *device)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  FpDeviceState state;
+
+  if (fp_device_use_worker (device))
+    return priv->main_state;
+
+  fp_device_copy_state (device, &state);
+  return state;
+}
+
+static FpDeviceCall *
+fp_device_call_new (FpDevice           *device,
+                    FpDeviceCallType    type,
+                    GCancellable       *cancellable,
+                    GAsyncReadyCallback callback,
+                    gpointer            user_data)
+{
+  FpDeviceCall *call = g_new0 (FpDeviceCall, 1);
+
+  call->ref_count = 1;
+  call->type = type;
+  call->device = g_object_ref (device);
+  call->context = g_main_context_ref_thread_default ();
+  if (cancellable)
+    call->cancellable = g_object_ref (cancellable);
+  call->callback = callback;
+  call->user_data = user_data;
+
+  return call;
+}
+
+static FpDeviceCall *
+fp_device_call_ref (FpDeviceCall *call)
+{
+  g_atomic_int_inc (&call->ref_count);
+
+  return call;
+}
+
+static void
+fp_device_call_unref (FpDeviceCall *call)
+{
+  if (!g_atomic_int_dec_and_test (&call->ref_count))
+    return;
+
+  /* Only if the result was never delivered */
+  if (call->report_destroy)
+    call->report_destroy (call->report_data);
+
+  g_clear_object (&call->result);
+  g_clear_object (&call->print);
+  g_clear_pointer (&call->prints, g_ptr_array_unref);
+  g_clear_object (&call->cancellable);
+  g_main_context_unref (call->context);
+  g_object_unref (call->device);
+  g_free (call);
+}
+
+static void
+fp_device_call_report_free (FpDeviceCallReport *report)
+{
+  fp_device_call_unref (report->call);
+  g_clear_object (&report->match);
+  g_clear_object (&report->print);
+  g_clear_error (&report->error);
+  g_free (report);
+}
+
+static gboolean
+fp_device_call_report_cb (gpointer user_data)
+{
+  FpDeviceCallReport *report = user_data;
+  FpDeviceCall *call = report->call;
+
+  if (call->type == FP_DEVICE_CALL_ENROLL)
+    ((FpEnrollProgress) call->report_cb)(call->device,
+                                         report->completed_stages,
+                                         report->print,
+                                         call->report_data,
+                                         report->error);
+  else
+    ((FpMatchCb) call->report_cb)(call->device,
+                                  report->match,
+                                  report->print,
+                                  call->report_data,
+                                  report->error);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Reports are queued before the result, so they arrive in order */
+static void
+fp_device_call_report (FpDeviceCall *call,
+                       gint          completed_stages,
+                       FpPrint      *match,
+                       FpPrint      *print,
+                       GError       *error)
+{
+  FpDeviceCallReport *report = g_new0 (FpDeviceCallReport, 1);
+
+  report->call = fp_device_call_ref (call);
+  report->completed_stages = completed_stages;
+  if (match)
+    report->match = g_object_ref (match);
+  if (print)
+    report->print = g_object_ref (print);
+  if (error)
+    report->error = g_error_copy (error);
+
+  attach_idle (call->context, fp_device_call_report_cb, report,
+               (GDestroyNotify) fp_device_call_report_free);
+}
+
+static void
+fp_device_call_enroll_progress (FpDevice *device,
+                                gint      completed_stages,
+                                FpPrint  *print,
+                                gpointer  user_data,
+                                GError   *error)
+{
+  fp_device_call_report (user_data, completed_stages, NULL, print, error);
+}
+
+static void
+fp_device_call_match (FpDevice *device,
+                      FpPrint  *match,
+                      FpPrint  *print,
+                      gpointer  user_data,
+                      GError   *error)
+{
+  fp_device_call_report (user_data, 0, match, print, error);
+}
+
+static gboolean
+fp_device_call_return_cb (gpointer user_data)
+{
+  FpDeviceCall *call = user_data;
+
+  if (call->callback)
+    call->callback (G_OBJECT (call->device), call->result, call->user_data);
+
+  /* Like the task data of a direct call, destroy after the callback */
+  if (call->report_destroy)
+    {
+      call->report_destroy (call->report_data);
+      call->report_destroy = NULL;
+    }
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+fp_device_call_done_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  FpDeviceCall *call = user_data;
+
+  call->result = g_object_ref (res);
+  attach_idle (call->context, fp_device_call_return_cb, call,
+               (GDestroyNotify) fp_device_call_unref);
+}
+
+static gboolean
+fp_device_call_run_cb (gpointer user_data)
+{
+  FpDeviceCall *call = user_data;
+  FpDevice *device = call->device;
+  GCancellable *cancellable = call->cancellable;
+  GAsyncReadyCallback done = fp_device_call_done_cb;
+  FpEnrollProgress progress_cb = NULL;
+  FpMatchCb match_cb = NULL;
+
+  /* The call stays alive until its result was delivered, so the reporting
+   * closures do not need a reference of their own. */
+  if (call->report_cb)
+    {
+      progress_cb = fp_device_call_enroll_progress;
+      match_cb = fp_device_call_match;
+    }
+
+  switch (call->type)
+    {
+    case FP_DEVICE_CALL_OPEN:
+      fp_device_open (device, cancellable, done, fp_device_call_ref (call));
+      break;
+
+    case FP_DEVICE_CALL_CLOSE:
+      fp_device_close (device, cancellable, done, fp_device_call_ref (call));
+      break;
+
+    case FP_DEVICE_CALL_SUSPEND:
+      fp_device_suspend (device, cancellable, done, fp_device_call_ref (call));
+      break;
+
+    case FP_DEVICE_CALL_RESUME:
+      fp_device_resume (device, cancellable, done, fp_device_call_ref (call));
+      break;
+
+    case FP_DEVICE_CALL_ENROLL:
+      fp_device_enroll (device, call->print, cancellable,
+                        progress_cb, call, NULL,
+                        done, fp_device_call_ref (call));
+      break;
+
+    case FP_DEVICE_CALL_VERIFY:
+      fp_device_verify (device, call->print, cancellable,
+                        match_cb, call, NULL,
+                        done, fp_device_call_ref (call));
+      break;
+
+    case FP_DEVICE_CALL_IDENTIFY:
+      fp_device_identify (device, call->prints, cancellable,
+                          match_cb, call, NULL,
+                          done, fp_device_call_ref (call));
+      break;
+
+    case FP_DEVICE_CALL_CAPTURE:
+      fp_device_capture (device, call->wait_for_finger, cancellable,
+                         done, fp_device_call_ref (call));
+      break;
+
+    case FP_DEVICE_CALL_DELETE_PRINT:
+      fp_device_delete_print (device, call->print, cancellable,
+                              done, fp_device_call_ref (call));
+      break;
+
+    case FP_DEVICE_CALL_LIST_PRINTS:
+      fp_device_list_prints (device, cancellable, done, fp_device_call_ref (call));
+      break;
+
+    case FP_DEVICE_CALL_CLEAR_STORAGE:
+      fp_device_clear_storage (device, cancellable, done, fp_device_call_ref (call));
+      break;
+
+    default:
+      g_assert_not_reached ();
+    }
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Takes over the call */
+static void
+fp_device_call_run (FpDeviceCall *call)
+{
+  fpi_device_worker_invoke (call->device, fp_device_call_run_cb, call,
+                            (GDestroyNotify) fp_device_call_unref);
+}
+
 static void
 fp_device_constructed (GObject *object)
 {
@@ -205,6 +557,8 @@ fp_device_constructed (GObject *object)
   priv->temp_last_update = g_get_monotonic_time ();
   priv->temp_last_active = FALSE;
 
+  fp_device_copy_state (self, &priv->main_state);
+
   G_OBJECT_CLASS (fp_device_parent_class)->constructed (object);
 }
 
@@ -219,6 +573,11 @@ fp_device_finalize (GObject *object)
   if (priv->is_open)
     g_warning ("User destroyed open device! Not cleaning up properly!");
 
+  /* Nothing may be dispatched while the sources go away */
+  fpi_device_worker_stop (self);
+  g_mutex_clear (&priv->worker_lock);
+  g_clear_pointer (&priv->main_context, g_main_context_unref);
+
   g_clear_pointer (&priv->temp_timeout, g_source_destroy);
 
   g_slist_free_full (priv->sources, (GDestroyNotify) g_source_destroy);
@@ -229,6 +588,7 @@ fp_device_finalize (GObject *object)
 
   g_clear_pointer (&priv->device_id, g_free);
   g_clear_pointer (&priv->device_name, g_free);
+  g_clear_pointer (&priv->storage_cache, g_ptr_array_unref);
 
   g_clear_object (&priv->usb_device);
   g_clear_pointer (&priv->virtual_env, g_free);
@@ -247,23 +607,28 @@ fp_device_get_property (GObject    *object,
   FpDevice *self = FP_DEVICE (object);
   FpDevicePrivate *priv = fp_device_get_instance_private (self);
   FpDeviceClass *cls = FP_DEVICE_GET_CLASS (self);
+  FpDeviceState state = fp_device_get_state (self);
 
   switch (prop_id)
     {
     case PROP_NR_ENROLL_STAGES:
-      g_value_set_uint (value, priv->nr_enroll_stages);
+      g_value_set_uint (value, state.nr_enroll_stages);
       break;
 
     case PROP_SCAN_TYPE:
-      g_value_set_enum (value, priv->scan_type);
+      g_value_set_enum (value, state.scan_type);
       break;
 
     case PROP_FINGER_STATUS:
-      g_value_set_flags (value, priv->finger_status);
+      g_value_set_flags (value, state.finger_status);
       break;
 
     case PROP_TEMPERATURE:
-      g_value_set_enum (value, priv->temp_current);
+      g_value_set_enum (value, state.temp_current);
+      break;
+
+    case PROP_THROTTLE:
+      g_value_set_boolean (value, priv->throttle);
       break;
 
     case PROP_DRIVER:
@@ -279,11 +644,11 @@ fp_device_get_property (GObject    *object,
       break;
 
     case PROP_OPEN:
-      g_value_set_boolean (value, priv->is_open);
+      g_value_set_boolean (value, state.is_open);
       break;
 
     case PROP_REMOVED:
-      g_value_set_boolean (value, priv->is_removed);
+      g_value_set_boolean (value, state.is_removed);
       break;
 
     case PROP_FPI_USB_DEVICE:
@@ -354,6 +719,14 @@ fp_device_set_property (GObject      *object,
       priv->driver_data = g_value_get_uint64 (value);
       break;
 
+    case PROP_FPI_WORKER_THREAD:
+      priv->use_worker = g_value_get_boolean (value);
+      break;
+
+    case PROP_THROTTLE:
+      priv->throttle = g_value_get_boolean (value);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -423,6 +796,76 @@ fp_device_async_initable_iface_init (GAsyncInitableIface *iface)
   iface->init_finish = fp_device_async_initable_init_finish;
 }
 
+typedef struct
+{
+  FpDevice     *device;
+  guint         n_pspecs;
+  GParamSpec  **pspecs;
+  FpDeviceState state;
+} FpDeviceNotifyData;
+
+static void
+fp_device_notify_data_free (FpDeviceNotifyData *data)
+{
+  guint i;
+
+  for (i = 0; i < data->n_pspecs; i++)
+    g_param_spec_unref (data->pspecs[i]);
+  g_free (data->pspecs);
+  g_object_unref (data->device);
+  g_free (data);
+}
+
+static gboolean
+fp_device_notify_cb (gpointer user_data)
+{
+  FpDeviceNotifyData *data = user_data;
+  FpDevicePrivate *priv = fp_device_get_instance_private (data->device);
+
+  priv->main_state = data->state;
+
+  G_OBJECT_CLASS (fp_device_parent_class)->dispatch_properties_changed (G_OBJECT (data->device),
+                                                                        data->n_pspecs,
+                                                                        data->pspecs);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Notifications made by the worker thread are emitted in the main context */
+static void
+fp_device_dispatch_properties_changed (GObject     *object,
+                                       guint        n_pspecs,
+                                       GParamSpec **pspecs)
+{
+  FpDevice *device = FP_DEVICE (object);
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  FpDeviceNotifyData *data;
+  guint i;
+
+  if (!fpi_device_in_worker_thread (device))
+    {
+      /* Changes made before the worker started */
+      if (fpi_device_in_driver_thread (device))
+        fp_device_copy_state (device, &priv->main_state);
+
+      G_OBJECT_CLASS (fp_device_parent_class)->dispatch_properties_changed (object,
+                                                                            n_pspecs,
+                                                                            pspecs);
+      return;
+    }
+
+  data = g_new0 (FpDeviceNotifyData, 1);
+  data->device = g_object_ref (device);
+  data->n_pspecs = n_pspecs;
+  data->pspecs = g_new (GParamSpec *, n_pspecs);
+  for (i = 0; i < n_pspecs; i++)
+    data->pspecs[i] = g_param_spec_ref (pspecs[i]);
+  fp_device_copy_state (device, &data->state);
+
+  fpi_device_main_context_invoke (device, fp_device_notify_cb, data,
+                                  (GDestroyNotify) fp_device_notify_data_free);
+}
+
 static void
 fp_device_class_init (FpDeviceClass *klass)
 {
@@ -432,6 +875,7 @@ fp_device_class_init (FpDeviceClass *klass)
   object_class->finalize = fp_device_finalize;
   object_class->get_property = fp_device_get_property;
   object_class->set_property = fp_device_set_property;
+  object_class->dispatch_properties_changed = fp_device_dispatch_properties_changed;
 
   properties[PROP_NR_ENROLL_STAGES] =
     g_param_spec_uint ("nr-enroll-stages",
@@ -462,6 +906,22 @@ fp_device_class_init (FpDeviceClass *klass)
                        FP_TYPE_TEMPERATURE, FP_TEMPERATURE_COLD,
                        G_PARAM_STATIC_STRINGS | G_PARAM_READABLE);
 
+  /**
+   * FpDevice:throttle:
+   *
+   * Whether enroll, verify, identify and capture wait for the device to cool
+   * down instead of failing with %FP_DEVICE_ERROR_TOO_HOT. Operations are
+   * started at the rate that the temperature model expects to be sustainable,
+   * see fp_device_get_throttle_delay(). The device is busy while an operation
+   * is waiting.
+   */
+  properties[PROP_THROTTLE] =
+    g_param_spec_boolean ("throttle",
+                          "Throttle",
+                          "Delay operations to prevent overheating instead of failing them",
+                          FALSE,
+                          G_PARAM_STATIC_STRINGS | G_PARAM_READWRITE);
+
   properties[PROP_DRIVER] =
     g_param_spec_string ("driver",
                          "Driver",
@@ -594,12 +1054,30 @@ fp_device_class_init (FpDeviceClass *klass)
                          0,
                          G_PARAM_STATIC_STRINGS | G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY);
 
+  /**
+   * FpDevice::fpi-worker-thread: (skip)
+   *
+   * This property is only for internal purposes.
+   *
+   * Stability: private
+   */
+  properties[PROP_FPI_WORKER_THREAD] =
+    g_param_spec_boolean ("fpi-worker-thread",
+                          "Worker thread",
+                          "Private: Whether to drive the device from a thread of its own",
+                          FALSE,
+                          G_PARAM_STATIC_STRINGS | G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY);
+
   g_object_class_install_properties (object_class, N_PROPS, properties);
 }
 
 static void
 fp_device_init (FpDevice *self)
 {
+  FpDevicePrivate *priv = fp_device_get_instance_private (self);
+
+  g_mutex_init (&priv->worker_lock);
+  priv->main_context = g_main_context_ref_thread_default ();
 }
 
 /**
@@ -657,11 +1135,9 @@ fp_device_get_name (FpDevice *device)
 gboolean
 fp_device_is_open (FpDevice *device)
 {
-  FpDevicePrivate *priv = fp_device_get_instance_private (device);
-
   g_return_val_if_fail (FP_IS_DEVICE (device), FALSE);
 
-  return priv->is_open;
+  return fp_device_get_state (device).is_open;
 }
 
 /**
@@ -675,11 +1151,9 @@ fp_device_is_open (FpDevice *device)
 FpScanType
 fp_device_get_scan_type (FpDevice *device)
 {
-  FpDevicePrivate *priv = fp_device_get_instance_private (device);
-
   g_return_val_if_fail (FP_IS_DEVICE (device), FP_SCAN_TYPE_SWIPE);
 
-  return priv->scan_type;
+  return fp_device_get_state (device).scan_type;
 }
 
 /**
@@ -695,11 +1169,9 @@ fp_device_get_scan_type (FpDevice *device)
 FpFingerStatusFlags
 fp_device_get_finger_status (FpDevice *device)
 {
-  FpDevicePrivate *priv = fp_device_get_instance_private (device);
-
   g_return_val_if_fail (FP_IS_DEVICE (device), FP_FINGER_STATUS_NONE);
 
-  return priv->finger_status;
+  return fp_device_get_state (device).finger_status;
 }
 
 /**
@@ -713,11 +1185,9 @@ fp_device_get_finger_status (FpDevice *device)
 gint
 fp_device_get_nr_enroll_stages (FpDevice *device)
 {
-  FpDevicePrivate *priv = fp_device_get_instance_private (device);
-
   g_return_val_if_fail (FP_IS_DEVICE (device), -1);
 
-  return priv->nr_enroll_stages;
+  return fp_device_get_state (device).nr_enroll_stages;
 }
 
 /**
@@ -732,11 +1202,26 @@ fp_device_get_nr_enroll_stages (FpDevice *device)
 FpTemperature
 fp_device_get_temperature (FpDevice *device)
 {
-  FpDevicePrivate *priv = fp_device_get_instance_private (device);
-
   g_return_val_if_fail (FP_IS_DEVICE (device), -1);
 
-  return priv->temp_current;
+  return fp_device_get_state (device).temp_current;
+}
+
+/**
+ * fp_device_get_throttle_delay:
+ * @device: A #FpDevice
+ *
+ * Predicts how long an operation started now would wait for the device to
+ * cool down if #FpDevice:throttle is set.
+ *
+ * Returns: The delay in milliseconds, 0 if the operation would start right away
+ */
+guint
+fp_device_get_throttle_delay (FpDevice *device)
+{
+  g_return_val_if_fail (FP_IS_DEVICE (device), 0);
+
+  return (fpi_device_get_throttle_delay (device) + 999) / 1000;
 }
 
 /**
@@ -820,6 +1305,15 @@ fp_device_open (FpDevice           *device,
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
   GError *error = NULL;
 
+  if (fp_device_use_worker (device))
+    {
+      FpDeviceCall *call = fp_device_call_new (device, FP_DEVICE_CALL_OPEN,
+                                               cancellable, callback, user_data);
+
+      fp_device_call_run (call);
+      return;
+    }
+
   task = g_task_new (device, cancellable, callback, user_data);
   if (g_task_return_error_if_cancelled (task))
     return;
@@ -905,6 +1399,15 @@ fp_device_close (FpDevice           *device,
   g_autoptr(GTask) task = NULL;
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
 
+  if (fp_device_use_worker (device))
+    {
+      FpDeviceCall *call = fp_device_call_new (device, FP_DEVICE_CALL_CLOSE,
+                                               cancellable, callback, user_data);
+
+      fp_device_call_run (call);
+      return;
+    }
+
   task = g_task_new (device, cancellable, callback, user_data);
   if (g_task_return_error_if_cancelled (task))
     return;
@@ -981,6 +1484,15 @@ fp_device_suspend (FpDevice           *device,
   g_autoptr(GTask) task = NULL;
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
 
+  if (fp_device_use_worker (device))
+    {
+      FpDeviceCall *call = fp_device_call_new (device, FP_DEVICE_CALL_SUSPEND,
+                                               cancellable, callback, user_data);
+
+      fp_device_call_run (call);
+      return;
+    }
+
   task = g_task_new (device, cancellable, callback, user_data);
 
   if (priv->suspend_resume_task || priv->is_suspended)
@@ -1046,6 +1558,15 @@ fp_device_resume (FpDevice           *device,
   g_autoptr(GTask) task = NULL;
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
 
+  if (fp_device_use_worker (device))
+    {
+      FpDeviceCall *call = fp_device_call_new (device, FP_DEVICE_CALL_RESUME,
+                                               cancellable, callback, user_data);
+
+      fp_device_call_run (call);
+      return;
+    }
+
   task = g_task_new (device, cancellable, callback, user_data);
 
   if (priv->suspend_resume_task || !priv->is_suspended)
@@ -1135,6 +1656,21 @@ fp_device_enroll (FpDevice           *device,
   FpEnrollData *data;
   FpiPrintType print_type;
 
+  if (fp_device_use_worker (device))
+    {
+      FpDeviceCall *call = fp_device_call_new (device, FP_DEVICE_CALL_ENROLL,
+                                               cancellable, callback, user_data);
+
+      if (FP_IS_PRINT (template_print))
+        call->print = g_object_ref_sink (template_print);
+      call->report_cb = G_CALLBACK (progress_cb);
+      call->report_data = progress_data;
+      call->report_destroy = progress_destroy;
+
+      fp_device_call_run (call);
+      return;
+    }
+
   task = g_task_new (device, cancellable, callback, user_data);
   if (g_task_return_error_if_cancelled (task))
     return;
@@ -1181,12 +1717,16 @@ fp_device_enroll (FpDevice           *device,
         }
     }
 
-  fpi_device_update_temp (device, TRUE);
-  if (priv->temp_current == FP_TEMPERATURE_HOT)
+  /* A throttled operation waits for the device to cool down instead */
+  if (!priv->throttle)
     {
-      g_task_return_error (task, fpi_device_error_new (FP_DEVICE_ERROR_TOO_HOT));
-      fpi_device_update_temp (device, FALSE);
-      return;
+      fpi_device_update_temp (device, TRUE);
+      if (priv->temp_current == FP_TEMPERATURE_HOT)
+        {
+          g_task_return_error (task, fpi_device_error_new (FP_DEVICE_ERROR_TOO_HOT));
+          fpi_device_update_temp (device, FALSE);
+          return;
+        }
     }
 
   priv->current_action = FPI_DEVICE_ACTION_ENROLL;
@@ -1202,7 +1742,7 @@ fp_device_enroll (FpDevice           *device,
   // Attach the progress data as task data so that it is destroyed
   g_task_set_task_data (priv->current_task, data, (GDestroyNotify) enroll_data_free);
 
-  FP_DEVICE_GET_CLASS (device)->enroll (device);
+  fpi_device_start_throttled (device, FP_DEVICE_GET_CLASS (device)->enroll);
 }
 
 /**
@@ -1273,6 +1813,21 @@ fp_device_verify (FpDevice           *device,
   FpDeviceClass *cls = FP_DEVICE_GET_CLASS (device);
   FpMatchData *data;
 
+  if (fp_device_use_worker (device))
+    {
+      FpDeviceCall *call = fp_device_call_new (device, FP_DEVICE_CALL_VERIFY,
+                                               cancellable, callback, user_data);
+
+      if (enrolled_print)
+        call->print = g_object_ref (enrolled_print);
+      call->report_cb = G_CALLBACK (match_cb);
+      call->report_data = match_data;
+      call->report_destroy = match_destroy;
+
+      fp_device_call_run (call);
+      return;
+    }
+
   task = g_task_new (device, cancellable, callback, user_data);
   if (g_task_return_error_if_cancelled (task))
     return;
@@ -1299,12 +1854,16 @@ fp_device_verify (FpDevice           *device,
       return;
     }
 
-  fpi_device_update_temp (device, TRUE);
-  if (priv->temp_current == FP_TEMPERATURE_HOT)
+  /* A throttled operation waits for the device to cool down instead */
+  if (!priv->throttle)
     {
-      g_task_return_error (task, fpi_device_error_new (FP_DEVICE_ERROR_TOO_HOT));
-      fpi_device_update_temp (device, FALSE);
-      return;
+      fpi_device_update_temp (device, TRUE);
+      if (priv->temp_current == FP_TEMPERATURE_HOT)
+        {
+          g_task_return_error (task, fpi_device_error_new (FP_DEVICE_ERROR_TOO_HOT));
+          fpi_device_update_temp (device, FALSE);
+          return;
+        }
     }
 
   priv->current_action = FPI_DEVICE_ACTION_VERIFY;
@@ -1320,7 +1879,7 @@ fp_device_verify (FpDevice           *device,
   // Attach the match data as task data so that it is destroyed
   g_task_set_task_data (priv->current_task, data, (GDestroyNotify) match_data_free);
 
-  cls->verify (device);
+  fpi_device_start_throttled (device, cls->verify);
 }
 
 /**
@@ -1400,6 +1959,21 @@ fp_device_identify (FpDevice           *device,
   FpMatchData *data;
   int i;
 
+  if (fp_device_use_worker (device))
+    {
+      FpDeviceCall *call = fp_device_call_new (device, FP_DEVICE_CALL_IDENTIFY,
+                                               cancellable, callback, user_data);
+
+      if (prints)
+        call->prints = g_ptr_array_ref (prints);
+      call->report_cb = G_CALLBACK (match_cb);
+      call->report_data = match_data;
+      call->report_destroy = match_destroy;
+
+      fp_device_call_run (call);
+      return;
+    }
+
   task = g_task_new (device, cancellable, callback, user_data);
   if (g_task_return_error_if_cancelled (task))
     return;
@@ -1434,12 +2008,16 @@ fp_device_identify (FpDevice           *device,
       return;
     }
 
-  fpi_device_update_temp (device, TRUE);
-  if (priv->temp_current == FP_TEMPERATURE_HOT)
+  /* A throttled operation waits for the device to cool down instead */
+  if (!priv->throttle)
     {
-      g_task_return_error (task, fpi_device_error_new (FP_DEVICE_ERROR_TOO_HOT));
-      fpi_device_update_temp (device, FALSE);
-      return;
+      fpi_device_update_temp (device, TRUE);
+      if (priv->temp_current == FP_TEMPERATURE_HOT)
+        {
+          g_task_return_error (task, fpi_device_error_new (FP_DEVICE_ERROR_TOO_HOT));
+          fpi_device_update_temp (device, FALSE);
+          return;
+        }
     }
 
   priv->current_action = FPI_DEVICE_ACTION_IDENTIFY;
@@ -1461,7 +2039,7 @@ fp_device_identify (FpDevice           *device,
   // Attach the match data as task data so that it is destroyed
   g_task_set_task_data (priv->current_task, data, (GDestroyNotify) match_data_free);
 
-  cls->identify (device);
+  fpi_device_start_throttled (device, cls->identify);
 }
 
 /**
@@ -1533,6 +2111,17 @@ fp_device_capture (FpDevice           *device,
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
   FpDeviceClass *cls = FP_DEVICE_GET_CLASS (device);
 
+  if (fp_device_use_worker (device))
+    {
+      FpDeviceCall *call = fp_device_call_new (device, FP_DEVICE_CALL_CAPTURE,
+                                               cancellable, callback, user_data);
+
+      call->wait_for_finger = wait_for_finger;
+
+      fp_device_call_run (call);
+      return;
+    }
+
   task = g_task_new (device, cancellable, callback, user_data);
   if (g_task_return_error_if_cancelled (task))
     return;
@@ -1559,12 +2148,16 @@ fp_device_capture (FpDevice           *device,
       return;
     }
 
-  fpi_device_update_temp (device, TRUE);
-  if (priv->temp_current == FP_TEMPERATURE_HOT)
+  /* A throttled operation waits for the device to cool down instead */
+  if (!priv->throttle)
     {
-      g_task_return_error (task, fpi_device_error_new (FP_DEVICE_ERROR_TOO_HOT));
-      fpi_device_update_temp (device, FALSE);
-      return;
+      fpi_device_update_temp (device, TRUE);
+      if (priv->temp_current == FP_TEMPERATURE_HOT)
+        {
+          g_task_return_error (task, fpi_device_error_new (FP_DEVICE_ERROR_TOO_HOT));
+          fpi_device_update_temp (device, FALSE);
+          return;
+        }
     }
 
   priv->current_action = FPI_DEVICE_ACTION_CAPTURE;
@@ -1573,7 +2166,7 @@ fp_device_capture (FpDevice           *device,
 
   priv->wait_for_finger = wait_for_finger;
 
-  cls->capture (device);
+  fpi_device_start_throttled (device, cls->capture);
 }
 
 /**
@@ -1624,6 +2217,18 @@ fp_device_delete_print (FpDevice           *device,
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
   FpDeviceClass *cls = FP_DEVICE_GET_CLASS (device);
 
+  if (fp_device_use_worker (device))
+    {
+      FpDeviceCall *call = fp_device_call_new (device, FP_DEVICE_CALL_DELETE_PRINT,
+                                               cancellable, callback, user_data);
+
+      if (enrolled_print)
+        call->print = g_object_ref (enrolled_print);
+
+      fp_device_call_run (call);
+      return;
+    }
+
   task = g_task_new (device, cancellable, callback, user_data);
   if (g_task_return_error_if_cancelled (task))
     return;
@@ -1702,6 +2307,15 @@ fp_device_list_prints (FpDevice           *device,
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
   FpDeviceClass *cls = FP_DEVICE_GET_CLASS (device);
 
+  if (fp_device_use_worker (device))
+    {
+      FpDeviceCall *call = fp_device_call_new (device, FP_DEVICE_CALL_LIST_PRINTS,
+                                               cancellable, callback, user_data);
+
+      fp_device_call_run (call);
+      return;
+    }
+
   task = g_task_new (device, cancellable, callback, user_data);
   if (g_task_return_error_if_cancelled (task))
     return;
@@ -1728,6 +2342,14 @@ fp_device_list_prints (FpDevice           *device,
       return;
     }
 
+  if (priv->storage_cache)
+    {
+      g_debug ("Returning %u cached prints", priv->storage_cache->len);
+      g_task_return_pointer (task, fpi_device_copy_storage_cache (device),
+                             (GDestroyNotify) g_ptr_array_unref);
+      return;
+    }
+
   priv->current_action = FPI_DEVICE_ACTION_LIST;
   priv->current_task = g_steal_pointer (&task);
   setup_task_cancellable (device);
@@ -1779,6 +2401,15 @@ fp_device_clear_storage (FpDevice           *device,
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
   FpDeviceClass *cls = FP_DEVICE_GET_CLASS (device);
 
+  if (fp_device_use_worker (device))
+    {
+      FpDeviceCall *call = fp_device_call_new (device, FP_DEVICE_CALL_CLEAR_STORAGE,
+                                               cancellable, callback, user_data);
+
+      fp_device_call_run (call);
+      return;
+    }
+
   task = g_task_new (device, cancellable, callback, user_data);
   if (g_task_return_error_if_cancelled (task))
     return;
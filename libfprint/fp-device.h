@@ -225,6 +225,7 @@ FpScanType   fp_device_get_scan_type (FpDevice *device);
 FpFingerStatusFlags fp_device_get_finger_status (FpDevice *device);
 gint         fp_device_get_nr_enroll_stages (FpDevice *device);
 FpTemperature fp_device_get_temperature (FpDevice *device);
+guint        fp_device_get_throttle_delay (FpDevice *device);
 
 FpDeviceFeature     fp_device_get_features (FpDevice *device);
 gboolean            fp_device_has_feature (FpDevice       *device,
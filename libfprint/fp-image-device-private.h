@@ -38,6 +38,7 @@ typedef struct
 
   gint                bz3_threshold;
   FpiPrintType        algorithm;
+  gint                min_quality;
 } FpImageDevicePrivate;
 
 
@@ -194,6 +194,7 @@ fp_image_device_constructed (GObject * obj)
   priv->algorithm = FPI_PRINT_NBIS;
   if (cls->algorithm > 0)
     priv->algorithm = cls->algorithm;
+  priv->min_quality = cls->min_quality;
 
   G_OBJECT_CLASS (fp_image_device_parent_class)->constructed (obj);
 }
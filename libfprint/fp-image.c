@@ -23,6 +23,7 @@
 
 #include "fpi-compat.h"
 #include "fpi-image.h"
+#include "fpi-image-ops.h"
 #include "fpi-log.h"
 
 #include <config.h>
@@ -43,6 +44,7 @@ enum {
   PROP_0,
   PROP_WIDTH,
   PROP_HEIGHT,
+  PROP_KEEP_BINARIZED,
   N_PROPS
 };
 
@@ -57,13 +59,39 @@ fp_image_new (gint width, gint height)
                        NULL);
 }
 
+/* The data is owned by data_bytes once a detection took a reference to it,
+ * so that replacing it does not free the pixels that are still read. */
+static void
+fp_image_replace_data (FpImage *self, guint8 *data)
+{
+  if (self->data_bytes)
+    g_clear_pointer (&self->data_bytes, g_bytes_unref);
+  else
+    g_free (self->data);
+
+  self->data = data;
+}
+
+static GBytes *
+fp_image_ref_pixels (FpImage *self)
+{
+  if (!self->data)
+    return self->view_buffer ? g_bytes_ref (self->view_buffer) : NULL;
+
+  if (!self->data_bytes)
+    self->data_bytes = g_bytes_new_take (self->data, self->width * self->height);
+
+  return g_bytes_ref (self->data_bytes);
+}
+
 static void
 fp_image_finalize (GObject *object)
 {
   FpImage *self = (FpImage *) object;
 
-  g_clear_pointer (&self->data, g_free);
+  fp_image_replace_data (self, NULL);
   g_clear_pointer (&self->binarized, g_free);
+  g_clear_pointer (&self->view_buffer, g_bytes_unref);
   g_clear_pointer (&self->minutiae, g_ptr_array_unref);
 
   G_OBJECT_CLASS (fp_image_parent_class)->finalize (object);
@@ -95,6 +123,10 @@ fp_image_get_property (GObject    *object,
       g_value_set_uint (value, self->height);
       break;
 
+    case PROP_KEEP_BINARIZED:
+      g_value_set_boolean (value, self->keep_binarized);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -118,6 +150,10 @@ fp_image_set_property (GObject      *object,
       self->height = g_value_get_uint (value);
       break;
 
+    case PROP_KEEP_BINARIZED:
+      self->keep_binarized = g_value_get_boolean (value);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -151,12 +187,28 @@ fp_image_class_init (FpImageClass *klass)
                        0,
                        G_PARAM_STATIC_STRINGS | G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
 
+  /**
+   * FpImage:keep-binarized:
+   *
+   * Whether fp_image_detect_minutiae() keeps the binarized image that it
+   * creates, so that fp_image_get_binarized() returns it right away. It is
+   * dropped by default to save memory. Images returned by
+   * fp_device_capture() have this set.
+   */
+  properties[PROP_KEEP_BINARIZED] =
+    g_param_spec_boolean ("keep-binarized",
+                          "Keep binarized",
+                          "Whether minutiae detection keeps the binarized image",
+                          FALSE,
+                          G_PARAM_STATIC_STRINGS | G_PARAM_READWRITE);
+
   g_object_class_install_properties (object_class, N_PROPS, properties);
 }
 
 static void
 fp_image_init (FpImage *self)
 {
+  self->quality = -1;
 }
 
 typedef struct
@@ -167,7 +219,11 @@ typedef struct
   gint                 width, height;
   gdouble              ppmm;
   FpiImageFlags        flags;
+  GBytes              *buffer;
+  const guint8        *pixels;
+  gsize                stride;
   guchar              *image;
+  gboolean             keep_binarized;
   guchar              *binarized;
 } DetectMinutiaeData;
 
@@ -184,8 +240,9 @@ static void
 fp_image_detect_minutiae_free (DetectMinutiaeData *data)
 {
   g_clear_pointer (&data->image, g_free);
-  g_clear_pointer (&data->minutiae, free_minutiae);
   g_clear_pointer (&data->binarized, g_free);
+  g_clear_pointer (&data->buffer, g_bytes_unref);
+  g_clear_pointer (&data->minutiae, free_minutiae);
   g_free (data);
 }
 
@@ -209,8 +266,7 @@ fp_image_sigfm_extract_cb (GObject * source_object, GAsyncResult * res,
     {
       image = FP_IMAGE (source_object);
 
-      g_clear_pointer (&image->data, g_free);
-      image->data = g_steal_pointer (&data->image);
+      fp_image_replace_data (image, g_steal_pointer (&data->image));
       image->sigfm_info = g_steal_pointer (&data->sigfm_info);
     }
 
@@ -234,9 +290,14 @@ fp_image_detect_minutiae_cb (GObject      *source_object,
 
       image->flags = data->flags;
 
-      g_clear_pointer (&image->data, g_free);
-      image->data = g_steal_pointer (&data->image);
+      /* Otherwise the pixels were used as they are */
+      if (data->image)
+        {
+          g_clear_pointer (&image->view_buffer, g_bytes_unref);
+          fp_image_replace_data (image, g_steal_pointer (&data->image));
+        }
 
+      /* Otherwise computed again by fp_image_get_binarized() if needed */
       g_clear_pointer (&image->binarized, g_free);
       image->binarized = g_steal_pointer (&data->binarized);
 
@@ -255,55 +316,6 @@ fp_image_detect_minutiae_cb (GObject      *source_object,
     data->user_cb (source_object, res, user_data);
 }
 
-static void
-vflip (guint8 *data, gint width, gint height)
-{
-  int data_len = width * height;
-  unsigned char rowbuf[width];
-  int i;
-
-  for (i = 0; i < height / 2; i++)
-    {
-      int offset = i * width;
-      int swap_offset = data_len - (width * (i + 1));
-
-      /* copy top row into buffer */
-      memcpy (rowbuf, data + offset, width);
-
-      /* copy lower row over upper row */
-      memcpy (data + offset, data + swap_offset, width);
-
-      /* copy buffer over lower row */
-      memcpy (data + swap_offset, rowbuf, width);
-    }
-}
-
-static void
-hflip (guint8 *data, gint width, gint height)
-{
-  unsigned char rowbuf[width];
-  int i, j;
-
-  for (i = 0; i < height; i++)
-    {
-      int offset = i * width;
-
-      memcpy (rowbuf, data + offset, width);
-      for (j = 0; j < width; j++)
-        data[offset + j] = rowbuf[width - j - 1];
-    }
-}
-
-static void
-invert_colors (guint8 *data, gint width, gint height)
-{
-  int data_len = width * height;
-  int i;
-
-  for (i = 0; i < data_len; i++)
-    data[i] = 0xff - data[i];
-}
-
 static void
 fp_image_sigfm_extract_thread_func (GTask * task, void * src_obj,
                                   void * task_data,
@@ -327,6 +339,41 @@ fp_image_sigfm_extract_thread_func (GTask * task, void * src_obj,
   g_object_unref (task);
 }
 
+/* Runs the NBIS extraction on a normalized image. Only the minutiae and,
+ * if @binarized is given, the binarized image are kept, the maps are only
+ * needed while extracting. */
+static gint
+fp_image_run_nbis (const guint8        *image,
+                   gint                 width,
+                   gint                 height,
+                   gdouble              ppmm,
+                   gboolean             partial,
+                   struct fp_minutiae **minutiae,
+                   guint8             **binarized)
+{
+  struct fp_minutiae *detected = NULL;
+  guchar *bdata = NULL;
+  gint r;
+  g_autofree LFSPARMS *lfsparms = NULL;
+
+  lfsparms = g_memdup2 (&g_lfsparms_V2, sizeof (LFSPARMS));
+  lfsparms->remove_perimeter_pts = partial;
+
+  /* Temporary allocations are served from the thread's arena, only the
+   * results are moved out of it. */
+  nbis_arena_begin ();
+  r = get_minutiae (&detected, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+                    binarized ? &bdata : NULL, NULL, NULL, NULL,
+                    (guint8 *) image, width, height, 8, ppmm, lfsparms);
+
+  if (binarized)
+    *binarized = nbis_arena_steal (bdata);
+  *minutiae = nbis_arena_steal_minutiae (detected);
+  nbis_arena_end ();
+
+  return r;
+}
+
 static void
 fp_image_detect_minutiae_thread_func (GTask        *task,
                                       gpointer      source_object,
@@ -335,45 +382,32 @@ fp_image_detect_minutiae_thread_func (GTask        *task,
 {
   g_autoptr(GTimer) timer = NULL;
   DetectMinutiaeData *data = task_data;
-  struct fp_minutiae *minutiae = NULL;
-  g_autofree gint *direction_map = NULL;
-  g_autofree gint *low_contrast_map = NULL;
-  g_autofree gint *low_flow_map = NULL;
-  g_autofree gint *high_curve_map = NULL;
-  g_autofree gint *quality_map = NULL;
-  g_autofree guchar *bdata = NULL;
-  gint map_w, map_h;
-  gint bw, bh, bd;
+  const FpiImageFlags normalize = FPI_IMAGE_H_FLIPPED | FPI_IMAGE_V_FLIPPED |
+                                  FPI_IMAGE_COLORS_INVERTED;
   gint r;
-  g_autofree LFSPARMS *lfsparms = NULL;
-
-  /* Normalize the image first */
-  if (data->flags & FPI_IMAGE_H_FLIPPED)
-    hflip (data->image, data->width, data->height);
-
-  if (data->flags & FPI_IMAGE_V_FLIPPED)
-    vflip (data->image, data->width, data->height);
 
-  if (data->flags & FPI_IMAGE_COLORS_INVERTED)
-    invert_colors (data->image, data->width, data->height);
-
-  data->flags &= ~(FPI_IMAGE_H_FLIPPED | FPI_IMAGE_V_FLIPPED | FPI_IMAGE_COLORS_INVERTED);
-
-  lfsparms = g_memdup2 (&g_lfsparms_V2, sizeof (LFSPARMS));
-  lfsparms->remove_perimeter_pts = data->flags & FPI_IMAGE_PARTIAL ? TRUE : FALSE;
+  /* Normalize the image first, this also packs the rows of a view. The
+   * pixels are not modified anymore once the image has been captured. */
+  if ((data->flags & normalize) || data->stride != (gsize) data->width)
+    {
+      data->image = g_malloc (data->width * data->height);
+      fpi_image_u8_normalize (data->pixels, data->stride, data->image,
+                              data->width, data->height,
+                              data->flags & FPI_IMAGE_H_FLIPPED ? TRUE : FALSE,
+                              data->flags & FPI_IMAGE_V_FLIPPED ? TRUE : FALSE,
+                              data->flags & FPI_IMAGE_COLORS_INVERTED ? TRUE : FALSE);
+      data->flags &= ~normalize;
+    }
 
   timer = g_timer_new ();
-  r = get_minutiae (&minutiae, &quality_map, &direction_map,
-                    &low_contrast_map, &low_flow_map, &high_curve_map,
-                    &map_w, &map_h, &bdata, &bw, &bh, &bd,
-                    data->image, data->width, data->height, 8,
-                    data->ppmm, lfsparms);
+  r = fp_image_run_nbis (data->image ? data->image : data->pixels,
+                         data->width, data->height, data->ppmm,
+                         data->flags & FPI_IMAGE_PARTIAL ? TRUE : FALSE,
+                         &data->minutiae,
+                         data->keep_binarized ? &data->binarized : NULL);
   g_timer_stop (timer);
   fp_dbg ("Minutiae scan completed in %f secs", g_timer_elapsed (timer, NULL));
 
-  data->binarized = g_steal_pointer (&bdata);
-  data->minutiae = minutiae;
-
   if (r)
     {
       fp_err ("get minutiae failed, code %d", r);
@@ -437,6 +471,23 @@ fp_image_get_ppmm (FpImage *self)
   return self->ppmm;
 }
 
+/**
+ * fp_image_get_quality:
+ * @self: A #FpImage
+ *
+ * Gets an estimate of how much of the image is covered by a usable
+ * fingerprint, as the fraction of small blocks that contain ridges.
+ * Image devices may reject captures below a driver specific threshold and
+ * ask the user to retry instead.
+ *
+ * Returns: the quality of the image, between 0 and 1
+ */
+gdouble
+fp_image_get_quality (FpImage *self)
+{
+  return fpi_image_get_quality (self);
+}
+
 /**
  * fp_image_get_data:
  * @self: A #FpImage
@@ -450,6 +501,20 @@ fp_image_get_ppmm (FpImage *self)
 const guchar *
 fp_image_get_data (FpImage *self, gsize *len)
 {
+  /* Views are only copied into a buffer of their own when needed */
+  if (!self->data && self->view_buffer)
+    {
+      const guint8 *pixels;
+      gsize stride;
+
+      pixels = fpi_image_get_pixels (self, &stride);
+      self->data = g_malloc (self->width * self->height);
+      fpi_image_u8_normalize (pixels, stride, self->data,
+                              self->width, self->height,
+                              FALSE, FALSE, FALSE);
+      g_clear_pointer (&self->view_buffer, g_bytes_unref);
+    }
+
   if (len)
     *len = self->width * self->height;
 
@@ -463,13 +528,35 @@ fp_image_get_data (FpImage *self, gsize *len)
  *
  * Gets the binarized data for an image. This data must not be modified or
  * freed. You need to first detect the minutiae using
- * fp_image_detect_minutiae().
+ * fp_image_detect_minutiae(). Unless #FpImage:keep-binarized was set for
+ * the detection, the first call computes the binarized image again, which
+ * takes about as long as the detection itself.
  *
  * Returns: (transfer none) (array length=len): The binarized image data
  */
 const guchar *
 fp_image_get_binarized (FpImage *self, gsize *len)
 {
+  /* Fallback if the detection did not keep it, the image data is
+   * normalized by then, so binarizing it again gives the same result. */
+  if (!self->binarized && self->minutiae)
+    {
+      struct fp_minutiae *minutiae = NULL;
+      gint r;
+
+      r = fp_image_run_nbis (fp_image_get_data (self, NULL),
+                             self->width, self->height, self->ppmm,
+                             self->flags & FPI_IMAGE_PARTIAL ? TRUE : FALSE,
+                             &minutiae, &self->binarized);
+      g_clear_pointer (&minutiae, free_minutiae);
+
+      if (r)
+        {
+          fp_err ("Binarizing image failed, code %d", r);
+          g_clear_pointer (&self->binarized, g_free);
+        }
+    }
+
   if (len && self->binarized)
     *len = self->width * self->height;
 
@@ -503,12 +590,13 @@ fp_image_extract_sigfm_info (FpImage * self, GCancellable * cancellable,
                            GAsyncReadyCallback callback, gpointer user_data)
 {
   GTask * task;
-  ExtractSfmData * data = g_new0 (ExtractSfmData, 1);
+  ExtractSfmData * data;
 
+  data = g_new0 (ExtractSfmData, 1);
   task = g_task_new (self, cancellable, fp_image_sigfm_extract_cb, user_data);
 
-  data->image = g_malloc (self->width * self->height);
-  memcpy (data->image, self->data, self->width * self->height);
+  data->image = g_memdup2 (fp_image_get_data (self, NULL),
+                           self->width * self->height);
   data->width = self->width;
   data->height = self->height;
   data->user_cb = callback;
@@ -524,7 +612,8 @@ fp_image_extract_sigfm_info (FpImage * self, GCancellable * cancellable,
  * @callback: the function to call on completion
  * @user_data: the data to pass to @callback
  *
- * Detects the minutiae found in an image.
+ * Detects the minutiae found in an image. The binarized image created on
+ * the way is only kept if #FpImage:keep-binarized is set.
  */
 void
 fp_image_detect_minutiae (FpImage            *self,
@@ -533,16 +622,20 @@ fp_image_detect_minutiae (FpImage            *self,
                           gpointer            user_data)
 {
   GTask *task;
-  DetectMinutiaeData *data = g_new0 (DetectMinutiaeData, 1);
+  DetectMinutiaeData *data;
 
+  data = g_new0 (DetectMinutiaeData, 1);
   task = g_task_new (self, cancellable, fp_image_detect_minutiae_cb, user_data);
 
-  data->image = g_malloc (self->width * self->height);
-  memcpy (data->image, self->data, self->width * self->height);
+  /* The image may replace its pixels while the detection is running,
+   * for example when an earlier detection on it finishes. */
+  data->buffer = fp_image_ref_pixels (self);
+  data->pixels = fpi_image_get_pixels (self, &data->stride);
   data->flags = self->flags;
   data->width = self->width;
   data->height = self->height;
   data->ppmm = self->ppmm;
+  data->keep_binarized = self->keep_binarized;
   data->user_cb = callback;
 
   g_task_set_task_data (task, data, (GDestroyNotify) fp_image_detect_minutiae_free);
@@ -37,6 +37,7 @@ FpImage     *fp_image_new (gint width,
 guint         fp_image_get_width (FpImage *self);
 guint         fp_image_get_height (FpImage *self);
 gdouble       fp_image_get_ppmm (FpImage *self);
+gdouble       fp_image_get_quality (FpImage *self);
 
 GPtrArray *   fp_image_get_minutiae (FpImage *self);
 
@@ -44,3 +44,14 @@ struct _FpPrint
   GVariant  *data;
   GPtrArray *prints;
 };
+
+/* The layout of serialized prints, see fp_print_serialize() */
+#define FPI_PRINT_VARIANT_TYPE G_VARIANT_TYPE ("(issbymsmsia{sv}v)")
+
+FpPrint *fpi_print_copy (FpPrint *print);
+
+FpPrint *fpi_print_deserialize_fast (const guchar *data,
+                                     gsize         length);
+FpPrint *fpi_print_deserialize_variant (const guchar *data,
+                                        gsize         length,
+                                        GError      **error);
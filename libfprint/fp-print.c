@@ -634,8 +634,6 @@ fp_print_equal (FpPrint *self, FpPrint *other)
     }
 }
 
-#define FPI_PRINT_VARIANT_TYPE G_VARIANT_TYPE ("(issbymsmsia{sv}v)")
-
 G_STATIC_ASSERT (sizeof (((struct xyt_struct *) NULL)->xcol[0]) == 4);
 
 /**
@@ -785,175 +783,175 @@ fp_print_deserialize (const guchar *data,
                       gsize         length,
                       GError      **error)
 {
-  g_autoptr(FpPrint) result = NULL;
-  g_autoptr(GVariant) raw_value = NULL;
-  g_autoptr(GVariant) value = NULL;
-  g_autoptr(GVariant) print_data = NULL;
-  g_autoptr(GDate) date = NULL;
-  guchar *aligned_data = NULL;
-  guint8 finger_int8;
-  FpFinger finger;
-  g_autofree gchar *username = NULL;
-  g_autofree gchar *description = NULL;
-  gint julian_date;
-  FpiPrintType type;
-  const gchar *driver;
-  const gchar *device_id;
-  gboolean device_stored;
+  FpPrint *result;
 
   g_assert (data);
   g_assert (length > 3);
 
   if (memcmp (data, "FP3", 3) != 0)
-    goto invalid_format;
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Data could not be parsed");
+      return NULL;
+    }
 
-  /* NOTE:
-   * We make sure that we have no variant left over from the parsing at the end
-   * of this function (meaning we don't need to keep the data around.
-   */
+  result = fpi_print_deserialize_fast (data + 3, length - 3);
+  if (result)
+    return result;
 
-  /* To support GLIB < 2.60 we need to make sure that the memory is aligned correctly.
-   * We also need to copy the backing store for the raw data that we may keep for
-   * longer. */
-  aligned_data = g_malloc (length - 3);
-  memcpy (aligned_data, data + 3, length - 3);
-  raw_value = g_variant_new_from_data (FPI_PRINT_VARIANT_TYPE,
-                                       aligned_data, length - 3,
-                                       FALSE, g_free, aligned_data);
+  return fpi_print_deserialize_variant (data + 3, length - 3, error);
+}
 
-  if (!raw_value)
-    goto invalid_format;
+/* Prints deserialized by one thread in a row */
+#define DESERIALIZE_CHUNK_SIZE 32
 
-  if (G_BYTE_ORDER == G_BIG_ENDIAN)
-    value = g_variant_byteswap (raw_value);
-  else
-    value = g_variant_get_normal_form (raw_value);
-
-  g_variant_get (value,
-                 "(i&s&sbymsmsi@a{sv}v)",
-                 &type,
-                 &driver,
-                 &device_id,
-                 &device_stored,
-                 &finger_int8,
-                 &username,
-                 &description,
-                 &julian_date,
-                 NULL,
-                 &print_data);
-
-  finger = finger_int8;
-
-  /* Assume data is valid at this point if the values are somewhat sane. */
-  if (type == FPI_PRINT_NBIS)
-    {
-      g_autoptr(GVariant) prints = g_variant_get_child_value (print_data, 0);
-      guint i;
+typedef struct
+{
+  GPtrArray    *blobs;
+  GPtrArray    *prints;
+  gint          next_chunk;
+  gint          n_workers;
+} DeserializeManyData;
 
-      result = g_object_new (FP_TYPE_PRINT,
-                             "driver", driver,
-                             "device-id", device_id,
-                             "device-stored", device_stored,
-                             NULL);
-      g_object_ref_sink (result);
-      fpi_print_set_type (result, FPI_PRINT_NBIS);
-      for (i = 0; i < g_variant_n_children (prints); i++)
-        {
-          g_autofree struct xyt_struct *xyt = NULL;
-          const gint32 *xcol, *ycol, *thetacol;
-          gsize xlen, ylen, thetalen;
-          g_autoptr(GVariant) xyt_data = NULL;
-          GVariant *child;
+static void
+deserialize_many_print_free (gpointer print)
+{
+  /* Prints that failed to deserialize are NULL */
+  if (print)
+    g_object_unref (print);
+}
 
-          xyt_data = g_variant_get_child_value (prints, i);
+static void
+deserialize_many_data_free (DeserializeManyData *data)
+{
+  g_ptr_array_unref (data->blobs);
+  g_ptr_array_unref (data->prints);
+  g_free (data);
+}
 
-          child = g_variant_get_child_value (xyt_data, 0);
-          xcol = g_variant_get_fixed_array (child, &xlen, sizeof (gint32));
-          g_variant_unref (child);
+static void
+deserialize_many_thread_func (GTask        *worker,
+                              gpointer      source_object,
+                              gpointer      task_data,
+                              GCancellable *cancellable)
+{
+  DeserializeManyData *data = task_data;
+  guint start;
 
-          child = g_variant_get_child_value (xyt_data, 1);
-          ycol = g_variant_get_fixed_array (child, &ylen, sizeof (gint32));
-          g_variant_unref (child);
+  /* Chunks are taken as they come, so that every thread stays busy */
+  while ((start = g_atomic_int_add (&data->next_chunk, 1) * DESERIALIZE_CHUNK_SIZE) <
+         data->blobs->len)
+    {
+      guint end = MIN (start + DESERIALIZE_CHUNK_SIZE, data->blobs->len);
+      guint i;
+
+      if (g_cancellable_is_cancelled (cancellable))
+        break;
+
+      for (i = start; i < end; i++)
+        {
+          g_autoptr(GError) error = NULL;
+          GBytes *blob = g_ptr_array_index (data->blobs, i);
+          const guchar *blob_data;
+          gsize blob_length;
+
+          blob_data = g_bytes_get_data (blob, &blob_length);
+          if (blob_length <= 3)
+            {
+              g_debug ("Print %u is too short", i);
+              continue;
+            }
+
+          /* Every index is only written by one thread */
+          data->prints->pdata[i] = fp_print_deserialize (blob_data, blob_length, &error);
+          if (error)
+            g_debug ("Print %u could not be deserialized: %s", i, error->message);
+        }
+    }
 
-          child = g_variant_get_child_value (xyt_data, 2);
-          thetacol = g_variant_get_fixed_array (child, &thetalen, sizeof (gint32));
-          g_variant_unref (child);
+  g_task_return_boolean (worker, TRUE);
+}
 
-          if (xlen != ylen || xlen != thetalen)
-            goto invalid_format;
+static void
+deserialize_many_worker_done (GObject      *source_object,
+                              GAsyncResult *res,
+                              gpointer      user_data)
+{
+  GTask *task = user_data;
+  DeserializeManyData *data = g_task_get_task_data (task);
 
-          if (xlen > G_N_ELEMENTS (xyt->xcol))
-            goto invalid_format;
+  data->n_workers--;
+  if (data->n_workers > 0)
+    return;
 
-          xyt = g_new0 (struct xyt_struct, 1);
-          xyt->nrows = xlen;
-          memcpy (xyt->xcol, xcol, sizeof (xcol[0]) * xlen);
-          memcpy (xyt->ycol, ycol, sizeof (xcol[0]) * xlen);
-          memcpy (xyt->thetacol, thetacol, sizeof (xcol[0]) * xlen);
+  if (!g_task_return_error_if_cancelled (task))
+    g_task_return_pointer (task, g_ptr_array_ref (data->prints),
+                           (GDestroyNotify) g_ptr_array_unref);
 
-          g_ptr_array_add (result->prints, g_steal_pointer (&xyt));
-        }
-    }
-  else if (type == FPI_PRINT_SIGFM)
-    {
-      g_autoptr(GVariant) prints = g_variant_get_child_value (print_data, 0);
-      guint i;
+  g_object_unref (task);
+}
 
-      result = g_object_new (FP_TYPE_PRINT, "driver", driver, "device-id",
-                             device_id, "device-stored", device_stored, NULL);
-      g_object_ref_sink (result);
-      fpi_print_set_type (result, FPI_PRINT_SIGFM);
+/**
+ * fp_print_deserialize_many:
+ * @blobs: (element-type GBytes): The serialized prints
+ * @cancellable: (nullable): a #GCancellable, or %NULL
+ * @callback: the function to call on completion
+ * @user_data: the data to pass to @callback
+ *
+ * Deserializes many prints at once, e.g. when loading all stored prints.
+ * The work is spread over several threads. See fp_print_deserialize().
+ */
+void
+fp_print_deserialize_many (GPtrArray          *blobs,
+                           GCancellable       *cancellable,
+                           GAsyncReadyCallback callback,
+                           gpointer            user_data)
+{
+  GTask *task;
+  DeserializeManyData *data;
+  guint n_chunks;
+  gint i;
 
-      for (i = 0; i < g_variant_n_children (prints); i++)
-        {
-          g_autoptr(GVariant) sigfm_data = NULL;
+  g_return_if_fail (blobs != NULL);
 
-          sigfm_data = g_variant_get_child_value (prints, i);
+  task = g_task_new (NULL, cancellable, callback, user_data);
+  g_task_set_source_tag (task, fp_print_deserialize_many);
 
-          GVariant * child = g_variant_get_child_value (sigfm_data, 0);
-          gsize slen;
-          const unsigned char * serialized =
-            g_variant_get_fixed_array (child, &slen, sizeof (unsigned char));
-          g_variant_unref (child);
+  data = g_new0 (DeserializeManyData, 1);
+  data->blobs = g_ptr_array_ref (blobs);
+  data->prints = g_ptr_array_new_full (blobs->len, deserialize_many_print_free);
+  g_ptr_array_set_size (data->prints, blobs->len);
+  g_task_set_task_data (task, data, (GDestroyNotify) deserialize_many_data_free);
 
-          SigfmImgInfo * sigfm_info = sigfm_deserialize_binary (serialized, slen);
-          if (!sigfm_info)
-            goto invalid_format;
+  n_chunks = (blobs->len + DESERIALIZE_CHUNK_SIZE - 1) / DESERIALIZE_CHUNK_SIZE;
+  data->n_workers = MAX (1, MIN (n_chunks, g_get_num_processors ()));
 
-          g_ptr_array_add (result->prints, g_steal_pointer (&sigfm_info));
-        }
-    }
-  else if (type == FPI_PRINT_RAW)
+  for (i = 0; i < data->n_workers; i++)
     {
-      g_autoptr(GVariant) fp_data = g_variant_get_child_value (print_data, 0);
-
-      result = g_object_new (FP_TYPE_PRINT,
-                             "fpi-type", type,
-                             "driver", driver,
-                             "device-id", device_id,
-                             "device-stored", device_stored,
-                             "fpi-data", fp_data,
-                             NULL);
-      g_object_ref_sink (result);
-    }
-  else
-    {
-      g_warning ("Invalid print type: 0x%X", type);
-      goto invalid_format;
-    }
+      g_autoptr(GTask) worker = NULL;
 
-  date = g_date_new_julian (julian_date);
-  g_object_set (result,
-                "finger", finger,
-                "username", username,
-                "description", description,
-                "enroll_date", date,
-                NULL);
+      worker = g_task_new (NULL, cancellable, deserialize_many_worker_done, task);
+      g_task_set_task_data (worker, data, NULL);
+      g_task_run_in_thread (worker, deserialize_many_thread_func);
+    }
+}
 
-  return g_steal_pointer (&result);
+/**
+ * fp_print_deserialize_many_finish:
+ * @result: A #GAsyncResult
+ * @error: Return location for errors, or %NULL to ignore
+ *
+ * Finish deserializing prints started with fp_print_deserialize_many().
+ *
+ * Returns: (element-type FpPrint) (transfer container): The prints in the
+ *   order of the serialized data, entries that could not be deserialized
+ *   are %NULL
+ */
+GPtrArray *
+fp_print_deserialize_many_finish (GAsyncResult *result,
+                                  GError      **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, NULL), NULL);
 
-invalid_format:
-  g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
-               "Data could not be parsed");
-  return NULL;
+  return g_task_propagate_pointer (G_TASK (result), error);
 }
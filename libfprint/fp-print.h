@@ -113,4 +113,11 @@ FpPrint *fp_print_deserialize (const guchar *data,
                                gsize         length,
                                GError      **error);
 
+void       fp_print_deserialize_many (GPtrArray          *blobs,
+                                      GCancellable       *cancellable,
+                                      GAsyncReadyCallback callback,
+                                      gpointer            user_data);
+GPtrArray *fp_print_deserialize_many_finish (GAsyncResult *result,
+                                             GError      **error);
+
 G_END_DECLS
@@ -312,68 +312,185 @@ fpi_assemble_frames (struct fpi_frame_asmbl_ctx *ctx,
   return img;
 }
 
+/* Sliding window median. The window is kept sorted and updated with one
+ * insertion and one removal per output sample, instead of copying and
+ * sorting the full window every time. Samples at the edges use a truncated
+ * window, and the upper median is used for windows of even size. */
 static int
-cmpint (const void *p1, const void *p2, gpointer data)
+sorted_window_find (const int *win, int len, int value)
 {
-  int a = *((int *) p1);
-  int b = *((int *) p2);
+  int lo = 0, hi = len;
 
-  if (a < b)
-    return -1;
-  else if (a == b)
-    return 0;
-  else
-    return 1;
+  while (lo < hi)
+    {
+      int mid = lo + (hi - lo) / 2;
+
+      if (win[mid] < value)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
+static void
+sorted_window_insert (int *win, int *len, int value)
+{
+  int pos = sorted_window_find (win, *len, value);
+
+  memmove (win + pos + 1, win + pos, (*len - pos) * sizeof (int));
+  win[pos] = value;
+  *len += 1;
+}
+
+static void
+sorted_window_remove (int *win, int *len, int value)
+{
+  int pos = sorted_window_find (win, *len, value);
+
+  g_assert (pos < *len && win[pos] == value);
+
+  memmove (win + pos, win + pos + 1, (*len - pos - 1) * sizeof (int));
+  *len -= 1;
 }
 
 static void
 median_filter (int *data, int size, int filtersize)
 {
   int i;
-  int *result = (int *) g_malloc0 (size * sizeof (int));
-  int *sortbuf = (int *) g_malloc0 (filtersize * sizeof (int));
+  int half = (filtersize - 1) / 2;
+  int win_len = 0;
+  int *result;
+  int *win;
+
+  if (size <= 0)
+    return;
+
+  result = g_new (int, size);
+  win = g_new (int, 2 * half + 1);
+
+  for (i = 0; i <= half && i < size; i++)
+    sorted_window_insert (win, &win_len, data[i]);
 
   for (i = 0; i < size; i++)
     {
-      int i1 = i - (filtersize - 1) / 2;
-      int i2 = i + (filtersize - 1) / 2;
-      if (i1 < 0)
-        i1 = 0;
-      if (i2 >= size)
-        i2 = size - 1;
-      memmove (sortbuf, data + i1, (i2 - i1 + 1) * sizeof (int));
-      g_qsort_with_data (sortbuf, i2 - i1 + 1, sizeof (int), cmpint, NULL);
-      result[i] = sortbuf[(i2 - i1 + 1) / 2];
+      if (i > 0)
+        {
+          if (i + half < size)
+            sorted_window_insert (win, &win_len, data[i + half]);
+          if (i - half - 1 >= 0)
+            sorted_window_remove (win, &win_len, data[i - half - 1]);
+        }
+      result[i] = win[win_len / 2];
     }
+
   memmove (data, result, size * sizeof (int));
   g_free (result);
-  g_free (sortbuf);
+  g_free (win);
 }
 
+/* The interpolation divides by the same denominator for a complete output
+ * line. Instead of dividing every pixel, multiply by a precomputed
+ * reciprocal. The numerator is at most 255 times the denominator, so with
+ * a denominator of l bits a shift of 2 * l + 8 bits gives the exact same
+ * result as the integer division (see Granlund and Montgomery, "Division
+ * by Invariant Integers using Multiplication"). The product stays within
+ * 64 bits for denominators of up to 23 bits, larger ones (resolutions of
+ * 128 output lines per input line or more) use the plain division.
+ */
 static void
-interpolate_lines (struct fpi_line_asmbl_ctx *ctx,
-                   GSList *line1, gint32 y1_f,
-                   GSList *line2, gint32 y2_f,
+interpolate_lines (const guint8 *line1, gint32 y1_f,
+                   const guint8 *line2, gint32 y2_f,
                    unsigned char *output, gint32 yi_f,
                    int size)
 {
+  guint32 w1 = y2_f - yi_f;
+  guint32 w2 = yi_f - y1_f;
+  guint32 div = y2_f - y1_f;
+  guint shift;
+  guint64 recip;
   int i;
-  unsigned char p1, p2;
 
-  if (!line1 || !line2)
-    return;
+  g_assert (div > 0);
+  g_assert (yi_f >= y1_f && yi_f < y2_f);
+
+  if (div >= (1 << 23))
+    {
+      for (i = 0; i < size; i++)
+        output[i] = (w2 * (guint64) line2[i] + w1 * (guint64) line1[i]) / div;
+      return;
+    }
+
+  shift = 2 * g_bit_storage (div) + 8;
+  recip = ((G_GUINT64_CONSTANT (1) << shift) + div - 1) / div;
 
   for (i = 0; i < size; i++)
     {
-      gint unscaled;
-      p1 = ctx->get_pixel (ctx, line1, i);
-      p2 = ctx->get_pixel (ctx, line2, i);
+      guint64 unscaled = w2 * (guint32) line2[i] + w1 * (guint32) line1[i];
 
-      unscaled = (yi_f - y1_f) * p2 + (y2_f - yi_f) * p1;
-      output[i] = (unscaled) / (y2_f - y1_f);
+      output[i] = (unscaled * recip) >> shift;
     }
 }
 
+/* Common part of the line assembly once the offsets between line pairs
+ * are known and all pixels have been fetched into @pixels, which holds
+ * @num_pixel_lines rows of ctx->line_width pixels. */
+static FpImage *
+assemble_lines_finish (struct fpi_line_asmbl_ctx *ctx,
+                       int                       *offsets,
+                       const guint8              *pixels,
+                       size_t                     num_pixel_lines,
+                       size_t                     num_lines)
+{
+  int i;
+  /* The y coordinate is tracked as a 16.16 fixed point number. All
+   * variables postfixed with _f follow this format here and in
+   * interpolate_lines.
+   * We could also use floating point here, but using fixed point means
+   * we get consistent results across architectures.
+   */
+  gint32 y_f = 0;
+  int line_ind = 0;
+  unsigned char *output = g_malloc0 (ctx->line_width * ctx->max_height);
+  FpImage *img;
+
+  median_filter (offsets, (num_lines / 2) - 1, ctx->median_filter_size);
+
+  fp_dbg ("offsets_filtered: %"G_GINT64_FORMAT, g_get_real_time ());
+  for (i = 0; i <= (num_lines / 2) - 1; i++)
+    fp_dbg ("%d", offsets[i]);
+  for (i = 0; i < num_lines - 1; i++)
+    {
+      int offset = offsets[i / 2];
+      if (offset > 0)
+        {
+          gint32 ynext_f = y_f + (ctx->resolution << 16) / offset;
+          while ((line_ind << 16) < ynext_f)
+            {
+              if (line_ind > ctx->max_height - 1)
+                goto out;
+              if (i + 1 < num_pixel_lines)
+                interpolate_lines (pixels + i * ctx->line_width, y_f,
+                                   pixels + (i + 1) * ctx->line_width, ynext_f,
+                                   output + line_ind * ctx->line_width,
+                                   line_ind << 16,
+                                   ctx->line_width);
+              line_ind++;
+            }
+          y_f = ynext_f;
+        }
+    }
+out:
+  img = fp_image_new (ctx->line_width, line_ind);
+  img->height = line_ind;
+  img->width = ctx->line_width;
+  img->flags = FPI_IMAGE_V_FLIPPED;
+  memmove (img->data, output, ctx->line_width * line_ind);
+  g_free (output);
+  return img;
+}
+
 /**
  * fpi_assemble_lines:
  * @ctx: #fpi_frame_asmbl_ctx - frame assembling context
@@ -386,6 +503,9 @@ interpolate_lines (struct fpi_line_asmbl_ctx *ctx,
  * Note that @num_lines might be shorter than the length of the list,
  * if some lines should be skipped.
  *
+ * Drivers that store their lines in a single buffer should use
+ * fpi_assemble_lines_array() instead.
+ *
  * Returns: a newly allocated #fp_img.
  */
 FpImage *
@@ -393,23 +513,18 @@ fpi_assemble_lines (struct fpi_line_asmbl_ctx *ctx,
                     GSList *lines, size_t num_lines)
 {
   /* Number of output lines per distance between two scanners */
-  int i;
+  int i, x;
   GSList *row1, *row2;
-  /* The y coordinate is tracked as a 16.16 fixed point number. All
-   * variables postfixed with _f follow this format here and in
-   * interpolate_lines.
-   * We could also use floating point here, but using fixed point means
-   * we get consistent results across architectures.
-   */
-  gint32 y_f = 0;
-  int line_ind = 0;
-  int *offsets = g_new0 (int, num_lines / 2);
-  unsigned char *output = g_malloc0 (ctx->line_width * ctx->max_height);
+  size_t num_pixel_lines = 0;
+  int *offsets;
+  guint8 *pixels;
   FpImage *img;
 
   g_return_val_if_fail (lines != NULL, NULL);
   g_return_val_if_fail (num_lines >= 2, NULL);
 
+  offsets = g_new0 (int, num_lines / 2);
+
   fp_dbg ("%"G_GINT64_FORMAT, g_get_real_time ());
 
   row1 = lines;
@@ -442,41 +557,93 @@ fpi_assemble_lines (struct fpi_line_asmbl_ctx *ctx,
         row1 = g_slist_next (row1);
     }
 
-  median_filter (offsets, (num_lines / 2) - 1, ctx->median_filter_size);
+  /* Fetch every pixel exactly once, the interpolation then only works on
+   * plain arrays. */
+  pixels = g_malloc (num_lines * ctx->line_width);
+  for (row1 = lines; row1 && num_pixel_lines < num_lines; row1 = g_slist_next (row1))
+    {
+      guint8 *line = pixels + num_pixel_lines * ctx->line_width;
 
-  fp_dbg ("offsets_filtered: %"G_GINT64_FORMAT, g_get_real_time ());
-  for (i = 0; i <= (num_lines / 2) - 1; i++)
-    fp_dbg ("%d", offsets[i]);
-  row1 = lines;
-  for (i = 0; i < num_lines - 1; i++, row1 = g_slist_next (row1))
+      for (x = 0; x < ctx->line_width; x++)
+        line[x] = ctx->get_pixel (ctx, row1, x);
+      num_pixel_lines++;
+    }
+
+  img = assemble_lines_finish (ctx, offsets, pixels, num_pixel_lines, num_lines);
+
+  g_free (offsets);
+  g_free (pixels);
+  return img;
+}
+
+/**
+ * fpi_assemble_lines_array:
+ * @ctx: #fpi_frame_asmbl_ctx - frame assembling context
+ * @lines: buffer holding the lines
+ * @stride: distance in bytes between the start of two lines in @lines
+ * @num_lines: number of lines in @lines
+ *
+ * Variant of fpi_assemble_lines() for lines that are stored in a single
+ * buffer. It uses the @get_deviation_array and @get_pixel_array callbacks
+ * of @ctx and produces the same result as fpi_assemble_lines() would for
+ * the same lines.
+ *
+ * Returns: a newly allocated #fp_img.
+ */
+FpImage *
+fpi_assemble_lines_array (struct fpi_line_asmbl_ctx *ctx,
+                          const guint8 *lines, gsize stride,
+                          size_t num_lines)
+{
+  int i, j, x;
+  int *offsets;
+  guint8 *pixels;
+  FpImage *img;
+
+  g_return_val_if_fail (lines != NULL, NULL);
+  g_return_val_if_fail (num_lines >= 2, NULL);
+  g_return_val_if_fail (ctx->get_deviation_array != NULL, NULL);
+  g_return_val_if_fail (ctx->get_pixel_array != NULL, NULL);
+
+  offsets = g_new0 (int, num_lines / 2);
+
+  fp_dbg ("%"G_GINT64_FORMAT, g_get_real_time ());
+
+  for (i = 0; i < num_lines - 1; i += 2)
     {
-      int offset = offsets[i / 2];
-      if (offset > 0)
+      const guint8 *row1 = lines + i * stride;
+      int bestmatch = i;
+      int bestdiff = 0;
+      int firstrow, lastrow;
+
+      firstrow = i + 1;
+      lastrow = MIN (i + ctx->max_search_offset, num_lines - 1);
+
+      for (j = firstrow; j <= lastrow; j++)
         {
-          gint32 ynext_f = y_f + (ctx->resolution << 16) / offset;
-          while ((line_ind << 16) < ynext_f)
+          int diff = ctx->get_deviation_array (ctx, row1, lines + j * stride);
+          if ((j == firstrow) || (diff < bestdiff))
             {
-              if (line_ind > ctx->max_height - 1)
-                goto out;
-              interpolate_lines (ctx,
-                                 row1, y_f,
-                                 g_slist_next (row1),
-                                 ynext_f,
-                                 output + line_ind * ctx->line_width,
-                                 line_ind << 16,
-                                 ctx->line_width);
-              line_ind++;
+              bestdiff = diff;
+              bestmatch = j;
             }
-          y_f = ynext_f;
         }
+      offsets[i / 2] = bestmatch - i;
+      fp_dbg ("%d", offsets[i / 2]);
     }
-out:
-  img = fp_image_new (ctx->line_width, line_ind);
-  img->height = line_ind;
-  img->width = ctx->line_width;
-  img->flags = FPI_IMAGE_V_FLIPPED;
-  memmove (img->data, output, ctx->line_width * line_ind);
+
+  pixels = g_malloc (num_lines * ctx->line_width);
+  for (i = 0; i < num_lines; i++)
+    {
+      guint8 *line = pixels + i * ctx->line_width;
+
+      for (x = 0; x < ctx->line_width; x++)
+        line[x] = ctx->get_pixel_array (ctx, lines, stride, i, x);
+    }
+
+  img = assemble_lines_finish (ctx, offsets, pixels, num_lines, num_lines);
+
   g_free (offsets);
-  g_free (output);
+  g_free (pixels);
   return img;
 }
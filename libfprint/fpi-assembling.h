@@ -79,6 +79,10 @@ FpImage *fpi_assemble_frames (struct fpi_frame_asmbl_ctx *ctx,
  * @get_deviation: pointer to a function that returns the numerical difference
  *                 between two lines
  * @get_pixel: pixel accessor, returns pixel brightness at x of line
+ * @get_deviation_array: same as @get_deviation, used by
+ *                       fpi_assemble_lines_array()
+ * @get_pixel_array: pixel accessor used by fpi_assemble_lines_array(),
+ *                   returns pixel brightness at x of the given line
  *
  * #fpi_line_asmbl_ctx is a structure holding the context for line assembling
  * routines.
@@ -110,8 +114,21 @@ struct fpi_line_asmbl_ctx
   unsigned char (*get_pixel)(struct fpi_line_asmbl_ctx *ctx,
                              GSList                    *line,
                              unsigned int               x);
+  int          (*get_deviation_array)(struct fpi_line_asmbl_ctx *ctx,
+                                      const guint8              *line1,
+                                      const guint8              *line2);
+  unsigned char (*get_pixel_array)(struct fpi_line_asmbl_ctx *ctx,
+                                   const guint8              *lines,
+                                   gsize                      stride,
+                                   size_t                     line,
+                                   unsigned int               x);
 };
 
 FpImage *fpi_assemble_lines (struct fpi_line_asmbl_ctx *ctx,
                              GSList                    *lines,
                              size_t                     num_lines);
+
+FpImage *fpi_assemble_lines_array (struct fpi_line_asmbl_ctx *ctx,
+                                   const guint8              *lines,
+                                   gsize                      stride,
+                                   size_t                     num_lines);
@@ -0,0 +1,150 @@
+/*
+ * Internal FpContext helpers
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define FP_COMPONENT "context"
+
+#include "fpi-context.h"
+
+struct _FpiUsbDriverIndex
+{
+  /* (vid << 16 | pid) to a GArray of UsbDriverCandidate */
+  GHashTable *ids;
+  GPtrArray  *classes;
+};
+
+typedef struct
+{
+  FpDeviceClass   *cls;
+  const FpIdEntry *entry;
+} UsbDriverCandidate;
+
+#define USB_ID_KEY(vid, pid) GUINT_TO_POINTER ((guint) (vid) << 16 | (pid))
+
+/**
+ * fpi_usb_driver_index_new:
+ * @drivers: (element-type GType): the driver types to index
+ *
+ * Creates an index of the USB drivers in @drivers. Candidates for a device
+ * are kept in the order of @drivers and their id_table.
+ *
+ * Returns: (transfer full): a new #FpiUsbDriverIndex
+ */
+FpiUsbDriverIndex *
+fpi_usb_driver_index_new (GArray *drivers)
+{
+  FpiUsbDriverIndex *index = g_new0 (FpiUsbDriverIndex, 1);
+  guint i;
+
+  index->ids = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                                      (GDestroyNotify) g_array_unref);
+  index->classes = g_ptr_array_new_with_free_func (g_type_class_unref);
+
+  for (i = 0; i < drivers->len; i++)
+    {
+      GType driver = g_array_index (drivers, GType, i);
+      FpDeviceClass *cls = g_type_class_ref (driver);
+      const FpIdEntry *entry;
+
+      g_ptr_array_add (index->classes, cls);
+
+      if (cls->type != FP_DEVICE_TYPE_USB)
+        continue;
+
+      for (entry = cls->id_table; entry->pid; entry++)
+        {
+          UsbDriverCandidate candidate = { cls, entry };
+          GArray *candidates;
+
+          candidates = g_hash_table_lookup (index->ids,
+                                            USB_ID_KEY (entry->vid, entry->pid));
+          if (!candidates)
+            {
+              candidates = g_array_sized_new (FALSE, FALSE,
+                                              sizeof (UsbDriverCandidate), 1);
+              g_hash_table_insert (index->ids,
+                                   USB_ID_KEY (entry->vid, entry->pid),
+                                   candidates);
+            }
+
+          g_array_append_val (candidates, candidate);
+        }
+    }
+
+  return index;
+}
+
+void
+fpi_usb_driver_index_free (FpiUsbDriverIndex *index)
+{
+  g_hash_table_destroy (index->ids);
+  g_ptr_array_unref (index->classes);
+  g_free (index);
+}
+
+/**
+ * fpi_usb_driver_index_lookup:
+ * @index: a #FpiUsbDriverIndex
+ * @device: (nullable): the #GUsbDevice passed to usb_discover
+ * @vid: the USB vendor ID
+ * @pid: the USB product ID
+ * @entry: (out) (transfer none): the matching id_table entry
+ *
+ * Finds the best driver for a USB device. Drivers implementing usb_discover
+ * are asked for their score, all others score 50. On a tie the candidate
+ * found first wins.
+ *
+ * Returns: the driver type or %G_TYPE_NONE if no driver supports the device
+ */
+GType
+fpi_usb_driver_index_lookup (FpiUsbDriverIndex *index,
+                             GUsbDevice        *device,
+                             guint16            vid,
+                             guint16            pid,
+                             const FpIdEntry  **entry)
+{
+  GType found_driver = G_TYPE_NONE;
+  gint found_score = 0;
+  GArray *candidates;
+  guint i;
+
+  *entry = NULL;
+
+  candidates = g_hash_table_lookup (index->ids, USB_ID_KEY (vid, pid));
+  if (!candidates)
+    return G_TYPE_NONE;
+
+  for (i = 0; i < candidates->len; i++)
+    {
+      UsbDriverCandidate *candidate = &g_array_index (candidates, UsbDriverCandidate, i);
+      gint driver_score = 50;
+
+      if (candidate->cls->usb_discover)
+        driver_score = candidate->cls->usb_discover (device);
+
+      /* Is this driver better than the one we had? */
+      if (driver_score <= found_score)
+        continue;
+
+      found_score = driver_score;
+      found_driver = G_TYPE_FROM_CLASS (candidate->cls);
+      *entry = candidate->entry;
+    }
+
+  return found_driver;
+}
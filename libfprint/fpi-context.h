@@ -21,6 +21,7 @@
 #include <gusb.h>
 #include "fp-context.h"
 #include "fpi-compat.h"
+#include "fpi-device.h"
 
 /**
  * fpi_get_driver_types:
@@ -33,3 +34,24 @@
  *   all driver types
  */
 GArray *fpi_get_driver_types (void);
+
+/**
+ * FpiUsbDriverIndex:
+ *
+ * Maps USB vendor and product IDs to the drivers listing them in their
+ * #FpDeviceClass id_table, so that a device can be matched without
+ * walking the tables of all drivers.
+ *
+ * Stability: private
+ */
+typedef struct _FpiUsbDriverIndex FpiUsbDriverIndex;
+
+FpiUsbDriverIndex *fpi_usb_driver_index_new (GArray *drivers);
+void               fpi_usb_driver_index_free (FpiUsbDriverIndex *index);
+GType              fpi_usb_driver_index_lookup (FpiUsbDriverIndex *index,
+                                                GUsbDevice        *device,
+                                                guint16            vid,
+                                                guint16            pid,
+                                                const FpIdEntry  **entry);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (FpiUsbDriverIndex, fpi_usb_driver_index_free)
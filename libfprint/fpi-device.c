@@ -22,10 +22,12 @@
 #include <math.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <glib/gstdio.h>
 
 #include "fpi-log.h"
 
 #include "fp-device-private.h"
+#include "fp-print-private.h"
 
 /**
  * SECTION: fpi-device
@@ -50,6 +52,165 @@ fp_device_get_instance_private (FpDevice *self)
                             g_type_class_get_instance_private_offset (dev_class));
 }
 
+/* Lets the tests set up the device state directly */
+FpDevicePrivate *
+fpi_device_get_private (FpDevice *device)
+{
+  return fp_device_get_instance_private (device);
+}
+
+/* Devices created with "fpi-worker-thread" set run the driver on a thread
+ * of their own, see fp-device.c for how public calls are forwarded to it. */
+
+static void
+attach_idle (GMainContext  *context,
+             GSourceFunc    func,
+             gpointer       data,
+             GDestroyNotify notify)
+{
+  g_autoptr(GSource) source = g_idle_source_new ();
+
+  g_source_set_callback (source, func, data, notify);
+  g_source_attach (source, context);
+}
+
+static gpointer
+worker_thread_main (gpointer user_data)
+{
+  g_autoptr(GMainLoop) loop = user_data;
+  GMainContext *context = g_main_loop_get_context (loop);
+
+  g_main_context_push_thread_default (context);
+  g_main_loop_run (loop);
+  g_main_context_pop_thread_default (context);
+
+  return NULL;
+}
+
+/* Needs to be called with the worker lock held */
+static void
+worker_start (FpDevice *device)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+
+  if (priv->worker_thread)
+    return;
+
+  priv->worker_context = g_main_context_new ();
+  priv->worker_loop = g_main_loop_new (priv->worker_context, FALSE);
+  priv->worker_thread = g_thread_new (FP_DEVICE_GET_CLASS (device)->id,
+                                      worker_thread_main,
+                                      g_main_loop_ref (priv->worker_loop));
+}
+
+void
+fpi_device_worker_stop (FpDevice *device)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  g_autoptr(GMainLoop) loop = NULL;
+  g_autoptr(GMainContext) context = NULL;
+  GThread *thread;
+
+  g_mutex_lock (&priv->worker_lock);
+  thread = g_steal_pointer (&priv->worker_thread);
+  loop = g_steal_pointer (&priv->worker_loop);
+  context = g_steal_pointer (&priv->worker_context);
+  g_mutex_unlock (&priv->worker_lock);
+
+  if (!thread)
+    return;
+
+  g_main_loop_quit (loop);
+
+  /* The last reference may be dropped by the worker itself */
+  if (thread == g_thread_self ())
+    g_thread_unref (thread);
+  else
+    g_thread_join (thread);
+}
+
+gboolean
+fpi_device_in_worker_thread (FpDevice *device)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  gboolean in_worker;
+
+  g_mutex_lock (&priv->worker_lock);
+  in_worker = priv->worker_thread == g_thread_self ();
+  g_mutex_unlock (&priv->worker_lock);
+
+  return in_worker;
+}
+
+/**
+ * fpi_device_in_driver_thread:
+ * @device: The #FpDevice
+ *
+ * Checks whether the calling thread is the one the driver runs on. That is
+ * the worker thread if the device has one, see #FpContext:device-threads,
+ * and any thread otherwise. Only this thread may access the driver state.
+ *
+ * Returns: Whether the driver state may be accessed
+ */
+gboolean
+fpi_device_in_driver_thread (FpDevice *device)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  gboolean in_driver;
+
+  g_mutex_lock (&priv->worker_lock);
+  in_driver = !priv->worker_thread || priv->worker_thread == g_thread_self ();
+  g_mutex_unlock (&priv->worker_lock);
+
+  return in_driver;
+}
+
+/* Runs @func in the main context the device was created in, right away if
+ * the caller is not the worker thread. */
+void
+fpi_device_main_context_invoke (FpDevice      *device,
+                                GSourceFunc    func,
+                                gpointer       data,
+                                GDestroyNotify notify)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+
+  if (!fpi_device_in_worker_thread (device))
+    {
+      func (data);
+      if (notify)
+        notify (data);
+      return;
+    }
+
+  attach_idle (priv->main_context, func, data, notify);
+}
+
+/**
+ * fpi_device_worker_invoke:
+ * @device: The #FpDevice
+ * @func: The function to run
+ * @data: The data to pass to @func
+ * @notify: (nullable): Called to free @data once @func has run
+ *
+ * Runs @func on the worker thread of @device, starting it if needed. Use
+ * this to get back to the driver from callbacks that arrive in the main
+ * context, e.g. property notifications, see fpi_device_in_driver_thread().
+ */
+void
+fpi_device_worker_invoke (FpDevice      *device,
+                          GSourceFunc    func,
+                          gpointer       data,
+                          GDestroyNotify notify)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+
+  g_mutex_lock (&priv->worker_lock);
+  worker_start (device);
+  attach_idle (priv->worker_context, func, data, notify);
+  g_mutex_unlock (&priv->worker_lock);
+}
+
 /**
  * fpi_device_class_auto_initialize_features:
  *
@@ -664,10 +825,34 @@ fpi_device_get_cancellable (FpDevice *device)
   return priv->current_cancellable;
 }
 
+static gboolean
+emit_removed_cb (gpointer user_data)
+{
+  g_signal_emit_by_name (user_data, "removed");
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Like property notifications, the signal is emitted in the main context */
+static void
+emit_removed (FpDevice *device)
+{
+  fpi_device_main_context_invoke (device, emit_removed_cb,
+                                  g_object_ref (device), g_object_unref);
+}
+
 static void
 emit_removed_on_task_completed (FpDevice *device)
 {
-  g_signal_emit_by_name (device, "removed");
+  emit_removed (device);
+}
+
+static gboolean
+remove_in_worker_cb (gpointer user_data)
+{
+  fpi_device_remove (FP_DEVICE (user_data));
+
+  return G_SOURCE_REMOVE;
 }
 
 /**
@@ -678,6 +863,10 @@ emit_removed_on_task_completed (FpDevice *device)
  * removed from the system).
  *
  * For USB devices, this API is called automatically by #FpContext.
+ *
+ * If the device has a worker thread, the removal is handled on it. The
+ * notification and the #FpDevice::removed signal are still emitted in the
+ * main context.
  */
 void
 fpi_device_remove (FpDevice *device)
@@ -685,6 +874,14 @@ fpi_device_remove (FpDevice *device)
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
 
   g_return_if_fail (FP_IS_DEVICE (device));
+
+  if (!fpi_device_in_driver_thread (device))
+    {
+      fpi_device_worker_invoke (device, remove_in_worker_cb,
+                                g_object_ref (device), g_object_unref);
+      return;
+    }
+
   g_return_if_fail (!priv->is_removed);
 
   priv->is_removed = TRUE;
@@ -703,7 +900,7 @@ fpi_device_remove (FpDevice *device)
     }
   else
     {
-      g_signal_emit_by_name (device, "removed");
+      emit_removed (device);
     }
 }
 
@@ -911,6 +1108,7 @@ clear_device_cancel_action (FpDevice *device)
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
 
   g_clear_pointer (&priv->current_idle_cancel_source, g_source_destroy);
+  g_clear_pointer (&priv->throttle_source, g_source_destroy);
 
   if (priv->current_cancellable_id)
     {
@@ -1070,6 +1268,58 @@ fpi_device_task_return_data_free (FpDeviceTaskReturnData *data)
   g_free (data);
 }
 
+/* The cache never shares prints with the API user, as changing their
+ * metadata would otherwise change the cache too. */
+static GPtrArray *
+copy_prints (GPtrArray *prints)
+{
+  GPtrArray *copy = g_ptr_array_new_full (prints->len, g_object_unref);
+  guint i;
+
+  for (i = 0; i < prints->len; i++)
+    g_ptr_array_add (copy, fpi_print_copy (g_ptr_array_index (prints, i)));
+
+  return copy;
+}
+
+/* Returns a new array with copies of the cached prints */
+GPtrArray *
+fpi_device_copy_storage_cache (FpDevice *device)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+
+  g_return_val_if_fail (priv->storage_cache != NULL, NULL);
+
+  return copy_prints (priv->storage_cache);
+}
+
+static void
+storage_cache_drop (FpDevice *device)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+
+  if (!priv->storage_cache)
+    return;
+
+  g_debug ("Dropping storage cache");
+  g_clear_pointer (&priv->storage_cache, g_ptr_array_unref);
+}
+
+static void
+storage_cache_remove (FpDevice *device, FpPrint *print)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  guint index;
+
+  if (!priv->storage_cache)
+    return;
+
+  while (g_ptr_array_find_with_equal_func (priv->storage_cache, print,
+                                           (GEqualFunc) fp_print_equal,
+                                           &index))
+    g_ptr_array_remove_index (priv->storage_cache, index);
+}
+
 static void
 fpi_device_return_task_in_idle (FpDevice              *device,
                                 FpDeviceTaskReturnType return_type,
@@ -1078,6 +1328,10 @@ fpi_device_return_task_in_idle (FpDevice              *device,
   FpDevicePrivate *priv = fp_device_get_instance_private (device);
   FpDeviceTaskReturnData *data;
 
+  /* Whatever failed, the storage may not be in the state we expect */
+  if (return_type == FP_DEVICE_TASK_RETURN_ERROR)
+    storage_cache_drop (device);
+
   data = g_new0 (FpDeviceTaskReturnData, 1);
   data->device = g_object_ref (device);
   data->type = return_type;
@@ -1163,6 +1417,7 @@ fpi_device_open_complete (FpDevice *device, GError *error)
 
   clear_device_cancel_action (device);
   fpi_device_report_finger_status (device, FP_FINGER_STATUS_NONE);
+  storage_cache_drop (device);
 
   if (!error)
     fpi_device_return_task_in_idle (device, FP_DEVICE_TASK_RETURN_BOOL,
@@ -1191,6 +1446,7 @@ fpi_device_close_complete (FpDevice *device, GError *error)
 
   clear_device_cancel_action (device);
   fpi_device_report_finger_status (device, FP_FINGER_STATUS_NONE);
+  storage_cache_drop (device);
 
   switch (priv->type)
     {
@@ -1266,6 +1522,12 @@ fpi_device_enroll_complete (FpDevice *device, FpPrint *print, GError *error)
           finger_str = g_enum_to_string (FP_TYPE_FINGER, fp_print_get_finger (print));
           g_debug ("Print for finger %s enrolled", finger_str);
 
+          if (priv->storage_cache)
+            {
+              storage_cache_remove (device, print);
+              g_ptr_array_add (priv->storage_cache, fpi_print_copy (print));
+            }
+
           fpi_device_return_task_in_idle (device, FP_DEVICE_TASK_RETURN_OBJECT, print);
         }
       else
@@ -1483,6 +1745,14 @@ fpi_device_delete_complete (FpDevice *device,
 
   g_debug ("Device reported deletion completion");
 
+  if (!error)
+    {
+      FpPrint *print;
+
+      fpi_device_get_delete_data (device, &print);
+      storage_cache_remove (device, print);
+    }
+
   clear_device_cancel_action (device);
   fpi_device_report_finger_status (device, FP_FINGER_STATUS_NONE);
 
@@ -1533,6 +1803,12 @@ fpi_device_list_complete (FpDevice  *device,
                                         "Driver failed to provide a list of prints");
     }
 
+  if (!error && FP_DEVICE_GET_CLASS (device)->cache_storage)
+    {
+      g_clear_pointer (&priv->storage_cache, g_ptr_array_unref);
+      priv->storage_cache = copy_prints (prints);
+    }
+
   if (!error)
     fpi_device_return_task_in_idle (device, FP_DEVICE_TASK_RETURN_PTR_ARRAY, prints);
   else
@@ -1683,6 +1959,38 @@ fpi_device_resume (FpDevice *device)
     }
 }
 
+/* The sysfs name of the USB device, i.e. the bus and the ports leading to it */
+static gchar *
+usb_device_port_path (GUsbDevice *usb_device)
+{
+  g_autoptr(GString) ports = NULL;
+  g_autoptr(GUsbDevice) dev = NULL;
+  guint8 bus;
+
+  ports = g_string_new (NULL);
+  bus = g_usb_device_get_bus (usb_device);
+
+  /* Walk up, skipping the root hub. */
+  g_set_object (&dev, usb_device);
+  while (TRUE)
+    {
+      g_autoptr(GUsbDevice) parent = g_usb_device_get_parent (dev);
+      g_autofree gchar *port_str = NULL;
+      guint8 port;
+
+      if (!parent)
+        break;
+
+      port = g_usb_device_get_port_number (dev);
+      port_str = g_strdup_printf ("%d.", port);
+      g_string_prepend (ports, port_str);
+      g_set_object (&dev, parent);
+    }
+  g_string_set_size (ports, ports->len - 1);
+
+  return g_strdup_printf ("%d-%s", bus, ports->str);
+}
+
 void
 fpi_device_configure_wakeup (FpDevice *device, gboolean enabled)
 {
@@ -1692,36 +2000,15 @@ fpi_device_configure_wakeup (FpDevice *device, gboolean enabled)
     {
     case FP_DEVICE_TYPE_USB:
       {
-        g_autoptr(GString) ports = NULL;
-        g_autoptr(GUsbDevice) dev = NULL;
         const char *wakeup_command = enabled ? "enabled" : "disabled";
-        guint8 bus;
+        g_autofree gchar *port_path = NULL;
         g_autofree gchar *sysfs_wakeup = NULL;
         g_autofree gchar *sysfs_persist = NULL;
         int res;
 
-        ports = g_string_new (NULL);
-        bus = g_usb_device_get_bus (priv->usb_device);
-
-        /* Walk up, skipping the root hub. */
-        g_set_object (&dev, priv->usb_device);
-        while (TRUE)
-          {
-            g_autoptr(GUsbDevice) parent = g_usb_device_get_parent (dev);
-            g_autofree gchar *port_str = NULL;
-            guint8 port;
-
-            if (!parent)
-              break;
+        port_path = usb_device_port_path (priv->usb_device);
 
-            port = g_usb_device_get_port_number (dev);
-            port_str = g_strdup_printf ("%d.", port);
-            g_string_prepend (ports, port_str);
-            g_set_object (&dev, parent);
-          }
-        g_string_set_size (ports, ports->len - 1);
-
-        sysfs_wakeup = g_strdup_printf ("/sys/bus/usb/devices/%d-%s/power/wakeup", bus, ports->str);
+        sysfs_wakeup = g_strdup_printf ("/sys/bus/usb/devices/%s/power/wakeup", port_path);
         res = update_attr (sysfs_wakeup, wakeup_command);
         if (res < 0)
           g_debug ("Failed to set %s to %s", sysfs_wakeup, wakeup_command);
@@ -1731,7 +2018,7 @@ fpi_device_configure_wakeup (FpDevice *device, gboolean enabled)
          * This is not helpful, as it will receive a reset and will be in a bad
          * state. Instead, seeing an unplug and a new device makes more sense.
          */
-        sysfs_persist = g_strdup_printf ("/sys/bus/usb/devices/%d-%s/power/persist", bus, ports->str);
+        sysfs_persist = g_strdup_printf ("/sys/bus/usb/devices/%s/power/persist", port_path);
         res = update_attr (sysfs_persist, "0");
         if (res < 0)
           g_warning ("Failed to disable USB persist by writing to %s", sysfs_persist);
@@ -1872,6 +2159,9 @@ fpi_device_clear_storage_complete (FpDevice *device,
   clear_device_cancel_action (device);
   fpi_device_report_finger_status (device, FP_FINGER_STATUS_NONE);
 
+  if (!error && priv->storage_cache)
+    g_ptr_array_set_size (priv->storage_cache, 0);
+
   if (!error)
     fpi_device_return_task_in_idle (device, FP_DEVICE_TASK_RETURN_BOOL,
                                     GUINT_TO_POINTER (TRUE));
@@ -2196,6 +2486,21 @@ fpi_device_update_temp (FpDevice *device, gboolean is_active)
       priv->temp_current_ratio = alpha * priv->temp_current_ratio;
     }
 
+  /* Remember how long operations keep the device active */
+  if (is_active && !priv->temp_last_active)
+    {
+      priv->temp_active_since = now;
+    }
+  else if (!is_active && priv->temp_last_active)
+    {
+      priv->temp_last_active_seconds = (now - priv->temp_active_since) / 1e6;
+      priv->temp_last_active_end = now;
+      if (priv->temp_active_estimate > 0)
+        priv->temp_active_estimate = (priv->temp_active_estimate + priv->temp_last_active_seconds) / 2;
+      else
+        priv->temp_active_estimate = priv->temp_last_active_seconds;
+    }
+
   priv->temp_last_active = is_active;
   priv->temp_last_update = now;
 
@@ -2271,3 +2576,543 @@ fpi_device_update_temp (FpDevice *device, gboolean is_active)
                                                update_temp_timeout,
                                                NULL, NULL);
 }
+
+/**
+ * fpi_device_get_throttle_delay:
+ * @device: The #FpDevice
+ *
+ * Purely internal function to predict how long an operation needs to wait
+ * so that the temperature model does not expect it to become hot. The
+ * expected length of the operation is the running average of the previous
+ * ones. A HOT device is only admitted again once it cooled down to WARM.
+ * Additionally, the device is kept idle for long enough to stay within
+ * the duty cycle reported with fpi_device_set_duty_cycle().
+ *
+ * Returns: The delay in microseconds
+ */
+gint64
+fpi_device_get_throttle_delay (FpDevice *device)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  gint64 now = g_get_monotonic_time ();
+  gdouble passed_seconds;
+  gdouble ratio;
+  gdouble admit_ratio;
+  gdouble delay = 0;
+
+  if (priv->temp_hot_seconds < 0)
+    return 0;
+
+  passed_seconds = (now - priv->temp_last_update) / 1e6;
+  if (priv->temp_last_active)
+    {
+      gdouble alpha = exp (-passed_seconds / priv->temp_hot_seconds);
+
+      ratio = alpha * priv->temp_current_ratio + 1 - alpha;
+    }
+  else
+    {
+      ratio = priv->temp_current_ratio * exp (-passed_seconds / priv->temp_cold_seconds);
+    }
+
+  /* Highest ratio from which an operation of the expected length still
+   * finishes before reaching HOT, with the same slack that the model uses
+   * for its updates. A COLD device is always admitted. */
+  admit_ratio = 1.0 - (1.0 - TEMP_WARM_HOT_THRESH) *
+                exp ((priv->temp_active_estimate + TEMP_DELAY_SECONDS) / priv->temp_hot_seconds);
+  admit_ratio = MAX (admit_ratio, TEMP_COLD_THRESH);
+
+  /* A HOT device stays HOT until it cooled down to TEMP_HOT_WARM_THRESH */
+  if (priv->temp_current == FP_TEMPERATURE_HOT)
+    admit_ratio = MIN (admit_ratio, TEMP_HOT_WARM_THRESH);
+
+  if (ratio > admit_ratio)
+    delay = priv->temp_cold_seconds * log (ratio / admit_ratio);
+
+  if (priv->temp_duty_cycle > 0 && priv->temp_duty_cycle < 1.0 &&
+      priv->temp_last_active_end > 0)
+    {
+      gdouble rest_seconds;
+
+      rest_seconds = priv->temp_last_active_seconds * (1.0 - priv->temp_duty_cycle) / priv->temp_duty_cycle;
+      rest_seconds -= (now - priv->temp_last_active_end) / 1e6;
+      delay = MAX (delay, rest_seconds);
+    }
+
+  return delay * G_USEC_PER_SEC;
+}
+
+static void throttle_timeout_cb (FpDevice *device,
+                                 gpointer  user_data);
+
+static void
+throttle_schedule (FpDevice *device, gint64 delay)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+
+  g_debug ("Throttling operation for %0.2f seconds", delay / 1e6);
+
+  priv->throttle_source = fpi_device_add_timeout (device,
+                                                  delay / 1000 + 1,
+                                                  throttle_timeout_cb,
+                                                  NULL, NULL);
+}
+
+static void
+throttle_timeout_cb (FpDevice *device, gpointer user_data)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  gint64 delay;
+
+  priv->throttle_source = NULL;
+
+  /* Without a cancel vfunc the cancellation is only noticed here */
+  if (g_cancellable_is_cancelled (priv->current_cancellable))
+    {
+      fpi_device_action_error (device,
+                               g_error_new_literal (G_IO_ERROR,
+                                                    G_IO_ERROR_CANCELLED,
+                                                    "Operation was cancelled"));
+      return;
+    }
+
+  /* The model may have changed while waiting, e.g. if a driver reported
+   * a lower duty cycle. */
+  delay = fpi_device_get_throttle_delay (device);
+  if (delay > 0)
+    {
+      throttle_schedule (device, delay);
+      return;
+    }
+
+  g_debug ("Starting throttled operation");
+
+  fpi_device_update_temp (device, TRUE);
+  priv->throttle_start (device);
+}
+
+/**
+ * fpi_device_start_throttled:
+ * @device: The #FpDevice
+ * @start: The driver function that starts the current action
+ *
+ * Purely internal function to start the current action. If #FpDevice:throttle
+ * is set, this is delayed until fpi_device_get_throttle_delay() permits it.
+ * Otherwise the caller has already updated the temperature model.
+ */
+void
+fpi_device_start_throttled (FpDevice *device,
+                            void (*start) (FpDevice *device))
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  gint64 delay;
+
+  if (!priv->throttle)
+    {
+      start (device);
+      return;
+    }
+
+  delay = fpi_device_get_throttle_delay (device);
+  if (delay <= 0)
+    {
+      fpi_device_update_temp (device, TRUE);
+      start (device);
+      return;
+    }
+
+  priv->throttle_start = start;
+  throttle_schedule (device, delay);
+}
+
+/**
+ * fpi_device_set_duty_cycle:
+ * @device: The #FpDevice
+ * @duty_cycle: The share of time the sensor may be active, between 0 and 1
+ *
+ * Reports the share of time the sensor can be active in sustained operation,
+ * if it is known to be lower than the temperature model permits. When
+ * #FpDevice:throttle is set, operations are delayed so that the device stays
+ * idle for long enough after each one. A value of 1 removes the limit.
+ */
+void
+fpi_device_set_duty_cycle (FpDevice *device,
+                           gdouble   duty_cycle)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+
+  g_return_if_fail (FP_IS_DEVICE (device));
+  g_return_if_fail (duty_cycle > 0 && duty_cycle <= 1.0);
+
+  priv->temp_duty_cycle = duty_cycle;
+}
+
+/*
+ * Calibration cache
+ *
+ * Entries are kept per driver and device for the lifetime of the process.
+ * If FP_CALIBRATION_DIR is set, they are also written to a file in that
+ * directory, so that they survive restarts of the process.
+ */
+
+/* Bump when the file layout changes, older files are ignored */
+#define CALIBRATION_FILE_VERSION 1
+/* file version, driver, device, firmware, data version, time, checksum, data */
+#define CALIBRATION_FILE_FORMAT "(usssuxsay)"
+
+typedef struct
+{
+  gchar  *firmware;
+  guint   version;
+  gint64  timestamp;
+  GBytes *data;
+} FpiCalibrationEntry;
+
+G_LOCK_DEFINE_STATIC (calibration_cache);
+static GHashTable *calibration_cache = NULL;
+
+static void
+calibration_entry_free (FpiCalibrationEntry *entry)
+{
+  g_free (entry->firmware);
+  g_bytes_unref (entry->data);
+  g_free (entry);
+}
+
+/* Tells apart the devices of a driver. Most drivers do not report a device
+ * ID from probe, so fall back to where the device is connected. */
+static gchar *
+calibration_device (FpDevice *device)
+{
+  FpDevicePrivate *priv = fp_device_get_instance_private (device);
+  g_autofree gchar *port_path = NULL;
+
+  if (g_strcmp0 (priv->device_id, "0") != 0)
+    return g_strdup_printf ("id:%s", priv->device_id);
+
+  switch (priv->type)
+    {
+    case FP_DEVICE_TYPE_USB:
+      port_path = usb_device_port_path (priv->usb_device);
+      return g_strdup_printf ("usb:%s", port_path);
+
+    case FP_DEVICE_TYPE_UDEV:
+      return g_strdup_printf ("udev:%s:%s",
+                              priv->udev_data.spidev_path ? priv->udev_data.spidev_path : "",
+                              priv->udev_data.hidraw_path ? priv->udev_data.hidraw_path : "");
+
+    case FP_DEVICE_TYPE_VIRTUAL:
+      return g_strdup_printf ("virtual:%s",
+                              priv->virtual_env ? priv->virtual_env : "");
+
+    default:
+      g_assert_not_reached ();
+      return NULL;
+    }
+}
+
+static gchar *
+calibration_key (FpDevice *device)
+{
+  g_autofree gchar *device_name = calibration_device (device);
+
+  return g_strdup_printf ("%s\n%s",
+                          FP_DEVICE_GET_CLASS (device)->id, device_name);
+}
+
+static gchar *
+calibration_path (FpDevice *device, const gchar *key)
+{
+  const gchar *dir = g_getenv ("FP_CALIBRATION_DIR");
+  g_autofree gchar *checksum = NULL;
+  g_autofree gchar *basename = NULL;
+
+  if (!dir || !*dir)
+    return NULL;
+
+  /* Device IDs can contain anything, so only use them hashed */
+  checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA256, key, -1);
+  basename = g_strdup_printf ("%s-%s.calibration",
+                              FP_DEVICE_GET_CLASS (device)->id, checksum);
+
+  return g_build_filename (dir, basename, NULL);
+}
+
+static void
+calibration_cache_insert (const gchar *key, FpiCalibrationEntry *entry)
+{
+  G_LOCK (calibration_cache);
+  if (!calibration_cache)
+    calibration_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                               (GDestroyNotify) calibration_entry_free);
+  g_hash_table_replace (calibration_cache, g_strdup (key), entry);
+  G_UNLOCK (calibration_cache);
+}
+
+static FpiCalibrationEntry *
+calibration_load (FpDevice *device, const gchar *key)
+{
+  g_autofree gchar *path = calibration_path (device, key);
+  g_autofree gchar *contents = NULL;
+  g_autofree gchar *checksum = NULL;
+  g_autofree gchar *device_name = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GVariant) variant = NULL;
+  g_autoptr(GVariant) data_var = NULL;
+  FpiCalibrationEntry *entry;
+  const gchar *driver, *stored_device, *firmware, *stored_checksum;
+  const guint8 *data;
+  gsize length, data_length;
+  guint file_version, version;
+  gint64 timestamp;
+
+  if (!path)
+    return NULL;
+
+  if (!g_file_get_contents (path, &contents, &length, &error))
+    {
+      if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+        g_warning ("Could not read calibration: %s", error->message);
+      return NULL;
+    }
+
+  variant = g_variant_new_from_data (G_VARIANT_TYPE (CALIBRATION_FILE_FORMAT),
+                                     contents, length, FALSE, NULL, NULL);
+  g_variant_ref_sink (variant);
+  if (!g_variant_is_normal_form (variant))
+    {
+      g_warning ("Ignoring malformed calibration file %s", path);
+      return NULL;
+    }
+
+  g_variant_get (variant, "(u&s&s&sux&s@ay)",
+                 &file_version, &driver, &stored_device, &firmware,
+                 &version, &timestamp, &stored_checksum, &data_var);
+
+  if (file_version != CALIBRATION_FILE_VERSION)
+    {
+      g_debug ("Ignoring calibration file %s with version %u",
+               path, file_version);
+      return NULL;
+    }
+
+  device_name = calibration_device (device);
+  if (g_strcmp0 (driver, FP_DEVICE_GET_CLASS (device)->id) != 0 ||
+      g_strcmp0 (stored_device, device_name) != 0)
+    {
+      g_warning ("Ignoring calibration file %s of a different device", path);
+      return NULL;
+    }
+
+  data = g_variant_get_fixed_array (data_var, &data_length, 1);
+  checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA256, data, data_length);
+  if (g_strcmp0 (checksum, stored_checksum) != 0)
+    {
+      g_warning ("Ignoring corrupted calibration file %s", path);
+      return NULL;
+    }
+
+  entry = g_new0 (FpiCalibrationEntry, 1);
+  entry->firmware = g_strdup (firmware);
+  entry->version = version;
+  entry->timestamp = timestamp;
+  entry->data = g_bytes_new (data, data_length);
+
+  return entry;
+}
+
+static void
+calibration_save (FpDevice *device, const gchar *key, FpiCalibrationEntry *entry)
+{
+  g_autofree gchar *path = calibration_path (device, key);
+  g_autofree gchar *dir = NULL;
+  g_autofree gchar *checksum = NULL;
+  g_autofree gchar *device_name = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GVariant) variant = NULL;
+  const guint8 *data;
+  gsize data_length;
+
+  if (!path)
+    return;
+
+  device_name = calibration_device (device);
+
+  data = g_bytes_get_data (entry->data, &data_length);
+  checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA256, data, data_length);
+
+  variant = g_variant_new ("(usssuxs@ay)",
+                           CALIBRATION_FILE_VERSION,
+                           FP_DEVICE_GET_CLASS (device)->id,
+                           device_name,
+                           entry->firmware,
+                           entry->version,
+                           entry->timestamp,
+                           checksum,
+                           g_variant_new_fixed_array (G_VARIANT_TYPE_BYTE,
+                                                      data, data_length, 1));
+  g_variant_ref_sink (variant);
+
+  dir = g_path_get_dirname (path);
+  if (g_mkdir_with_parents (dir, 0700) != 0)
+    {
+      g_warning ("Could not create calibration directory %s: %s",
+                 dir, g_strerror (errno));
+      return;
+    }
+
+  if (!g_file_set_contents (path, g_variant_get_data (variant),
+                            g_variant_get_size (variant), &error))
+    g_warning ("Could not store calibration: %s", error->message);
+}
+
+/**
+ * fpi_device_calibration_store:
+ * @device: The #FpDevice
+ * @firmware: (nullable): The firmware version of the device
+ * @version: The version of the layout of @data
+ * @data: The calibration data
+ *
+ * Stores calibration data (e.g. a background image) of @device, so that it
+ * can be reused with fpi_device_calibration_lookup() the next time the
+ * device is opened, replacing any earlier calibration. Calibration is kept
+ * per device ID if the driver reports one from probe, otherwise per USB port
+ * or device node the device is connected to.
+ *
+ * If the environment variable FP_CALIBRATION_DIR is set, the calibration is
+ * also written to that directory and survives restarts of the process.
+ */
+void
+fpi_device_calibration_store (FpDevice    *device,
+                              const gchar *firmware,
+                              guint        version,
+                              GBytes      *data)
+{
+  g_autofree gchar *key = NULL;
+  FpiCalibrationEntry *entry;
+
+  g_return_if_fail (FP_IS_DEVICE (device));
+  g_return_if_fail (data != NULL);
+
+  key = calibration_key (device);
+
+  entry = g_new0 (FpiCalibrationEntry, 1);
+  entry->firmware = g_strdup (firmware ? firmware : "");
+  entry->version = version;
+  entry->timestamp = g_get_real_time ();
+  entry->data = g_bytes_ref (data);
+
+  calibration_save (device, key, entry);
+  calibration_cache_insert (key, entry);
+}
+
+/**
+ * fpi_device_calibration_lookup:
+ * @device: The #FpDevice
+ * @firmware: (nullable): The firmware version of the device
+ * @version: The version of the layout of the data
+ * @max_age: The maximum age of the calibration, or 0 for no limit
+ *
+ * Retrieves the calibration stored by fpi_device_calibration_store(). It is
+ * only returned if @firmware and @version match and it was stored less than
+ * @max_age microseconds ago, otherwise the driver needs to calibrate again.
+ *
+ * Returns: (transfer full) (nullable): The calibration data or %NULL
+ */
+GBytes *
+fpi_device_calibration_lookup (FpDevice    *device,
+                               const gchar *firmware,
+                               guint        version,
+                               GTimeSpan    max_age)
+{
+  g_autofree gchar *key = NULL;
+  FpiCalibrationEntry *entry = NULL;
+  GBytes *data = NULL;
+  gint64 now;
+
+  g_return_val_if_fail (FP_IS_DEVICE (device), NULL);
+  g_return_val_if_fail (max_age >= 0, NULL);
+
+  key = calibration_key (device);
+
+  G_LOCK (calibration_cache);
+  if (calibration_cache)
+    entry = g_hash_table_lookup (calibration_cache, key);
+  G_UNLOCK (calibration_cache);
+
+  if (!entry)
+    {
+      entry = calibration_load (device, key);
+      if (!entry)
+        return NULL;
+
+      calibration_cache_insert (key, entry);
+    }
+
+  now = g_get_real_time ();
+
+  G_LOCK (calibration_cache);
+  /* Another thread may have replaced it in the meantime */
+  entry = g_hash_table_lookup (calibration_cache, key);
+  if (!entry)
+    {
+      g_debug ("Calibration was dropped");
+    }
+  else if (g_strcmp0 (entry->firmware, firmware ? firmware : "") != 0)
+    {
+      g_debug ("Calibration is for firmware %s", entry->firmware);
+    }
+  else if (entry->version != version)
+    {
+      g_debug ("Calibration has version %u", entry->version);
+    }
+  else if (entry->timestamp > now ||
+           (max_age > 0 && now - entry->timestamp > max_age))
+    {
+      g_debug ("Calibration has expired");
+    }
+  else
+    {
+      data = g_bytes_ref (entry->data);
+    }
+  G_UNLOCK (calibration_cache);
+
+  return data;
+}
+
+/**
+ * fpi_device_calibration_drop:
+ * @device: The #FpDevice
+ *
+ * Removes the stored calibration of @device, e.g. because the driver found
+ * it to not be suitable anymore.
+ */
+void
+fpi_device_calibration_drop (FpDevice *device)
+{
+  g_autofree gchar *key = NULL;
+  g_autofree gchar *path = NULL;
+
+  g_return_if_fail (FP_IS_DEVICE (device));
+
+  key = calibration_key (device);
+
+  G_LOCK (calibration_cache);
+  if (calibration_cache)
+    g_hash_table_remove (calibration_cache, key);
+  G_UNLOCK (calibration_cache);
+
+  path = calibration_path (device, key);
+  if (path && g_unlink (path) != 0 && errno != ENOENT)
+    g_warning ("Could not remove calibration file %s: %s",
+               path, g_strerror (errno));
+}
+
+/* Forgets the calibration kept in memory, the files are kept */
+void
+fpi_device_calibration_clear_memory (void)
+{
+  G_LOCK (calibration_cache);
+  g_clear_pointer (&calibration_cache, g_hash_table_unref);
+  G_UNLOCK (calibration_cache);
+}
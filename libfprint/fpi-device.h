@@ -86,6 +86,13 @@ struct _FpIdEntry
  *   after being mostly cold. Set to -1 if the device can be always-on.
  * @temp_cold_seconds: Assumed time in seconds for the device to be mostly cold
  *   after having been too hot to operate.
+ * @cache_storage: Remember the prints returned by @list and keep them up to
+ *   date from the enroll, delete and clear_storage completions, so that
+ *   further listing does not need to talk to the device. The cache is dropped
+ *   when the device is opened or closed and whenever an action fails. The
+ *   cache holds its own copies of the prints and listing returns new copies
+ *   each time. Only set this if prints are never added or removed by other
+ *   means.
  * @usb_discover: Class method to check whether a USB device is supported by
  *  the driver. Should return 0 if the device is unsupported and a positive
  *  score otherwise. The default score is 50 and the driver with the highest
@@ -157,6 +164,8 @@ struct _FpDeviceClass
   gint32 temp_hot_seconds;
   gint32 temp_cold_seconds;
 
+  gboolean cache_storage;
+
   /* Callbacks */
   gint (*usb_discover) (GUsbDevice *usb_device);
   void (*probe)    (FpDevice *device);
@@ -325,4 +334,23 @@ gboolean fpi_device_report_finger_status_changes (FpDevice           *device,
                                                   FpFingerStatusFlags added_status,
                                                   FpFingerStatusFlags removed_status);
 
+void fpi_device_set_duty_cycle (FpDevice *device,
+                                gdouble   duty_cycle);
+
+void     fpi_device_calibration_store (FpDevice    *device,
+                                       const gchar *firmware,
+                                       guint        version,
+                                       GBytes      *data);
+GBytes * fpi_device_calibration_lookup (FpDevice    *device,
+                                        const gchar *firmware,
+                                        guint        version,
+                                        GTimeSpan    max_age);
+void     fpi_device_calibration_drop (FpDevice *device);
+
+gboolean fpi_device_in_driver_thread (FpDevice *device);
+void     fpi_device_worker_invoke (FpDevice      *device,
+                                   GSourceFunc    func,
+                                   gpointer       data,
+                                   GDestroyNotify notify);
+
 G_END_DECLS
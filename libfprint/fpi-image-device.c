@@ -210,9 +210,14 @@ fp_image_device_maybe_complete_action (FpImageDevice *self, GError *error)
 
   if (action == FPI_DEVICE_ACTION_ENROLL)
     {
+      FpImageDeviceClass *cls = FP_IMAGE_DEVICE_GET_CLASS (self);
       FpPrint *enroll_print;
       fpi_device_get_enroll_data (device, &enroll_print);
 
+      if (priv->algorithm == FPI_PRINT_NBIS)
+        fpi_print_nbis_consolidate (enroll_print, priv->bz3_threshold,
+                                    cls->nbis_consolidate);
+
       fpi_device_enroll_complete (device, g_object_ref (enroll_print), NULL);
     }
   else if (action == FPI_DEVICE_ACTION_VERIFY)
@@ -510,12 +515,28 @@ fpi_image_device_image_captured (FpImageDevice *self, FpImage *image)
 
   g_debug ("Image device captured an image");
 
+  /* Reject unusable captures before the expensive feature extraction.
+   * In capture mode the image is returned as is. */
+  if (action != FPI_DEVICE_ACTION_CAPTURE && priv->min_quality > 0 &&
+      fpi_image_get_quality (image) * 100 < priv->min_quality)
+    {
+      g_debug ("Image quality %.2f below minimum of %d%%, asking for a retry",
+               fpi_image_get_quality (image), priv->min_quality);
+      g_object_unref (image);
+      fpi_image_device_retry_scan (self, FP_DEVICE_RETRY_CENTER_FINGER);
+      return;
+    }
+
   priv->minutiae_scan_active = TRUE;
 
   if (priv->algorithm != FPI_PRINT_SIGFM)
     {
       /* XXX: We also detect minutiae in capture mode, we solely do this
-       *      to normalize the image which will happen as a by-product. */
+       *      to normalize the image which will happen as a by-product.
+       *      The image is handed out then, so keep the binarized one. */
+      if (action == FPI_DEVICE_ACTION_CAPTURE)
+        image->keep_binarized = TRUE;
+
       fp_image_detect_minutiae (image,
                                 fpi_device_get_cancellable (FP_DEVICE (self)),
                                 fpi_image_device_minutiae_detected, self);
@@ -81,6 +81,13 @@ typedef enum {
  * @bz3_threshold: Threshold to consider bozorth3 score a match, default: 40
  * @img_width: Width of the image, only provide if constant
  * @img_height: Height of the image, only provide if constant
+ * @algorithm: The matching algorithm, default: %FPI_DEVICE_ALGO_NBIS
+ * @min_quality: Minimum percentage of image blocks containing ridges, see
+ *   fpi_image_get_quality(). Images below it are rejected with a retry
+ *   before minutiae detection. Default: 0, which disables the check.
+ * @nbis_consolidate: Whether to merge the NBIS enroll stages into one
+ *   template when enrollment completes, see fpi_print_nbis_consolidate().
+ *   Default: %FPI_PRINT_CONSOLIDATE_NONE
  * @img_open: Open the device and do basic initialization
  *   (use this instead of the #FpDeviceClass open vfunc)
  * @img_close: Close the device
@@ -114,6 +121,8 @@ struct _FpImageDeviceClass
   gint                    img_width;
   gint                    img_height;
   FpiImageDeviceAlgorithm algorithm;
+  gint                    min_quality;
+  FpiPrintConsolidateMode nbis_consolidate;
 
   void                    (*img_open)     (FpImageDevice *dev);
   void                    (*img_close)    (FpImageDevice *dev);
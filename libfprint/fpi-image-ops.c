@@ -0,0 +1,467 @@
+/*
+ * FPrint raw frame preprocessing helpers
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "fpi-image-ops.h"
+
+#include <string.h>
+
+/**
+ * SECTION:fpi-image-ops
+ * @title: Raw frame preprocessing
+ * @short_description: Background removal and tone mapping of sensor data
+ *
+ * Many sensors deliver frames with more than 8 bit per pixel which need
+ * to have a calibration (background) frame removed and then need to be
+ * reduced to the 8 bit grayscale used by #FpImage. The helpers in here
+ * implement the common steps for that.
+ *
+ * The per pixel loops are kept branch free so that the compiler can
+ * vectorize them. Percentiles are selected using histograms rather than
+ * by sorting a copy of the frame, and tone mapping goes through a lookup
+ * table so that there is no division per pixel.
+ */
+
+/**
+ * fpi_image_u16_subtract:
+ * @frame: The frame to correct in place
+ * @background: The background frame
+ * @len: Number of pixels
+ * @n_clamped: (out) (optional): Number of pixels darker than the background
+ *
+ * Subtracts @background from @frame, pixels that are darker than the
+ * background are set to 0.
+ *
+ * Returns: The sum of all pixels of the corrected frame
+ */
+guint64
+fpi_image_u16_subtract (guint16       *frame,
+                        const guint16 *background,
+                        gsize          len,
+                        gsize         *n_clamped)
+{
+  guint64 sum = 0;
+  gsize clamped = 0;
+  gsize i;
+
+  for (i = 0; i < len; i++)
+    {
+      guint16 px = frame[i];
+      guint16 bg = background[i];
+      guint16 res = px > bg ? px - bg : 0;
+
+      clamped += px < bg;
+      frame[i] = res;
+      sum += res;
+    }
+
+  if (n_clamped)
+    *n_clamped = clamped;
+
+  return sum;
+}
+
+/**
+ * fpi_image_u16_absdiff:
+ * @frame: The frame to correct in place
+ * @background: The background frame
+ * @len: Number of pixels
+ *
+ * Replaces every pixel of @frame with its absolute difference to the
+ * pixel in @background.
+ *
+ * Returns: The sum of all pixels of the corrected frame
+ */
+guint64
+fpi_image_u16_absdiff (guint16       *frame,
+                       const guint16 *background,
+                       gsize          len)
+{
+  guint64 sum = 0;
+  gsize i;
+
+  for (i = 0; i < len; i++)
+    {
+      guint16 px = frame[i];
+      guint16 bg = background[i];
+      guint16 res = px > bg ? px - bg : bg - px;
+
+      frame[i] = res;
+      sum += res;
+    }
+
+  return sum;
+}
+
+/**
+ * fpi_image_u8_subtract_from:
+ * @frame: The frame to correct in place
+ * @background: The background frame
+ * @len: Number of pixels
+ * @gain: Factor to amplify the result with
+ *
+ * For sensors where a finger makes the image darker. Every pixel of
+ * @frame is replaced by how much darker it is than @background,
+ * multiplied by @gain and saturated at 255.
+ *
+ * Returns: The sum of all pixels of the corrected frame
+ */
+guint64
+fpi_image_u8_subtract_from (guint8       *frame,
+                            const guint8 *background,
+                            gsize         len,
+                            guint         gain)
+{
+  guint64 sum = 0;
+  gsize i;
+
+  for (i = 0; i < len; i++)
+    {
+      guint px = frame[i];
+      guint bg = background[i];
+      guint res = (bg > px ? bg - px : 0) * gain;
+
+      res = MIN (res, 255);
+      frame[i] = res;
+      sum += res;
+    }
+
+  return sum;
+}
+
+/**
+ * fpi_image_u16_min_max:
+ * @data: The pixel data
+ * @len: Number of pixels
+ * @min: (out): The smallest pixel value
+ * @max: (out): The largest pixel value
+ *
+ * Finds the range of the pixel values in @data. For an empty frame @min
+ * is set to 0xffff and @max to 0.
+ */
+void
+fpi_image_u16_min_max (const guint16 *data,
+                       gsize          len,
+                       guint16       *min,
+                       guint16       *max)
+{
+  guint16 lo = G_MAXUINT16;
+  guint16 hi = 0;
+  gsize i;
+
+  for (i = 0; i < len; i++)
+    {
+      lo = MIN (lo, data[i]);
+      hi = MAX (hi, data[i]);
+    }
+
+  *min = lo;
+  *max = hi;
+}
+
+/**
+ * fpi_image_u16_percentiles:
+ * @data: The pixel data
+ * @len: Number of pixels
+ * @ranks: (array length=n_ranks): The requested ranks, each less than @len
+ * @values: (out) (array length=n_ranks): The pixel values at @ranks
+ * @n_ranks: Number of ranks, at most %FPI_IMAGE_MAX_PERCENTILES
+ *
+ * Selects the values that would be at the positions @ranks if @data was
+ * sorted in ascending order, without sorting it. This uses one histogram
+ * pass over the upper byte of every pixel to find the bin holding each
+ * rank and a second pass to resolve the lower byte within that bin.
+ */
+void
+fpi_image_u16_percentiles (const guint16 *data,
+                           gsize          len,
+                           const gsize   *ranks,
+                           guint16       *values,
+                           guint          n_ranks)
+{
+  guint32 hist_hi[256] = { 0 };
+  guint32 hist_lo[FPI_IMAGE_MAX_PERCENTILES][256] = { { 0 } };
+  guint hi[FPI_IMAGE_MAX_PERCENTILES];
+  gsize below[FPI_IMAGE_MAX_PERCENTILES];
+  gsize i;
+  guint r;
+
+  g_return_if_fail (n_ranks <= FPI_IMAGE_MAX_PERCENTILES);
+  g_return_if_fail (len <= G_MAXUINT32);
+
+  for (i = 0; i < len; i++)
+    hist_hi[data[i] >> 8]++;
+
+  for (r = 0; r < n_ranks; r++)
+    {
+      gsize acc = 0;
+      guint b;
+
+      g_return_if_fail (ranks[r] < len);
+
+      for (b = 0; acc + hist_hi[b] <= ranks[r]; b++)
+        acc += hist_hi[b];
+
+      hi[r] = b;
+      below[r] = acc;
+    }
+
+  for (i = 0; i < len; i++)
+    for (r = 0; r < n_ranks; r++)
+      hist_lo[r][data[i] & 0xff] += (data[i] >> 8) == hi[r];
+
+  for (r = 0; r < n_ranks; r++)
+    {
+      gsize acc = below[r];
+      guint b;
+
+      for (b = 0; acc + hist_lo[r][b] <= ranks[r]; b++)
+        acc += hist_lo[r][b];
+
+      values[r] = (hi[r] << 8) | b;
+    }
+}
+
+/* The lookup table of the last level set mapped on this thread. Drivers
+ * map every frame of a capture, often with the same levels, so the table
+ * is only rebuilt when the levels change and its buffer is reused. */
+typedef struct
+{
+  guint16 *levels;
+  guint8  *values;
+  guint    n_levels;
+  guint8  *lut;
+  gsize    lut_size;
+} LevelsLut;
+
+static void
+levels_lut_free (LevelsLut *cache)
+{
+  g_free (cache->levels);
+  g_free (cache->values);
+  g_free (cache->lut);
+  g_free (cache);
+}
+
+static GPrivate levels_lut_private = G_PRIVATE_INIT ((GDestroyNotify) levels_lut_free);
+
+static const guint8 *
+levels_lut_get (const guint16 *levels,
+                const guint8  *values,
+                guint          n_levels)
+{
+  LevelsLut *cache = g_private_get (&levels_lut_private);
+  guint16 lo = levels[0];
+  guint16 hi = levels[n_levels - 1];
+  guint k;
+
+  if (!cache)
+    {
+      cache = g_new0 (LevelsLut, 1);
+      g_private_set (&levels_lut_private, cache);
+    }
+
+  if (cache->n_levels == n_levels &&
+      memcmp (cache->levels, levels, n_levels * sizeof (guint16)) == 0 &&
+      memcmp (cache->values, values, n_levels) == 0)
+    return cache->lut;
+
+  if (cache->n_levels != n_levels)
+    {
+      g_free (cache->levels);
+      g_free (cache->values);
+      cache->levels = g_new (guint16, n_levels);
+      cache->values = g_new (guint8, n_levels);
+      cache->n_levels = n_levels;
+    }
+  memcpy (cache->levels, levels, n_levels * sizeof (guint16));
+  memcpy (cache->values, values, n_levels);
+
+  if (cache->lut_size < (gsize) (hi - lo + 1))
+    {
+      g_free (cache->lut);
+      cache->lut_size = hi - lo + 1;
+      cache->lut = g_malloc (cache->lut_size);
+    }
+
+  for (k = 0; k + 1 < n_levels; k++)
+    {
+      guint start = levels[k];
+      guint end = levels[k + 1];
+      gint span = end - start;
+      gint delta = values[k + 1] - values[k];
+      guint v;
+
+      /* The last segment includes its upper level */
+      if (k + 2 == n_levels)
+        end++;
+
+      for (v = start; v < end; v++)
+        cache->lut[v - lo] = span ? values[k] + (gint) (v - start) * delta / span : values[k];
+    }
+
+  return cache->lut;
+}
+
+/**
+ * fpi_image_u16_map_levels:
+ * @data: The pixel data
+ * @out: (out): Output buffer of @len bytes
+ * @len: Number of pixels
+ * @levels: (array length=n_levels): Ascending input levels
+ * @values: (array length=n_levels): Output value for each level
+ * @n_levels: Number of levels, at least 2
+ *
+ * Maps the pixels to 8 bit using a piecewise linear curve. A pixel with
+ * `levels[k] <= px < levels[k + 1]` is mapped to
+ * `values[k] + (px - levels[k]) * (values[k + 1] - values[k]) / (levels[k + 1] - levels[k])`
+ * using integer arithmetic, the last segment includes its upper level.
+ * Pixels outside of the range of @levels are clamped to the first and
+ * last level respectively.
+ *
+ * The curve is evaluated once per level in a lookup table, so the cost
+ * per pixel does not depend on the number of levels. The table is kept
+ * and reused for as long as the same levels and values are passed.
+ */
+void
+fpi_image_u16_map_levels (const guint16 *data,
+                          guint8        *out,
+                          gsize          len,
+                          const guint16 *levels,
+                          const guint8  *values,
+                          guint          n_levels)
+{
+  const guint8 *lut;
+  guint16 lo, hi;
+  gsize i;
+  guint k;
+
+  g_return_if_fail (n_levels >= 2);
+
+  for (k = 0; k + 1 < n_levels; k++)
+    g_return_if_fail (levels[k] <= levels[k + 1]);
+
+  lo = levels[0];
+  hi = levels[n_levels - 1];
+  lut = levels_lut_get (levels, values, n_levels);
+
+  for (i = 0; i < len; i++)
+    out[i] = lut[CLAMP (data[i], lo, hi) - lo];
+}
+
+/**
+ * fpi_image_u16_stretch:
+ * @data: The pixel data
+ * @out: (out): Output buffer of @len bytes
+ * @len: Number of pixels
+ *
+ * Linearly maps the range of pixel values in @data onto 0 to 255. If all
+ * pixels have the same value, the output is all 0.
+ */
+void
+fpi_image_u16_stretch (const guint16 *data,
+                       guint8        *out,
+                       gsize          len)
+{
+  static const guint8 values[] = { 0, 0xff };
+  guint16 levels[2];
+
+  fpi_image_u16_min_max (data, len, &levels[0], &levels[1]);
+  if (len == 0)
+    return;
+
+  fpi_image_u16_map_levels (data, out, len, levels, values, G_N_ELEMENTS (levels));
+}
+
+/* Eight pixels at a time, a byte swap of the word mirrors them. GCC does
+ * not vectorize loops of unknown length at -O2. */
+static void
+normalize_row (const guint8 *in,
+               guint8       *out,
+               guint         width,
+               gboolean      h_flip,
+               guint8        mask)
+{
+  const guint64 mask64 = mask ? G_MAXUINT64 : 0;
+  guint64 v;
+  guint x = 0;
+
+  if (h_flip)
+    {
+      for (; x + sizeof (v) <= width; x += sizeof (v))
+        {
+          memcpy (&v, in + width - x - sizeof (v), sizeof (v));
+          v = GUINT64_SWAP_LE_BE (v) ^ mask64;
+          memcpy (out + x, &v, sizeof (v));
+        }
+      for (; x < width; x++)
+        out[x] = in[width - 1 - x] ^ mask;
+    }
+  else
+    {
+      for (; x + sizeof (v) <= width; x += sizeof (v))
+        {
+          memcpy (&v, in + x, sizeof (v));
+          v ^= mask64;
+          memcpy (out + x, &v, sizeof (v));
+        }
+      for (; x < width; x++)
+        out[x] = in[x] ^ mask;
+    }
+}
+
+/**
+ * fpi_image_u8_normalize:
+ * @src: The first row of the source pixels
+ * @stride: Distance between two source rows in bytes
+ * @out: (out): Output buffer of @width * @height bytes
+ * @width: Width of the image
+ * @height: Height of the image
+ * @h_flip: Whether to mirror the rows
+ * @v_flip: Whether to reverse the order of the rows
+ * @invert: Whether to invert the pixel values
+ *
+ * Copies a possibly cropped or padded image into a packed buffer while
+ * undoing the flips and the colour inversion in the same pass. @src and
+ * @out must not overlap.
+ */
+void
+fpi_image_u8_normalize (const guint8 *src,
+                        gsize         stride,
+                        guint8       *out,
+                        guint         width,
+                        guint         height,
+                        gboolean      h_flip,
+                        gboolean      v_flip,
+                        gboolean      invert)
+{
+  /* 0xff - v is the same as v ^ 0xff for bytes */
+  const guint8 mask = invert ? 0xff : 0x00;
+  guint y;
+
+  for (y = 0; y < height; y++)
+    {
+      const guint8 *in = src + (gsize) (v_flip ? height - 1 - y : y) * stride;
+      guint8 *row = out + (gsize) y * width;
+
+      if (h_flip || invert)
+        normalize_row (in, row, width, h_flip, mask);
+      else
+        memcpy (row, in, width);
+    }
+}
@@ -0,0 +1,75 @@
+/*
+ * FPrint raw frame preprocessing helpers
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * FPI_IMAGE_MAX_PERCENTILES:
+ *
+ * The maximum number of ranks that can be passed to
+ * fpi_image_u16_percentiles() at once.
+ */
+#define FPI_IMAGE_MAX_PERCENTILES 8
+
+guint64 fpi_image_u16_subtract (guint16       *frame,
+                                const guint16 *background,
+                                gsize          len,
+                                gsize         *n_clamped);
+guint64 fpi_image_u16_absdiff (guint16       *frame,
+                               const guint16 *background,
+                               gsize          len);
+guint64 fpi_image_u8_subtract_from (guint8       *frame,
+                                    const guint8 *background,
+                                    gsize         len,
+                                    guint         gain);
+
+void fpi_image_u16_min_max (const guint16 *data,
+                            gsize          len,
+                            guint16       *min,
+                            guint16       *max);
+void fpi_image_u16_percentiles (const guint16 *data,
+                                gsize          len,
+                                const gsize   *ranks,
+                                guint16       *values,
+                                guint          n_ranks);
+
+void fpi_image_u16_map_levels (const guint16 *data,
+                               guint8        *out,
+                               gsize          len,
+                               const guint16 *levels,
+                               const guint8  *values,
+                               guint          n_levels);
+void fpi_image_u16_stretch (const guint16 *data,
+                            guint8        *out,
+                            gsize          len);
+
+void fpi_image_u8_normalize (const guint8 *src,
+                             gsize         stride,
+                             guint8       *out,
+                             guint         width,
+                             guint         height,
+                             gboolean      h_flip,
+                             gboolean      v_flip,
+                             gboolean      invert);
+
+G_END_DECLS
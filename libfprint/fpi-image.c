@@ -99,6 +99,70 @@ gint fpi_mean_sq_diff_norm(const guint8 *buf1, const guint8 *buf2, gint size) {
   return res / size;
 }
 
+/**
+ * fpi_image_get_quality:
+ * @image: A #FpImage
+ *
+ * Cheap estimate of how much of @image is covered by a usable print. The
+ * image is split into blocks of %FPI_IMAGE_QUALITY_BLOCK_SIZE pixels and
+ * every block whose pixel variance reaches %FPI_IMAGE_QUALITY_MIN_VARIANCE
+ * is counted as containing ridges. Empty, smudged or mostly partial
+ * captures have few such blocks.
+ *
+ * This only needs a single pass over the pixels and is meant to reject
+ * unusable images before running the much more expensive minutiae
+ * detection. It does not depend on the image orientation or on whether
+ * the colours are inverted, so it can be used on the image as captured.
+ * The result is cached in the image.
+ *
+ * Returns: The fraction of blocks containing ridges, between 0 and 1
+ */
+gdouble fpi_image_get_quality(FpImage *image) {
+  const guint bs = FPI_IMAGE_QUALITY_BLOCK_SIZE;
+  const guint64 n = bs * bs;
+  guint blocks_x = image->width / bs;
+  guint blocks_y = image->height / bs;
+  guint n_ridge = 0;
+  guint bx, by, x, y;
+  const guint8 *pixels;
+  gsize stride;
+
+  if (image->quality >= 0)
+    return image->quality;
+
+  if (blocks_x == 0 || blocks_y == 0) {
+    image->quality = 0;
+    return image->quality;
+  }
+
+  pixels = fpi_image_get_pixels(image, &stride);
+
+  for (by = 0; by < blocks_y; by++) {
+    for (bx = 0; bx < blocks_x; bx++) {
+      guint64 sum = 0, sum_sq = 0;
+
+      for (y = by * bs; y < (by + 1) * bs; y++) {
+        const guint8 *row = pixels + y * stride + bx * bs;
+
+        for (x = 0; x < bs; x++) {
+          sum += row[x];
+          sum_sq += row[x] * row[x];
+        }
+      }
+
+      /* variance * n^2 = n * sum_sq - sum^2 */
+      if (n * sum_sq - sum * sum >= FPI_IMAGE_QUALITY_MIN_VARIANCE * n * n)
+        n_ridge++;
+    }
+  }
+
+  image->quality = (gdouble)n_ridge / (blocks_x * blocks_y);
+  fp_dbg("Image quality %.2f (%u of %u blocks)", image->quality, n_ridge,
+         blocks_x * blocks_y);
+
+  return image->quality;
+}
+
 FpImage *fpi_image_resize(FpImage *orig_img, guint w_factor, guint h_factor) {
 #ifdef HAVE_PIXMAN
   int new_width = orig_img->width * w_factor;
@@ -108,7 +172,8 @@ FpImage *fpi_image_resize(FpImage *orig_img, guint w_factor, guint h_factor) {
   FpImage *newimg;
 
   orig = pixman_image_create_bits(PIXMAN_a8, orig_img->width, orig_img->height,
-                                  (uint32_t *)orig_img->data, orig_img->width);
+                                  (uint32_t *)fp_image_get_data(orig_img, NULL),
+                                  orig_img->width);
   resized = pixman_image_create_bits(PIXMAN_a8, new_width, new_height, NULL,
                                      new_width);
 
@@ -141,3 +206,65 @@ FpImage *fpi_image_resize(FpImage *orig_img, guint w_factor, guint h_factor) {
   return g_object_ref(orig_img);
 #endif
 }
+
+/**
+ * fpi_image_new_view:
+ * @buffer: The buffer holding the pixels
+ * @offset: Offset of the first pixel of the image in @buffer
+ * @stride: Distance between two rows in @buffer in bytes
+ * @width: Width of the image
+ * @height: Height of the image
+ * @flags: #FpiImageFlags describing the orientation of the pixels
+ *
+ * Creates an image from a region of a capture buffer without copying it.
+ * This avoids cropping the capture into a new buffer and then normalizing
+ * it, the pixels are only copied once when the minutiae are detected. The
+ * image keeps a reference to @buffer, so its content must not be changed
+ * afterwards.
+ *
+ * Returns: (transfer full): A new #FpImage
+ */
+FpImage *fpi_image_new_view(GBytes *buffer, gsize offset, gsize stride,
+                            guint width, guint height, FpiImageFlags flags) {
+  FpImage *image;
+
+  g_return_val_if_fail(buffer != NULL, NULL);
+  g_return_val_if_fail(width > 0 && height > 0, NULL);
+  g_return_val_if_fail(stride >= width, NULL);
+  g_return_val_if_fail(offset + (gsize)(height - 1) * stride + width <=
+                           g_bytes_get_size(buffer),
+                       NULL);
+
+  /* An empty image does not allocate its own pixel buffer */
+  image = fp_image_new(0, 0);
+  image->width = width;
+  image->height = height;
+  image->flags = flags;
+  image->view_buffer = g_bytes_ref(buffer);
+  image->view_offset = offset;
+  image->view_stride = stride;
+
+  return image;
+}
+
+/**
+ * fpi_image_get_pixels:
+ * @image: A #FpImage
+ * @stride: (out): Return location for the distance between two rows
+ *
+ * Gets the pixels of @image as they were captured, without copying them
+ * if @image is a view. Row y starts at y * @stride bytes from the
+ * returned pointer.
+ *
+ * Returns: (transfer none): The first row of the image
+ */
+const guint8 *fpi_image_get_pixels(FpImage *image, gsize *stride) {
+  if (image->data || !image->view_buffer) {
+    *stride = image->width;
+    return image->data;
+  }
+
+  *stride = image->view_stride;
+  return (const guint8 *)g_bytes_get_data(image->view_buffer, NULL) +
+         image->view_offset;
+}
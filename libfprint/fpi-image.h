@@ -50,6 +50,10 @@ typedef enum {
  *
  * Structure holding an image. The public fields are only public for internal
  * use by the drivers.
+ *
+ * Images created using fpi_image_new_view() do not have their own pixel
+ * buffer until fp_image_get_data() is called, use fpi_image_get_pixels() to
+ * read them.
  */
 struct _FpImage
 {
@@ -67,18 +71,51 @@ struct _FpImage
   /*< private >*/
   guint8      *data;
   guint8      *binarized;
+  GBytes      *data_bytes;
+  gboolean     keep_binarized;
+
+  GBytes      *view_buffer;
+  gsize        view_offset;
+  gsize        view_stride;
 
   GPtrArray   *minutiae;
   SigfmImgInfo * sigfm_info;
+  gdouble      quality;
   guint        ref_count;
 };
 
+/**
+ * FPI_IMAGE_QUALITY_BLOCK_SIZE:
+ *
+ * Size of the square blocks examined by fpi_image_get_quality().
+ */
+#define FPI_IMAGE_QUALITY_BLOCK_SIZE 8
+
+/**
+ * FPI_IMAGE_QUALITY_MIN_VARIANCE:
+ *
+ * Minimum pixel variance for a block to be considered to contain ridges.
+ */
+#define FPI_IMAGE_QUALITY_MIN_VARIANCE 64
+
 gint fpi_std_sq_dev (const guint8 *buf,
                      gint          size);
 gint fpi_mean_sq_diff_norm (const guint8 *buf1,
                             const guint8 *buf2,
                             gint          size);
 
+gdouble fpi_image_get_quality (FpImage *image);
+
 FpImage *fpi_image_resize (FpImage *orig,
                            guint    w_factor,
                            guint    h_factor);
+
+FpImage *fpi_image_new_view (GBytes       *buffer,
+                             gsize         offset,
+                             gsize         stride,
+                             guint         width,
+                             guint         height,
+                             FpiImageFlags flags);
+
+const guint8 *fpi_image_get_pixels (FpImage *image,
+                                    gsize   *stride);
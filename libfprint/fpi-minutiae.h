@@ -39,7 +39,9 @@ struct fp_minutia
 /* fp_minutiae structure definition */
 struct fp_minutiae
 {
-  int                 alloc;
-  int                 num;
-  struct fp_minutia **list;
+  int                    alloc;
+  int                    num;
+  struct fp_minutia    **list;
+  /* Spatial index of list, only kept while detecting minutiae */
+  struct minutiae_grid *grid;
 };
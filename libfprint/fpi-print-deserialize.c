@@ -0,0 +1,567 @@
+/*
+ * Internal FpPrint deserialization
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "sigfm/sigfm.hpp"
+#define FP_COMPONENT "print"
+
+#include "fp-print-private.h"
+#include "fpi-compat.h"
+#include "fpi-log.h"
+
+/*
+ * Reading the serialized prints
+ *
+ * Parsing an untrusted GVariant means converting it into normal form first,
+ * which copies and validates the whole tree, and then looking up every
+ * child. For the common case of an NBIS print, the serialized data is read
+ * directly instead. The reader only accepts data that is in normal form and
+ * gives up on anything else (other print types, unexpected metadata or
+ * malformed data), which is then handled by the GVariant based parser. So
+ * both always give the same result.
+ *
+ * See the GVariant specification for the serialization format. All offsets
+ * below are relative to the start of the container that is being read.
+ */
+
+typedef struct
+{
+  const guint8 *data;
+  gsize         size;
+} FpiSerialSpan;
+
+static guint
+serial_offset_size (gsize container_size)
+{
+  if (container_size > G_MAXUINT32)
+    return 8;
+  else if (container_size > G_MAXUINT16)
+    return 4;
+  else if (container_size > G_MAXUINT8)
+    return 2;
+  else if (container_size > 0)
+    return 1;
+
+  return 0;
+}
+
+static gsize
+serial_read_offset (const guint8 *data, guint offset_size)
+{
+  guint64 value = 0;
+  guint i;
+
+  for (i = 0; i < offset_size; i++)
+    value |= ((guint64) data[i]) << (8 * i);
+
+  return value;
+}
+
+/* Reads the framing offset @index of a tuple, these are stored in reverse
+ * order at the end of the tuple. */
+static gboolean
+serial_tuple_offset (FpiSerialSpan span, guint offset_size, guint index,
+                     gsize limit, gsize *offset)
+{
+  if (offset_size == 0 || (index + 1) * offset_size > span.size)
+    return FALSE;
+
+  *offset = serial_read_offset (span.data + span.size - (index + 1) * offset_size,
+                                offset_size);
+
+  return *offset <= limit;
+}
+
+/* Moves @pos to the next multiple of @alignment, the padding needs to be 0 */
+static gboolean
+serial_align (FpiSerialSpan span, gsize *pos, gsize alignment, gsize limit)
+{
+  gsize aligned = (*pos + alignment - 1) & ~(alignment - 1);
+
+  if (aligned > limit)
+    return FALSE;
+
+  for (; *pos < aligned; (*pos)++)
+    if (span.data[*pos] != 0)
+      return FALSE;
+
+  return TRUE;
+}
+
+static gboolean
+serial_child (FpiSerialSpan span, gsize start, gsize end, FpiSerialSpan *child)
+{
+  if (start > end || end > span.size)
+    return FALSE;
+
+  child->data = span.data + start;
+  child->size = end - start;
+
+  return TRUE;
+}
+
+static gboolean
+serial_get_string (FpiSerialSpan span, const gchar **str)
+{
+  if (span.size == 0 || span.data[span.size - 1] != '\0')
+    return FALSE;
+
+  if (memchr (span.data, '\0', span.size - 1) != NULL)
+    return FALSE;
+
+  if (!g_utf8_validate ((const gchar *) span.data, span.size - 1, NULL))
+    return FALSE;
+
+  *str = (const gchar *) span.data;
+  return TRUE;
+}
+
+static gboolean
+serial_get_maybe_string (FpiSerialSpan span, const gchar **str)
+{
+  /* Nothing, otherwise the string followed by a 0 byte */
+  if (span.size == 0)
+    {
+      *str = NULL;
+      return TRUE;
+    }
+
+  if (span.data[span.size - 1] != 0)
+    return FALSE;
+
+  span.size -= 1;
+  return serial_get_string (span, str);
+}
+
+static gint32
+serial_get_int32 (const guint8 *data)
+{
+  gint32 value;
+
+  memcpy (&value, data, sizeof (value));
+  return GINT32_FROM_LE (value);
+}
+
+static gboolean
+serial_get_int32_array (FpiSerialSpan span, gint32 *values, gsize *n_values)
+{
+  gsize i;
+
+  if (span.size % sizeof (gint32) != 0)
+    return FALSE;
+
+  *n_values = span.size / sizeof (gint32);
+  if (*n_values > G_N_ELEMENTS (((struct xyt_struct *) NULL)->xcol))
+    return FALSE;
+
+  for (i = 0; i < *n_values; i++)
+    values[i] = serial_get_int32 (span.data + i * sizeof (gint32));
+
+  return TRUE;
+}
+
+/* (aiaiai) */
+static struct xyt_struct *
+serial_get_xyt (FpiSerialSpan span)
+{
+  g_autofree struct xyt_struct *xyt = g_new0 (struct xyt_struct, 1);
+  FpiSerialSpan child;
+  guint offset_size = serial_offset_size (span.size);
+  gsize limit, end, pos = 0;
+  gsize xlen, ylen, thetalen;
+
+  if (offset_size == 0 || 2 * offset_size > span.size)
+    return NULL;
+  limit = span.size - 2 * offset_size;
+
+  if (!serial_tuple_offset (span, offset_size, 0, limit, &end) ||
+      !serial_child (span, pos, end, &child) ||
+      !serial_get_int32_array (child, xyt->xcol, &xlen))
+    return NULL;
+
+  pos = end;
+  if (!serial_align (span, &pos, 4, limit) ||
+      !serial_tuple_offset (span, offset_size, 1, limit, &end) ||
+      !serial_child (span, pos, end, &child) ||
+      !serial_get_int32_array (child, xyt->ycol, &ylen))
+    return NULL;
+
+  pos = end;
+  if (!serial_align (span, &pos, 4, limit) ||
+      !serial_child (span, pos, limit, &child) ||
+      !serial_get_int32_array (child, xyt->thetacol, &thetalen))
+    return NULL;
+
+  if (xlen != ylen || xlen != thetalen)
+    return NULL;
+
+  xyt->nrows = xlen;
+
+  return g_steal_pointer (&xyt);
+}
+
+/* (a(aiaiai)), the tuple has a single member and no framing */
+static gboolean
+serial_get_xyt_array (FpiSerialSpan span, GPtrArray *prints)
+{
+  guint offset_size = serial_offset_size (span.size);
+  gsize offsets_start, n_elements, i, pos = 0;
+
+  if (span.size == 0)
+    return TRUE;
+
+  if (offset_size > span.size)
+    return FALSE;
+
+  offsets_start = serial_read_offset (span.data + span.size - offset_size, offset_size);
+  if (offsets_start > span.size - offset_size ||
+      (span.size - offsets_start) % offset_size != 0)
+    return FALSE;
+
+  n_elements = (span.size - offsets_start) / offset_size;
+
+  for (i = 0; i < n_elements; i++)
+    {
+      struct xyt_struct *xyt;
+      FpiSerialSpan child;
+      gsize end;
+
+      end = serial_read_offset (span.data + offsets_start + i * offset_size,
+                                offset_size);
+
+      if (!serial_align (span, &pos, 4, offsets_start) ||
+          end > offsets_start ||
+          !serial_child (span, pos, end, &child))
+        return FALSE;
+
+      xyt = serial_get_xyt (child);
+      if (!xyt)
+        return FALSE;
+
+      g_ptr_array_add (prints, xyt);
+      pos = end;
+    }
+
+  return pos == offsets_start;
+}
+
+/* The variant holding the NBIS data, followed by a 0 byte and its type */
+static gboolean
+serial_get_nbis_variant (FpiSerialSpan span, GPtrArray *prints)
+{
+  static const gchar type[] = "(a(aiaiai))";
+  FpiSerialSpan child;
+
+  if (span.size < sizeof (type) ||
+      memcmp (span.data + span.size - sizeof (type), "\0" "(a(aiaiai))", sizeof (type)) != 0)
+    return FALSE;
+
+  if (!serial_child (span, 0, span.size - sizeof (type), &child))
+    return FALSE;
+
+  return serial_get_xyt_array (child, prints);
+}
+
+/**
+ * fpi_print_deserialize_fast:
+ * @data: (array length=length): The serialized print without the header
+ * @length: Length of the data
+ *
+ * Purely internal function to read a serialized NBIS print without going
+ * through #GVariant.
+ *
+ * Returns: (transfer full) (nullable): The print, or %NULL if the data needs
+ *   to be parsed by fpi_print_deserialize_variant()
+ */
+FpPrint *
+fpi_print_deserialize_fast (const guchar *data,
+                            gsize         length)
+{
+  g_autoptr(FpPrint) result = NULL;
+  g_autoptr(GPtrArray) prints = NULL;
+  g_autoptr(GDate) date = NULL;
+  FpiSerialSpan span = { data, length };
+  FpiSerialSpan child;
+  const gchar *driver, *device_id, *username, *description;
+  guint offset_size = serial_offset_size (length);
+  gsize limit, pos, end;
+  guint8 device_stored, finger;
+  gint32 julian_date;
+  guint i;
+
+  /* (issbymsmsia{sv}v) with 5 framing offsets for s, s, ms, ms and a{sv} */
+  if (offset_size == 0 || 5 * offset_size > length)
+    return NULL;
+  limit = length - 5 * offset_size;
+
+  if (limit < 4 || serial_get_int32 (data) != FPI_PRINT_NBIS)
+    return NULL;
+
+  pos = 4;
+  if (!serial_tuple_offset (span, offset_size, 0, limit, &end) ||
+      !serial_child (span, pos, end, &child) ||
+      !serial_get_string (child, &driver))
+    return NULL;
+
+  pos = end;
+  if (!serial_tuple_offset (span, offset_size, 1, limit, &end) ||
+      !serial_child (span, pos, end, &child) ||
+      !serial_get_string (child, &device_id))
+    return NULL;
+
+  pos = end;
+  if (pos + 2 > limit)
+    return NULL;
+  device_stored = data[pos];
+  finger = data[pos + 1];
+  if (device_stored > 1)
+    return NULL;
+
+  pos += 2;
+  if (!serial_tuple_offset (span, offset_size, 2, limit, &end) ||
+      !serial_child (span, pos, end, &child) ||
+      !serial_get_maybe_string (child, &username))
+    return NULL;
+
+  pos = end;
+  if (!serial_tuple_offset (span, offset_size, 3, limit, &end) ||
+      !serial_child (span, pos, end, &child) ||
+      !serial_get_maybe_string (child, &description))
+    return NULL;
+
+  pos = end;
+  if (!serial_align (span, &pos, 4, limit) || pos + 4 > limit)
+    return NULL;
+  julian_date = serial_get_int32 (data + pos);
+
+  /* The a{sv} for expansion is always empty for now */
+  pos += 4;
+  if (!serial_align (span, &pos, 8, limit) ||
+      !serial_tuple_offset (span, offset_size, 4, limit, &end) ||
+      end != pos)
+    return NULL;
+
+  prints = g_ptr_array_new_with_free_func (g_free);
+  if (!serial_align (span, &pos, 8, limit) ||
+      !serial_child (span, pos, limit, &child) ||
+      !serial_get_nbis_variant (child, prints))
+    return NULL;
+
+  /* Built the same way as by fpi_print_deserialize_variant() */
+  result = g_object_new (FP_TYPE_PRINT,
+                         "driver", driver,
+                         "device-id", device_id,
+                         "device-stored", device_stored,
+                         NULL);
+  g_object_ref_sink (result);
+  fpi_print_set_type (result, FPI_PRINT_NBIS);
+  for (i = 0; i < prints->len; i++)
+    g_ptr_array_add (result->prints, g_steal_pointer (&prints->pdata[i]));
+
+  date = g_date_new_julian (julian_date);
+  g_object_set (result,
+                "finger", (FpFinger) finger,
+                "username", username,
+                "description", description,
+                "enroll_date", date,
+                NULL);
+
+  return g_steal_pointer (&result);
+}
+
+/**
+ * fpi_print_deserialize_variant:
+ * @data: (array length=length): The serialized print without the header
+ * @length: Length of the data
+ * @error: Return location for error
+ *
+ * Purely internal function to parse a serialized print using #GVariant.
+ *
+ * Returns: (transfer full): A newly created #FpPrint on success
+ */
+FpPrint *
+fpi_print_deserialize_variant (const guchar *data,
+                               gsize         length,
+                               GError      **error)
+{
+  g_autoptr(FpPrint) result = NULL;
+  g_autoptr(GVariant) raw_value = NULL;
+  g_autoptr(GVariant) value = NULL;
+  g_autoptr(GVariant) print_data = NULL;
+  g_autoptr(GDate) date = NULL;
+  guchar *aligned_data = NULL;
+  guint8 finger_int8;
+  FpFinger finger;
+  g_autofree gchar *username = NULL;
+  g_autofree gchar *description = NULL;
+  gint julian_date;
+  FpiPrintType type;
+  const gchar *driver;
+  const gchar *device_id;
+  gboolean device_stored;
+
+  /* NOTE:
+   * We make sure that we have no variant left over from the parsing at the end
+   * of this function (meaning we don't need to keep the data around.
+   */
+
+  /* To support GLIB < 2.60 we need to make sure that the memory is aligned correctly.
+   * We also need to copy the backing store for the raw data that we may keep for
+   * longer. */
+  aligned_data = g_malloc (length);
+  memcpy (aligned_data, data, length);
+  raw_value = g_variant_new_from_data (FPI_PRINT_VARIANT_TYPE,
+                                       aligned_data, length,
+                                       FALSE, g_free, aligned_data);
+
+  if (!raw_value)
+    goto invalid_format;
+
+  if (G_BYTE_ORDER == G_BIG_ENDIAN)
+    value = g_variant_byteswap (raw_value);
+  else
+    value = g_variant_get_normal_form (raw_value);
+
+  g_variant_get (value,
+                 "(i&s&sbymsmsi@a{sv}v)",
+                 &type,
+                 &driver,
+                 &device_id,
+                 &device_stored,
+                 &finger_int8,
+                 &username,
+                 &description,
+                 &julian_date,
+                 NULL,
+                 &print_data);
+
+  finger = finger_int8;
+
+  /* Assume data is valid at this point if the values are somewhat sane. */
+  if (type == FPI_PRINT_NBIS)
+    {
+      g_autoptr(GVariant) prints = g_variant_get_child_value (print_data, 0);
+      guint i;
+
+      result = g_object_new (FP_TYPE_PRINT,
+                             "driver", driver,
+                             "device-id", device_id,
+                             "device-stored", device_stored,
+                             NULL);
+      g_object_ref_sink (result);
+      fpi_print_set_type (result, FPI_PRINT_NBIS);
+      for (i = 0; i < g_variant_n_children (prints); i++)
+        {
+          g_autofree struct xyt_struct *xyt = NULL;
+          const gint32 *xcol, *ycol, *thetacol;
+          gsize xlen, ylen, thetalen;
+          g_autoptr(GVariant) xyt_data = NULL;
+          GVariant *child;
+
+          xyt_data = g_variant_get_child_value (prints, i);
+
+          child = g_variant_get_child_value (xyt_data, 0);
+          xcol = g_variant_get_fixed_array (child, &xlen, sizeof (gint32));
+          g_variant_unref (child);
+
+          child = g_variant_get_child_value (xyt_data, 1);
+          ycol = g_variant_get_fixed_array (child, &ylen, sizeof (gint32));
+          g_variant_unref (child);
+
+          child = g_variant_get_child_value (xyt_data, 2);
+          thetacol = g_variant_get_fixed_array (child, &thetalen, sizeof (gint32));
+          g_variant_unref (child);
+
+          if (xlen != ylen || xlen != thetalen)
+            goto invalid_format;
+
+          if (xlen > G_N_ELEMENTS (xyt->xcol))
+            goto invalid_format;
+
+          xyt = g_new0 (struct xyt_struct, 1);
+          xyt->nrows = xlen;
+          memcpy (xyt->xcol, xcol, sizeof (xcol[0]) * xlen);
+          memcpy (xyt->ycol, ycol, sizeof (xcol[0]) * xlen);
+          memcpy (xyt->thetacol, thetacol, sizeof (xcol[0]) * xlen);
+
+          g_ptr_array_add (result->prints, g_steal_pointer (&xyt));
+        }
+    }
+  else if (type == FPI_PRINT_SIGFM)
+    {
+      g_autoptr(GVariant) prints = g_variant_get_child_value (print_data, 0);
+      guint i;
+
+      result = g_object_new (FP_TYPE_PRINT, "driver", driver, "device-id",
+                             device_id, "device-stored", device_stored, NULL);
+      g_object_ref_sink (result);
+      fpi_print_set_type (result, FPI_PRINT_SIGFM);
+
+      for (i = 0; i < g_variant_n_children (prints); i++)
+        {
+          g_autoptr(GVariant) sigfm_data = NULL;
+
+          sigfm_data = g_variant_get_child_value (prints, i);
+
+          GVariant * child = g_variant_get_child_value (sigfm_data, 0);
+          gsize slen;
+          const unsigned char * serialized =
+            g_variant_get_fixed_array (child, &slen, sizeof (unsigned char));
+          g_variant_unref (child);
+
+          SigfmImgInfo * sigfm_info = sigfm_deserialize_binary (serialized, slen);
+          if (!sigfm_info)
+            goto invalid_format;
+
+          g_ptr_array_add (result->prints, g_steal_pointer (&sigfm_info));
+        }
+    }
+  else if (type == FPI_PRINT_RAW)
+    {
+      g_autoptr(GVariant) fp_data = g_variant_get_child_value (print_data, 0);
+
+      result = g_object_new (FP_TYPE_PRINT,
+                             "fpi-type", type,
+                             "driver", driver,
+                             "device-id", device_id,
+                             "device-stored", device_stored,
+                             "fpi-data", fp_data,
+                             NULL);
+      g_object_ref_sink (result);
+    }
+  else
+    {
+      g_warning ("Invalid print type: 0x%X", type);
+      goto invalid_format;
+    }
+
+  date = g_date_new_julian (julian_date);
+  g_object_set (result,
+                "finger", finger,
+                "username", username,
+                "description", description,
+                "enroll_date", date,
+                NULL);
+
+  return g_steal_pointer (&result);
+
+invalid_format:
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+               "Data could not be parsed");
+  return NULL;
+}
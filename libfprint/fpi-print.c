@@ -27,6 +27,11 @@
 #include "fpi-compat.h"
 #include "fpi-device.h"
 
+#include <math.h>
+
+/* Bozorth keeps its state in globals, only one match may run at a time */
+G_LOCK_DEFINE_STATIC (bozorth);
+
 /**
  * SECTION: fpi-print
  * @title: Internal FpPrint
@@ -100,6 +105,51 @@ void fpi_print_set_device_stored(FpPrint *print, gboolean device_stored) {
   g_object_notify(G_OBJECT(print), "device-stored");
 }
 
+/**
+ * fpi_print_copy:
+ * @print: A #FpPrint
+ *
+ * Purely internal function to duplicate a print, including its metadata.
+ * The image is shared, everything that can be changed through the public
+ * API is copied.
+ *
+ * Returns: (transfer full): A new #FpPrint
+ */
+FpPrint *fpi_print_copy(FpPrint *print) {
+  FpPrint *copy;
+  guint i;
+
+  g_return_val_if_fail(FP_IS_PRINT(print), NULL);
+
+  copy = g_object_new(FP_TYPE_PRINT, "driver", print->driver, "device-id",
+                      print->device_id, "device-stored", print->device_stored,
+                      "finger", print->finger, "username", print->username,
+                      "description", print->description, "enroll-date",
+                      print->enroll_date, "fpi-data", print->data, NULL);
+  g_object_ref_sink(copy);
+
+  if (print->image)
+    copy->image = g_object_ref(print->image);
+
+  if (print->type == FPI_PRINT_UNDEFINED)
+    return copy;
+
+  fpi_print_set_type(copy, print->type);
+
+  if (print->type == FPI_PRINT_NBIS) {
+    for (i = 0; i < print->prints->len; i++)
+      g_ptr_array_add(copy->prints,
+                      g_memdup2(g_ptr_array_index(print->prints, i),
+                                sizeof(struct xyt_struct)));
+  } else if (print->type == FPI_PRINT_SIGFM) {
+    for (i = 0; i < print->prints->len; i++)
+      g_ptr_array_add(copy->prints,
+                      sigfm_copy_info(g_ptr_array_index(print->prints, i)));
+  }
+
+  return copy;
+}
+
 /* XXX: This is the old version, but wouldn't it be smarter to instead
  * use the highest quality mintutiae? Possibly just using bz_prune from
  * upstream? */
@@ -179,6 +229,7 @@ fpi_print_add_from_image (FpPrint *print,
       _minutiae.num = minutiae->len;
       _minutiae.list = (struct fp_minutia **) minutiae->pdata;
       _minutiae.alloc = minutiae->len;
+      _minutiae.grid = NULL;
 
       xyt = g_new0 (struct xyt_struct, 1);
       minutiae_to_xyt (&_minutiae, image->width, image->height, xyt);
@@ -215,6 +266,7 @@ fpi_print_add_from_image (FpPrint *print,
  */
 FpiMatchResult fpi_print_bz3_match(FpPrint *template, FpPrint *print,
                                    gint bz3_threshold, GError **error) {
+  FpiMatchResult result = FPI_MATCH_FAIL;
   struct xyt_struct *pstruct;
   gint probe_len;
   gint i;
@@ -234,9 +286,11 @@ FpiMatchResult fpi_print_bz3_match(FpPrint *template, FpPrint *print,
   }
 
   pstruct = g_ptr_array_index(print->prints, 0);
+
+  G_LOCK(bozorth);
   probe_len = bozorth_probe_init(pstruct);
 
-  for (i = 0; i < template->prints->len; i++) {
+  for (i = 0; i < template->prints->len && result == FPI_MATCH_FAIL; i++) {
     struct xyt_struct *gstruct;
     gint score;
     gstruct = g_ptr_array_index(template->prints, i);
@@ -244,10 +298,343 @@ FpiMatchResult fpi_print_bz3_match(FpPrint *template, FpPrint *print,
     fp_dbg("score %d/%d", score, bz3_threshold);
 
     if (score >= bz3_threshold)
-      return FPI_MATCH_SUCCESS;
+      result = FPI_MATCH_SUCCESS;
   }
+  G_UNLOCK(bozorth);
 
-  return FPI_MATCH_FAIL;
+  return result;
+}
+
+/* Tolerances used to decide that two aligned minutiae are the same */
+#define CONSOLIDATE_MAX_DIST 10
+#define CONSOLIDATE_MAX_ANGLE 30
+/* Width of the rotation histogram bins and inlier window, in degrees */
+#define CONSOLIDATE_ROT_BIN 4
+#define CONSOLIDATE_ROT_TOLERANCE 6
+
+typedef struct
+{
+  gint x;
+  gint y;
+  gint theta;
+  gint support;
+  gint order;
+} ConsolidatedMinutia;
+
+typedef struct
+{
+  gdouble rot;
+  gdouble tx;
+  gdouble ty;
+} RigidTransform;
+
+static gint
+cmp_double (gconstpointer a, gconstpointer b)
+{
+  gdouble da = *(const gdouble *) a;
+  gdouble db = *(const gdouble *) b;
+
+  return (da > db) - (da < db);
+}
+
+static gint
+cmp_consolidated_minutia (gconstpointer a, gconstpointer b)
+{
+  const ConsolidatedMinutia *ma = a;
+  const ConsolidatedMinutia *mb = b;
+
+  if (ma->support != mb->support)
+    return mb->support - ma->support;
+
+  return ma->order - mb->order;
+}
+
+static gint
+edge_angle (struct xyt_struct *xyt, gint k, gint j)
+{
+  gdouble a = atan2 (xyt->ycol[j] - xyt->ycol[k], xyt->xcol[j] - xyt->xcol[k]);
+
+  return (gint) lround (a * 180.0 / G_PI);
+}
+
+/* Needs to be called with the bozorth lock held.
+ * Scores @probe against @gallery and, if the score reaches @bz3_threshold,
+ * estimates the rigid transform mapping @probe onto @gallery from the
+ * compatible edge pairs Bozorth found. The rotation is the mode of the per
+ * edge pair rotations, the translation the median over the minutiae of the
+ * pairs agreeing with it.
+ * Bozorth returns the pairs in its global colp[] table, which the next
+ * match overwrites, so they are copied out right after matching. */
+static gint
+bz3_align (struct xyt_struct *probe,
+           struct xyt_struct *gallery,
+           gint               bz3_threshold,
+           RigidTransform    *transform)
+{
+  guint votes[360 / CONSOLIDATE_ROT_BIN] = { 0 };
+  g_autofree gdouble *tx = NULL;
+  g_autofree gdouble *ty = NULL;
+  g_autofree gint (*pairs)[COLP_SIZE_2] = NULL;
+  gint rot_sum = 0, n_inliers = 0;
+  gint probe_len, np, score;
+  guint best_bin = 0, best_votes = 0;
+  gdouble c, s;
+  gint rot;
+  gint i;
+
+  probe_len = bozorth_probe_init (probe);
+  np = bz_match (probe_len, bozorth_gallery_init (gallery));
+  score = bz_match_score (np, probe, gallery);
+
+  if (score < bz3_threshold || np == 0)
+    return score;
+
+  pairs = g_memdup2 (colp, np * sizeof (colp[0]));
+
+  for (i = 0; i < np; i++)
+    {
+      rot = IANGLE180 (edge_angle (gallery, pairs[i][3] - 1, pairs[i][4] - 1) -
+                       edge_angle (probe, pairs[i][1] - 1, pairs[i][2] - 1));
+      votes[(rot + 180) / CONSOLIDATE_ROT_BIN % G_N_ELEMENTS (votes)]++;
+    }
+
+  for (i = 0; i < G_N_ELEMENTS (votes); i++)
+    {
+      guint n = votes[i] +
+                votes[(i + 1) % G_N_ELEMENTS (votes)] +
+                votes[(i + G_N_ELEMENTS (votes) - 1) % G_N_ELEMENTS (votes)];
+
+      if (n > best_votes)
+        {
+          best_votes = n;
+          best_bin = i;
+        }
+    }
+
+  rot = best_bin * CONSOLIDATE_ROT_BIN + CONSOLIDATE_ROT_BIN / 2 - 180;
+
+  tx = g_new (gdouble, 2 * np);
+  ty = g_new (gdouble, 2 * np);
+
+  /* Refine the rotation on the inliers, then collect translations */
+  for (i = 0; i < np; i++)
+    {
+      gint d = IANGLE180 (edge_angle (gallery, pairs[i][3] - 1, pairs[i][4] - 1) -
+                          edge_angle (probe, pairs[i][1] - 1, pairs[i][2] - 1) - rot);
+
+      if (ABS (d) <= CONSOLIDATE_ROT_TOLERANCE)
+        {
+          rot_sum += d;
+          n_inliers++;
+        }
+    }
+
+  g_assert (n_inliers > 0);
+  transform->rot = (rot + (gdouble) rot_sum / n_inliers) * G_PI / 180.0;
+  c = cos (transform->rot);
+  s = sin (transform->rot);
+  n_inliers = 0;
+
+  for (i = 0; i < np; i++)
+    {
+      gint d = IANGLE180 (edge_angle (gallery, pairs[i][3] - 1, pairs[i][4] - 1) -
+                          edge_angle (probe, pairs[i][1] - 1, pairs[i][2] - 1) - rot);
+      gint end;
+
+      if (ABS (d) > CONSOLIDATE_ROT_TOLERANCE)
+        continue;
+
+      for (end = 0; end < 2; end++)
+        {
+          gint p = pairs[i][1 + end] - 1;
+          gint g = pairs[i][3 + end] - 1;
+
+          tx[n_inliers] = gallery->xcol[g] - (c * probe->xcol[p] - s * probe->ycol[p]);
+          ty[n_inliers] = gallery->ycol[g] - (s * probe->xcol[p] + c * probe->ycol[p]);
+          n_inliers++;
+        }
+    }
+
+  qsort (tx, n_inliers, sizeof (gdouble), cmp_double);
+  qsort (ty, n_inliers, sizeof (gdouble), cmp_double);
+  transform->tx = tx[n_inliers / 2];
+  transform->ty = ty[n_inliers / 2];
+
+  return score;
+}
+
+static void
+consolidated_add (GArray *merged, gint x, gint y, gint theta)
+{
+  ConsolidatedMinutia m = { x, y, theta, 1, merged->len };
+  guint i;
+
+  for (i = 0; i < merged->len; i++)
+    {
+      ConsolidatedMinutia *o = &g_array_index (merged, ConsolidatedMinutia, i);
+      gint dx = o->x - x;
+      gint dy = o->y - y;
+
+      if (dx * dx + dy * dy <= CONSOLIDATE_MAX_DIST * CONSOLIDATE_MAX_DIST &&
+          ABS (IANGLE180 (o->theta - theta)) <= CONSOLIDATE_MAX_ANGLE)
+        {
+          o->support++;
+          return;
+        }
+    }
+
+  g_array_append_val (merged, m);
+}
+
+/**
+ * fpi_print_nbis_consolidate:
+ * @print: A #FpPrint of type #FPI_PRINT_NBIS
+ * @bz3_threshold: The BZ3 match threshold
+ * @mode: How the merged template is stored
+ *
+ * Merges the per enroll stage minutiae of @print into a single template,
+ * so that matching needs one Bozorth comparison instead of one per stage.
+ *
+ * The stage that matches best against all others is used as reference.
+ * The remaining stages are aligned to it using the edge pairs found by
+ * Bozorth and their minutiae are added to it, skipping those that
+ * coincide with an existing one. If there are more than
+ * %MAX_BOZORTH_MINUTIAE minutiae, the ones seen in the most stages are
+ * kept.
+ *
+ * Stages that do not match the reference with at least @bz3_threshold
+ * cannot be aligned reliably and are always kept as separate templates.
+ *
+ * Returns: The number of stages merged into the consolidated template,
+ *   0 if @print was not modified
+ */
+gint
+fpi_print_nbis_consolidate (FpPrint                *print,
+                            gint                    bz3_threshold,
+                            FpiPrintConsolidateMode mode)
+{
+  g_autoptr(GArray) merged = NULL;
+  g_autofree gint *score_sums = NULL;
+  g_autofree gboolean *aligned = NULL;
+  g_autofree struct minutiae_struct *c = NULL;
+  struct xyt_struct *ref, *xyt;
+  GPtrArray *prints;
+  guint n_stages, n_merged = 1;
+  guint i, j, best = 0;
+
+  g_return_val_if_fail (print->type == FPI_PRINT_NBIS, 0);
+
+  n_stages = print->prints->len;
+  if (mode == FPI_PRINT_CONSOLIDATE_NONE || n_stages < 2)
+    return 0;
+
+  score_sums = g_new0 (gint, n_stages);
+  aligned = g_new0 (gboolean, n_stages);
+
+  G_LOCK (bozorth);
+
+  for (j = 0; j < n_stages; j++)
+    {
+      struct xyt_struct *probe = g_ptr_array_index (print->prints, j);
+      gint probe_len = bozorth_probe_init (probe);
+
+      for (i = 0; i < n_stages; i++)
+        if (i != j)
+          score_sums[i] += bozorth_to_gallery (probe_len, probe,
+                                               g_ptr_array_index (print->prints, i));
+    }
+
+  for (i = 1; i < n_stages; i++)
+    if (score_sums[i] > score_sums[best])
+      best = i;
+
+  ref = g_ptr_array_index (print->prints, best);
+  merged = g_array_sized_new (FALSE, FALSE, sizeof (ConsolidatedMinutia),
+                              n_stages * MAX_BOZORTH_MINUTIAE);
+  for (i = 0; i < ref->nrows; i++)
+    consolidated_add (merged, ref->xcol[i], ref->ycol[i], ref->thetacol[i]);
+
+  aligned[best] = TRUE;
+
+  for (i = 0; i < n_stages; i++)
+    {
+      RigidTransform t;
+      gdouble cs, sn;
+      gint score;
+
+      if (i == best)
+        continue;
+
+      xyt = g_ptr_array_index (print->prints, i);
+      score = bz3_align (xyt, ref, bz3_threshold, &t);
+      if (score < bz3_threshold)
+        {
+          fp_dbg ("Not merging enroll stage %u, score %d/%d against stage %u",
+                  i, score, bz3_threshold, best);
+          continue;
+        }
+
+      cs = cos (t.rot);
+      sn = sin (t.rot);
+      for (j = 0; j < xyt->nrows; j++)
+        consolidated_add (merged,
+                          lround (cs * xyt->xcol[j] - sn * xyt->ycol[j] + t.tx),
+                          lround (sn * xyt->xcol[j] + cs * xyt->ycol[j] + t.ty),
+                          IANGLE180 (xyt->thetacol[j] +
+                                     (gint) lround (t.rot * 180.0 / G_PI)));
+
+      aligned[i] = TRUE;
+      n_merged++;
+    }
+
+  G_UNLOCK (bozorth);
+
+  if (n_merged < 2)
+    return 0;
+
+  g_array_sort (merged, cmp_consolidated_minutia);
+  g_array_set_size (merged, MIN (merged->len, MAX_BOZORTH_MINUTIAE));
+
+  /* Bozorth expects the minutiae to be sorted by x and y */
+  c = g_new (struct minutiae_struct, merged->len);
+  for (i = 0; i < merged->len; i++)
+    {
+      ConsolidatedMinutia *m = &g_array_index (merged, ConsolidatedMinutia, i);
+
+      c[i].col[0] = m->x;
+      c[i].col[1] = m->y;
+      c[i].col[2] = m->theta;
+      c[i].col[3] = m->support;
+    }
+  qsort (c, merged->len, sizeof (struct minutiae_struct), sort_x_y);
+
+  xyt = g_new0 (struct xyt_struct, 1);
+  xyt->nrows = merged->len;
+  for (i = 0; i < merged->len; i++)
+    {
+      xyt->xcol[i] = c[i].col[0];
+      xyt->ycol[i] = c[i].col[1];
+      xyt->thetacol[i] = c[i].col[2];
+    }
+
+  fp_dbg ("Consolidated %u of %u enroll stages into %d minutiae",
+          n_merged, n_stages, xyt->nrows);
+
+  prints = g_ptr_array_new_with_free_func (g_free);
+  g_ptr_array_add (prints, xyt);
+  for (i = 0; i < n_stages; i++)
+    {
+      if (mode == FPI_PRINT_CONSOLIDATE_REPLACE && aligned[i])
+        continue;
+
+      g_ptr_array_add (prints, g_ptr_array_index (print->prints, i));
+      g_ptr_array_index (print->prints, i) = NULL;
+    }
+
+  g_ptr_array_unref (print->prints);
+  print->prints = prints;
+
+  return n_merged;
 }
 
 FpiMatchResult fpi_print_sigfm_match(FpPrint *template, FpPrint *print,
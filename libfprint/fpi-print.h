@@ -31,6 +31,22 @@ typedef enum {
   FPI_MATCH_SUCCESS,
 } FpiMatchResult;
 
+/**
+ * FpiPrintConsolidateMode:
+ * @FPI_PRINT_CONSOLIDATE_NONE: Keep one template per enroll stage
+ * @FPI_PRINT_CONSOLIDATE_REPLACE: Replace the stages that could be merged
+ *   with the consolidated template
+ * @FPI_PRINT_CONSOLIDATE_KEEP_STAGES: Store the consolidated template in
+ *   front of all the per stage templates
+ *
+ * How fpi_print_nbis_consolidate() stores the merged template.
+ */
+typedef enum {
+  FPI_PRINT_CONSOLIDATE_NONE = 0,
+  FPI_PRINT_CONSOLIDATE_REPLACE,
+  FPI_PRINT_CONSOLIDATE_KEEP_STAGES,
+} FpiPrintConsolidateMode;
+
 void     fpi_print_add_print (FpPrint *print,
                               FpPrint *add);
 
@@ -48,6 +64,10 @@ FpiMatchResult fpi_print_bz3_match (FpPrint *temp,
                                     gint     bz3_threshold,
                                     GError **error);
 
+gint fpi_print_nbis_consolidate (FpPrint                *print,
+                                 gint                    bz3_threshold,
+                                 FpiPrintConsolidateMode mode);
+
 FpiMatchResult fpi_print_sigfm_match (FpPrint * template, FpPrint * print,
                                     gint bz3_threshold, GError * *error);
 
@@ -17,6 +17,8 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <config.h>
+
 #include "fpi-spi-transfer.h"
 #include <sys/ioctl.h>
 #include <linux/spi/spidev.h>
@@ -69,10 +71,26 @@ dump_buffer (guchar *buf, gssize dump_len)
     g_debug ("%s", line->str);
 }
 
+/* Only read the environment once, transfers may run at a high rate */
+static gboolean
+log_transfer_enabled (void)
+{
+#if ENABLE_TRANSFER_TRACE
+  static gsize enabled = 0;
+
+  if (g_once_init_enter (&enabled))
+    g_once_init_leave (&enabled, g_getenv ("FP_DEBUG_TRANSFER") ? 2 : 1);
+
+  return enabled == 2;
+#else
+  return FALSE;
+#endif
+}
+
 static void
 log_transfer (FpiSpiTransfer *transfer, gboolean submit, GError *error)
 {
-  if (g_getenv ("FP_DEBUG_TRANSFER"))
+  if (G_UNLIKELY (log_transfer_enabled ()))
     {
       if (submit)
         {
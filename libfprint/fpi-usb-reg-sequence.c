@@ -0,0 +1,473 @@
+/*
+ * FPrint USB register write sequences
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define FP_COMPONENT "usb-reg-sequence"
+
+#include <string.h>
+
+#include "fpi-log.h"
+#include "fpi-usb-reg-sequence.h"
+
+/**
+ * SECTION:fpi-usb-reg-sequence
+ * @title: USB register write sequences
+ * @short_description: Write fixed register tables to a device
+ *
+ * Many sensors are set up by writing long, fixed tables of register values.
+ * An #FpiUsbRegSequence turns such a table into the payloads of the USB
+ * transfers that carry it once, so that the table can be written again and
+ * again without being converted each time. Drivers usually build the
+ * sequences for their static tables on first use and keep them around.
+ *
+ * Two layouts are supported. Bulk sequences pack register/value byte pairs
+ * into transfers of up to a given number of registers, breaks added with
+ * fpi_usb_reg_sequence_add_break() force the following registers into a new
+ * transfer. Control sequences send one host to device control transfer per
+ * register, with the register as index and the value as the single data
+ * byte.
+ *
+ * fpi_usb_reg_sequence_write() sends the transfers one after the other.
+ * Every register (and break) added to the sequence has an index, which is
+ * included in the error message if a transfer fails.
+ *
+ * fpi_usb_reg_sequence_get_cached() keeps the sequences built for the
+ * register tables of a driver with the device, so that each table is only
+ * converted once per device.
+ */
+
+typedef struct
+{
+  guint  first_index;
+  guint  offset;
+  guint  length;
+} FpiUsbRegPacket;
+
+struct _FpiUsbRegSequence
+{
+  gint                  ref_count;
+
+  FpiTransferType       type;
+  guint8                endpoint;
+  guint                 max_regs;
+  GUsbDeviceRequestType request_type;
+  GUsbDeviceRecipient   recipient;
+  guint8                request;
+
+  /* Register/value pairs of all packets */
+  GByteArray           *data;
+  GArray               *packets;
+  guint                 n_entries;
+  gboolean              open;
+};
+
+typedef struct
+{
+  FpiUsbRegSequence        *sequence;
+  FpDevice                 *device;
+  guint                     next;
+  guint                     timeout_ms;
+  GCancellable             *cancellable;
+
+  FpiUsbRegSequenceCallback callback;
+  gpointer                  user_data;
+} FpiUsbRegSequenceWrite;
+
+/* A sequence built from a register table, with a copy of the table it was
+ * built from. */
+typedef struct
+{
+  gpointer           table;
+  gsize              table_size;
+  FpiUsbRegSequence *sequence;
+} FpiUsbRegCacheEntry;
+
+#define REG_SEQUENCE_CACHE_KEY "fpi-usb-reg-sequence-cache"
+
+static FpiUsbRegSequence *
+reg_sequence_new (FpiTransferType type)
+{
+  FpiUsbRegSequence *sequence = g_new0 (FpiUsbRegSequence, 1);
+
+  sequence->ref_count = 1;
+  sequence->type = type;
+  sequence->data = g_byte_array_new ();
+  sequence->packets = g_array_new (FALSE, FALSE, sizeof (FpiUsbRegPacket));
+
+  return sequence;
+}
+
+/**
+ * fpi_usb_reg_sequence_new_bulk:
+ * @endpoint: The bulk-out endpoint to write to
+ * @max_regs_per_transfer: The maximum number of registers per transfer
+ *
+ * Creates an empty sequence that sends register/value byte pairs to a bulk
+ * endpoint.
+ *
+ * Returns: (transfer full): A new #FpiUsbRegSequence
+ */
+FpiUsbRegSequence *
+fpi_usb_reg_sequence_new_bulk (guint8 endpoint,
+                               guint  max_regs_per_transfer)
+{
+  FpiUsbRegSequence *sequence;
+
+  g_return_val_if_fail (!(endpoint & FPI_USB_ENDPOINT_IN), NULL);
+  g_return_val_if_fail (max_regs_per_transfer > 0, NULL);
+
+  sequence = reg_sequence_new (FP_TRANSFER_BULK);
+  sequence->endpoint = endpoint;
+  sequence->max_regs = max_regs_per_transfer;
+
+  return sequence;
+}
+
+/**
+ * fpi_usb_reg_sequence_new_control:
+ * @request_type: The request type of the control transfers
+ * @recipient: The recipient of the control transfers
+ * @request: The request of the control transfers
+ *
+ * Creates an empty sequence that writes every register with its own control
+ * transfer.
+ *
+ * Returns: (transfer full): A new #FpiUsbRegSequence
+ */
+FpiUsbRegSequence *
+fpi_usb_reg_sequence_new_control (GUsbDeviceRequestType request_type,
+                                  GUsbDeviceRecipient   recipient,
+                                  guint8                request)
+{
+  FpiUsbRegSequence *sequence;
+
+  sequence = reg_sequence_new (FP_TRANSFER_CONTROL);
+  sequence->request_type = request_type;
+  sequence->recipient = recipient;
+  sequence->request = request;
+  sequence->max_regs = 1;
+
+  return sequence;
+}
+
+/**
+ * fpi_usb_reg_sequence_ref:
+ * @sequence: A #FpiUsbRegSequence
+ *
+ * Returns: (transfer full): @sequence
+ */
+FpiUsbRegSequence *
+fpi_usb_reg_sequence_ref (FpiUsbRegSequence *sequence)
+{
+  g_return_val_if_fail (sequence, NULL);
+  g_return_val_if_fail (sequence->ref_count > 0, NULL);
+
+  g_atomic_int_inc (&sequence->ref_count);
+
+  return sequence;
+}
+
+/**
+ * fpi_usb_reg_sequence_unref:
+ * @sequence: A #FpiUsbRegSequence
+ *
+ * Drops a reference, the sequence is freed once the last reference is gone.
+ * Sequences that are being written are kept alive until the write finished.
+ */
+void
+fpi_usb_reg_sequence_unref (FpiUsbRegSequence *sequence)
+{
+  g_return_if_fail (sequence);
+  g_return_if_fail (sequence->ref_count > 0);
+
+  if (!g_atomic_int_dec_and_test (&sequence->ref_count))
+    return;
+
+  g_byte_array_unref (sequence->data);
+  g_array_unref (sequence->packets);
+  g_free (sequence);
+}
+
+/**
+ * fpi_usb_reg_sequence_add:
+ * @sequence: A #FpiUsbRegSequence
+ * @reg: The register
+ * @value: The value to write to @reg
+ *
+ * Appends a register write to the sequence.
+ */
+void
+fpi_usb_reg_sequence_add (FpiUsbRegSequence *sequence,
+                          guint8             reg,
+                          guint8             value)
+{
+  FpiUsbRegPacket *packet = NULL;
+  const guint8 pair[] = { reg, value };
+
+  g_return_if_fail (sequence);
+
+  if (sequence->open)
+    packet = &g_array_index (sequence->packets, FpiUsbRegPacket,
+                             sequence->packets->len - 1);
+
+  if (!packet || packet->length / 2 >= sequence->max_regs)
+    {
+      FpiUsbRegPacket new_packet = {
+        .first_index = sequence->n_entries,
+        .offset = sequence->data->len,
+        .length = 0,
+      };
+
+      g_array_append_val (sequence->packets, new_packet);
+      packet = &g_array_index (sequence->packets, FpiUsbRegPacket,
+                               sequence->packets->len - 1);
+      sequence->open = TRUE;
+    }
+
+  g_byte_array_append (sequence->data, pair, sizeof (pair));
+  packet->length += sizeof (pair);
+  sequence->n_entries++;
+}
+
+/**
+ * fpi_usb_reg_sequence_add_break:
+ * @sequence: A #FpiUsbRegSequence
+ *
+ * Makes sure the next register is written in a new transfer. The break
+ * takes up an index, so that indices match tables that contain separator
+ * entries.
+ */
+void
+fpi_usb_reg_sequence_add_break (FpiUsbRegSequence *sequence)
+{
+  g_return_if_fail (sequence);
+
+  sequence->open = FALSE;
+  sequence->n_entries++;
+}
+
+/**
+ * fpi_usb_reg_sequence_get_n_transfers:
+ * @sequence: A #FpiUsbRegSequence
+ *
+ * Returns: The number of transfers needed to write @sequence
+ */
+guint
+fpi_usb_reg_sequence_get_n_transfers (FpiUsbRegSequence *sequence)
+{
+  g_return_val_if_fail (sequence, 0);
+
+  return sequence->packets->len;
+}
+
+static void
+reg_cache_entry_free (FpiUsbRegCacheEntry *entry)
+{
+  fpi_usb_reg_sequence_unref (entry->sequence);
+  g_free (entry->table);
+  g_free (entry);
+}
+
+/**
+ * fpi_usb_reg_sequence_get_cached:
+ * @device: The #FpDevice the sequence is written to
+ * @table: The register table
+ * @table_size: The size of @table in bytes
+ * @build_func: (scope call): Function building the sequence for @table
+ * @n_entries: The number of entries in @table, passed to @build_func
+ *
+ * Gets the sequence for a register table of the driver, calling
+ * @build_func to build it if @device did not see @table before. The
+ * sequences are stored with @device and freed together with it.
+ *
+ * Sequences are looked up by the address of @table. Some drivers change
+ * their tables at runtime, so a sequence is only reused while the contents
+ * of @table are the same as when it was built.
+ *
+ * Returns: (transfer full): The #FpiUsbRegSequence for @table
+ */
+FpiUsbRegSequence *
+fpi_usb_reg_sequence_get_cached (FpDevice                  *device,
+                                 gconstpointer              table,
+                                 gsize                      table_size,
+                                 FpiUsbRegSequenceBuildFunc build_func,
+                                 guint                      n_entries)
+{
+  FpiUsbRegCacheEntry *entry;
+  GHashTable *cache;
+
+  g_return_val_if_fail (FP_IS_DEVICE (device), NULL);
+  g_return_val_if_fail (table, NULL);
+  g_return_val_if_fail (build_func, NULL);
+
+  cache = g_object_get_data (G_OBJECT (device), REG_SEQUENCE_CACHE_KEY);
+  if (!cache)
+    {
+      cache = g_hash_table_new_full (NULL, NULL, NULL,
+                                     (GDestroyNotify) reg_cache_entry_free);
+      g_object_set_data_full (G_OBJECT (device), REG_SEQUENCE_CACHE_KEY,
+                              cache, (GDestroyNotify) g_hash_table_unref);
+    }
+
+  entry = g_hash_table_lookup (cache, table);
+  if (!entry || entry->table_size != table_size ||
+      memcmp (entry->table, table, table_size) != 0)
+    {
+      entry = g_new0 (FpiUsbRegCacheEntry, 1);
+      entry->table = g_memdup2 (table, table_size);
+      entry->table_size = table_size;
+      entry->sequence = build_func (table, n_entries);
+      g_hash_table_insert (cache, (gpointer) table, entry);
+    }
+
+  return fpi_usb_reg_sequence_ref (entry->sequence);
+}
+
+static void reg_sequence_transfer_cb (FpiUsbTransfer *transfer,
+                                      FpDevice       *device,
+                                      gpointer        user_data,
+                                      GError         *error);
+
+static void
+reg_sequence_write_finish (FpiUsbRegSequenceWrite *write, GError *error)
+{
+  FpiUsbRegSequence *sequence = write->sequence;
+
+  if (error)
+    {
+      const FpiUsbRegPacket *packet =
+        &g_array_index (sequence->packets, FpiUsbRegPacket, write->next - 1);
+
+      g_prefix_error (&error, "Writing register %u (0x%02x) failed: ",
+                      packet->first_index,
+                      sequence->data->data[packet->offset]);
+      fp_dbg ("%s", error->message);
+    }
+
+  if (write->callback)
+    write->callback (sequence, write->device, write->user_data, error);
+  else
+    g_clear_error (&error);
+
+  g_clear_object (&write->cancellable);
+  fpi_usb_reg_sequence_unref (sequence);
+  g_free (write);
+}
+
+static void
+reg_sequence_submit_next (FpiUsbRegSequenceWrite *write)
+{
+  FpiUsbRegSequence *sequence = write->sequence;
+  const FpiUsbRegPacket *packet;
+  FpiUsbTransfer *transfer;
+
+  packet = &g_array_index (sequence->packets, FpiUsbRegPacket, write->next);
+  transfer = fpi_usb_transfer_new (write->device);
+  transfer->short_is_error = TRUE;
+
+  if (sequence->type == FP_TRANSFER_BULK)
+    {
+      /* The sequence is referenced until the write has finished */
+      fpi_usb_transfer_fill_bulk_full (transfer, sequence->endpoint,
+                                       sequence->data->data + packet->offset,
+                                       packet->length, NULL);
+    }
+  else
+    {
+      const guint8 *pair = sequence->data->data + packet->offset;
+
+      fpi_usb_transfer_fill_control (transfer,
+                                     G_USB_DEVICE_DIRECTION_HOST_TO_DEVICE,
+                                     sequence->request_type,
+                                     sequence->recipient,
+                                     sequence->request,
+                                     0,
+                                     pair[0],
+                                     1);
+      transfer->buffer[0] = pair[1];
+    }
+
+  write->next++;
+  fpi_usb_transfer_submit (transfer, write->timeout_ms, write->cancellable,
+                           reg_sequence_transfer_cb, write);
+}
+
+static void
+reg_sequence_transfer_cb (FpiUsbTransfer *transfer,
+                          FpDevice       *device,
+                          gpointer        user_data,
+                          GError         *error)
+{
+  FpiUsbRegSequenceWrite *write = user_data;
+
+  if (error || write->next >= write->sequence->packets->len)
+    {
+      reg_sequence_write_finish (write, error);
+      return;
+    }
+
+  reg_sequence_submit_next (write);
+}
+
+/**
+ * fpi_usb_reg_sequence_write:
+ * @sequence: A #FpiUsbRegSequence
+ * @device: The #FpDevice to write to
+ * @timeout_ms: Timeout for each transfer in ms, 0 for no timeout
+ * @cancellable: (nullable): A #GCancellable
+ * @callback: Callback once the sequence has been written
+ * @user_data: Data to pass to @callback
+ *
+ * Writes all registers of @sequence to @device in order, every transfer is
+ * only sent once the previous one returned. The first failing transfer
+ * stops the write. An empty sequence completes right away, before this
+ * function returns.
+ */
+void
+fpi_usb_reg_sequence_write (FpiUsbRegSequence        *sequence,
+                            FpDevice                 *device,
+                            guint                     timeout_ms,
+                            GCancellable             *cancellable,
+                            FpiUsbRegSequenceCallback callback,
+                            gpointer                  user_data)
+{
+  FpiUsbRegSequenceWrite *write;
+
+  g_return_if_fail (sequence);
+  g_return_if_fail (FP_IS_DEVICE (device));
+
+  write = g_new0 (FpiUsbRegSequenceWrite, 1);
+  write->sequence = fpi_usb_reg_sequence_ref (sequence);
+  write->device = device;
+  write->timeout_ms = timeout_ms;
+  if (cancellable)
+    write->cancellable = g_object_ref (cancellable);
+  write->callback = callback;
+  write->user_data = user_data;
+
+  fp_dbg ("Writing %u registers in %u transfers",
+          sequence->n_entries, sequence->packets->len);
+
+  if (sequence->packets->len == 0)
+    {
+      reg_sequence_write_finish (write, NULL);
+      return;
+    }
+
+  reg_sequence_submit_next (write);
+}
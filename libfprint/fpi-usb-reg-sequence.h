@@ -0,0 +1,86 @@
+/*
+ * FPrint USB register write sequences
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include "fpi-usb-transfer.h"
+
+G_BEGIN_DECLS
+
+typedef struct _FpiUsbRegSequence FpiUsbRegSequence;
+
+/**
+ * FpiUsbRegSequenceCallback:
+ * @sequence: The #FpiUsbRegSequence that was written
+ * @dev: The #FpDevice it was written to
+ * @user_data: User data passed to fpi_usb_reg_sequence_write()
+ * @error: (transfer full): The #GError or %NULL
+ *
+ * Called once the sequence has been written or a transfer failed. The
+ * message of @error then contains the index of the register write that
+ * failed.
+ */
+typedef void (*FpiUsbRegSequenceCallback)(FpiUsbRegSequence *sequence,
+                                          FpDevice          *dev,
+                                          gpointer           user_data,
+                                          GError            *error);
+
+/**
+ * FpiUsbRegSequenceBuildFunc:
+ * @table: The register table
+ * @n_entries: The number of entries in @table
+ *
+ * Builds the sequence for a register table of a driver, see
+ * fpi_usb_reg_sequence_get_cached().
+ *
+ * Returns: (transfer full): A new #FpiUsbRegSequence
+ */
+typedef FpiUsbRegSequence *(*FpiUsbRegSequenceBuildFunc)(gconstpointer table,
+                                                         guint         n_entries);
+
+FpiUsbRegSequence *fpi_usb_reg_sequence_new_bulk (guint8 endpoint,
+                                                  guint  max_regs_per_transfer);
+FpiUsbRegSequence *fpi_usb_reg_sequence_new_control (GUsbDeviceRequestType request_type,
+                                                     GUsbDeviceRecipient   recipient,
+                                                     guint8                request);
+FpiUsbRegSequence *fpi_usb_reg_sequence_ref (FpiUsbRegSequence *sequence);
+void               fpi_usb_reg_sequence_unref (FpiUsbRegSequence *sequence);
+
+void               fpi_usb_reg_sequence_add (FpiUsbRegSequence *sequence,
+                                             guint8             reg,
+                                             guint8             value);
+void               fpi_usb_reg_sequence_add_break (FpiUsbRegSequence *sequence);
+guint              fpi_usb_reg_sequence_get_n_transfers (FpiUsbRegSequence *sequence);
+
+FpiUsbRegSequence *fpi_usb_reg_sequence_get_cached (FpDevice                  *device,
+                                                    gconstpointer              table,
+                                                    gsize                      table_size,
+                                                    FpiUsbRegSequenceBuildFunc build_func,
+                                                    guint                      n_entries);
+
+void               fpi_usb_reg_sequence_write (FpiUsbRegSequence        *sequence,
+                                               FpDevice                 *device,
+                                               guint                     timeout_ms,
+                                               GCancellable             *cancellable,
+                                               FpiUsbRegSequenceCallback callback,
+                                               gpointer                  user_data);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (FpiUsbRegSequence, fpi_usb_reg_sequence_unref)
+
+G_END_DECLS
@@ -17,6 +17,8 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <config.h>
+
 #include "fpi-usb-transfer.h"
 
 /**
@@ -30,15 +32,229 @@
  *
  * Drivers should use this API only rather than accessing the GUsbDevice
  * directly in most cases.
+ *
+ * Setting G_MESSAGES_DEBUG and FP_DEBUG_TRANSFER will result in the message
+ * content to be dumped. Setting FP_DEBUG_TRANSFER_RING records the transfers
+ * into a fixed size in-memory ring instead, see fpi_usb_transfer_trace_dump().
+ * Both are only read once and can be compiled out with the
+ * transfer-tracing build option.
  */
 
 
 G_DEFINE_BOXED_TYPE (FpiUsbTransfer, fpi_usb_transfer, fpi_usb_transfer_ref, fpi_usb_transfer_unref)
 
+#if ENABLE_TRANSFER_TRACE
+
+#define TRACE_RING_DEFAULT_SIZE 1024
+#define TRACE_RING_MAX_SIZE (1 << 20)
+#define TRACE_DATA_LEN 16
+/* Minimum time between two dumps triggered by failed transfers */
+#define TRACE_REPORT_INTERVAL_US (10 * G_USEC_PER_SEC)
+
+typedef enum {
+  TRANSFER_TRACE_RESOLVED = 1 << 0,
+  TRANSFER_TRACE_LOG      = 1 << 1,
+  TRANSFER_TRACE_RING     = 1 << 2,
+} TransferTraceFlags;
+
+typedef struct
+{
+  /* Sequence number plus one, zero while the entry is being written */
+  gint          seq;
+  gint64        time;
+  gconstpointer transfer;
+  gssize        length;
+  GQuark        error_domain;
+  gint          error_code;
+  gint8         type;
+  guint8        endpoint;
+  guint8        submit;
+  guint8        data_len;
+  guint8        data[TRACE_DATA_LEN];
+} TransferTraceEntry;
+
+static TransferTraceEntry *trace_ring;
+static guint trace_ring_mask;
+static gint trace_ring_head;
+/* Where the last dump triggered by a failed transfer ended, and when */
+static gint trace_ring_reported;
+static gint64 trace_ring_reported_time;
+
+/* The environment is only looked at for the first transfer, the flags are
+ * cached afterwards so that a disabled trace costs a single atomic read. */
+static gsize
+transfer_trace_flags (void)
+{
+  static gsize flags = 0;
+
+  if (g_once_init_enter (&flags))
+    {
+      gsize res = TRANSFER_TRACE_RESOLVED;
+      const char *ring_size;
+
+      if (g_getenv ("FP_DEBUG_TRANSFER"))
+        res |= TRANSFER_TRACE_LOG;
+
+      ring_size = g_getenv ("FP_DEBUG_TRANSFER_RING");
+      if (ring_size)
+        {
+          guint64 size = g_ascii_strtoull (ring_size, NULL, 10);
+          guint entries = 1;
+
+          if (size == 0)
+            size = TRACE_RING_DEFAULT_SIZE;
+          size = MIN (size, TRACE_RING_MAX_SIZE);
+          while (entries < size)
+            entries <<= 1;
+
+          trace_ring = g_new0 (TransferTraceEntry, entries);
+          trace_ring_mask = entries - 1;
+          res |= TRANSFER_TRACE_RING;
+        }
+
+      g_once_init_leave (&flags, res);
+    }
+
+  return flags;
+}
+
+static gboolean
+transfer_is_in (FpiUsbTransfer *transfer)
+{
+  if (transfer->type == FP_TRANSFER_CONTROL)
+    return transfer->direction == G_USB_DEVICE_DIRECTION_DEVICE_TO_HOST;
+
+  return (transfer->endpoint & FPI_USB_ENDPOINT_IN) != 0;
+}
+
 static void
-log_transfer (FpiUsbTransfer *transfer, gboolean submit, GError *error)
+trace_transfer (FpiUsbTransfer *transfer, gboolean submit, GError *error)
 {
-  if (g_getenv ("FP_DEBUG_TRANSFER"))
+  TransferTraceEntry *entry;
+  guint seq;
+
+  /* Writers claim a slot and mark it as incomplete until it is filled, a
+   * concurrent dump skips entries that are being rewritten. The fence
+   * keeps the fields from being written before the slot is marked. */
+  seq = (guint) g_atomic_int_add (&trace_ring_head, 1);
+  entry = &trace_ring[seq & trace_ring_mask];
+  __atomic_store_n (&entry->seq, 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+
+  entry->time = g_get_monotonic_time ();
+  entry->transfer = transfer;
+  entry->length = submit ? transfer->length : transfer->actual_length;
+  entry->error_domain = error ? error->domain : 0;
+  entry->error_code = error ? error->code : 0;
+  entry->type = transfer->type;
+  entry->endpoint = transfer->endpoint;
+  entry->submit = submit;
+  entry->data_len = 0;
+
+  if (!submit == transfer_is_in (transfer) && entry->length > 0 && transfer->buffer)
+    {
+      entry->data_len = MIN (entry->length, TRACE_DATA_LEN);
+      memcpy (entry->data, transfer->buffer, entry->data_len);
+    }
+
+  __atomic_store_n (&entry->seq, (gint) (seq + 1), __ATOMIC_RELEASE);
+}
+
+/* Formats the entries from @from on, or from the oldest one still in the
+ * ring, up to the current head which is returned in @end. */
+static gchar *
+trace_ring_format (guint from, guint *end)
+{
+  GString *out = g_string_new (NULL);
+  guint head, start, i;
+
+  head = (guint) g_atomic_int_get (&trace_ring_head);
+  start = head > trace_ring_mask + 1 ? head - (trace_ring_mask + 1) : 0;
+  if (from - start <= head - start)
+    start = from;
+
+  for (i = start; i != head; i++)
+    {
+      TransferTraceEntry *slot = &trace_ring[i & trace_ring_mask];
+      TransferTraceEntry entry;
+      guint8 j;
+
+      /* The copy is only valid if the slot was not rewritten meanwhile,
+       * the fence keeps it from being read after the second check. */
+      if ((guint) __atomic_load_n (&slot->seq, __ATOMIC_ACQUIRE) != i + 1)
+        continue;
+      entry = *slot;
+      __atomic_thread_fence (__ATOMIC_ACQUIRE);
+      if ((guint) __atomic_load_n (&slot->seq, __ATOMIC_RELAXED) != i + 1)
+        continue;
+
+      g_string_append_printf (out, "%" G_GINT64_FORMAT " %p %s type %d endpoint 0x%02x length %zd",
+                              entry.time,
+                              entry.transfer,
+                              entry.submit ? "submit" : "complete",
+                              entry.type,
+                              entry.endpoint,
+                              entry.length);
+      if (entry.error_domain)
+        g_string_append_printf (out, " error %s:%d",
+                                g_quark_to_string (entry.error_domain),
+                                entry.error_code);
+
+      if (entry.data_len)
+        g_string_append_c (out, ':');
+      for (j = 0; j < entry.data_len; j++)
+        g_string_append_printf (out, " %02x", entry.data[j]);
+      g_string_append_c (out, '\n');
+    }
+
+  if (end)
+    *end = head;
+
+  return g_string_free (out, FALSE);
+}
+
+/* Only the transfers since the previous dump are logged, and at most once
+ * per TRACE_REPORT_INTERVAL_US, so that a failing device does not flood
+ * the logs. Timeouts are expected while polling for a finger and are not
+ * reported, fpi_usb_transfer_trace_dump() still shows them. */
+static void
+trace_ring_report (GError *error)
+{
+  g_autofree gchar *trace = NULL;
+  gint64 now;
+  guint end;
+
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED) ||
+      g_error_matches (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT))
+    return;
+
+  now = g_get_monotonic_time ();
+  if (trace_ring_reported_time &&
+      now - trace_ring_reported_time < TRACE_REPORT_INTERVAL_US)
+    return;
+  trace_ring_reported_time = now;
+
+  trace = trace_ring_format ((guint) g_atomic_int_get (&trace_ring_reported), &end);
+  g_atomic_int_set (&trace_ring_reported, (gint) end);
+
+  g_message ("USB transfer failed: %s, transfers since the last report:\n%s",
+             error->message, trace);
+}
+
+static void
+log_transfer_full (FpiUsbTransfer *transfer, gboolean submit, GError *error)
+{
+  gsize flags = transfer_trace_flags ();
+
+  if (flags & TRANSFER_TRACE_RING)
+    {
+      trace_transfer (transfer, submit, error);
+
+      if (error)
+        trace_ring_report (error);
+    }
+
+  if (flags & TRANSFER_TRACE_LOG)
     {
       if (!submit)
         {
@@ -88,6 +304,52 @@ log_transfer (FpiUsbTransfer *transfer, gboolean submit, GError *error)
     }
 }
 
+static inline void
+log_transfer (FpiUsbTransfer *transfer, gboolean submit, GError *error)
+{
+  if (G_UNLIKELY (transfer_trace_flags () != TRANSFER_TRACE_RESOLVED))
+    log_transfer_full (transfer, submit, error);
+}
+
+#else
+
+static inline void
+log_transfer (FpiUsbTransfer *transfer, gboolean submit, GError *error)
+{
+}
+
+#endif
+
+/**
+ * fpi_usb_transfer_trace_dump:
+ *
+ * Renders the transfers recorded in the in-memory trace ring, oldest first.
+ * The ring is enabled by setting FP_DEBUG_TRANSFER_RING to the number of
+ * transfers to keep (a default size is used for non-numeric values). Each
+ * record holds the time, endpoint, length, error and the first bytes
+ * of the transferred data. Recording does not take locks and only formats
+ * data when this function is called, so it can stay enabled in production.
+ *
+ * The transfers recorded since the previous report are also logged when a
+ * transfer fails for any other reason than being cancelled or timing out,
+ * at most once every 10 seconds.
+ *
+ * Returns: (transfer full) (nullable): The trace, or %NULL if the ring is
+ *   disabled
+ */
+gchar *
+fpi_usb_transfer_trace_dump (void)
+{
+#if ENABLE_TRANSFER_TRACE
+  if (!(transfer_trace_flags () & TRANSFER_TRACE_RING))
+    return NULL;
+
+  return trace_ring_format (0, NULL);
+#else
+  return NULL;
+#endif
+}
+
 /**
  * fpi_usb_transfer_new:
  * @device: The #FpDevice the transfer is for
@@ -367,6 +629,9 @@ transfer_cancel_cb (FpDevice *device, gpointer user_data)
   callback = transfer->callback;
   transfer->callback = NULL;
   transfer->actual_length = -1;
+
+  log_transfer (transfer, FALSE, error);
+
   callback (transfer, transfer->device, transfer->user_data, error);
 
   fpi_usb_transfer_unref (transfer);
@@ -539,12 +804,12 @@ fpi_usb_transfer_submit_sync (FpiUsbTransfer *transfer,
       g_return_val_if_reached (FALSE);
     }
 
-  log_transfer (transfer, FALSE, *error);
-
   if (!res)
     transfer->actual_length = -1;
   else
     transfer->actual_length = actual_length;
 
+  log_transfer (transfer, FALSE, *error);
+
   return res;
 }
@@ -158,6 +158,21 @@ typedef struct rotgrids{
 typedef struct fp_minutia MINUTIA;
 typedef struct fp_minutiae MINUTIAE;
 
+/* Uniform grid bucketing the indices of a minutiae list by location, so */
+/* that the points near a new minutia can be found without scanning the  */
+/* whole list.  Each cell holds its list indices in increasing order.    */
+typedef struct minutiae_grid{
+   int cell_size;
+   int grid_w;
+   int grid_h;
+   int *nums;
+   int *allocs;
+   int **cells;
+   /* Scratch list of neighbor indices returned by minutiae_grid_nbrs() */
+   int *nbrs;
+   int nbrs_alloc;
+} MINUTIAE_GRID;
+
 typedef struct feature_pattern{
    int type;
    int appearing;
@@ -266,6 +281,10 @@ typedef struct g_lfsparms{
    /* Ridge Counting Controls */
    int    max_nbrs;
    int    max_ridge_steps;
+
+   /* Index minutiae by location while detecting and counting ridges, */
+   /* the result is the same as when scanning the whole list.         */
+   int    use_minutiae_grid;
 } LFSPARMS;
 
 /*************************************************************************/
@@ -966,6 +985,9 @@ extern void skip_repeated_vertical_pair(int *, const int,
 /* minutia.c */
 extern int alloc_minutiae(MINUTIAE **, const int);
 extern int realloc_minutiae(MINUTIAE *, const int);
+extern int alloc_minutiae_grid(MINUTIAE *, const int, const int, const int);
+extern void free_minutiae_grid(MINUTIAE *);
+extern int minutiae_grid_nbrs(int **, MINUTIAE *, const int, const int);
 extern int detect_minutiae(MINUTIAE *, unsigned char *, const int, const int,
                      const int *, const int *, const int, const int,
                      const LFSPARMS *);
@@ -1189,10 +1211,10 @@ extern void sort_row_on_x(ROW *);
 /* sort.c */
 extern int sort_indices_int_inc(int **, int *, const int);
 extern int sort_indices_double_inc(int **, double *, const int);
-extern void bubble_sort_int_inc_2(int *, int *, const int);
-extern void bubble_sort_double_inc_2(double *, int *, const int);
-extern void bubble_sort_double_dec_2(double *, int *,  const int);
-extern void bubble_sort_int_inc(int *, const int);
+extern void stable_sort_int_inc_2(int *, int *, const int);
+extern void stable_sort_double_inc_2(double *, int *, const int);
+extern void stable_sort_double_dec_2(double *, int *,  const int);
+extern void stable_sort_int_inc(int *, const int);
 
 /* util.c */
 extern int maxv(const int *, const int);
@@ -31,3 +31,28 @@
 		g_assert(g_size_checked_mul(&dest, a, b));	\
 		g_assert(dest < G_MAXINT);			\
 	}
+
+/* Extraction scoped allocations, see nbis-arena.c */
+struct fp_minutiae;
+
+void     nbis_arena_begin (void);
+void     nbis_arena_end (void);
+gpointer nbis_arena_steal (gpointer mem);
+struct fp_minutiae *nbis_arena_steal_minutiae (struct fp_minutiae *minutiae);
+
+gpointer nbis_malloc (gsize size);
+gpointer nbis_malloc0 (gsize size);
+gpointer nbis_realloc (gpointer mem,
+                       gsize    size);
+void     nbis_free (gpointer mem);
+
+#ifdef NBIS_COMPILATION
+#undef g_malloc
+#undef g_malloc0
+#undef g_realloc
+#undef g_free
+#define g_malloc(size) nbis_malloc (size)
+#define g_malloc0(size) nbis_malloc0 (size)
+#define g_realloc(mem, size) nbis_realloc (mem, size)
+#define g_free(mem) nbis_free (mem)
+#endif
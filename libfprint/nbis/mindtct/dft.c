@@ -361,7 +361,7 @@ int sort_dft_waves(int *wis, const double *powmaxs, const double *pownorms,
    }
 
    /* Sort the statistic indices on the normalized squared power. */
-   bubble_sort_double_dec_2(pownorms2, wis, nstats);
+   stable_sort_double_dec_2(pownorms2, wis, nstats);
 
    /* Deallocate the working memory. */
    g_free(pownorms2);
@@ -92,6 +92,8 @@ of the software.
       obw      - width (in pixels) of binarized image
       obh      - height (in pixels) of binarized image
       obd      - pixel depth (in bits) of binarized image
+      All outputs except ominutiae may be NULL if the caller does not
+      need them, the maps and the binarized image are freed in that case.
    Return Code:
       Zero     - successful completion
       Negative - system error
@@ -156,19 +158,42 @@ int get_minutiae(MINUTIAE **ominutiae, int **oquality_map,
       return(ret);
    }
 
-   /* Set output pointers. */
+   /* Set output pointers, releasing what the caller does not want. */
    *ominutiae = minutiae;
-   *oquality_map = quality_map;
-   *odirection_map = direction_map;
-   *olow_contrast_map = low_contrast_map;
-   *olow_flow_map = low_flow_map;
-   *ohigh_curve_map = high_curve_map;
-   *omap_w = map_w;
-   *omap_h = map_h;
-   *obdata = bdata;
-   *obw = bw;
-   *obh = bh;
-   *obd = id;
+   if(oquality_map)
+      *oquality_map = quality_map;
+   else
+      g_free(quality_map);
+   if(odirection_map)
+      *odirection_map = direction_map;
+   else
+      g_free(direction_map);
+   if(olow_contrast_map)
+      *olow_contrast_map = low_contrast_map;
+   else
+      g_free(low_contrast_map);
+   if(olow_flow_map)
+      *olow_flow_map = low_flow_map;
+   else
+      g_free(low_flow_map);
+   if(ohigh_curve_map)
+      *ohigh_curve_map = high_curve_map;
+   else
+      g_free(high_curve_map);
+   if(omap_w)
+      *omap_w = map_w;
+   if(omap_h)
+      *omap_h = map_h;
+   if(obdata)
+      *obdata = bdata;
+   else
+      g_free(bdata);
+   if(obw)
+      *obw = bw;
+   if(obh)
+      *obh = bh;
+   if(obd)
+      *obd = id;
 
    /* Return normally. */
    return(0);
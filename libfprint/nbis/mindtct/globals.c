@@ -155,7 +155,9 @@ LFSPARMS g_lfsparms = {
 
    /* Ridge Counting Controls */
    MAX_NBRS,
-   MAX_RIDGE_STEPS
+   MAX_RIDGE_STEPS,
+
+   TRUE  /* index minutiae by location */
 };
 
 
@@ -241,7 +243,9 @@ LFSPARMS g_lfsparms_V2 = {
 
    /* Ridge Counting Controls */
    MAX_NBRS,
-   MAX_RIDGE_STEPS
+   MAX_RIDGE_STEPS,
+
+   TRUE  /* index minutiae by location */
 };
 
 /* Variables for conducting 8-connected neighbor analyses. */
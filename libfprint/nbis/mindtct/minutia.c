@@ -58,6 +58,9 @@ of the software.
                ROUTINES:
                         alloc_minutiae()
                         realloc_minutiae()
+                        alloc_minutiae_grid()
+                        free_minutiae_grid()
+                        minutiae_grid_nbrs()
                         detect_minutiae()
                         detect_minutiae_V2()
                         update_minutiae()
@@ -101,6 +104,54 @@ of the software.
 #include <stdio.h>
 #include <lfs.h>
 
+/* Returns the grid cell a minutia falls into. */
+static int minutiae_grid_cell(const MINUTIAE_GRID *grid,
+                              const MINUTIA *minutia)
+{
+   int cx, cy;
+
+   cx = min(max(minutia->x / grid->cell_size, 0), grid->grid_w - 1);
+   cy = min(max(minutia->y / grid->cell_size, 0), grid->grid_h - 1);
+
+   return((cy * grid->grid_w) + cx);
+}
+
+/* Adds a list index to a grid cell, it must be larger than all of */
+/* the indices already in the cell.                                */
+static void minutiae_grid_append(MINUTIAE_GRID *grid, const int cell,
+                                 const int index)
+{
+   if(grid->nums[cell] >= grid->allocs[cell]){
+      grid->allocs[cell] = max(4, grid->allocs[cell] * 2);
+      grid->cells[cell] = (int *)g_realloc(grid->cells[cell],
+                                           grid->allocs[cell] * sizeof(int));
+   }
+   grid->cells[cell][grid->nums[cell]++] = index;
+}
+
+/* Removes a list index from the grid, shifting the larger indices */
+/* down the same way remove_minutia() slides the list.             */
+static void minutiae_grid_remove(MINUTIAE_GRID *grid, const MINUTIA *minutia,
+                                 const int index)
+{
+   int cell, i, n;
+
+   cell = minutiae_grid_cell(grid, minutia);
+   for(i = 0; i < grid->nums[cell]; i++){
+      if(grid->cells[cell][i] == index){
+         for(n = i+1; n < grid->nums[cell]; n++)
+            grid->cells[cell][n-1] = grid->cells[cell][n];
+         grid->nums[cell]--;
+         break;
+      }
+   }
+
+   for(cell = 0; cell < grid->grid_w * grid->grid_h; cell++)
+      for(i = grid->nums[cell]-1; (i >= 0) && (grid->cells[cell][i] > index);
+          i--)
+         grid->cells[cell][i]--;
+}
+
 /*************************************************************************
 **************************************************************************
 #cat: alloc_minutiae - Allocates and initializes a minutia list based on the
@@ -123,6 +174,7 @@ int alloc_minutiae(MINUTIAE **ominutiae, const int DEFAULT_BOZORTH_MINUTIAE)
 
    minutiae->alloc = DEFAULT_BOZORTH_MINUTIAE;
    minutiae->num = 0;
+   minutiae->grid = (MINUTIAE_GRID *)NULL;
 
    *ominutiae = minutiae;
    return(0);
@@ -152,6 +204,143 @@ int realloc_minutiae(MINUTIAE *minutiae, const int incr_minutiae)
    return(0);
 }
 
+/*************************************************************************
+**************************************************************************
+#cat: alloc_minutiae_grid - Allocates a uniform grid indexing the minutiae
+#cat:            list by location and attaches it to the list.  While the
+#cat:            grid is attached, points added with update_minutiae() or
+#cat:            update_minutiae_V2() and removed with remove_minutia() are
+#cat:            kept in the grid.  Reordering the list is not supported.
+
+   Input:
+      minutiae  - list of minutiae, may already contain points
+      iw        - width (in pixels) of image
+      ih        - height (in pixels) of image
+      cell_size - width and height (in pixels) of each grid cell
+   Output:
+      minutiae  - list of minutiae with the grid attached
+   Return Code:
+      Zero      - successful completion
+      Negative  - system error
+**************************************************************************/
+int alloc_minutiae_grid(MINUTIAE *minutiae, const int iw, const int ih,
+                        const int cell_size)
+{
+   MINUTIAE_GRID *grid;
+   int i, cell;
+
+   if(cell_size <= 0){
+      fprintf(stderr, "ERROR : alloc_minutiae_grid : invalid cell size\n");
+      return(-390);
+   }
+
+   grid = (MINUTIAE_GRID *)g_malloc(sizeof(MINUTIAE_GRID));
+   grid->cell_size = cell_size;
+   grid->grid_w = max(1, (iw + cell_size - 1) / cell_size);
+   grid->grid_h = max(1, (ih + cell_size - 1) / cell_size);
+   grid->nums = (int *)g_malloc0(grid->grid_w * grid->grid_h * sizeof(int));
+   grid->allocs = (int *)g_malloc0(grid->grid_w * grid->grid_h * sizeof(int));
+   grid->cells = (int **)g_malloc0(grid->grid_w * grid->grid_h *
+                                   sizeof(int *));
+   grid->nbrs = (int *)NULL;
+   grid->nbrs_alloc = 0;
+
+   free_minutiae_grid(minutiae);
+   minutiae->grid = grid;
+
+   /* Index the points already in the list. */
+   for(i = 0; i < minutiae->num; i++){
+      cell = minutiae_grid_cell(grid, minutiae->list[i]);
+      minutiae_grid_append(grid, cell, i);
+   }
+
+   return(0);
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: free_minutiae_grid - Deallocates the grid attached to a minutiae
+#cat:            list, if any.  The minutiae themselves are kept.
+
+   Input:
+      minutiae  - list of minutiae
+   Output:
+      minutiae  - list of minutiae without grid
+**************************************************************************/
+void free_minutiae_grid(MINUTIAE *minutiae)
+{
+   MINUTIAE_GRID *grid = minutiae->grid;
+   int i;
+
+   if(grid == (MINUTIAE_GRID *)NULL)
+      return;
+
+   for(i = 0; i < grid->grid_w * grid->grid_h; i++)
+      g_free(grid->cells[i]);
+   g_free(grid->cells);
+   g_free(grid->nums);
+   g_free(grid->allocs);
+   g_free(grid->nbrs);
+   g_free(grid);
+
+   minutiae->grid = (MINUTIAE_GRID *)NULL;
+}
+
+/*************************************************************************
+**************************************************************************
+#cat: minutiae_grid_nbrs - Returns the indices of all minutiae in the grid
+#cat:            cell containing the specified point and the 8 cells
+#cat:            around it.  This includes every minutia whose X and Y
+#cat:            distances to the point are both less than the cell size.
+
+   Input:
+      minutiae  - list of minutiae with a grid attached
+      x         - x-pixel coord of point
+      y         - y-pixel coord of point
+   Output:
+      onbrs     - points to the list indices in increasing order, valid
+                  until the next call or until the grid is deallocated
+   Return Code:
+      Non-negative - number of indices returned
+**************************************************************************/
+int minutiae_grid_nbrs(int **onbrs, MINUTIAE *minutiae,
+                       const int x, const int y)
+{
+   MINUTIAE_GRID *grid = minutiae->grid;
+   int cx, cy, gx, gy, cell;
+   int i, j, n, nnbrs, index;
+
+   cx = min(max(x / grid->cell_size, 0), grid->grid_w - 1);
+   cy = min(max(y / grid->cell_size, 0), grid->grid_h - 1);
+
+   /* There can't be more neighbors than minutiae in the list. */
+   if(grid->nbrs_alloc < minutiae->num){
+      grid->nbrs_alloc = minutiae->alloc;
+      grid->nbrs = (int *)g_realloc(grid->nbrs,
+                                    grid->nbrs_alloc * sizeof(int));
+   }
+
+   nnbrs = 0;
+   for(gy = max(cy - 1, 0); gy <= min(cy + 1, grid->grid_h - 1); gy++){
+      for(gx = max(cx - 1, 0); gx <= min(cx + 1, grid->grid_w - 1); gx++){
+         cell = (gy * grid->grid_w) + gx;
+         /* Insert the cell's indices keeping the result sorted. */
+         for(n = 0; n < grid->nums[cell]; n++){
+            index = grid->cells[cell][n];
+            for(i = nnbrs; (i > 0) && (grid->nbrs[i-1] > index); i--)
+               ;
+            for(j = nnbrs; j > i; j--)
+               grid->nbrs[j] = grid->nbrs[j-1];
+            grid->nbrs[i] = index;
+            nnbrs++;
+         }
+      }
+   }
+
+   *onbrs = grid->nbrs;
+   return(nnbrs);
+}
+
 /*************************************************************************
 **************************************************************************
 #cat: detect_minutiae - Takes a binary image and its associated IMAP and
@@ -226,11 +415,23 @@ int detect_minutiae_V2(MINUTIAE *minutiae,
       return(ret);
    }
 
+   /* Index the detected points by location, so that duplicates can */
+   /* be found among the close ones only.                           */
+   if(lfsparms->use_minutiae_grid &&
+      (ret = alloc_minutiae_grid(minutiae, iw, ih,
+                                 lfsparms->max_minutia_delta))){
+      g_free(pdirection_map);
+      g_free(plow_flow_map);
+      g_free(phigh_curve_map);
+      return(ret);
+   }
+
    if((ret = scan4minutiae_horizontally_V2(minutiae, bdata, iw, ih,
                  pdirection_map, plow_flow_map, phigh_curve_map, lfsparms))){
       g_free(pdirection_map);
       g_free(plow_flow_map);
       g_free(phigh_curve_map);
+      free_minutiae_grid(minutiae);
       return(ret);
    }
 
@@ -239,6 +440,7 @@ int detect_minutiae_V2(MINUTIAE *minutiae,
       g_free(pdirection_map);
       g_free(plow_flow_map);
       g_free(phigh_curve_map);
+      free_minutiae_grid(minutiae);
       return(ret);
    }
 
@@ -246,6 +448,7 @@ int detect_minutiae_V2(MINUTIAE *minutiae,
    g_free(pdirection_map);
    g_free(plow_flow_map);
    g_free(phigh_curve_map);
+   free_minutiae_grid(minutiae);
 
    /* Return normally. */
    return(0);
@@ -274,8 +477,9 @@ int update_minutiae(MINUTIAE *minutiae, MINUTIA *minutia,
                    unsigned char *bdata, const int iw, const int ih,
                    const LFSPARMS *lfsparms)
 {
-   int i, ret, dy, dx, delta_dir;
+   int i, n, ret, dy, dx, delta_dir;
    int qtr_ndirs, full_ndirs;
+   int *nbrs, nnbrs;
 
    /* Check to see if minutiae list is full ... if so, then extend */
    /* the length of the allocated list of minutia points.          */
@@ -293,10 +497,19 @@ int update_minutiae(MINUTIAE *minutiae, MINUTIA *minutia,
    /* Compute number of directions in full circle. */
    full_ndirs = lfsparms->num_directions<<1;
 
+   /* Only minutiae in neighboring grid cells can be close enough, */
+   /* otherwise the whole list has to be searched.                 */
+   nbrs = (int *)NULL;
+   if(minutiae->grid != (MINUTIAE_GRID *)NULL)
+      nnbrs = minutiae_grid_nbrs(&nbrs, minutiae, minutia->x, minutia->y);
+   else
+      nnbrs = minutiae->num;
+
    /* Is the minutiae list empty? */
-   if(minutiae->num > 0){
+   if(nnbrs > 0){
       /* Foreach minutia stored in the list... */
-      for(i = 0; i < minutiae->num; i++){
+      for(n = 0; n < nnbrs; n++){
+         i = (nbrs != (int *)NULL) ? nbrs[n] : n;
          /* If x distance between new minutia and current list minutia */
          /* are sufficiently close...                                 */
          dx = abs(minutiae->list[i]->x - minutia->x);
@@ -364,6 +577,10 @@ int update_minutiae(MINUTIAE *minutiae, MINUTIA *minutia,
 
    /* Otherwise, assume new minutia is not in the list, so add it. */
    minutiae->list[minutiae->num] = minutia;
+   if(minutiae->grid != (MINUTIAE_GRID *)NULL)
+      minutiae_grid_append(minutiae->grid,
+                           minutiae_grid_cell(minutiae->grid, minutia),
+                           minutiae->num);
    (minutiae->num)++;
 
    /* New minutia was successfully added to the list. */
@@ -398,9 +615,10 @@ int update_minutiae_V2(MINUTIAE *minutiae, MINUTIA *minutia,
                    unsigned char *bdata, const int iw, const int ih,
                    const LFSPARMS *lfsparms)
 {
-   int i, ret, dy, dx, delta_dir;
+   int i, n, ret, dy, dx, delta_dir;
    int qtr_ndirs, full_ndirs;
    int map_scan_dir;
+   int *nbrs, nnbrs;
 
    /* Check to see if minutiae list is full ... if so, then extend */
    /* the length of the allocated list of minutia points.          */
@@ -418,10 +636,20 @@ int update_minutiae_V2(MINUTIAE *minutiae, MINUTIA *minutia,
    /* Compute number of directions in full circle. */
    full_ndirs = lfsparms->num_directions<<1;
 
+   /* Only minutiae in neighboring grid cells can be close enough, */
+   /* otherwise the whole list has to be searched.                 */
+   nbrs = (int *)NULL;
+   if(minutiae->grid != (MINUTIAE_GRID *)NULL)
+      nnbrs = minutiae_grid_nbrs(&nbrs, minutiae, minutia->x, minutia->y);
+   else
+      nnbrs = minutiae->num;
+
    /* Is the minutiae list empty? */
-   if(minutiae->num > 0){
+   if(nnbrs > 0){
       /* Foreach minutia stored in the list (in reverse order) ... */
-      for(i = minutiae->num-1; i >= 0; i--){
+      /* Removing one only shifts the indices not yet visited.     */
+      for(n = nnbrs-1; n >= 0; n--){
+         i = (nbrs != (int *)NULL) ? nbrs[n] : n;
          /* If x distance between new minutia and current list minutia */
          /* are sufficiently close...                                 */
          dx = abs(minutiae->list[i]->x - minutia->x);
@@ -508,6 +736,10 @@ int update_minutiae_V2(MINUTIAE *minutiae, MINUTIA *minutia,
    /* Otherwise, assume new minutia is not in the list, or those that */
    /* were close neighbors were selectively removed, so add it.       */
    minutiae->list[minutiae->num] = minutia;
+   if(minutiae->grid != (MINUTIAE_GRID *)NULL)
+      minutiae_grid_append(minutiae->grid,
+                           minutiae_grid_cell(minutiae->grid, minutia),
+                           minutiae->num);
    (minutiae->num)++;
 
    /* New minutia was successfully added to the list. */
@@ -561,6 +793,8 @@ int sort_minutiae_y_x(MINUTIAE *minutiae, const int iw, const int ih)
    g_free(minutiae->list);
    /* Assign new sorted list of minutia to minutiae list. */
    minutiae->list = newlist;
+   /* The grid indexes the old order. */
+   free_minutiae_grid(minutiae);
 
    /* Free the working memories supporting the sort. */
    g_free(order);
@@ -616,6 +850,8 @@ int sort_minutiae_x_y(MINUTIAE *minutiae, const int iw, const int ih)
    g_free(minutiae->list);
    /* Assign new sorted list of minutia to minutiae list. */
    minutiae->list = newlist;
+   /* The grid indexes the old order. */
+   free_minutiae_grid(minutiae);
 
    /* Free the working memories supporting the sort. */
    g_free(order);
@@ -771,6 +1007,7 @@ void free_minutiae(MINUTIAE *minutiae)
       free_minutia(minutiae->list[i]);
    /* Deallocate list of minutia pointers. */
    g_free(minutiae->list);
+   free_minutiae_grid(minutiae);
 
    /* Deallocate the list structure. */
    g_free(minutiae);
@@ -820,6 +1057,10 @@ int remove_minutia(const int index, MINUTIAE *minutiae)
       return(-380);
    }
 
+   /* Keep the grid in sync with the list. */
+   if(minutiae->grid != (MINUTIAE_GRID *)NULL)
+      minutiae_grid_remove(minutiae->grid, minutiae->list[index], index);
+
    /* Deallocate the minutia structure to be removed. */
    free_minutia(minutiae->list[index]);
 
@@ -305,11 +305,7 @@ int remove_hooks(MINUTIAE *minutiae,
    /* Allocate list of minutia indices that upon completion of testing */
    /* should be removed from the minutiae lists.  Note: That using      */
    /* "calloc" initializes the list to FALSE.                          */
-   to_remove = (int *)calloc(minutiae->num, sizeof(int));
-   if(to_remove == (int *)NULL){
-      fprintf(stderr, "ERROR : remove_hooks : calloc : to_remove\n");
-      return(-640);
-   }
+   to_remove = (int *)g_malloc0(minutiae->num * sizeof(int));
 
    /* Compute number directions in full circle. */
    full_ndirs = lfsparms->num_directions<<1;
@@ -556,12 +552,7 @@ int remove_islands_and_lakes(MINUTIAE *minutiae,
    /* Allocate list of minutia indices that upon completion of testing */
    /* should be removed from the minutiae lists.  Note: That using      */
    /* "calloc" initializes the list to FALSE.                          */
-   to_remove = (int *)calloc(minutiae->num, sizeof(int));
-   if(to_remove == (int *)NULL){
-      fprintf(stderr,
-              "ERROR : remove_islands_and_lakes : calloc : to_remove\n");
-      return(-610);
-   }
+   to_remove = (int *)g_malloc0(minutiae->num * sizeof(int));
 
    /* Compute number directions in full circle. */
    full_ndirs = lfsparms->num_directions<<1;
@@ -1380,13 +1371,13 @@ int remove_perimeter_pts(MINUTIAE *minutiae,
     if (!lfsparms->remove_perimeter_pts)
         return(0);
 
-    to_remove = calloc(minutiae->num, sizeof(int));
-    left = calloc(ih, sizeof(int));
-    left_up = calloc(ih, sizeof(int));
-    left_down = calloc(ih, sizeof(int));
-    right = calloc(ih, sizeof(int));
-    right_up = calloc(ih, sizeof(int));
-    right_down = calloc(ih, sizeof(int));
+    to_remove = g_malloc0(minutiae->num * sizeof(int));
+    left = g_malloc0(ih * sizeof(int));
+    left_up = g_malloc0(ih * sizeof(int));
+    left_down = g_malloc0(ih * sizeof(int));
+    right = g_malloc0(ih * sizeof(int));
+    right_up = g_malloc0(ih * sizeof(int));
+    right_down = g_malloc0(ih * sizeof(int));
 
     /* Pass downwards */
     left_min = iw - 1;
@@ -1454,10 +1445,10 @@ int remove_perimeter_pts(MINUTIAE *minutiae,
         else
             right[i] = right_up[i];
     }
-    free(left_up);
-    free(left_down);
-    free(right_up);
-    free(right_down);
+    g_free(left_up);
+    g_free(left_down);
+    g_free(right_up);
+    g_free(right_down);
 
     /* Mark minitiae close to the edge */
     for (i = 0; i < ih; i++) {
@@ -1467,8 +1458,8 @@ int remove_perimeter_pts(MINUTIAE *minutiae,
             mark_minutiae_in_range(minutiae, to_remove, right[i], i, lfsparms);
     }
 
-    free(left);
-    free(right);
+    g_free(left);
+    g_free(right);
 
     for (i = minutiae->num - 1; i >= 0; i--) {
         /* If the current minutia index is flagged for removal ... */
@@ -1476,13 +1467,13 @@ int remove_perimeter_pts(MINUTIAE *minutiae,
             removed ++;
             /* Remove the minutia from the minutiae list. */
             if((ret = remove_minutia(i, minutiae))){
-                free(to_remove);
+                g_free(to_remove);
                 return(ret);
             }
         }
     }
 
-    free(to_remove);
+    g_free(to_remove);
 
     return (0);
 }
@@ -1523,11 +1514,7 @@ int remove_overlaps(MINUTIAE *minutiae,
    /* Allocate list of minutia indices that upon completion of testing */
    /* should be removed from the minutiae lists.  Note: That using      */
    /* "calloc" initializes the list to FALSE.                          */
-   to_remove = (int *)calloc(minutiae->num, sizeof(int));
-   if(to_remove == (int *)NULL){
-      fprintf(stderr, "ERROR : remove_overlaps : calloc : to_remove\n");
-      return(-650);
-   }
+   to_remove = (int *)g_malloc0(minutiae->num * sizeof(int));
 
    /* Compute number directions in full circle. */
    full_ndirs = lfsparms->num_directions<<1;
@@ -71,6 +71,128 @@ of the software.
 #include <lfs.h>
 #include <log.h>
 
+/* Smallest grid cell (in pixels) used to look up neighbors. */
+#define MIN_NBR_CELL_SIZE 8
+
+/* Number of trajectory pixels ridge_count() can hold without allocating. */
+#define RIDGE_LINE_PIXELS 256
+
+/* Same as find_transition(), but on the pixel values already read along */
+/* the trajectory.                                                       */
+static int find_pixel_transition(int *iptr, const unsigned char pix1,
+                                 const unsigned char pix2,
+                                 const unsigned char *pixels, const int num)
+{
+   int i;
+
+   for(i = *iptr; i < num-1; i++){
+      if((pixels[i] == pix1) && (pixels[i+1] == pix2)){
+         *iptr = i+1;
+         return(TRUE);
+      }
+   }
+
+   *iptr = num;
+   return(FALSE);
+}
+
+static void free_line_pixels(unsigned char *pixels,
+                             unsigned char *line_pixels)
+{
+   if(pixels != line_pixels)
+      g_free(pixels);
+}
+
+/* Inserts a neighbor keeping the lists ordered on squared distance and */
+/* then on index, which is the order the column-wise search finds them */
+/* in.  Returns the new number of neighbors.                            */
+static int insert_grid_neighbor(const int second, const double dist2,
+                                int *nbr_list, double *nbr_sqr_dists,
+                                const int nnbrs, const int max_nbrs)
+{
+   int pos, i;
+
+   for(pos = 0; pos < nnbrs; pos++)
+      if((dist2 < nbr_sqr_dists[pos]) ||
+         ((dist2 == nbr_sqr_dists[pos]) && (second < nbr_list[pos])))
+         break;
+
+   /* Not closer than any of a full list. */
+   if(pos >= max_nbrs)
+      return(nnbrs);
+
+   for(i = min(nnbrs, max_nbrs-1); i > pos; i--){
+      nbr_list[i] = nbr_list[i-1];
+      nbr_sqr_dists[i] = nbr_sqr_dists[i-1];
+   }
+   nbr_list[pos] = second;
+   nbr_sqr_dists[pos] = dist2;
+
+   return(min(nnbrs+1, max_nbrs));
+}
+
+/* Finds the same neighbors as the column-wise search in find_neighbors(), */
+/* the closest minutiae after the primary one in the list.  Rings of grid  */
+/* cells are searched outward until no point in the next ring can be as    */
+/* close as the farthest neighbor found.  As the list is sorted on x, only */
+/* the cells in and right of the primary's column need to be searched.     */
+static int find_grid_neighbors(int *nbr_list, double *nbr_sqr_dists,
+                               const int max_nbrs, const int first,
+                               MINUTIAE *minutiae)
+{
+   MINUTIAE_GRID *grid = minutiae->grid;
+   MINUTIA *minutia1, *minutia2;
+   int cx, cy, gx, gy, gx_start, gx_step, cell, r, max_r;
+   int n, second, nnbrs;
+   double dist2, bound;
+
+   minutia1 = minutiae->list[first];
+   cx = min(minutia1->x / grid->cell_size, grid->grid_w - 1);
+   cy = min(minutia1->y / grid->cell_size, grid->grid_h - 1);
+   max_r = max(grid->grid_w - 1 - cx, max(cy, grid->grid_h - 1 - cy));
+
+   nnbrs = 0;
+   for(r = 0; r <= max_r; r++){
+      /* Points in ring r are at least this far away in x or y. */
+      if((r > 0) && (nnbrs == max_nbrs)){
+         bound = (double)(((r-1) * grid->cell_size) + 1);
+         if(bound * bound > nbr_sqr_dists[max_nbrs-1])
+            break;
+      }
+
+      for(gy = max(cy - r, 0); gy <= min(cy + r, grid->grid_h - 1); gy++){
+         /* Top and bottom rows of the ring are searched completely, */
+         /* the others only in the ring's right column.               */
+         if(abs(gy - cy) == r){
+            gx_start = cx;
+            gx_step = 1;
+         }
+         else{
+            gx_start = cx + r;
+            gx_step = r + 1;
+         }
+
+         for(gx = gx_start; (gx <= cx + r) && (gx < grid->grid_w);
+             gx += gx_step){
+            cell = (gy * grid->grid_w) + gx;
+            for(n = 0; n < grid->nums[cell]; n++){
+               second = grid->cells[cell][n];
+               if(second <= first)
+                  continue;
+
+               minutia2 = minutiae->list[second];
+               dist2 = squared_distance(minutia1->x, minutia1->y,
+                                        minutia2->x, minutia2->y);
+               nnbrs = insert_grid_neighbor(second, dist2, nbr_list,
+                                            nbr_sqr_dists, nnbrs, max_nbrs);
+            }
+         }
+      }
+   }
+
+   return(nnbrs);
+}
+
 /*************************************************************************
 **************************************************************************
 #cat: count_minutiae_ridges - Takes a list of minutiae, and for each one,
@@ -95,7 +217,7 @@ int count_minutiae_ridges(MINUTIAE *minutiae,
                       const LFSPARMS *lfsparms)
 {
    int ret;
-   int i;
+   int i, cell_size;
 
    print2log("\nFINDING NBRS AND COUNTING RIDGES:\n");
 
@@ -109,16 +231,35 @@ int count_minutiae_ridges(MINUTIAE *minutiae,
       return(ret);
    }
 
+   /* The sort ranks points on x*iw+y, so the list is only ordered on */
+   /* x then y if all points lie above y == iw.  Only then can the    */
+   /* neighbors be looked up by location instead of scanning columns. */
+   for(i = 0; (i < minutiae->num) && (minutiae->list[i]->y < iw); i++)
+      ;
+   if(lfsparms->use_minutiae_grid &&
+      (minutiae->num > 1) && (i == minutiae->num)){
+      /* Size the cells to hold a few neighbors each on average. */
+      cell_size = (int)sqrt((double)iw * ih * lfsparms->max_nbrs /
+                            minutiae->num);
+      if((ret = alloc_minutiae_grid(minutiae, iw, ih,
+                                    max(cell_size, MIN_NBR_CELL_SIZE)))){
+         return(ret);
+      }
+   }
+
    /* Foreach remaining sorted minutia in list ... */
    for(i = 0; i < minutiae->num-1; i++){
       /* Located neighbors and count number of ridges in between. */
       /* NOTE: neighbor and ridge count results are stored in     */
       /*       minutiae->list[i].                                 */
       if((ret = count_minutia_ridges(i, minutiae, bdata, iw, ih, lfsparms))){
+         free_minutiae_grid(minutiae);
          return(ret);
       }
    }
 
+   free_minutiae_grid(minutiae);
+
    /* Return normally. */
    return(0);
 }
@@ -245,6 +386,14 @@ int find_neighbors(int **onbr_list, int *onnbrs, const int max_nbrs,
    /* Compute location of maximum last stored neighbor. */
    last_nbr = max_nbrs - 1;
 
+   /* If the minutiae are indexed by location, only search the grid */
+   /* cells around the primary minutia.                             */
+   if(minutiae->grid != (MINUTIAE_GRID *)NULL){
+      nnbrs = find_grid_neighbors(nbr_list, nbr_sqr_dists, max_nbrs,
+                                  first, minutiae);
+      second = minutiae->num;
+   }
+
    /* While minutia (in sorted order) still remian for processing ... */
    /* NOTE: The minutia in the input list have been sorted on X and   */
    /* then on Y.  So, the neighbors are selected according to those   */
@@ -505,7 +654,7 @@ int sort_neighbors(int *nbr_list, const int nnbrs, const int first,
    }
 
    /* Sort the neighbor indicies into rank order. */
-   bubble_sort_double_inc_2(join_thetas, nbr_list, nnbrs);
+   stable_sort_double_inc_2(join_thetas, nbr_list, nnbrs);
 
    /* Deallocate the list of angles. */
    g_free(join_thetas);
@@ -537,10 +686,10 @@ int ridge_count(const int first, const int second, MINUTIAE *minutiae,
                 const LFSPARMS *lfsparms)
 {
    MINUTIA *minutia1, *minutia2;
-   int i, ret, found;
+   int i, ret;
    int *xlist, *ylist, num;
    int ridge_count, ridge_start, ridge_end;
-   int prevpix, curpix;
+   unsigned char line_pixels[RIDGE_LINE_PIXELS], *pixels;
 
    minutia1 = minutiae->list[first];
    minutia2 = minutiae->list[second];
@@ -566,22 +715,23 @@ int ridge_count(const int first, const int second, MINUTIAE *minutiae,
       return(0);
    }
 
+   /* Read the pixels along the trajectory once, so that transitions */
+   /* are searched for in contiguous memory.                         */
+   if(num <= RIDGE_LINE_PIXELS)
+      pixels = line_pixels;
+   else
+      pixels = (unsigned char *)g_malloc(num);
+   for(i = 0; i < num; i++)
+      pixels[i] = *(bdata+(ylist[i]*iw)+xlist[i]);
+
    /* Find first pixel opposite type along linear trajectory from */
    /* first minutia.                                              */
-   prevpix = *(bdata+(ylist[0]*iw)+xlist[0]);
-   i = 1;
-   found = FALSE;
-   while(i < num){
-      curpix = *(bdata+(ylist[i]*iw)+xlist[i]);
-      if(curpix != prevpix){
-         found = TRUE;
-         break;
-      }
-      i++;
-   }
+   for(i = 1; (i < num) && (pixels[i] == pixels[0]); i++)
+      ;
 
    /* If opposite pixel not found ... then no ridges to count */
-   if(!found){
+   if(i == num){
+      free_line_pixels(pixels, line_pixels);
       g_free(xlist);
       g_free(ylist);
       return(0);
@@ -596,8 +746,9 @@ int ridge_count(const int first, const int second, MINUTIAE *minutiae,
    /* While not at the end of the trajectory ... */
    while(i < num){
       /* If 0-to-1 transition not found ... */
-      if(!find_transition(&i, 0, 1, xlist, ylist, num, bdata, iw, ih)){
+      if(!find_pixel_transition(&i, 0, 1, pixels, num)){
          /* Then we are done looking for ridges. */
+         free_line_pixels(pixels, line_pixels);
          g_free(xlist);
          g_free(ylist);
 
@@ -613,8 +764,9 @@ int ridge_count(const int first, const int second, MINUTIAE *minutiae,
       print2log(": RS %d,%d ", xlist[i], ylist[i]);
 
       /* If 1-to-0 transition not found ... */
-      if(!find_transition(&i, 1, 0, xlist, ylist, num, bdata, iw, ih)){
+      if(!find_pixel_transition(&i, 1, 0, pixels, num)){
          /* Then we are done looking for ridges. */
+         free_line_pixels(pixels, line_pixels);
          g_free(xlist);
          g_free(ylist);
 
@@ -642,6 +794,7 @@ int ridge_count(const int first, const int second, MINUTIAE *minutiae,
 
       /* If system error ... */
       if(ret < 0){
+         free_line_pixels(pixels, line_pixels);
          g_free(xlist);
          g_free(ylist);
          /* Return the error code. */
@@ -662,6 +815,7 @@ int ridge_count(const int first, const int second, MINUTIAE *minutiae,
    }
 
    /* Deallocate working memories. */
+   free_line_pixels(pixels, line_pixels);
    g_free(xlist);
    g_free(ylist);
 
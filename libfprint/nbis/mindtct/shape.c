@@ -259,9 +259,7 @@ int shape_from_contour(SHAPE **oshape, const int *contour_x,
 **************************************************************************/
 void sort_row_on_x(ROW *row)
 {
-   /* Conduct a simple increasing bubble sort on the x-coords */
-   /* in the given row.  A bubble sort is satisfactory as the */
-   /* number of points will be relatively small.              */
-   bubble_sort_int_inc(row->xs, row->npts);
+   /* Sort the x-coords in the given row into increasing order. */
+   stable_sort_int_inc(row->xs, row->npts);
 }
 
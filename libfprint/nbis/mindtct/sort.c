@@ -57,15 +57,191 @@ of the software.
                ROUTINES:
                         sort_indices_int_inc()
                         sort_indices_double_inc()
-                        bubble_sort_int_inc_2()
-                        bubble_sort_double_inc_2()
-                        bubble_sort_double_dec_2()
-                        bubble_sort_int_inc()
+                        stable_sort_int_inc_2()
+                        stable_sort_double_inc_2()
+                        stable_sort_double_dec_2()
+                        stable_sort_int_inc()
 ***********************************************************************/
 
 #include <stdio.h>
 #include <lfs.h>
 
+/* The stable sorts below all share one in-place merge sort (SymMerge by */
+/* Kim and Kutzner), which needs no memory beyond a recursion depth of   */
+/* log2(len).  Ranks are moved only when strictly out of order, so equal */
+/* ranks keep their relative order.  Either iranks or dranks is set, and */
+/* items is optional.                                                    */
+typedef struct sort_lists{
+   int *iranks;
+   double *dranks;
+   int *items;
+   int decreasing;
+} SORT_LISTS;
+
+/* Number of ranks sorted by insertion before merging. */
+#define SORT_BLOCK_SIZE 20
+
+/* Returns TRUE if rank i has to go before rank j. */
+static inline int sort_less(const SORT_LISTS *lists, const int i, const int j)
+{
+   if(lists->iranks != (int *)NULL)
+      return(lists->iranks[i] < lists->iranks[j]);
+   if(lists->decreasing)
+      return(lists->dranks[i] > lists->dranks[j]);
+   return(lists->dranks[i] < lists->dranks[j]);
+}
+
+static inline void sort_swap(const SORT_LISTS *lists, const int i, const int j)
+{
+   int titem;
+   double trank;
+
+   if(lists->iranks != (int *)NULL){
+      titem = lists->iranks[i];
+      lists->iranks[i] = lists->iranks[j];
+      lists->iranks[j] = titem;
+   }
+   else{
+      trank = lists->dranks[i];
+      lists->dranks[i] = lists->dranks[j];
+      lists->dranks[j] = trank;
+   }
+
+   if(lists->items != (int *)NULL){
+      titem = lists->items[i];
+      lists->items[i] = lists->items[j];
+      lists->items[j] = titem;
+   }
+}
+
+static void sort_insertion(const SORT_LISTS *lists, const int a, const int b)
+{
+   int i, j;
+
+   for(i = a+1; i < b; i++)
+      for(j = i; (j > a) && sort_less(lists, j, j-1); j--)
+         sort_swap(lists, j, j-1);
+}
+
+/* Exchanges the n entries starting at a with those starting at b. */
+static void sort_swap_range(const SORT_LISTS *lists, const int a,
+                            const int b, const int n)
+{
+   int i;
+
+   for(i = 0; i < n; i++)
+      sort_swap(lists, a+i, b+i);
+}
+
+/* Rotates [a,b) so that the entries starting at m move to a. */
+static void sort_rotate(const SORT_LISTS *lists, const int a, const int m,
+                        const int b)
+{
+   int i, j;
+
+   i = m - a;
+   j = b - m;
+   while(i != j){
+      if(i > j){
+         sort_swap_range(lists, m-i, m, j);
+         i -= j;
+      }
+      else{
+         sort_swap_range(lists, m-i, m+j-i, i);
+         j -= i;
+      }
+   }
+   sort_swap_range(lists, m-i, m, i);
+}
+
+/* Merges the sorted runs [a,m) and [m,b) in place. */
+static void sort_sym_merge(const SORT_LISTS *lists, const int a, const int m,
+                           const int b)
+{
+   int i, j, h, k, mid, n, start, r, c, p, end;
+
+   /* Insert a single leading entry after all ranks not after it. */
+   if(m-a == 1){
+      i = m;
+      j = b;
+      while(i < j){
+         h = (int)(((unsigned int)(i+j)) >> 1);
+         if(sort_less(lists, h, a))
+            i = h+1;
+         else
+            j = h;
+      }
+      for(k = a; k < i-1; k++)
+         sort_swap(lists, k, k+1);
+      return;
+   }
+
+   /* Insert a single trailing entry before all ranks after it. */
+   if(b-m == 1){
+      i = a;
+      j = m;
+      while(i < j){
+         h = (int)(((unsigned int)(i+j)) >> 1);
+         if(!sort_less(lists, m, h))
+            i = h+1;
+         else
+            j = h;
+      }
+      for(k = m; k > i; k--)
+         sort_swap(lists, k, k-1);
+      return;
+   }
+
+   mid = (int)(((unsigned int)(a+b)) >> 1);
+   n = mid + m;
+   if(m > mid){
+      start = n - b;
+      r = mid;
+   }
+   else{
+      start = a;
+      r = m;
+   }
+   p = n - 1;
+
+   while(start < r){
+      c = (int)(((unsigned int)(start+r)) >> 1);
+      if(!sort_less(lists, p-c, c))
+         start = c+1;
+      else
+         r = c;
+   }
+
+   end = n - start;
+   if((start < m) && (m < end))
+      sort_rotate(lists, start, m, end);
+   if((a < start) && (start < mid))
+      sort_sym_merge(lists, a, start, mid);
+   if((mid < end) && (end < b))
+      sort_sym_merge(lists, mid, end, b);
+}
+
+static void sort_stable(const SORT_LISTS *lists, const int len)
+{
+   int a, b, m, block_size;
+
+   /* Sort small blocks by insertion ... */
+   block_size = SORT_BLOCK_SIZE;
+   for(a = 0, b = block_size; b <= len; a = b, b += block_size)
+      sort_insertion(lists, a, b);
+   sort_insertion(lists, a, len);
+
+   /* ... and merge them pairwise into ever larger ones. */
+   while(block_size < len){
+      for(a = 0, b = 2*block_size; b <= len; a = b, b += 2*block_size)
+         sort_sym_merge(lists, a, a+block_size, b);
+      m = a + block_size;
+      if(m < len)
+         sort_sym_merge(lists, a, m, len);
+      block_size *= 2;
+   }
+}
+
 /*************************************************************************
 **************************************************************************
 #cat: sort_indices_int_inc - Takes a list of integers and returns a list of
@@ -95,7 +271,7 @@ int sort_indices_int_inc(int **optr, int *ranks, const int num)
       order[i] = i;
 
    /* Sort the indecies into rank order. */
-   bubble_sort_int_inc_2(ranks, order, num);
+   stable_sort_int_inc_2(ranks, order, num);
 
    /* Set output pointer to the resulting order of sorted indices. */
    *optr = order;
@@ -123,10 +299,10 @@ int sort_indices_int_inc(int **optr, int *ranks, const int num)
 
 /*************************************************************************
 **************************************************************************
-#cat: bubble_sort_int_inc_2 - Takes a list of integer ranks and a corresponding
+#cat: stable_sort_int_inc_2 - Takes a list of integer ranks and a corresponding
 #cat:                         list of integer attributes, and sorts the ranks
 #cat:                         into increasing order moving the attributes
-#cat:                         correspondingly.
+#cat:                         correspondingly.  Equal ranks keep their order.
 
    Input:
       ranks     - list of integers to be sort on
@@ -136,48 +312,19 @@ int sort_indices_int_inc(int **optr, int *ranks, const int num)
       ranks     - list of integers sorted in increasing order
       items     - list of attributes in corresponding sorted order
 **************************************************************************/
-void bubble_sort_int_inc_2(int *ranks, int *items, const int len)
+void stable_sort_int_inc_2(int *ranks, int *items, const int len)
 {
-   int done = 0;
-   int i, p, n, trank, titem;
-
-   /* Set counter to the length of the list being sorted. */
-   n = len;
-
-   /* While swaps in order continue to occur from the */
-   /* previous iteration...                           */
-   while(!done){
-      /* Reset the done flag to TRUE. */
-      done = TRUE;
-      /* Foreach rank in list up to current end index...               */
-      /* ("p" points to current rank and "i" points to the next rank.) */
-      for (i=1, p = 0; i<n; i++, p++){
-         /* If previous rank is < current rank ... */
-         if(ranks[p] > ranks[i]){
-            /* Swap ranks. */
-            trank = ranks[i];
-            ranks[i] = ranks[p];
-            ranks[p] = trank;
-            /* Swap items. */
-            titem = items[i];
-            items[i] = items[p];
-            items[p] = titem;
-            /* Changes were made, so set done flag to FALSE. */
-            done = FALSE;
-         }
-         /* Otherwise, rank pair is in order, so continue. */
-      }
-      /* Decrement the ending index. */
-      n--;
-   }
+   SORT_LISTS lists = { ranks, (double *)NULL, items, FALSE };
+
+   sort_stable(&lists, len);
 }
 
 /*************************************************************************
 **************************************************************************
-#cat: bubble_sort_double_inc_2 - Takes a list of double ranks and a
+#cat: stable_sort_double_inc_2 - Takes a list of double ranks and a
 #cat:              corresponding list of integer attributes, and sorts the
 #cat:              ranks into increasing order moving the attributes
-#cat:              correspondingly.
+#cat:              correspondingly.  Equal ranks keep their order.
 
    Input:
       ranks     - list of double to be sort on
@@ -187,48 +334,18 @@ void bubble_sort_int_inc_2(int *ranks, int *items, const int len)
       ranks     - list of doubles sorted in increasing order
       items     - list of attributes in corresponding sorted order
 **************************************************************************/
-void bubble_sort_double_inc_2(double *ranks, int *items, const int len)
+void stable_sort_double_inc_2(double *ranks, int *items, const int len)
 {
-   int done = 0;
-   int i, p, n, titem;
-   double trank;
+   SORT_LISTS lists = { (int *)NULL, ranks, items, FALSE };
 
-   /* Set counter to the length of the list being sorted. */
-   n = len;
-
-   /* While swaps in order continue to occur from the */
-   /* previous iteration...                           */
-   while(!done){
-      /* Reset the done flag to TRUE. */
-      done = TRUE;
-      /* Foreach rank in list up to current end index...               */
-      /* ("p" points to current rank and "i" points to the next rank.) */
-      for (i=1, p = 0; i<n; i++, p++){
-         /* If previous rank is < current rank ... */
-         if(ranks[p] > ranks[i]){
-            /* Swap ranks. */
-            trank = ranks[i];
-            ranks[i] = ranks[p];
-            ranks[p] = trank;
-            /* Swap items. */
-            titem = items[i];
-            items[i] = items[p];
-            items[p] = titem;
-            /* Changes were made, so set done flag to FALSE. */
-            done = FALSE;
-         }
-         /* Otherwise, rank pair is in order, so continue. */
-      }
-      /* Decrement the ending index. */
-      n--;
-   }
+   sort_stable(&lists, len);
 }
 
 /***************************************************************************
 **************************************************************************
-#cat: bubble_sort_double_dec_2 - Conducts a simple bubble sort returning a list
-#cat:        of ranks in decreasing order and their associated items in sorted
-#cat:        order as well.
+#cat: stable_sort_double_dec_2 - Sorts a list of ranks into decreasing order
+#cat:        and their associated items into the same order.  Equal ranks
+#cat:        keep their order.
 
    Input:
       ranks - list of values to be sorted
@@ -240,37 +357,17 @@ void bubble_sort_double_inc_2(double *ranks, int *items, const int len)
               If these items are indices, upon return, they may be used as
               indirect addresses reflecting the sorted order of the ranks.
 ****************************************************************************/
-void bubble_sort_double_dec_2(double *ranks, int *items,  const int len)
+void stable_sort_double_dec_2(double *ranks, int *items,  const int len)
 {
-   int done = 0;
-   int i, p, n, titem;
-   double trank;
+   SORT_LISTS lists = { (int *)NULL, ranks, items, TRUE };
 
-   n = len;
-   while(!done){
-      done = 1;
-      for (i=1, p = 0;i<n;i++, p++){
-         /* If previous rank is < current rank ... */
-         if(ranks[p] < ranks[i]){
-            /* Swap ranks */
-            trank = ranks[i];
-            ranks[i] = ranks[p];
-            ranks[p] = trank;
-            /* Swap corresponding items */
-            titem = items[i];
-            items[i] = items[p];
-            items[p] = titem;
-            done = 0;
-         }
-      }
-      n--;
-   }
+   sort_stable(&lists, len);
 }
 
 /*************************************************************************
 **************************************************************************
-#cat: bubble_sort_int_inc - Takes a list of integers and sorts them into
-#cat:            increasing order using a simple bubble sort.
+#cat: stable_sort_int_inc - Takes a list of integers and sorts them into
+#cat:            increasing order.
 
    Input:
       ranks     - list of integers to be sort on
@@ -278,36 +375,9 @@ void bubble_sort_double_dec_2(double *ranks, int *items,  const int len)
    Output:
       ranks     - list of integers sorted in increasing order
 **************************************************************************/
-void bubble_sort_int_inc(int *ranks, const int len)
+void stable_sort_int_inc(int *ranks, const int len)
 {
-   int done = 0;
-   int i, p, n;
-   int trank;
-
-   /* Set counter to the length of the list being sorted. */
-   n = len;
-
-   /* While swaps in order continue to occur from the */
-   /* previous iteration...                           */
-   while(!done){
-      /* Reset the done flag to TRUE. */
-      done = TRUE;
-      /* Foreach rank in list up to current end index...               */
-      /* ("p" points to current rank and "i" points to the next rank.) */
-      for (i=1, p = 0; i<n; i++, p++){
-         /* If previous rank is < current rank ... */
-         if(ranks[p] > ranks[i]){
-            /* Swap ranks. */
-            trank = ranks[i];
-            ranks[i] = ranks[p];
-            ranks[p] = trank;
-            /* Changes were made, so set done flag to FALSE. */
-            done = FALSE;
-         }
-         /* Otherwise, rank pair is in order, so continue. */
-      }
-      /* Decrement the ending index. */
-      n--;
-   }
-}
+   SORT_LISTS lists = { ranks, (double *)NULL, (int *)NULL, FALSE };
 
+   sort_stable(&lists, len);
+}
@@ -0,0 +1,383 @@
+/*
+ * Extraction scoped allocator for the NBIS copy/paste library
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <string.h>
+#include <lfs.h>
+
+/*
+ * A single minutiae extraction does thousands of small allocations (minutiae,
+ * contours, neighbour lists, removal flags, ...). Within the library the GLib
+ * allocation functions are redirected here, and between nbis_arena_begin()
+ * and nbis_arena_end() small blocks are bumped out of per-thread chunks
+ * instead of going through the system allocator. Freeing the most recent
+ * block rolls the chunk back, other frees are deferred until the arena ends.
+ *
+ * Large blocks (images and maps) always come from the heap, and outside of an
+ * extraction everything behaves like the plain GLib functions. Anything that
+ * has to outlive the extraction must be passed through nbis_arena_steal()
+ * before the arena ends.
+ *
+ * The arena is kept around for the thread, so worker threads that run
+ * extractions repeatedly only allocate chunks for their first captures.
+ */
+
+/* Alignment of every block, large enough for doubles and pointers */
+#define NBIS_ARENA_ALIGN 16
+#define NBIS_ARENA_CHUNK_SIZE (256 * 1024)
+/* Larger blocks come from the heap, so every block fits into a new chunk */
+#define NBIS_ARENA_MAX_BLOCK (32 * 1024)
+/* Chunks kept for the next extraction on this thread */
+#define NBIS_ARENA_KEEP_CHUNKS 8
+
+typedef struct _NbisArenaChunk NbisArenaChunk;
+
+struct _NbisArenaChunk
+{
+  NbisArenaChunk *next;
+  gsize           used;
+  gsize           last;
+};
+
+typedef struct
+{
+  /* Chunks in use, the current one first */
+  NbisArenaChunk *chunks;
+  /* Empty chunks ready to be used */
+  NbisArenaChunk *spare;
+  gboolean        active;
+} NbisArena;
+
+/* Every block is preceded by its size */
+typedef union
+{
+  gsize  size;
+  guint8 padding[NBIS_ARENA_ALIGN];
+} NbisArenaBlock;
+
+#define CHUNK_HEADER_SIZE \
+  ((sizeof (NbisArenaChunk) + NBIS_ARENA_ALIGN - 1) & ~(NBIS_ARENA_ALIGN - 1))
+#define CHUNK_DATA(chunk) ((guint8 *) (chunk) + CHUNK_HEADER_SIZE)
+
+static void
+nbis_arena_free_chunks (NbisArenaChunk *chunk)
+{
+  while (chunk)
+    {
+      NbisArenaChunk *next = chunk->next;
+
+      (g_free) (chunk);
+      chunk = next;
+    }
+}
+
+static void
+nbis_arena_free (NbisArena *arena)
+{
+  nbis_arena_free_chunks (arena->chunks);
+  nbis_arena_free_chunks (arena->spare);
+  (g_free) (arena);
+}
+
+static GPrivate nbis_arena_private = G_PRIVATE_INIT ((GDestroyNotify) nbis_arena_free);
+
+static NbisArena *
+nbis_arena_get_active (void)
+{
+  NbisArena *arena = g_private_get (&nbis_arena_private);
+
+  if (arena && arena->active)
+    return arena;
+
+  return NULL;
+}
+
+static NbisArenaBlock *
+nbis_arena_find_block (NbisArena *arena, gconstpointer mem)
+{
+  NbisArenaChunk *chunk;
+  const guint8 *ptr = mem;
+
+  for (chunk = arena->chunks; chunk; chunk = chunk->next)
+    if (ptr > CHUNK_DATA (chunk) && ptr < CHUNK_DATA (chunk) + chunk->used)
+      return (NbisArenaBlock *) ptr - 1;
+
+  return NULL;
+}
+
+static gpointer
+nbis_arena_alloc (NbisArena *arena, gsize size)
+{
+  NbisArenaChunk *chunk = arena->chunks;
+  gsize needed;
+  NbisArenaBlock *block;
+
+  needed = sizeof (NbisArenaBlock) +
+           ((size + NBIS_ARENA_ALIGN - 1) & ~(gsize) (NBIS_ARENA_ALIGN - 1));
+
+  if (!chunk || chunk->used + needed > NBIS_ARENA_CHUNK_SIZE)
+    {
+      if (arena->spare)
+        {
+          chunk = arena->spare;
+          arena->spare = chunk->next;
+        }
+      else
+        {
+          chunk = (g_malloc) (CHUNK_HEADER_SIZE + NBIS_ARENA_CHUNK_SIZE);
+        }
+
+      chunk->used = 0;
+      chunk->last = 0;
+      chunk->next = arena->chunks;
+      arena->chunks = chunk;
+    }
+
+  block = (NbisArenaBlock *) (CHUNK_DATA (chunk) + chunk->used);
+  block->size = size;
+  chunk->last = chunk->used;
+  chunk->used += needed;
+
+  return block + 1;
+}
+
+/**
+ * nbis_arena_begin:
+ *
+ * Starts serving small allocations made by the library on the calling
+ * thread from the thread's arena.
+ */
+void
+nbis_arena_begin (void)
+{
+  NbisArena *arena = g_private_get (&nbis_arena_private);
+
+  if (!arena)
+    {
+      arena = (g_malloc0) (sizeof (NbisArena));
+      g_private_set (&nbis_arena_private, arena);
+    }
+
+  g_return_if_fail (!arena->active);
+  arena->active = TRUE;
+}
+
+/**
+ * nbis_arena_end:
+ *
+ * Releases every block allocated from the arena since nbis_arena_begin(),
+ * blocks that are still needed must have been stolen before.
+ */
+void
+nbis_arena_end (void)
+{
+  NbisArena *arena = nbis_arena_get_active ();
+  NbisArenaChunk *chunk;
+  guint kept = 0;
+
+  g_return_if_fail (arena != NULL);
+
+  for (chunk = arena->spare; chunk; chunk = chunk->next)
+    kept++;
+
+  while (arena->chunks)
+    {
+      chunk = arena->chunks;
+      arena->chunks = chunk->next;
+
+      if (kept < NBIS_ARENA_KEEP_CHUNKS)
+        {
+          chunk->next = arena->spare;
+          arena->spare = chunk;
+          kept++;
+        }
+      else
+        {
+          (g_free) (chunk);
+        }
+    }
+
+  arena->active = FALSE;
+}
+
+/**
+ * nbis_arena_steal:
+ * @mem: (nullable): memory allocated by the library
+ *
+ * Moves a block out of the active arena, so that it can be used after
+ * nbis_arena_end() and released with g_free().
+ *
+ * Returns: (transfer full): a heap copy of @mem, or @mem itself if it does
+ *   not belong to the arena
+ */
+gpointer
+nbis_arena_steal (gpointer mem)
+{
+  NbisArena *arena = nbis_arena_get_active ();
+  NbisArenaBlock *block;
+
+  if (!arena || !mem)
+    return mem;
+
+  block = nbis_arena_find_block (arena, mem);
+  if (!block)
+    return mem;
+
+  return g_memdup2 (mem, block->size);
+}
+
+/**
+ * nbis_arena_steal_minutiae:
+ * @minutiae: (transfer full): minutiae detected by get_minutiae()
+ *
+ * Moves the minutiae and everything they reference out of the active arena.
+ *
+ * Returns: (transfer full): the minutiae, to be freed with free_minutiae()
+ */
+MINUTIAE *
+nbis_arena_steal_minutiae (MINUTIAE *minutiae)
+{
+  int i;
+
+  if (!minutiae)
+    return NULL;
+
+  /* The spatial index only exists while detecting */
+  g_assert (minutiae->grid == NULL);
+
+  minutiae = nbis_arena_steal (minutiae);
+  minutiae->list = nbis_arena_steal (minutiae->list);
+
+  for (i = 0; i < minutiae->num; i++)
+    {
+      MINUTIA *minutia = nbis_arena_steal (minutiae->list[i]);
+
+      minutia->nbrs = nbis_arena_steal (minutia->nbrs);
+      minutia->ridge_counts = nbis_arena_steal (minutia->ridge_counts);
+      minutiae->list[i] = minutia;
+    }
+
+  return minutiae;
+}
+
+gpointer
+nbis_malloc (gsize size)
+{
+  NbisArena *arena;
+
+  if (size == 0 || size > NBIS_ARENA_MAX_BLOCK)
+    return (g_malloc) (size);
+
+  arena = nbis_arena_get_active ();
+  if (!arena)
+    return (g_malloc) (size);
+
+  return nbis_arena_alloc (arena, size);
+}
+
+gpointer
+nbis_malloc0 (gsize size)
+{
+  gpointer mem = nbis_malloc (size);
+
+  if (mem)
+    memset (mem, 0, size);
+
+  return mem;
+}
+
+gpointer
+nbis_realloc (gpointer mem, gsize size)
+{
+  NbisArena *arena = nbis_arena_get_active ();
+  NbisArenaChunk *chunk;
+  NbisArenaBlock *block;
+  gpointer new_mem;
+
+  if (!arena || !mem)
+    return mem ? (g_realloc) (mem, size) : nbis_malloc (size);
+
+  block = nbis_arena_find_block (arena, mem);
+  if (!block)
+    return (g_realloc) (mem, size);
+
+  if (size == 0)
+    {
+      nbis_free (mem);
+      return NULL;
+    }
+
+  /* Grow the most recent block in place if it still fits */
+  chunk = arena->chunks;
+  if ((guint8 *) block == CHUNK_DATA (chunk) + chunk->last &&
+      size <= NBIS_ARENA_MAX_BLOCK)
+    {
+      gsize needed = sizeof (NbisArenaBlock) +
+                     ((size + NBIS_ARENA_ALIGN - 1) & ~(gsize) (NBIS_ARENA_ALIGN - 1));
+
+      if (chunk->last + needed <= NBIS_ARENA_CHUNK_SIZE)
+        {
+          block->size = size;
+          chunk->used = chunk->last + needed;
+          return mem;
+        }
+    }
+
+  if (size <= block->size)
+    {
+      block->size = size;
+      return mem;
+    }
+
+  new_mem = nbis_malloc (size);
+  memcpy (new_mem, mem, block->size);
+  nbis_free (mem);
+
+  return new_mem;
+}
+
+void
+nbis_free (gpointer mem)
+{
+  NbisArena *arena;
+  NbisArenaChunk *chunk;
+  NbisArenaBlock *block;
+
+  if (!mem)
+    return;
+
+  arena = nbis_arena_get_active ();
+  if (!arena)
+    {
+      (g_free) (mem);
+      return;
+    }
+
+  block = nbis_arena_find_block (arena, mem);
+  if (!block)
+    {
+      (g_free) (mem);
+      return;
+    }
+
+  /* Only the most recent block can be given back right away */
+  chunk = arena->chunks;
+  if ((guint8 *) block == CHUNK_DATA (chunk) + chunk->last &&
+      chunk->used > chunk->last)
+    chunk->used = chunk->last;
+}
@@ -20,6 +20,7 @@
 #include <libfprint/fprint.h>
 
 #include "test-utils.h"
+#include "fpi-context.h"
 #include "fpi-device.h"
 
 static void
@@ -383,6 +384,202 @@ test_context_remove_device_active (void)
   fpt_teardown_virtual_device_environment ();
 }
 
+static void
+record_removed_thread_cb (FpDevice *device, GThread **thread)
+{
+  *thread = g_thread_self ();
+}
+
+static void
+record_notify_thread_cb (FpDevice *device, GParamSpec *pspec, GThread **thread)
+{
+  *thread = g_thread_self ();
+}
+
+static void
+test_context_device_threads_remove (void)
+{
+  g_autoptr(FpContext) context = NULL;
+  g_autoptr(GError) error = NULL;
+  FptContext tctx = { 0 };
+  GThread *removed_thread = NULL;
+  GThread *notify_thread = NULL;
+  GPtrArray *devices;
+  gboolean device_threads;
+
+  fpt_setup_virtual_device_environment (FPT_VIRTUAL_DEVICE_IMAGE);
+
+  context = g_object_new (FP_TYPE_CONTEXT, "device-threads", TRUE, NULL);
+  g_object_get (context, "device-threads", &device_threads, NULL);
+  g_assert_true (device_threads);
+
+  devices = fp_context_get_devices (context);
+  g_assert_cmpuint (devices->len, ==, 1);
+
+  tctx.fp_context = context;
+  tctx.device = g_ptr_array_index (devices, 0);
+  g_signal_connect (tctx.device, "removed", (GCallback) device_removed_cb, &tctx);
+  g_signal_connect (context, "device-removed", (GCallback) context_device_removed_cb, &tctx);
+  g_signal_connect (tctx.device, "removed", (GCallback) record_removed_thread_cb, &removed_thread);
+  g_signal_connect (tctx.device, "notify::removed", (GCallback) record_notify_thread_cb, &notify_thread);
+
+  fp_device_open_sync (tctx.device, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_true (fp_device_is_open (tctx.device));
+
+  fp_device_close_sync (tctx.device, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_false (fp_device_is_open (tctx.device));
+
+  /* The removal is handled by the worker, the signals are emitted in the
+   * main context again. */
+  fpi_device_remove (tctx.device);
+
+  while (GPOINTER_TO_INT (tctx.user_data) != CTX_DEVICE_REMOVED_CB)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_true (removed_thread == g_thread_self ());
+  g_assert_true (notify_thread == g_thread_self ());
+
+  g_assert_cmpuint (devices->len, ==, 0);
+
+  fpt_teardown_virtual_device_environment ();
+}
+
+/* USB drivers for the driver index, they are never instantiated */
+typedef FpDevice FptUsbDriverA;
+typedef FpDeviceClass FptUsbDriverAClass;
+typedef FpDevice FptUsbDriverB;
+typedef FpDeviceClass FptUsbDriverBClass;
+typedef FpDevice FptUsbDriverC;
+typedef FpDeviceClass FptUsbDriverCClass;
+
+G_DEFINE_TYPE (FptUsbDriverA, fpt_usb_driver_a, FP_TYPE_DEVICE)
+G_DEFINE_TYPE (FptUsbDriverB, fpt_usb_driver_b, FP_TYPE_DEVICE)
+G_DEFINE_TYPE (FptUsbDriverC, fpt_usb_driver_c, FP_TYPE_DEVICE)
+
+static const FpIdEntry driver_a_ids[] = {
+  { .vid = 0x1234, .pid = 0x0001, .driver_data = 1 },
+  { .vid = 0x1234, .pid = 0x0002, .driver_data = 2 },
+  { .vid = 0,      .pid = 0,      .driver_data = 0 },
+};
+
+static const FpIdEntry driver_b_ids[] = {
+  { .vid = 0x1234, .pid = 0x0002, .driver_data = 3 },
+  { .vid = 0x5678, .pid = 0x0001, .driver_data = 4 },
+  { .vid = 0,      .pid = 0,      .driver_data = 0 },
+};
+
+static const FpIdEntry driver_c_ids[] = {
+  { .vid = 0x1234, .pid = 0x0002, .driver_data = 5 },
+  { .vid = 0x5678, .pid = 0x0001, .driver_data = 6 },
+  { .vid = 0,      .pid = 0,      .driver_data = 0 },
+};
+
+static gint driver_c_score;
+
+static gint
+driver_c_usb_discover (GUsbDevice *device)
+{
+  return driver_c_score;
+}
+
+static void
+fpt_usb_driver_a_init (FptUsbDriverA *self)
+{
+}
+
+static void
+fpt_usb_driver_a_class_init (FptUsbDriverAClass *klass)
+{
+  klass->id = "fpt_usb_driver_a";
+  klass->type = FP_DEVICE_TYPE_USB;
+  klass->id_table = driver_a_ids;
+}
+
+static void
+fpt_usb_driver_b_init (FptUsbDriverB *self)
+{
+}
+
+static void
+fpt_usb_driver_b_class_init (FptUsbDriverBClass *klass)
+{
+  klass->id = "fpt_usb_driver_b";
+  klass->type = FP_DEVICE_TYPE_USB;
+  klass->id_table = driver_b_ids;
+}
+
+static void
+fpt_usb_driver_c_init (FptUsbDriverC *self)
+{
+}
+
+static void
+fpt_usb_driver_c_class_init (FptUsbDriverCClass *klass)
+{
+  klass->id = "fpt_usb_driver_c";
+  klass->type = FP_DEVICE_TYPE_USB;
+  klass->id_table = driver_c_ids;
+  klass->usb_discover = driver_c_usb_discover;
+}
+
+static void
+test_context_usb_driver_index (void)
+{
+  g_autoptr(GArray) drivers = g_array_new (FALSE, FALSE, sizeof (GType));
+  g_autoptr(FpiUsbDriverIndex) index = NULL;
+  GType types[] = {
+    fpt_usb_driver_a_get_type (),
+    fpt_usb_driver_b_get_type (),
+    fpt_usb_driver_c_get_type (),
+  };
+  const FpIdEntry *entry;
+
+  g_array_append_vals (drivers, types, G_N_ELEMENTS (types));
+  index = fpi_usb_driver_index_new (drivers);
+
+  g_assert_cmpuint (fpi_usb_driver_index_lookup (index, NULL, 0x1234, 0x0001, &entry),
+                    ==, types[0]);
+  g_assert_cmpuint (entry->driver_data, ==, 1);
+
+  g_assert_cmpuint (fpi_usb_driver_index_lookup (index, NULL, 0x5678, 0x0002, &entry),
+                    ==, G_TYPE_NONE);
+  g_assert_null (entry);
+
+  /* All drivers tie, the one registered first wins */
+  driver_c_score = 50;
+  g_assert_cmpuint (fpi_usb_driver_index_lookup (index, NULL, 0x1234, 0x0002, &entry),
+                    ==, types[0]);
+  g_assert_cmpuint (entry->driver_data, ==, 2);
+  g_assert_cmpuint (fpi_usb_driver_index_lookup (index, NULL, 0x5678, 0x0001, &entry),
+                    ==, types[1]);
+  g_assert_cmpuint (entry->driver_data, ==, 4);
+
+  /* A higher score wins regardless of the order */
+  driver_c_score = 51;
+  g_assert_cmpuint (fpi_usb_driver_index_lookup (index, NULL, 0x1234, 0x0002, &entry),
+                    ==, types[2]);
+  g_assert_cmpuint (entry->driver_data, ==, 5);
+
+  /* A lower score, or declining the device, leaves it to the others */
+  driver_c_score = 0;
+  g_assert_cmpuint (fpi_usb_driver_index_lookup (index, NULL, 0x5678, 0x0001, &entry),
+                    ==, types[1]);
+  g_assert_cmpuint (entry->driver_data, ==, 4);
+
+  /* The order of the driver list decides ties */
+  g_clear_pointer (&index, fpi_usb_driver_index_free);
+  g_array_remove_index (drivers, 0);
+  g_array_append_val (drivers, types[0]);
+  index = fpi_usb_driver_index_new (drivers);
+
+  driver_c_score = 50;
+  g_assert_cmpuint (fpi_usb_driver_index_lookup (index, NULL, 0x1234, 0x0002, &entry),
+                    ==, types[1]);
+  g_assert_cmpuint (entry->driver_data, ==, 3);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -397,6 +594,8 @@ main (int argc, char *argv[])
   g_test_add_func ("/context/remove-device-open", test_context_remove_device_open);
   g_test_add_func ("/context/remove-device-opening", test_context_remove_device_opening);
   g_test_add_func ("/context/remove-device-active", test_context_remove_device_active);
+  g_test_add_func ("/context/device-threads/remove", test_context_device_threads_remove);
+  g_test_add_func ("/context/usb-driver-index", test_context_usb_driver_index);
 
   return g_test_run ();
 }
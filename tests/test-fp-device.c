@@ -18,8 +18,12 @@
  */
 
 #include <libfprint/fprint.h>
+#include <gio/gunixsocketaddress.h>
+#include <glib/gstdio.h>
+#include <cairo.h>
 
 #include "test-utils.h"
+#include "test-config.h"
 
 static void
 on_device_opened (FpDevice *dev, GAsyncResult *res, FptContext *tctx)
@@ -262,6 +266,473 @@ test_device_identify_null_prints (void)
   g_assert_error (error, FP_DEVICE_ERROR, FP_DEVICE_ERROR_DATA_INVALID);
 }
 
+typedef struct
+{
+  FpDevice           *device;
+  GSocketConnection  *connection;
+  gchar              *path;
+  GThread            *driver_thread;
+  guint               n_notified;
+  FpFingerStatusFlags finger_status;
+  guint               n_done;
+  FpPrint            *expected_match;
+} ThreadedDevice;
+
+typedef struct
+{
+  guint8 *data;
+  gint    width;
+  gint    height;
+} TestImage;
+
+#define CAPTURE_WIDTH 256
+#define CAPTURE_HEIGHT 256
+
+static GThread *test_thread;
+
+/* Loads one of the example prints the same way virtual-image.py does */
+static void
+test_image_load (TestImage *image, const char *name)
+{
+  g_autofree char *filename = g_strdup_printf ("%s.png", name);
+  g_autofree char *path = NULL;
+  cairo_surface_t *png;
+  cairo_surface_t *img;
+  cairo_t *cr;
+
+  path = g_build_path (G_DIR_SEPARATOR_S, SOURCE_ROOT, "examples", "prints",
+                       filename, NULL);
+  png = cairo_image_surface_create_from_png (path);
+  g_assert_cmpint (cairo_surface_status (png), ==, CAIRO_STATUS_SUCCESS);
+
+  image->width = (cairo_image_surface_get_width (png) + 3) / 4 * 4;
+  image->height = (cairo_image_surface_get_height (png) + 3) / 4 * 4;
+  img = cairo_image_surface_create (CAIRO_FORMAT_A8, image->width, image->height);
+  g_assert_cmpint (cairo_image_surface_get_stride (img), ==, image->width);
+
+  cr = cairo_create (img);
+  cairo_set_source_rgba (cr, 1, 1, 1, 1);
+  cairo_paint (cr);
+  cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+  cairo_set_source_surface (cr, png, 0, 0);
+  cairo_paint (cr);
+  cairo_destroy (cr);
+
+  cairo_surface_flush (img);
+  image->data = g_memdup2 (cairo_image_surface_get_data (img),
+                           image->width * image->height);
+
+  cairo_surface_destroy (img);
+  cairo_surface_destroy (png);
+}
+
+static void
+on_threaded_device_init (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  g_autoptr(GError) error = NULL;
+  FpDevice **device = user_data;
+
+  *device = FP_DEVICE (g_async_initable_new_finish (G_ASYNC_INITABLE (source_object),
+                                                    res, &error));
+  g_assert_no_error (error);
+}
+
+static void
+on_threaded_state_changed (FpDevice *device, guint state, ThreadedDevice *tdev)
+{
+  tdev->driver_thread = g_thread_self ();
+}
+
+static void
+on_threaded_finger_status (FpDevice *device, GParamSpec *spec, ThreadedDevice *tdev)
+{
+  /* Notifications are emitted in the main context of the device */
+  g_assert_true (g_thread_self () == test_thread);
+  tdev->n_notified++;
+  tdev->finger_status = fp_device_get_finger_status (device);
+}
+
+static void
+threaded_device_setup (ThreadedDevice *tdev, GType driver, const char *dir, guint idx)
+{
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GSocketClient) client = NULL;
+  g_autoptr(GSocketAddress) address = NULL;
+  g_autofree char *filename = g_strdup_printf ("virtual-image-%u.socket", idx);
+
+  tdev->path = g_build_filename (dir, filename, NULL);
+  g_async_initable_new_async (driver, G_PRIORITY_DEFAULT, NULL,
+                              on_threaded_device_init, &tdev->device,
+                              "fpi-environ", tdev->path,
+                              "fpi-worker-thread", TRUE,
+                              NULL);
+  while (!tdev->device)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_signal_connect (tdev->device, "fpi-image-device-state-changed",
+                    G_CALLBACK (on_threaded_state_changed), tdev);
+  g_signal_connect (tdev->device, "notify::finger-status",
+                    G_CALLBACK (on_threaded_finger_status), tdev);
+
+  fp_device_open_sync (tdev->device, NULL, &error);
+  g_assert_no_error (error);
+
+  client = g_socket_client_new ();
+  address = g_unix_socket_address_new (tdev->path);
+  tdev->connection = g_socket_client_connect (client,
+                                              G_SOCKET_CONNECTABLE (address),
+                                              NULL, &error);
+  g_assert_no_error (error);
+}
+
+static void
+threaded_device_teardown (ThreadedDevice *tdev)
+{
+  g_autoptr(GError) error = NULL;
+
+  g_clear_object (&tdev->connection);
+
+  fp_device_close_sync (tdev->device, NULL, &error);
+  g_assert_no_error (error);
+  g_clear_object (&tdev->device);
+
+  g_unlink (tdev->path);
+  g_clear_pointer (&tdev->path, g_free);
+}
+
+static void
+threaded_device_send_image (ThreadedDevice *tdev, const TestImage *image)
+{
+  g_autoptr(GError) error = NULL;
+  GOutputStream *stream = g_io_stream_get_output_stream (G_IO_STREAM (tdev->connection));
+  const gint32 header[] = { image->width, image->height };
+
+  g_output_stream_write_all (stream, header, sizeof (header), NULL, NULL, &error);
+  g_assert_no_error (error);
+  g_output_stream_write_all (stream, image->data, image->width * image->height,
+                             NULL, NULL, &error);
+  g_assert_no_error (error);
+}
+
+static void
+threaded_devices_check_threads (ThreadedDevice *tdevs, guint n_devices)
+{
+  guint i, k;
+
+  for (i = 0; i < n_devices; i++)
+    {
+      /* Each driver ran on a thread of its own */
+      g_assert_nonnull (tdevs[i].driver_thread);
+      g_assert_true (tdevs[i].driver_thread != test_thread);
+      for (k = 0; k < i; k++)
+        g_assert_true (tdevs[i].driver_thread != tdevs[k].driver_thread);
+
+      g_assert_cmpuint (tdevs[i].n_notified, >, 0);
+
+      /* The getters return the state the notifications reported, even
+       * though the worker may be changing it */
+      g_assert_true (fp_device_is_open (tdevs[i].device));
+      g_assert_cmpuint (fp_device_get_finger_status (tdevs[i].device), ==,
+                        tdevs[i].finger_status);
+    }
+}
+
+/* Devices must not hold each other up. Driving several of them has to
+ * give at least half the overall rate of a single one, even on one CPU,
+ * which leaves plenty of room for slow CI machines. */
+static void
+assert_threaded_rate (guint n_devices, gdouble rate, gdouble *single_rate)
+{
+  g_assert_cmpfloat (rate, >, 0);
+
+  if (n_devices == 1)
+    *single_rate = rate;
+  else
+    g_assert_cmpfloat (rate, >=, *single_rate / 2);
+}
+
+static void
+threaded_devices_wait (ThreadedDevice *tdevs, guint n_devices, guint n_done)
+{
+  gboolean done = FALSE;
+  guint i;
+
+  while (!done)
+    {
+      g_main_context_iteration (NULL, TRUE);
+
+      done = TRUE;
+      for (i = 0; i < n_devices; i++)
+        done = done && tdevs[i].n_done == n_done;
+    }
+}
+
+static void
+on_threaded_capture (FpDevice *device, GAsyncResult *res, ThreadedDevice *tdev)
+{
+  g_autoptr(GError) error = NULL;
+  g_autoptr(FpImage) image = NULL;
+
+  /* Results come back to the caller, not the worker thread */
+  g_assert_true (g_thread_self () == test_thread);
+
+  image = fp_device_capture_finish (device, res, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (fp_image_get_width (image), ==, CAPTURE_WIDTH);
+  g_assert_cmpuint (fp_image_get_height (image), ==, CAPTURE_HEIGHT);
+
+  tdev->n_done++;
+}
+
+static gdouble
+run_threaded_captures (GType driver, guint n_devices, guint n_captures)
+{
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GRand) rand = g_rand_new_with_seed (n_devices);
+  g_autofree guint8 *data = g_malloc (CAPTURE_WIDTH * CAPTURE_HEIGHT);
+  g_autofree ThreadedDevice *tdevs = g_new0 (ThreadedDevice, n_devices);
+  g_autofree char *dir = NULL;
+  TestImage image = { data, CAPTURE_WIDTH, CAPTURE_HEIGHT };
+  gdouble elapsed, rate;
+  guint i, j;
+
+  dir = g_dir_make_tmp ("libfprint-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  for (i = 0; i < CAPTURE_WIDTH * CAPTURE_HEIGHT; i++)
+    data[i] = g_rand_int (rand);
+
+  for (i = 0; i < n_devices; i++)
+    threaded_device_setup (&tdevs[i], driver, dir, i);
+
+  g_test_timer_start ();
+
+  for (j = 1; j <= n_captures; j++)
+    {
+      for (i = 0; i < n_devices; i++)
+        fp_device_capture (tdevs[i].device, TRUE, NULL,
+                           (GAsyncReadyCallback) on_threaded_capture, &tdevs[i]);
+
+      for (i = 0; i < n_devices; i++)
+        threaded_device_send_image (&tdevs[i], &image);
+
+      threaded_devices_wait (tdevs, n_devices, j);
+    }
+
+  elapsed = g_test_timer_elapsed ();
+  rate = n_devices * n_captures / elapsed;
+  g_test_message ("%u devices: %.0f captures/s", n_devices, rate);
+
+  threaded_devices_check_threads (tdevs, n_devices);
+  for (i = 0; i < n_devices; i++)
+    threaded_device_teardown (&tdevs[i]);
+
+  g_rmdir (dir);
+
+  return rate;
+}
+
+static void
+test_device_threads_capture (void)
+{
+  g_autoptr(FpContext) context = fp_context_new ();
+  GType driver = g_type_from_name ("FpDeviceVirtualImage");
+  guint n_devices;
+
+  gdouble single_rate = 0;
+
+  g_assert_true (g_type_is_a (driver, FP_TYPE_DEVICE));
+  test_thread = g_thread_self ();
+
+  for (n_devices = 1; n_devices <= 4; n_devices *= 2)
+    assert_threaded_rate (n_devices,
+                          run_threaded_captures (driver, n_devices, 20),
+                          &single_rate);
+}
+
+static void
+on_threaded_enroll_progress (FpDevice *device,
+                             gint      completed_stages,
+                             FpPrint  *print,
+                             gpointer  user_data,
+                             GError   *error)
+{
+  ThreadedDevice *tdev = user_data;
+
+  g_assert_true (g_thread_self () == test_thread);
+  g_assert_no_error (error);
+
+  tdev->n_done = completed_stages;
+}
+
+static void
+on_threaded_enrolled (FpDevice *device, GAsyncResult *res, FpPrint **print)
+{
+  g_autoptr(GError) error = NULL;
+
+  g_assert_true (g_thread_self () == test_thread);
+
+  *print = fp_device_enroll_finish (device, res, &error);
+  g_assert_no_error (error);
+}
+
+static FpPrint *
+threaded_device_enroll (ThreadedDevice *tdev, const TestImage *image)
+{
+  FpPrint *print = NULL;
+  gint stage;
+
+  tdev->n_done = 0;
+  fp_device_enroll (tdev->device, fp_print_new (tdev->device), NULL,
+                    on_threaded_enroll_progress, tdev, NULL,
+                    (GAsyncReadyCallback) on_threaded_enrolled, &print);
+
+  for (stage = 1; stage <= fp_device_get_nr_enroll_stages (tdev->device); stage++)
+    {
+      threaded_device_send_image (tdev, image);
+      while (tdev->n_done < stage && !print)
+        g_main_context_iteration (NULL, TRUE);
+    }
+
+  while (!print)
+    g_main_context_iteration (NULL, TRUE);
+
+  tdev->n_done = 0;
+
+  return print;
+}
+
+static void
+on_threaded_verify (FpDevice *device, GAsyncResult *res, ThreadedDevice *tdev)
+{
+  g_autoptr(GError) error = NULL;
+  gboolean match;
+
+  g_assert_true (g_thread_self () == test_thread);
+
+  g_assert_true (fp_device_verify_finish (device, res, &match, NULL, &error));
+  g_assert_no_error (error);
+  g_assert_cmpint (match, ==, tdev->expected_match != NULL);
+
+  tdev->n_done++;
+}
+
+static void
+on_threaded_identify (FpDevice *device, GAsyncResult *res, ThreadedDevice *tdev)
+{
+  g_autoptr(GError) error = NULL;
+  g_autoptr(FpPrint) match = NULL;
+
+  g_assert_true (g_thread_self () == test_thread);
+
+  g_assert_true (fp_device_identify_finish (device, res, &match, NULL, &error));
+  g_assert_no_error (error);
+  g_assert_true (match == tdev->expected_match);
+
+  tdev->n_done++;
+}
+
+/* Bozorth keeps global state, so matching on several devices at the same
+ * time must still give the same results as on a single one. */
+static gdouble
+run_threaded_matching (GType driver, guint n_devices, guint n_rounds)
+{
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GPtrArray) gallery = g_ptr_array_new_with_free_func (g_object_unref);
+  g_autofree ThreadedDevice *tdevs = g_new0 (ThreadedDevice, n_devices);
+  g_autofree char *dir = NULL;
+  g_autofree guint8 *whorl_data = NULL;
+  g_autofree guint8 *arch_data = NULL;
+  TestImage whorl, arch;
+  FpPrint *whorl_print, *arch_print;
+  gdouble elapsed, rate;
+  guint i, j;
+
+  dir = g_dir_make_tmp ("libfprint-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  test_image_load (&whorl, "whorl");
+  whorl_data = whorl.data;
+  test_image_load (&arch, "tented_arch");
+  arch_data = arch.data;
+
+  for (i = 0; i < n_devices; i++)
+    threaded_device_setup (&tdevs[i], driver, dir, i);
+
+  /* All virtual image devices can use the same prints */
+  whorl_print = threaded_device_enroll (&tdevs[0], &whorl);
+  g_ptr_array_add (gallery, whorl_print);
+  arch_print = threaded_device_enroll (&tdevs[0], &arch);
+  g_ptr_array_add (gallery, arch_print);
+
+  g_test_timer_start ();
+
+  for (j = 1; j <= n_rounds; j++)
+    {
+      for (i = 0; i < n_devices; i++)
+        {
+          switch ((i + j) % 3)
+            {
+            case 0:
+              tdevs[i].expected_match = whorl_print;
+              fp_device_verify (tdevs[i].device, whorl_print, NULL,
+                                NULL, NULL, NULL,
+                                (GAsyncReadyCallback) on_threaded_verify, &tdevs[i]);
+              break;
+
+            case 1:
+              tdevs[i].expected_match = NULL;
+              fp_device_verify (tdevs[i].device, whorl_print, NULL,
+                                NULL, NULL, NULL,
+                                (GAsyncReadyCallback) on_threaded_verify, &tdevs[i]);
+              break;
+
+            default:
+              tdevs[i].expected_match = arch_print;
+              fp_device_identify (tdevs[i].device, gallery, NULL,
+                                  NULL, NULL, NULL,
+                                  (GAsyncReadyCallback) on_threaded_identify, &tdevs[i]);
+            }
+        }
+
+      for (i = 0; i < n_devices; i++)
+        threaded_device_send_image (&tdevs[i],
+                                    tdevs[i].expected_match == whorl_print ? &whorl : &arch);
+
+      threaded_devices_wait (tdevs, n_devices, j);
+    }
+
+  elapsed = g_test_timer_elapsed ();
+  rate = n_devices * n_rounds / elapsed;
+  g_test_message ("%u devices: %.0f matches/s", n_devices, rate);
+
+  threaded_devices_check_threads (tdevs, n_devices);
+  for (i = 0; i < n_devices; i++)
+    threaded_device_teardown (&tdevs[i]);
+
+  g_rmdir (dir);
+
+  return rate;
+}
+
+static void
+test_device_threads_match (void)
+{
+  g_autoptr(FpContext) context = fp_context_new ();
+  GType driver = g_type_from_name ("FpDeviceVirtualImage");
+  guint n_devices;
+
+  gdouble single_rate = 0;
+
+  g_assert_true (g_type_is_a (driver, FP_TYPE_DEVICE));
+  test_thread = g_thread_self ();
+
+  for (n_devices = 1; n_devices <= 4; n_devices *= 2)
+    assert_threaded_rate (n_devices,
+                          run_threaded_matching (driver, n_devices, 12),
+                          &single_rate);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -284,6 +755,8 @@ main (int argc, char *argv[])
   g_test_add_func ("/device/sync/has_storage", test_device_has_storage);
   g_test_add_func ("/device/sync/identify/cancelled", test_device_identify_cancelled);
   g_test_add_func ("/device/sync/identify/null-prints", test_device_identify_null_prints);
+  g_test_add_func ("/device/threads/capture", test_device_threads_capture);
+  g_test_add_func ("/device/threads/match", test_device_threads_match);
 
   return g_test_run ();
 }
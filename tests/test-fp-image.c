@@ -0,0 +1,412 @@
+/*
+ * FpImage Unit tests
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <cairo.h>
+#include <string.h>
+
+#include "fpi-image.h"
+#include "fp-print-private.h"
+#include "test-config.h"
+
+/* Loads one of the example prints the same way virtual-image.py does */
+static FpImage *
+test_image_load (const char *name)
+{
+  g_autofree char *filename = g_strdup_printf ("%s.png", name);
+  g_autofree char *path = NULL;
+  cairo_surface_t *png;
+  cairo_surface_t *img;
+  cairo_t *cr;
+  FpImage *image;
+  gint width, height;
+
+  path = g_build_path (G_DIR_SEPARATOR_S, SOURCE_ROOT, "examples", "prints",
+                       filename, NULL);
+  png = cairo_image_surface_create_from_png (path);
+  g_assert_cmpint (cairo_surface_status (png), ==, CAIRO_STATUS_SUCCESS);
+
+  width = (cairo_image_surface_get_width (png) + 3) / 4 * 4;
+  height = (cairo_image_surface_get_height (png) + 3) / 4 * 4;
+  img = cairo_image_surface_create (CAIRO_FORMAT_A8, width, height);
+  g_assert_cmpint (cairo_image_surface_get_stride (img), ==, width);
+
+  cr = cairo_create (img);
+  cairo_set_source_rgba (cr, 1, 1, 1, 1);
+  cairo_paint (cr);
+  cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+  cairo_set_source_surface (cr, png, 0, 0);
+  cairo_paint (cr);
+  cairo_destroy (cr);
+
+  cairo_surface_flush (img);
+  image = fp_image_new (width, height);
+  memcpy (image->data, cairo_image_surface_get_data (img), width * height);
+
+  cairo_surface_destroy (img);
+  cairo_surface_destroy (png);
+
+  return image;
+}
+
+/* Loads a window of the image captured in the umockdev test of @driver */
+static FpImage *
+test_capture_load (const char *driver, gint x, gint y, gint width, gint height)
+{
+  g_autofree char *path = NULL;
+  cairo_surface_t *png;
+  const guint8 *data;
+  FpImage *image;
+  gint stride;
+  gint i, j;
+
+  path = g_build_path (G_DIR_SEPARATOR_S, SOURCE_ROOT, "tests", driver,
+                       "capture.png", NULL);
+  png = cairo_image_surface_create_from_png (path);
+  g_assert_cmpint (cairo_surface_status (png), ==, CAIRO_STATUS_SUCCESS);
+  g_assert_cmpint (cairo_image_surface_get_format (png), ==, CAIRO_FORMAT_RGB24);
+
+  if (width < 0)
+    width = cairo_image_surface_get_width (png) - x;
+  if (height < 0)
+    height = cairo_image_surface_get_height (png) - y;
+  g_assert_cmpint (x + width, <=, cairo_image_surface_get_width (png));
+  g_assert_cmpint (y + height, <=, cairo_image_surface_get_height (png));
+
+  /* capture.py stores the gray value in all three colour channels */
+  data = cairo_image_surface_get_data (png);
+  stride = cairo_image_surface_get_stride (png);
+  image = fp_image_new (width, height);
+  for (j = 0; j < height; j++)
+    for (i = 0; i < width; i++)
+      image->data[j * width + i] = data[(y + j) * stride + (x + i) * 4 + 1];
+
+  cairo_surface_destroy (png);
+
+  return image;
+}
+
+static void
+on_minutiae_detected (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  g_autoptr(GError) error = NULL;
+  gboolean *done = user_data;
+
+  g_assert_true (fp_image_detect_minutiae_finish (FP_IMAGE (source_object), res, &error));
+  g_assert_no_error (error);
+
+  *done = TRUE;
+}
+
+static void
+detect_minutiae (FpImage *image)
+{
+  gboolean done = FALSE;
+
+  fp_image_detect_minutiae (image, NULL, on_minutiae_detected, &done);
+  while (!done)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_nonnull (fp_image_get_minutiae (image));
+}
+
+static void
+test_binarized_keep (void)
+{
+  g_autoptr(FpImage) kept = test_image_load ("whorl");
+  g_autoptr(FpImage) dropped = test_image_load ("whorl");
+  const guchar *binarized;
+  const guchar *recomputed;
+  gsize len = 0;
+
+  g_object_set (kept, "keep-binarized", TRUE, NULL);
+  detect_minutiae (kept);
+  detect_minutiae (dropped);
+
+  /* Only the image that asked for it holds the binarized image */
+  g_assert_nonnull (kept->binarized);
+  g_assert_null (dropped->binarized);
+
+  binarized = fp_image_get_binarized (kept, &len);
+  g_assert_true (binarized == kept->binarized);
+  g_assert_cmpuint (len, ==, kept->width * kept->height);
+
+  /* The fallback computes the same result from the normalized image */
+  len = 0;
+  recomputed = fp_image_get_binarized (dropped, &len);
+  g_assert_nonnull (recomputed);
+  g_assert_cmpmem (recomputed, len, binarized, kept->width * kept->height);
+}
+
+/* Copies the pixels and then mirrors and inverts the copy, the same way
+ * the detection used to normalize images. */
+static guint8 *
+copy_then_flip (const guint8 *pixels, guint width, guint height,
+                gboolean h_flip, gboolean v_flip, gboolean invert)
+{
+  guint8 *out = g_memdup2 (pixels, width * height);
+  guint x, y;
+
+  if (h_flip)
+    for (y = 0; y < height; y++)
+      for (x = 0; x < width / 2; x++)
+        {
+          guint8 tmp = out[y * width + x];
+
+          out[y * width + x] = out[y * width + width - 1 - x];
+          out[y * width + width - 1 - x] = tmp;
+        }
+
+  if (v_flip)
+    for (y = 0; y < height / 2; y++)
+      for (x = 0; x < width; x++)
+        {
+          guint8 tmp = out[y * width + x];
+
+          out[y * width + x] = out[(height - 1 - y) * width + x];
+          out[(height - 1 - y) * width + x] = tmp;
+        }
+
+  if (invert)
+    for (x = 0; x < width * height; x++)
+      out[x] = 255 - out[x];
+
+  return out;
+}
+
+static void
+assert_same_detection (FpImage *image, FpImage *reference)
+{
+  GPtrArray *minutiae = fp_image_get_minutiae (image);
+  GPtrArray *ref_minutiae = fp_image_get_minutiae (reference);
+  const guchar *data;
+  const guchar *ref_data;
+  gsize len, ref_len;
+  guint i;
+
+  g_assert_cmpuint (image->flags, ==, reference->flags);
+
+  data = fp_image_get_data (image, &len);
+  ref_data = fp_image_get_data (reference, &ref_len);
+  g_assert_cmpmem (data, len, ref_data, ref_len);
+
+  g_assert_cmpuint (minutiae->len, >, 0);
+  g_assert_cmpuint (minutiae->len, ==, ref_minutiae->len);
+  for (i = 0; i < minutiae->len; i++)
+    {
+      gint x, y, ref_x, ref_y;
+
+      fp_minutia_get_coords (g_ptr_array_index (minutiae, i), &x, &y);
+      fp_minutia_get_coords (g_ptr_array_index (ref_minutiae, i), &ref_x, &ref_y);
+      g_assert_cmpint (x, ==, ref_x);
+      g_assert_cmpint (y, ==, ref_y);
+    }
+}
+
+static void
+test_detect_normalized (void)
+{
+  const FpiImageFlags flags = FPI_IMAGE_H_FLIPPED | FPI_IMAGE_V_FLIPPED |
+                              FPI_IMAGE_COLORS_INVERTED;
+  g_autoptr(FpImage) print = test_image_load ("loop-right");
+  g_autoptr(FpImage) flipped = NULL;
+  g_autoptr(FpImage) reference = NULL;
+  g_autofree guint8 *raw = NULL;
+  g_autofree guint8 *normalized = NULL;
+  guint width = print->width;
+  guint height = print->height;
+
+  /* The pixels as a sensor that is mounted upside down would report them */
+  raw = copy_then_flip (print->data, width, height, TRUE, TRUE, TRUE);
+
+  flipped = fp_image_new (width, height);
+  memcpy (flipped->data, raw, width * height);
+  flipped->flags = flags;
+  detect_minutiae (flipped);
+
+  normalized = copy_then_flip (raw, width, height, TRUE, TRUE, TRUE);
+  reference = fp_image_new (width, height);
+  memcpy (reference->data, normalized, width * height);
+  detect_minutiae (reference);
+
+  assert_same_detection (flipped, reference);
+}
+
+static void
+test_detect_view (void)
+{
+  g_autoptr(FpImage) print = test_image_load ("arch");
+  g_autoptr(FpImage) view = NULL;
+  g_autoptr(FpImage) reference = NULL;
+  g_autoptr(GBytes) buffer = NULL;
+  g_autofree guint8 *raw = NULL;
+  g_autofree guint8 *normalized = NULL;
+  guint8 *capture;
+  guint width = print->width;
+  guint height = print->height;
+  gsize stride = width + 13;
+  gsize offset = 3 * stride + 7;
+  guint y;
+
+  /* Rows are stored bottom up in a larger capture buffer, with noise
+   * around the image. */
+  raw = copy_then_flip (print->data, width, height, FALSE, TRUE, FALSE);
+  capture = g_malloc (offset + height * stride);
+  memset (capture, 0x5a, offset + height * stride);
+  for (y = 0; y < height; y++)
+    memcpy (capture + offset + y * stride, raw + y * width, width);
+  buffer = g_bytes_new_take (capture, offset + height * stride);
+
+  view = fpi_image_new_view (buffer, offset, stride, width, height,
+                             FPI_IMAGE_V_FLIPPED);
+  detect_minutiae (view);
+
+  /* The capture buffer is not modified by the detection */
+  g_assert_cmpuint (capture[0], ==, 0x5a);
+  g_assert_cmpmem (capture + offset, width, raw, width);
+
+  normalized = copy_then_flip (raw, width, height, FALSE, TRUE, FALSE);
+  reference = fp_image_new (width, height);
+  memcpy (reference->data, normalized, width * height);
+  detect_minutiae (reference);
+
+  assert_same_detection (view, reference);
+}
+
+static void
+test_detect_overlapping (void)
+{
+  g_autoptr(FpImage) print = test_image_load ("whorl");
+  g_autoptr(FpImage) image = NULL;
+  g_autoptr(FpImage) reference = NULL;
+  g_autofree guint8 *raw = NULL;
+  gboolean first_done = FALSE;
+  gboolean second_done = FALSE;
+  guint width = print->width;
+  guint height = print->height;
+
+  /* Flipped, so that the first detection to finish replaces the pixels
+   * that the other one may still be reading. */
+  raw = copy_then_flip (print->data, width, height, FALSE, TRUE, FALSE);
+  image = fp_image_new (width, height);
+  memcpy (image->data, raw, width * height);
+  image->flags = FPI_IMAGE_V_FLIPPED;
+
+  fp_image_detect_minutiae (image, NULL, on_minutiae_detected, &first_done);
+  fp_image_detect_minutiae (image, NULL, on_minutiae_detected, &second_done);
+  while (!first_done || !second_done)
+    g_main_context_iteration (NULL, TRUE);
+
+  reference = fp_image_new (width, height);
+  memcpy (reference->data, print->data, width * height);
+  detect_minutiae (reference);
+
+  assert_same_detection (image, reference);
+}
+
+static FpPrint *
+make_nbis_print (void)
+{
+  FpPrint *print;
+
+  print = g_object_new (FP_TYPE_PRINT, "driver", "test_driver", "device-id", "0", NULL);
+  g_object_ref_sink (print);
+  fpi_print_set_type (print, FPI_PRINT_NBIS);
+
+  return print;
+}
+
+static FpPrint *
+make_capture_print (const char *driver, gint x, gint y, gint width, gint height)
+{
+  g_autoptr(FpImage) image = test_capture_load (driver, x, y, width, height);
+  g_autoptr(GError) error = NULL;
+  FpPrint *print = make_nbis_print ();
+
+  detect_minutiae (image);
+  g_assert_true (fpi_print_add_from_image (print, image, &error));
+  g_assert_no_error (error);
+
+  return print;
+}
+
+static void
+test_nbis_consolidate_capture (void)
+{
+  /* elanspi merges its enroll stages, its threshold is used here */
+  const gint bz3_threshold = 24;
+  /* Partial swipes of the same finger, simulated by overlapping windows
+   * of the elanspi capture (288x578). */
+  const gint stages[][2] = { { 0, 0 }, { 96, 0 }, { 0, 128 }, { 96, 128 }, { 48, 258 } };
+  const gint width = 192, height = 320;
+  g_autoptr(FpPrint) print = make_nbis_print ();
+  g_autoptr(FpPrint) merged = make_nbis_print ();
+  g_autoptr(FpPrint) probe = NULL;
+  g_autoptr(FpPrint) impostor = NULL;
+  g_autoptr(GError) error = NULL;
+  gint n_merged;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (stages); i++)
+    {
+      g_autoptr(FpPrint) stage = make_capture_print ("elanspi", stages[i][0], stages[i][1],
+                                                     width, height);
+
+      fpi_print_add_print (print, stage);
+    }
+
+  n_merged = fpi_print_nbis_consolidate (print, bz3_threshold,
+                                         FPI_PRINT_CONSOLIDATE_KEEP_STAGES);
+  g_assert_cmpint (n_merged, >=, 2);
+  g_assert_cmpuint (print->prints->len, ==, G_N_ELEMENTS (stages) + 1);
+
+  /* The merged template on its own */
+  g_ptr_array_add (merged->prints,
+                   g_memdup2 (g_ptr_array_index (print->prints, 0), sizeof (struct xyt_struct)));
+  g_assert_cmpint (((struct xyt_struct *) g_ptr_array_index (merged->prints, 0))->nrows, <=,
+                   MAX_BOZORTH_MINUTIAE);
+
+  /* A swipe over a part of the finger that no single stage covers fully */
+  probe = make_capture_print ("elanspi", 48, 64, width, height);
+  g_assert_cmpint (fpi_print_bz3_match (merged, probe, bz3_threshold, &error), ==,
+                   FPI_MATCH_SUCCESS);
+  g_assert_cmpint (fpi_print_bz3_match (print, probe, bz3_threshold, &error), ==,
+                   FPI_MATCH_SUCCESS);
+
+  /* A different finger, captured by another sensor */
+  impostor = make_capture_print ("egis0570", 0, 0, width, height);
+  g_assert_cmpint (fpi_print_bz3_match (merged, impostor, bz3_threshold, &error), ==,
+                   FPI_MATCH_FAIL);
+  g_assert_cmpint (fpi_print_bz3_match (print, impostor, bz3_threshold, &error), ==,
+                   FPI_MATCH_FAIL);
+  g_assert_no_error (error);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/image/binarized/keep", test_binarized_keep);
+  g_test_add_func ("/image/detect/normalized", test_detect_normalized);
+  g_test_add_func ("/image/detect/view", test_detect_view);
+  g_test_add_func ("/image/detect/overlapping", test_detect_overlapping);
+  g_test_add_func ("/image/nbis/consolidate", test_nbis_consolidate_capture);
+
+  return g_test_run ();
+}
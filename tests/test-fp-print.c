@@ -0,0 +1,487 @@
+/*
+ * FpPrint unit tests
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <libfprint/fprint.h>
+#include <math.h>
+
+#define FP_COMPONENT "print"
+
+#include "fpi-log.h"
+#include "fp-print-private.h"
+
+static FpPrint *
+make_nbis_print (GRand *rand, guint n_prints, gint max_rows)
+{
+  g_autoptr(FpPrint) print = NULL;
+  g_autoptr(GDate) date = NULL;
+  guint i;
+
+  print = g_object_new (FP_TYPE_PRINT,
+                        "driver", "test_driver",
+                        "device-id", g_rand_boolean (rand) ? "0" : "device-\xc3\xa4",
+                        "device-stored", g_rand_boolean (rand),
+                        NULL);
+  g_object_ref_sink (print);
+  fpi_print_set_type (print, FPI_PRINT_NBIS);
+
+  fp_print_set_finger (print, g_rand_int_range (rand, FP_FINGER_FIRST, FP_FINGER_LAST + 1));
+  if (g_rand_boolean (rand))
+    fp_print_set_username (print, g_rand_boolean (rand) ? "" : "user");
+  if (g_rand_boolean (rand))
+    fp_print_set_description (print, "A test print");
+  date = g_date_new_dmy (g_rand_int_range (rand, 1, 29), G_DATE_MARCH, 2026);
+  fp_print_set_enroll_date (print, date);
+
+  for (i = 0; i < n_prints; i++)
+    {
+      struct xyt_struct *xyt = g_new0 (struct xyt_struct, 1);
+      gint j;
+
+      xyt->nrows = g_rand_int_range (rand, 0, max_rows + 1);
+      for (j = 0; j < xyt->nrows; j++)
+        {
+          xyt->xcol[j] = g_rand_int_range (rand, -1000, 1000);
+          xyt->ycol[j] = g_rand_int_range (rand, -1000, 1000);
+          xyt->thetacol[j] = g_rand_int_range (rand, 0, 360);
+        }
+
+      g_ptr_array_add (print->prints, xyt);
+    }
+
+  return g_steal_pointer (&print);
+}
+
+#define TEST_BZ3_THRESHOLD 40
+#define TEST_FINGER_MINUTIAE 120
+
+/* Places minutiae on an area larger than the sensor */
+static void
+random_finger (GRand *rand, gint (*finger)[3])
+{
+  gint i;
+
+  for (i = 0; i < TEST_FINGER_MINUTIAE; i++)
+    {
+      finger[i][0] = g_rand_int_range (rand, -50, 210);
+      finger[i][1] = g_rand_int_range (rand, -50, 250);
+      finger[i][2] = IANGLE180 (g_rand_int_range (rand, 0, 360));
+    }
+}
+
+/* Moves the finger, crops it to the sensor and adds some noise */
+static struct xyt_struct *
+random_stage (GRand *rand, gint (*finger)[3])
+{
+  struct minutiae_struct c[MAX_BOZORTH_MINUTIAE];
+  struct xyt_struct *xyt = g_new0 (struct xyt_struct, 1);
+  gdouble rot = g_rand_double_range (rand, -0.25, 0.25);
+  gdouble tx = g_rand_double_range (rand, -30, 30);
+  gdouble ty = g_rand_double_range (rand, -30, 30);
+  gint i, n = 0;
+
+  for (i = 0; i < TEST_FINGER_MINUTIAE; i++)
+    {
+      gdouble x = cos (rot) * finger[i][0] - sin (rot) * finger[i][1] + tx;
+      gdouble y = sin (rot) * finger[i][0] + cos (rot) * finger[i][1] + ty;
+
+      if (x < 0 || x > 160 || y < 0 || y > 200)
+        continue;
+
+      c[n].col[0] = lround (x + g_rand_double_range (rand, -2, 2));
+      c[n].col[1] = lround (y + g_rand_double_range (rand, -2, 2));
+      c[n].col[2] = IANGLE180 (finger[i][2] + (gint) lround (rot * 180 / G_PI) +
+                               g_rand_int_range (rand, -5, 6));
+      c[n].col[3] = 0;
+      n++;
+    }
+
+  for (i = 0; i < 5; i++, n++)
+    {
+      c[n].col[0] = g_rand_int_range (rand, 0, 161);
+      c[n].col[1] = g_rand_int_range (rand, 0, 201);
+      c[n].col[2] = IANGLE180 (g_rand_int_range (rand, 0, 360));
+      c[n].col[3] = 0;
+    }
+
+  qsort (c, n, sizeof (struct minutiae_struct), sort_x_y);
+  xyt->nrows = n;
+  for (i = 0; i < n; i++)
+    {
+      xyt->xcol[i] = c[i].col[0];
+      xyt->ycol[i] = c[i].col[1];
+      xyt->thetacol[i] = c[i].col[2];
+    }
+
+  return xyt;
+}
+
+static void
+assert_prints_identical (FpPrint *a, FpPrint *b)
+{
+  g_assert_true (fp_print_equal (a, b));
+  g_assert_cmpint (fp_print_get_device_stored (a), ==, fp_print_get_device_stored (b));
+  g_assert_cmpint (fp_print_get_finger (a), ==, fp_print_get_finger (b));
+  g_assert_cmpstr (fp_print_get_username (a), ==, fp_print_get_username (b));
+  g_assert_cmpstr (fp_print_get_description (a), ==, fp_print_get_description (b));
+  g_assert_cmpint (g_date_compare (fp_print_get_enroll_date (a),
+                                   fp_print_get_enroll_date (b)), ==, 0);
+}
+
+static void
+test_deserialize_fast (void)
+{
+  g_autoptr(GRand) rand = g_rand_new_with_seed (1);
+  guint n_prints;
+
+  /* The largest prints use 4 byte framing offsets */
+  for (n_prints = 0; n_prints <= 40; n_prints += 5)
+    {
+      g_autoptr(FpPrint) print = make_nbis_print (rand, n_prints, 200);
+      g_autoptr(FpPrint) fast = NULL;
+      g_autoptr(FpPrint) variant = NULL;
+      g_autoptr(FpPrint) deserialized = NULL;
+      g_autoptr(GError) error = NULL;
+      g_autofree guchar *data = NULL;
+      gsize length;
+
+      g_assert_true (fp_print_serialize (print, &data, &length, &error));
+      g_assert_no_error (error);
+
+      fast = fpi_print_deserialize_fast (data + 3, length - 3);
+      g_assert_nonnull (fast);
+      variant = fpi_print_deserialize_variant (data + 3, length - 3, &error);
+      g_assert_no_error (error);
+
+      assert_prints_identical (fast, print);
+      assert_prints_identical (fast, variant);
+
+      deserialized = fp_print_deserialize (data, length, &error);
+      g_assert_no_error (error);
+      assert_prints_identical (deserialized, print);
+    }
+}
+
+static void
+test_deserialize_fast_raw (void)
+{
+  g_autoptr(FpPrint) print = NULL;
+  g_autoptr(FpPrint) deserialized = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree guchar *data = NULL;
+  gsize length;
+
+  print = g_object_new (FP_TYPE_PRINT,
+                        "driver", "test_driver",
+                        "device-id", "0",
+                        "fpi-type", FPI_PRINT_RAW,
+                        "fpi-data", g_variant_new_string ("Raw print data"),
+                        NULL);
+  g_object_ref_sink (print);
+
+  g_assert_true (fp_print_serialize (print, &data, &length, &error));
+  g_assert_no_error (error);
+
+  /* Only NBIS prints are read directly */
+  g_assert_null (fpi_print_deserialize_fast (data + 3, length - 3));
+
+  deserialized = fp_print_deserialize (data, length, &error);
+  g_assert_no_error (error);
+  g_assert_true (fp_print_equal (deserialized, print));
+}
+
+static gboolean
+ignore_fatal_log (const gchar   *log_domain,
+                  GLogLevelFlags log_level,
+                  const gchar   *message,
+                  gpointer       user_data)
+{
+  return FALSE;
+}
+
+static void
+ignore_log (const gchar   *log_domain,
+            GLogLevelFlags log_level,
+            const gchar   *message,
+            gpointer       user_data)
+{
+}
+
+static void
+test_deserialize_fuzz (void)
+{
+  g_autoptr(GRand) rand = g_rand_new_with_seed (2);
+  GLogFunc old_handler;
+  guint accepted = 0;
+  guint i, j;
+
+  /* Mutated fingers and dates are reported when setting the properties */
+  g_test_log_set_fatal_handler (ignore_fatal_log, NULL);
+  old_handler = g_log_set_default_handler (ignore_log, NULL);
+
+  for (i = 0; i < 200; i++)
+    {
+      g_autoptr(FpPrint) print = make_nbis_print (rand, g_rand_int_range (rand, 0, 6),
+                                                  g_rand_int_range (rand, 0, 201));
+      g_autoptr(GError) error = NULL;
+      g_autofree guchar *data = NULL;
+      gsize length;
+
+      g_assert_true (fp_print_serialize (print, &data, &length, &error));
+      g_assert_no_error (error);
+
+      for (j = 0; j < 50; j++)
+        {
+          g_autofree guchar *mutated = g_memdup2 (data + 3, length - 3);
+          gsize mutated_length = length - 3;
+          g_autoptr(FpPrint) fast = NULL;
+          g_autoptr(FpPrint) variant = NULL;
+          guint k;
+
+          switch (g_rand_int_range (rand, 0, 3))
+            {
+            case 0:
+              mutated[g_rand_int_range (rand, 0, mutated_length)] ^= 1 << g_rand_int_range (rand, 0, 8);
+              break;
+
+            case 1:
+              for (k = 0; k < 4; k++)
+                mutated[g_rand_int_range (rand, 0, mutated_length)] = g_rand_int_range (rand, 0, 256);
+              break;
+
+            case 2:
+              mutated_length = g_rand_int_range (rand, 0, mutated_length);
+              break;
+            }
+
+          /* Whatever is accepted must be read exactly like GVariant does */
+          fast = fpi_print_deserialize_fast (mutated, mutated_length);
+          if (!fast)
+            continue;
+
+          variant = fpi_print_deserialize_variant (mutated, mutated_length, &error);
+          g_assert_no_error (error);
+          assert_prints_identical (fast, variant);
+          accepted++;
+        }
+    }
+
+  g_log_set_default_handler (old_handler, NULL);
+  g_test_log_set_fatal_handler (NULL, NULL);
+
+  g_test_message ("%u mutated prints were accepted", accepted);
+  g_assert_cmpuint (accepted, >, 0);
+}
+
+static void
+on_deserialize_many (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  GAsyncResult **result = user_data;
+
+  *result = g_object_ref (res);
+}
+
+static void
+test_deserialize_many (void)
+{
+  g_autoptr(GRand) rand = g_rand_new_with_seed (3);
+  g_autoptr(GPtrArray) prints = g_ptr_array_new_with_free_func (g_object_unref);
+  g_autoptr(GPtrArray) blobs = g_ptr_array_new_with_free_func ((GDestroyNotify) g_bytes_unref);
+  g_autoptr(GPtrArray) deserialized = NULL;
+  g_autoptr(GAsyncResult) result = NULL;
+  g_autoptr(GCancellable) cancellable = NULL;
+  g_autoptr(GError) error = NULL;
+  guint i;
+
+  for (i = 0; i < 200; i++)
+    {
+      FpPrint *print = make_nbis_print (rand, 3, 50);
+      guchar *data;
+      gsize length;
+
+      g_assert_true (fp_print_serialize (print, &data, &length, &error));
+      g_assert_no_error (error);
+
+      g_ptr_array_add (prints, print);
+      g_ptr_array_add (blobs, g_bytes_new_take (data, length));
+    }
+
+  /* Broken entries do not prevent loading the others */
+  g_bytes_unref (g_ptr_array_index (blobs, 17));
+  g_ptr_array_index (blobs, 17) = g_bytes_new_static ("FP3garbage", 10);
+
+  fp_print_deserialize_many (blobs, NULL, on_deserialize_many, &result);
+  while (!result)
+    g_main_context_iteration (NULL, TRUE);
+
+  deserialized = fp_print_deserialize_many_finish (result, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (deserialized->len, ==, blobs->len);
+
+  for (i = 0; i < deserialized->len; i++)
+    {
+      if (i == 17)
+        g_assert_null (g_ptr_array_index (deserialized, i));
+      else
+        assert_prints_identical (g_ptr_array_index (deserialized, i),
+                                 g_ptr_array_index (prints, i));
+    }
+
+  g_clear_object (&result);
+
+  cancellable = g_cancellable_new ();
+  g_cancellable_cancel (cancellable);
+  fp_print_deserialize_many (blobs, cancellable, on_deserialize_many, &result);
+  while (!result)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_null (fp_print_deserialize_many_finish (result, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+}
+
+static FpPrint *
+make_stages_print (struct xyt_struct **stages, guint n_stages)
+{
+  FpPrint *print;
+  guint i;
+
+  print = g_object_new (FP_TYPE_PRINT, "driver", "test_driver", "device-id", "0", NULL);
+  g_object_ref_sink (print);
+  fpi_print_set_type (print, FPI_PRINT_NBIS);
+
+  for (i = 0; i < n_stages; i++)
+    g_ptr_array_add (print->prints, g_memdup2 (stages[i], sizeof (struct xyt_struct)));
+
+  return print;
+}
+
+static void
+assert_xyt_equal (struct xyt_struct *a, struct xyt_struct *b)
+{
+  g_assert_cmpint (a->nrows, ==, b->nrows);
+  g_assert_cmpmem (a->xcol, a->nrows * sizeof (int), b->xcol, b->nrows * sizeof (int));
+  g_assert_cmpmem (a->ycol, a->nrows * sizeof (int), b->ycol, b->nrows * sizeof (int));
+  g_assert_cmpmem (a->thetacol, a->nrows * sizeof (int), b->thetacol, b->nrows * sizeof (int));
+}
+
+static void
+test_nbis_consolidate (void)
+{
+  g_autoptr(GRand) rand = g_rand_new_with_seed (4);
+  gint finger[TEST_FINGER_MINUTIAE][3];
+  gint impostor[TEST_FINGER_MINUTIAE][3];
+  struct xyt_struct *stages[6];
+  g_autofree struct xyt_struct *probe = NULL;
+  g_autofree struct xyt_struct *impostor_probe = NULL;
+  g_autoptr(FpPrint) probe_print = NULL;
+  g_autoptr(FpPrint) impostor_print = NULL;
+  g_autoptr(GError) error = NULL;
+  gint max_rows = 0;
+  guint i;
+
+  random_finger (rand, finger);
+  random_finger (rand, impostor);
+  for (i = 0; i < 5; i++)
+    {
+      stages[i] = random_stage (rand, finger);
+      max_rows = MAX (max_rows, stages[i]->nrows);
+    }
+  /* A stage that cannot be aligned with the others */
+  stages[5] = random_stage (rand, impostor);
+
+  probe = random_stage (rand, finger);
+  probe_print = make_stages_print (&probe, 1);
+  impostor_probe = random_stage (rand, impostor);
+  impostor_print = make_stages_print (&impostor_probe, 1);
+
+  /* Nothing happens without a mode */
+    {
+      g_autoptr(FpPrint) print = make_stages_print (stages, 5);
+
+      g_assert_cmpint (fpi_print_nbis_consolidate (print, TEST_BZ3_THRESHOLD,
+                                                   FPI_PRINT_CONSOLIDATE_NONE), ==, 0);
+      g_assert_cmpuint (print->prints->len, ==, 5);
+      for (i = 0; i < 5; i++)
+        assert_xyt_equal (g_ptr_array_index (print->prints, i), stages[i]);
+    }
+
+  /* All stages are merged into one template that still matches each of
+   * them as well as a new scan of the same finger */
+    {
+      g_autoptr(FpPrint) print = make_stages_print (stages, 5);
+      struct xyt_struct *merged;
+
+      g_assert_cmpint (fpi_print_nbis_consolidate (print, TEST_BZ3_THRESHOLD,
+                                                   FPI_PRINT_CONSOLIDATE_REPLACE), ==, 5);
+      g_assert_cmpuint (print->prints->len, ==, 1);
+
+      merged = g_ptr_array_index (print->prints, 0);
+      g_assert_cmpint (merged->nrows, >, max_rows);
+      g_assert_cmpint (merged->nrows, <=, MAX_BOZORTH_MINUTIAE);
+
+      for (i = 0; i < 5; i++)
+        {
+          g_autoptr(FpPrint) stage = make_stages_print (&stages[i], 1);
+
+          g_assert_cmpint (fpi_print_bz3_match (print, stage, TEST_BZ3_THRESHOLD, &error), ==, FPI_MATCH_SUCCESS);
+        }
+      g_assert_cmpint (fpi_print_bz3_match (print, probe_print, TEST_BZ3_THRESHOLD, &error), ==, FPI_MATCH_SUCCESS);
+      g_assert_cmpint (fpi_print_bz3_match (print, impostor_print, TEST_BZ3_THRESHOLD, &error), ==, FPI_MATCH_FAIL);
+      g_assert_no_error (error);
+    }
+
+  /* The merged template goes in front of the unmodified stages */
+    {
+      g_autoptr(FpPrint) print = make_stages_print (stages, 5);
+
+      g_assert_cmpint (fpi_print_nbis_consolidate (print, TEST_BZ3_THRESHOLD,
+                                                   FPI_PRINT_CONSOLIDATE_KEEP_STAGES), ==, 5);
+      g_assert_cmpuint (print->prints->len, ==, 6);
+      for (i = 0; i < 5; i++)
+        assert_xyt_equal (g_ptr_array_index (print->prints, i + 1), stages[i]);
+    }
+
+  /* A stage of another finger is kept as a template of its own */
+    {
+      g_autoptr(FpPrint) print = make_stages_print (stages, 6);
+
+      g_assert_cmpint (fpi_print_nbis_consolidate (print, TEST_BZ3_THRESHOLD,
+                                                   FPI_PRINT_CONSOLIDATE_REPLACE), ==, 5);
+      g_assert_cmpuint (print->prints->len, ==, 2);
+      assert_xyt_equal (g_ptr_array_index (print->prints, 1), stages[5]);
+      g_assert_cmpint (fpi_print_bz3_match (print, impostor_print, TEST_BZ3_THRESHOLD, &error), ==, FPI_MATCH_SUCCESS);
+      g_assert_no_error (error);
+    }
+
+  for (i = 0; i < G_N_ELEMENTS (stages); i++)
+    g_free (stages[i]);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/print/deserialize/fast", test_deserialize_fast);
+  g_test_add_func ("/print/deserialize/fast/raw", test_deserialize_fast_raw);
+  g_test_add_func ("/print/deserialize/fuzz", test_deserialize_fuzz);
+  g_test_add_func ("/print/deserialize/many", test_deserialize_many);
+  g_test_add_func ("/print/nbis/consolidate", test_nbis_consolidate);
+
+  return g_test_run ();
+}
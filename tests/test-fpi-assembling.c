@@ -127,12 +127,153 @@ test_frame_assembling (void)
   g_assert (1);
 }
 
+static int
+line_get_deviation (struct fpi_line_asmbl_ctx *ctx,
+                    const guint8 *line1, const guint8 *line2)
+{
+  int res = 0;
+
+  for (int i = 0; i < ctx->line_width; i++)
+    res += (line1[i] - line2[i]) * (line1[i] - line2[i]);
+
+  return res;
+}
+
+static int
+line_list_get_deviation (struct fpi_line_asmbl_ctx *ctx,
+                         GSList *line1, GSList *line2)
+{
+  return line_get_deviation (ctx, line1->data, line2->data);
+}
+
+static unsigned char
+line_get_pixel (struct fpi_line_asmbl_ctx *ctx,
+                const guint8 *lines, gsize stride,
+                size_t line, unsigned int x)
+{
+  return lines[line * stride + x];
+}
+
+static unsigned char
+line_list_get_pixel (struct fpi_line_asmbl_ctx *ctx,
+                     GSList *line, unsigned int x)
+{
+  return ((guint8 *) line->data)[x];
+}
+
+static void
+test_line_assembling (void)
+{
+  g_autofree char *path = NULL;
+  g_autofree guint8 *lines = NULL;
+  cairo_surface_t *img = NULL;
+  int width, height, stride;
+  guchar *data;
+  size_t num_lines = 0;
+  struct fpi_line_asmbl_ctx ctx = { 0, };
+  GSList *list = NULL;
+
+  g_autoptr(FpImage) list_img = NULL;
+  g_autoptr(FpImage) array_img = NULL;
+
+  path = g_build_path (G_DIR_SEPARATOR_S, SOURCE_ROOT, "tests", "vfs5011", "capture.png", NULL);
+
+  img = cairo_image_surface_create_from_png (path);
+  data = cairo_image_surface_get_data (img);
+  width = cairo_image_surface_get_width (img);
+  height = cairo_image_surface_get_height (img);
+  stride = cairo_image_surface_get_stride (img);
+  g_assert_cmpint (cairo_image_surface_get_format (img), ==, CAIRO_FORMAT_RGB24);
+
+  ctx.line_width = width;
+  ctx.max_height = 2 * height;
+  ctx.resolution = 10;
+  ctx.median_filter_size = 25;
+  ctx.max_search_offset = 30;
+  ctx.get_deviation = line_list_get_deviation;
+  ctx.get_pixel = line_list_get_pixel;
+  ctx.get_deviation_array = line_get_deviation;
+  ctx.get_pixel_array = line_get_pixel;
+
+  /* Simulate a varying swipe speed by repeating rows a varying number
+   * of times. */
+  lines = g_malloc (width * height * 3);
+  for (int y = 0; y < height; y++)
+    for (int rep = 0; rep < 1 + (y / 7) % 3; rep++)
+      {
+        guint8 *line = lines + num_lines * width;
+
+        for (int x = 0; x < width; x++)
+          line[x] = data[x * 4 + y * stride + 1];
+        num_lines++;
+      }
+
+  for (int i = num_lines - 1; i >= 0; i--)
+    list = g_slist_prepend (list, lines + i * width);
+
+  list_img = fpi_assemble_lines (&ctx, list, num_lines);
+  array_img = fpi_assemble_lines_array (&ctx, lines, width, num_lines);
+
+  g_assert_cmpint (list_img->width, ==, width);
+  g_assert_cmpint (list_img->height, >, 0);
+  g_assert_cmpint (list_img->width, ==, array_img->width);
+  g_assert_cmpint (list_img->height, ==, array_img->height);
+  g_assert_cmpmem (list_img->data, list_img->width * list_img->height,
+                   array_img->data, array_img->width * array_img->height);
+
+  g_slist_free (list);
+  cairo_surface_destroy (img);
+}
+
+static void
+test_line_assembling_expected (void)
+{
+  const int width = 8, num_lines = 10;
+  const int resolutions[] = { 1, 2, 200 };
+  struct fpi_line_asmbl_ctx ctx = {
+    .line_width = width,
+    .max_height = (num_lines - 1) * 200,
+    .median_filter_size = 3,
+    .max_search_offset = 3,
+    .get_deviation_array = line_get_deviation,
+    .get_pixel_array = line_get_pixel,
+  };
+  guint8 lines[num_lines * width];
+
+  /* Every line is closest to the one following it, so the movement is
+   * one line per sample and no interpolation is needed at resolution 1. */
+  for (int y = 0; y < num_lines; y++)
+    for (int x = 0; x < width; x++)
+      lines[y * width + x] = y * 10 + x;
+
+  for (guint i = 0; i < G_N_ELEMENTS (resolutions); i++)
+    {
+      g_autoptr(FpImage) img = NULL;
+
+      ctx.resolution = resolutions[i];
+      img = fpi_assemble_lines_array (&ctx, lines, width, num_lines);
+      g_assert_cmpint (img->width, ==, width);
+      g_assert_cmpint (img->height, ==, (num_lines - 1) * ctx.resolution);
+
+      /* Lines in between are interpolated linearly, at resolution 2 every
+       * second line is the mean of its neighbours. Large resolutions need
+       * more than 23 bits for the interpolation denominator. */
+      for (int y = 0; y < img->height; y++)
+        for (int x = 0; x < width; x++)
+          g_assert_cmpint (img->data[y * width + x], ==,
+                           (y / ctx.resolution) * 10 + x +
+                           (y % ctx.resolution) * 10 / ctx.resolution);
+    }
+}
+
 int
 main (int argc, char *argv[])
 {
   g_test_init (&argc, &argv, NULL);
 
   g_test_add_func ("/assembling/frames", test_frame_assembling);
+  g_test_add_func ("/assembling/lines", test_line_assembling);
+  g_test_add_func ("/assembling/lines/expected", test_line_assembling_expected);
 
   return g_test_run ();
 }
@@ -20,6 +20,7 @@
 #include "fp-device.h"
 #include "fp-enums.h"
 #include <libfprint/fprint.h>
+#include <glib/gstdio.h>
 
 #define FP_COMPONENT "device"
 
@@ -28,6 +29,7 @@
 #include "fpi-log.h"
 #include "test-device-fake.h"
 #include "fp-print-private.h"
+#include "fp-device-private.h"
 
 /* gcc 12.0.1 is complaining about dangling pointers in the auto_close* functions */
 #if G_GNUC_CHECK_VERSION (12, 0)
@@ -2412,6 +2414,247 @@ test_driver_identify_warmup_cooldown (void)
   g_assert_cmpint (g_get_monotonic_time () - start_time, <, 5000000 + 500000);
 }
 
+/* Remaining delay predicted when the driver is invoked */
+static gint64 throttled_start_delay;
+
+static void
+fake_device_throttled_identify (FpDevice *device)
+{
+  FpiDeviceFake *fake_dev = FPI_DEVICE_FAKE (device);
+
+  fake_dev->last_called_function = fake_device_throttled_identify;
+  throttled_start_delay = fpi_device_get_throttle_delay (device);
+}
+
+/* Keeps the device active for the given time without blocking */
+static void
+run_active (FpDevice *device, gint64 usec)
+{
+  gint64 end_time = g_get_monotonic_time () + usec;
+
+  while (g_get_monotonic_time () < end_time)
+    {
+      g_main_context_iteration (NULL, FALSE);
+      g_assert_cmpint (fp_device_get_temperature (device), !=, FP_TEMPERATURE_HOT);
+    }
+}
+
+/* Waits for a throttled operation to reach the driver, the predicted delay
+ * must only go down while waiting. */
+static void
+wait_throttled (FpDevice *device)
+{
+  FpiDeviceFake *fake_dev = FPI_DEVICE_FAKE (device);
+  gint64 delay = G_MAXINT64;
+
+  while (fake_dev->last_called_function == NULL)
+    {
+      gint64 remaining = fpi_device_get_throttle_delay (device);
+
+      g_assert_cmpint (remaining, <=, delay);
+      delay = remaining;
+
+      g_main_context_iteration (NULL, TRUE);
+    }
+
+  /* The operation started as soon as it was admitted. The model is already
+   * active, so allow for the time spent since the admission. */
+  g_assert (fake_dev->last_called_function == fake_device_throttled_identify);
+  g_assert_cmpint (throttled_start_delay, <, 1000);
+}
+
+static void
+test_driver_identify_throttle (void)
+{
+  g_autoptr(FpAutoResetClass) dev_class = auto_reset_device_class ();
+  g_autoptr(MatchCbData) identify_data = g_new0 (MatchCbData, 1);
+  g_autoptr(GPtrArray) prints = NULL;
+  g_autoptr(FpAutoCloseDevice) device = NULL;
+  g_autoptr(GCancellable) cancellable = NULL;
+  void (*orig_identify) (FpDevice *device);
+  FpiDeviceFake *fake_dev;
+  guint delay;
+
+  dev_class->temp_hot_seconds = 2;
+  dev_class->temp_cold_seconds = 1;
+
+  device = g_object_new (FPI_TYPE_DEVICE_FAKE, "throttle", TRUE, NULL);
+  fake_dev = FPI_DEVICE_FAKE (device);
+  orig_identify = dev_class->identify;
+  dev_class->identify = fake_device_throttled_identify;
+
+  prints = make_fake_prints_gallery (device, 1);
+
+  g_assert_true (fp_device_open_sync (device, NULL, NULL));
+
+  /* A cold device starts right away */
+  g_assert_cmpuint (fp_device_get_throttle_delay (device), ==, 0);
+  fake_dev->last_called_function = NULL;
+  fp_device_identify (device, prints, NULL,
+                      NULL, NULL, NULL,
+                      (GAsyncReadyCallback) test_driver_identify_cb, identify_data);
+  g_assert (fake_dev->last_called_function == fake_device_throttled_identify);
+
+  /* Warm it up with an operation of 1.6s */
+  run_active (device, 1600000);
+  g_assert_cmpint (fp_device_get_temperature (device), ==, FP_TEMPERATURE_WARM);
+  orig_identify (device);
+  while (!identify_data->called)
+    g_main_context_iteration (NULL, TRUE);
+  g_assert_no_error (identify_data->error);
+  test_driver_match_data_clear (identify_data);
+
+  /* Another 1.6s operation would make it hot, so it has to wait a bit */
+  delay = fp_device_get_throttle_delay (device);
+  g_assert_cmpuint (delay, >, 0);
+  g_assert_cmpuint (delay, <, 1000);
+
+  /* Waiting operations can be cancelled before reaching the driver */
+  cancellable = g_cancellable_new ();
+  fake_dev->last_called_function = NULL;
+  fp_device_identify (device, prints, cancellable,
+                      NULL, NULL, NULL,
+                      (GAsyncReadyCallback) test_driver_identify_cb, identify_data);
+  g_assert_cmpint (fpi_device_get_current_action (device), ==, FPI_DEVICE_ACTION_IDENTIFY);
+  g_cancellable_cancel (cancellable);
+  while (!identify_data->called)
+    g_main_context_iteration (NULL, TRUE);
+  g_assert_error (identify_data->error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_assert_null (fake_dev->last_called_function);
+  test_driver_match_data_clear (identify_data);
+
+  /* A reported duty cycle of 20% requires 4 times the active time of rest */
+  fpi_device_set_duty_cycle (device, 0.2);
+  g_assert_cmpuint (fp_device_get_throttle_delay (device), >, 4000);
+  fpi_device_set_duty_cycle (device, 1.0);
+
+  /* Now the operation is delayed but the device never gets hot */
+  g_assert_cmpuint (fp_device_get_throttle_delay (device), >, 0);
+  fp_device_identify (device, prints, NULL,
+                      NULL, NULL, NULL,
+                      (GAsyncReadyCallback) test_driver_identify_cb, identify_data);
+  g_assert_null (fake_dev->last_called_function);
+  wait_throttled (device);
+
+  run_active (device, 1500000);
+  orig_identify (device);
+  while (!identify_data->called)
+    g_main_context_iteration (NULL, TRUE);
+  g_assert_no_error (identify_data->error);
+}
+
+static void
+test_driver_identify_throttle_hot (void)
+{
+  g_autoptr(FpAutoResetClass) dev_class = auto_reset_device_class ();
+  g_autoptr(MatchCbData) identify_data = g_new0 (MatchCbData, 1);
+  g_autoptr(GPtrArray) prints = NULL;
+  g_autoptr(FpAutoCloseDevice) device = NULL;
+  void (*orig_identify) (FpDevice *device);
+  FpDevicePrivate *priv;
+  FpiDeviceFake *fake_dev;
+  gint64 expected_delay;
+  gint64 delay;
+
+  dev_class->temp_hot_seconds = 2;
+  dev_class->temp_cold_seconds = 1;
+
+  device = g_object_new (FPI_TYPE_DEVICE_FAKE, "throttle", TRUE, NULL);
+  fake_dev = FPI_DEVICE_FAKE (device);
+  orig_identify = dev_class->identify;
+  dev_class->identify = fake_device_throttled_identify;
+
+  prints = make_fake_prints_gallery (device, 1);
+
+  g_assert_true (fp_device_open_sync (device, NULL, NULL));
+
+  /* The device is still HOT, but has already cooled down to a point from
+   * which a short operation would not reach the HOT threshold again. */
+  priv = fpi_device_get_private (device);
+  priv->temp_current = FP_TEMPERATURE_HOT;
+  priv->temp_current_ratio = 0.6;
+  priv->temp_last_active = FALSE;
+  priv->temp_last_update = g_get_monotonic_time ();
+  priv->temp_active_estimate = 0.1;
+
+  /* It must cool down to WARM first, i.e. cold_seconds * ln (0.6 / 0.5) */
+  expected_delay = dev_class->temp_cold_seconds * 182321;
+  delay = fpi_device_get_throttle_delay (device);
+  g_assert_cmpint (delay, <=, expected_delay);
+  g_assert_cmpint (delay, >, expected_delay / 2);
+
+  fake_dev->last_called_function = NULL;
+  fp_device_identify (device, prints, NULL,
+                      NULL, NULL, NULL,
+                      (GAsyncReadyCallback) test_driver_identify_cb, identify_data);
+  g_assert_null (fake_dev->last_called_function);
+  wait_throttled (device);
+  g_assert_cmpint (fp_device_get_temperature (device), ==, FP_TEMPERATURE_WARM);
+
+  orig_identify (device);
+  while (!identify_data->called)
+    g_main_context_iteration (NULL, TRUE);
+  g_assert_no_error (identify_data->error);
+}
+
+static void
+test_driver_identify_throttle_sustained (void)
+{
+  g_autoptr(FpAutoResetClass) dev_class = auto_reset_device_class ();
+  g_autoptr(GPtrArray) prints = NULL;
+  g_autoptr(FpAutoCloseDevice) device = NULL;
+  void (*orig_identify) (FpDevice *device);
+  FpiDeviceFake *fake_dev;
+  guint throttled = 0;
+  guint i;
+
+  dev_class->temp_hot_seconds = 2;
+  dev_class->temp_cold_seconds = 1;
+
+  device = g_object_new (FPI_TYPE_DEVICE_FAKE, "throttle", TRUE, NULL);
+  fake_dev = FPI_DEVICE_FAKE (device);
+  orig_identify = dev_class->identify;
+  dev_class->identify = fake_device_throttled_identify;
+
+  prints = make_fake_prints_gallery (device, 1);
+
+  g_assert_true (fp_device_open_sync (device, NULL, NULL));
+
+  /* Back to back operations of 0.4s, enough for the device to reach HOT
+   * within a few seconds if they were not throttled. */
+  for (i = 0; i < 8; i++)
+    {
+      g_autoptr(MatchCbData) identify_data = g_new0 (MatchCbData, 1);
+      gint64 delay;
+
+      delay = fpi_device_get_throttle_delay (device);
+      if (delay > 0)
+        throttled++;
+
+      /* The device is not kept idle for longer than needed. Cooling from
+       * the HOT threshold to where a 0.4s operation is admitted again
+       * takes a bit more than 0.1s. */
+      g_assert_cmpint (delay, <, 150000);
+
+      fake_dev->last_called_function = NULL;
+      fp_device_identify (device, prints, NULL,
+                          NULL, NULL, NULL,
+                          (GAsyncReadyCallback) test_driver_identify_cb, identify_data);
+      wait_throttled (device);
+
+      run_active (device, 400000);
+      orig_identify (device);
+      while (!identify_data->called)
+        g_main_context_iteration (NULL, TRUE);
+      g_assert_no_error (identify_data->error);
+      g_assert_cmpint (fp_device_get_temperature (device), !=, FP_TEMPERATURE_HOT);
+    }
+
+  /* The first operations run while the device warms up */
+  g_assert_cmpuint (throttled, >, 0);
+  g_assert_cmpuint (throttled, <, 8);
+}
+
 static void
 fake_device_stub_capture (FpDevice *device)
 {
@@ -2599,6 +2842,110 @@ test_driver_list_no_storage (void)
   g_assert_error (error, FP_DEVICE_ERROR, FP_DEVICE_ERROR_NOT_SUPPORTED);
 }
 
+static void
+test_driver_list_cached (void)
+{
+  g_autoptr(FpAutoResetClass) dev_class = auto_reset_device_class ();
+  g_autoptr(FpAutoCloseDevice) device = NULL;
+  g_autoptr(GPtrArray) prints = NULL;
+  g_autoptr(GPtrArray) cached = NULL;
+  g_autoptr(FpPrint) enrolled_print = NULL;
+  g_autoptr(FpPrint) template_print = NULL;
+  g_autoptr(FpPrint) out_print = NULL;
+  g_autoptr(GError) error = NULL;
+  FpiDeviceFake *fake_dev;
+
+  dev_class->cache_storage = TRUE;
+  device = auto_close_fake_device_new ();
+  fake_dev = FPI_DEVICE_FAKE (device);
+
+  fake_dev->ret_list = make_fake_prints_gallery (device, 5);
+  prints = fp_device_list_prints_sync (device, NULL, &error);
+  g_assert (fake_dev->last_called_function == dev_class->list);
+  g_assert_no_error (error);
+
+  /* Served from the cache */
+  fake_dev->last_called_function = NULL;
+  cached = fp_device_list_prints_sync (device, NULL, &error);
+  g_assert_null (fake_dev->last_called_function);
+  g_assert_no_error (error);
+  g_assert (cached != prints);
+  assert_equal_galleries (cached, prints);
+
+  /* The prints are copies, changing them does not change the cache */
+  g_assert (g_ptr_array_index (cached, 0) != g_ptr_array_index (prints, 0));
+  fp_print_set_description (g_ptr_array_index (cached, 0), "changed");
+  fp_print_set_username (g_ptr_array_index (prints, 0), "changed");
+  g_clear_pointer (&cached, g_ptr_array_unref);
+
+  cached = fp_device_list_prints_sync (device, NULL, &error);
+  g_assert_null (fake_dev->last_called_function);
+  g_assert_no_error (error);
+  assert_equal_galleries (cached, prints);
+  g_assert_null (fp_print_get_description (g_ptr_array_index (cached, 0)));
+  g_assert_null (fp_print_get_username (g_ptr_array_index (cached, 0)));
+  g_clear_pointer (&cached, g_ptr_array_unref);
+
+  /* Deletion is reflected */
+  g_assert_true (fp_device_delete_print_sync (device, g_ptr_array_index (prints, 2),
+                                              NULL, &error));
+  g_assert_no_error (error);
+  cached = fp_device_list_prints_sync (device, NULL, &error);
+  g_assert (fake_dev->last_called_function == dev_class->delete);
+  g_assert_cmpuint (cached->len, ==, 4);
+  g_assert_false (g_ptr_array_find_with_equal_func (cached, g_ptr_array_index (prints, 2),
+                                                    (GEqualFunc) fp_print_equal, NULL));
+  g_clear_pointer (&cached, g_ptr_array_unref);
+
+  /* So is enrollment */
+  enrolled_print = make_fake_print_reffed (device, g_variant_new_uint64 (42));
+  template_print = fp_print_new (device);
+  fake_dev->ret_print = enrolled_print;
+  out_print = fp_device_enroll_sync (device, template_print, NULL, NULL, NULL, &error);
+  fake_dev->ret_print = NULL;
+  g_assert_no_error (error);
+  g_assert (out_print == enrolled_print);
+  cached = fp_device_list_prints_sync (device, NULL, &error);
+  g_assert (fake_dev->last_called_function == dev_class->enroll);
+  g_assert_cmpuint (cached->len, ==, 5);
+  g_assert_false (g_ptr_array_find (cached, enrolled_print, NULL));
+  g_assert_true (g_ptr_array_find_with_equal_func (cached, enrolled_print,
+                                                   (GEqualFunc) fp_print_equal, NULL));
+  g_clear_pointer (&cached, g_ptr_array_unref);
+
+  /* And clearing the storage */
+  g_assert_true (fp_device_clear_storage_sync (device, NULL, &error));
+  g_assert_no_error (error);
+  cached = fp_device_list_prints_sync (device, NULL, &error);
+  g_assert (fake_dev->last_called_function == dev_class->clear_storage);
+  g_assert_cmpuint (cached->len, ==, 0);
+  g_clear_pointer (&cached, g_ptr_array_unref);
+
+  /* A failing action drops the cache */
+  fake_dev->ret_error = fpi_device_error_new (FP_DEVICE_ERROR_GENERAL);
+  g_assert_false (fp_device_clear_storage_sync (device, NULL, &error));
+  g_assert (error == g_steal_pointer (&fake_dev->ret_error));
+  g_clear_error (&error);
+
+  fake_dev->ret_list = make_fake_prints_gallery (device, 3);
+  cached = fp_device_list_prints_sync (device, NULL, &error);
+  g_assert (fake_dev->last_called_function == dev_class->list);
+  g_assert_no_error (error);
+  g_assert (cached == fake_dev->ret_list);
+  g_clear_pointer (&cached, g_ptr_array_unref);
+
+  /* As does reopening the device */
+  g_assert_true (fp_device_close_sync (device, NULL, &error));
+  g_assert_true (fp_device_open_sync (device, NULL, &error));
+  g_assert_no_error (error);
+
+  fake_dev->ret_list = make_fake_prints_gallery (device, 1);
+  cached = fp_device_list_prints_sync (device, NULL, &error);
+  g_assert (fake_dev->last_called_function == dev_class->list);
+  g_assert_no_error (error);
+  g_assert_cmpuint (cached->len, ==, 1);
+}
+
 static void
 test_driver_delete (void)
 {
@@ -3387,6 +3734,142 @@ test_driver_retry_error_types (void)
   g_test_assert_expected_messages ();
 }
 
+static void
+test_driver_calibration (void)
+{
+  g_autoptr(FpAutoCloseDevice) device = auto_close_fake_device_new ();
+  g_autoptr(FpAutoCloseDevice) other_device = auto_close_fake_device_new ();
+  g_autoptr(GBytes) data = g_bytes_new_static ("background", 10);
+  g_autoptr(GBytes) stored = NULL;
+
+  g_assert_null (fpi_device_calibration_lookup (device, "1.0", 1, 0));
+
+  fpi_device_calibration_store (device, "1.0", 1, data);
+
+  /* Shared with devices of the same driver and ID */
+  stored = fpi_device_calibration_lookup (other_device, "1.0", 1, 0);
+  g_assert_nonnull (stored);
+  g_assert_true (g_bytes_equal (stored, data));
+  g_clear_pointer (&stored, g_bytes_unref);
+
+  /* Firmware and version have to match */
+  g_assert_null (fpi_device_calibration_lookup (device, "1.1", 1, 0));
+  g_assert_null (fpi_device_calibration_lookup (device, NULL, 1, 0));
+  g_assert_null (fpi_device_calibration_lookup (device, "1.0", 2, 0));
+
+  /* And it has to be recent enough */
+  g_usleep (2000);
+  g_assert_null (fpi_device_calibration_lookup (device, "1.0", 1, 1000));
+  stored = fpi_device_calibration_lookup (device, "1.0", 1, G_TIME_SPAN_HOUR);
+  g_assert_true (g_bytes_equal (stored, data));
+  g_clear_pointer (&stored, g_bytes_unref);
+
+  fpi_device_calibration_drop (other_device);
+  g_assert_null (fpi_device_calibration_lookup (device, "1.0", 1, 0));
+}
+
+static void
+test_driver_calibration_device (void)
+{
+  g_autoptr(FpDevice) device = g_object_new (FPI_TYPE_DEVICE_FAKE,
+                                             "fpi-environ", "first", NULL);
+  g_autoptr(FpDevice) other_device = g_object_new (FPI_TYPE_DEVICE_FAKE,
+                                                   "fpi-environ", "second", NULL);
+  g_autoptr(FpDevice) same_device = g_object_new (FPI_TYPE_DEVICE_FAKE,
+                                                  "fpi-environ", "first", NULL);
+  g_autoptr(FpDevice) probed_device = NULL;
+  g_autoptr(FpDevice) other_probed_device = NULL;
+  g_autoptr(GBytes) data = g_bytes_new_static ("background", 10);
+  g_autoptr(GBytes) stored = NULL;
+
+  /* Without a device ID, devices are told apart by where they are
+   * connected, the environment for virtual ones */
+  g_assert_cmpstr (fp_device_get_device_id (device), ==, "0");
+  fpi_device_calibration_store (device, "1.0", 1, data);
+  g_assert_null (fpi_device_calibration_lookup (other_device, "1.0", 1, 0));
+
+  stored = fpi_device_calibration_lookup (same_device, "1.0", 1, 0);
+  g_assert_nonnull (stored);
+  g_assert_true (g_bytes_equal (stored, data));
+  g_clear_pointer (&stored, g_bytes_unref);
+
+  /* A device ID reported from probe takes precedence */
+  g_async_initable_new_async (FPI_TYPE_DEVICE_FAKE, G_PRIORITY_DEFAULT, NULL,
+                              on_driver_probe_async, &probed_device,
+                              "fpi-environ", "first", NULL);
+  g_async_initable_new_async (FPI_TYPE_DEVICE_FAKE, G_PRIORITY_DEFAULT, NULL,
+                              on_driver_probe_async, &other_probed_device,
+                              "fpi-environ", "second", NULL);
+
+  while (!FP_IS_DEVICE (probed_device) || !FP_IS_DEVICE (other_probed_device))
+    g_main_context_iteration (NULL, TRUE);
+
+  g_assert_cmpstr (fp_device_get_device_id (probed_device), !=, "0");
+  g_assert_null (fpi_device_calibration_lookup (probed_device, "1.0", 1, 0));
+
+  fpi_device_calibration_store (probed_device, "1.0", 1, data);
+  stored = fpi_device_calibration_lookup (other_probed_device, "1.0", 1, 0);
+  g_assert_nonnull (stored);
+  g_assert_true (g_bytes_equal (stored, data));
+  g_clear_pointer (&stored, g_bytes_unref);
+
+  fpi_device_calibration_drop (device);
+  fpi_device_calibration_drop (probed_device);
+}
+
+static void
+test_driver_calibration_persistent (void)
+{
+  g_autoptr(FpAutoCloseDevice) device = auto_close_fake_device_new ();
+  g_autoptr(GBytes) data = g_bytes_new_static ("background", 10);
+  g_autoptr(GBytes) stored = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GDir) dir = NULL;
+  g_autofree gchar *dir_path = NULL;
+  g_autofree gchar *path = NULL;
+  g_autofree gchar *contents = NULL;
+  gsize length, i;
+
+  dir_path = g_dir_make_tmp ("libfprint-XXXXXX", &error);
+  g_assert_no_error (error);
+  g_setenv ("FP_CALIBRATION_DIR", dir_path, TRUE);
+
+  fpi_device_calibration_store (device, NULL, 3, data);
+
+  /* Survives losing the calibration kept in memory */
+  fpi_device_calibration_clear_memory ();
+  stored = fpi_device_calibration_lookup (device, NULL, 3, 0);
+  g_assert_nonnull (stored);
+  g_assert_true (g_bytes_equal (stored, data));
+  g_clear_pointer (&stored, g_bytes_unref);
+
+  dir = g_dir_open (dir_path, 0, &error);
+  g_assert_no_error (error);
+  path = g_build_filename (dir_path, g_dir_read_name (dir), NULL);
+  g_assert_null (g_dir_read_name (dir));
+
+  /* Corrupted files are ignored */
+  g_file_get_contents (path, &contents, &length, &error);
+  g_assert_no_error (error);
+  for (i = 0; i + 10 <= length; i++)
+    if (memcmp (contents + i, "background", 10) == 0)
+      contents[i] = 'B';
+  g_file_set_contents (path, contents, length, &error);
+  g_assert_no_error (error);
+
+  fpi_device_calibration_clear_memory ();
+  g_test_expect_message (G_LOG_DOMAIN, G_LOG_LEVEL_WARNING,
+                         "*Ignoring corrupted calibration file*");
+  g_assert_null (fpi_device_calibration_lookup (device, NULL, 3, 0));
+  g_test_assert_expected_messages ();
+
+  fpi_device_calibration_drop (device);
+  g_assert_false (g_file_test (path, G_FILE_TEST_EXISTS));
+
+  g_unsetenv ("FP_CALIBRATION_DIR");
+  g_rmdir (dir_path);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -3467,6 +3950,9 @@ main (int argc, char *argv[])
   g_test_add_func ("/driver/identify/suspend_while_idle", test_driver_identify_suspend_while_idle);
 
   g_test_add_func ("/driver/identify/warmup_cooldown", test_driver_identify_warmup_cooldown);
+  g_test_add_func ("/driver/identify/throttle", test_driver_identify_throttle);
+  g_test_add_func ("/driver/identify/throttle/hot", test_driver_identify_throttle_hot);
+  g_test_add_func ("/driver/identify/throttle/sustained", test_driver_identify_throttle_sustained);
 
   g_test_add_func ("/driver/capture", test_driver_capture);
   g_test_add_func ("/driver/capture/not_supported", test_driver_capture_not_supported);
@@ -3474,6 +3960,7 @@ main (int argc, char *argv[])
   g_test_add_func ("/driver/list", test_driver_list);
   g_test_add_func ("/driver/list/error", test_driver_list_error);
   g_test_add_func ("/driver/list/no_storage", test_driver_list_no_storage);
+  g_test_add_func ("/driver/list/cached", test_driver_list_cached);
   g_test_add_func ("/driver/delete", test_driver_delete);
   g_test_add_func ("/driver/delete/error", test_driver_delete_error);
   g_test_add_func ("/driver/clear_storage", test_driver_clear_storage);
@@ -3499,6 +3986,10 @@ main (int argc, char *argv[])
   g_test_add_func ("/driver/timeout", test_driver_add_timeout);
   g_test_add_func ("/driver/timeout/cancelled", test_driver_add_timeout_cancelled);
 
+  g_test_add_func ("/driver/calibration", test_driver_calibration);
+  g_test_add_func ("/driver/calibration/persistent", test_driver_calibration_persistent);
+  g_test_add_func ("/driver/calibration/device", test_driver_calibration_device);
+
   g_test_add_func ("/driver/error_types", test_driver_error_types);
   g_test_add_func ("/driver/retry_error_types", test_driver_retry_error_types);
 
@@ -0,0 +1,332 @@
+/*
+ * FpImageDevice Unit tests
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <cairo.h>
+#include <string.h>
+
+#include "fpi-image-device.h"
+#include "fpi-image.h"
+#include "test-config.h"
+
+#define FAKE_MIN_QUALITY 25
+
+/* An image device that hands out the queued image whenever it waits for a
+ * finger, the same way the virtual image device does with automatic
+ * finger reports. */
+G_DECLARE_FINAL_TYPE (FpiDeviceFakeImage, fpi_device_fake_image, FPI, DEVICE_FAKE_IMAGE, FpImageDevice)
+
+struct _FpiDeviceFakeImage
+{
+  FpImageDevice parent;
+
+  FpImage      *image;
+};
+
+G_DEFINE_TYPE (FpiDeviceFakeImage, fpi_device_fake_image, FP_TYPE_IMAGE_DEVICE)
+
+static void
+fake_image_deliver (FpDevice *device, gpointer user_data)
+{
+  FpiDeviceFakeImage *self = FPI_DEVICE_FAKE_IMAGE (device);
+
+  g_assert_nonnull (self->image);
+
+  fpi_image_device_report_finger_status (FP_IMAGE_DEVICE (device), TRUE);
+  fpi_image_device_image_captured (FP_IMAGE_DEVICE (device), g_object_ref (self->image));
+  fpi_image_device_report_finger_status (FP_IMAGE_DEVICE (device), FALSE);
+}
+
+static void
+fake_image_open (FpImageDevice *dev)
+{
+  fpi_image_device_open_complete (dev, NULL);
+}
+
+static void
+fake_image_close (FpImageDevice *dev)
+{
+  fpi_image_device_close_complete (dev, NULL);
+}
+
+static void
+fake_image_activate (FpImageDevice *dev)
+{
+  fpi_image_device_activate_complete (dev, NULL);
+}
+
+static void
+fake_image_deactivate (FpImageDevice *dev)
+{
+  fpi_image_device_deactivate_complete (dev, NULL);
+}
+
+static void
+fake_image_change_state (FpImageDevice *dev, FpiImageDeviceState state)
+{
+  if (state == FPI_IMAGE_DEVICE_STATE_AWAIT_FINGER_ON)
+    fpi_device_add_timeout (FP_DEVICE (dev), 0, fake_image_deliver, NULL, NULL);
+}
+
+static void
+fpi_device_fake_image_finalize (GObject *object)
+{
+  FpiDeviceFakeImage *self = FPI_DEVICE_FAKE_IMAGE (object);
+
+  g_clear_object (&self->image);
+
+  G_OBJECT_CLASS (fpi_device_fake_image_parent_class)->finalize (object);
+}
+
+static void
+fpi_device_fake_image_init (FpiDeviceFakeImage *self)
+{
+}
+
+static const FpIdEntry fake_image_ids[] = {
+  { .virtual_envvar = "FP_FAKE_IMAGE_TEST_DEV" },
+  { .virtual_envvar = NULL }
+};
+
+static void
+fpi_device_fake_image_class_init (FpiDeviceFakeImageClass *klass)
+{
+  FpDeviceClass *dev_class = FP_DEVICE_CLASS (klass);
+  FpImageDeviceClass *img_class = FP_IMAGE_DEVICE_CLASS (klass);
+
+  dev_class->id = "fake_image_test_dev";
+  dev_class->full_name = "Fake image test device";
+  dev_class->type = FP_DEVICE_TYPE_VIRTUAL;
+  dev_class->id_table = fake_image_ids;
+  dev_class->nr_enroll_stages = 1;
+
+  img_class->min_quality = FAKE_MIN_QUALITY;
+  img_class->img_open = fake_image_open;
+  img_class->img_close = fake_image_close;
+  img_class->activate = fake_image_activate;
+  img_class->deactivate = fake_image_deactivate;
+  img_class->change_state = fake_image_change_state;
+
+  G_OBJECT_CLASS (klass)->finalize = fpi_device_fake_image_finalize;
+}
+
+/* Loads one of the example prints the same way virtual-image.py does */
+static FpImage *
+test_image_load (const char *name)
+{
+  g_autofree char *filename = g_strdup_printf ("%s.png", name);
+  g_autofree char *path = NULL;
+  cairo_surface_t *png;
+  cairo_surface_t *img;
+  cairo_t *cr;
+  FpImage *image;
+  gint width, height;
+
+  path = g_build_path (G_DIR_SEPARATOR_S, SOURCE_ROOT, "examples", "prints",
+                       filename, NULL);
+  png = cairo_image_surface_create_from_png (path);
+  g_assert_cmpint (cairo_surface_status (png), ==, CAIRO_STATUS_SUCCESS);
+
+  width = (cairo_image_surface_get_width (png) + 3) / 4 * 4;
+  height = (cairo_image_surface_get_height (png) + 3) / 4 * 4;
+  img = cairo_image_surface_create (CAIRO_FORMAT_A8, width, height);
+  g_assert_cmpint (cairo_image_surface_get_stride (img), ==, width);
+
+  cr = cairo_create (img);
+  cairo_set_source_rgba (cr, 1, 1, 1, 1);
+  cairo_paint (cr);
+  cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+  cairo_set_source_surface (cr, png, 0, 0);
+  cairo_paint (cr);
+  cairo_destroy (cr);
+
+  cairo_surface_flush (img);
+  image = fp_image_new (width, height);
+  memcpy (image->data, cairo_image_surface_get_data (img), width * height);
+
+  cairo_surface_destroy (img);
+  cairo_surface_destroy (png);
+
+  return image;
+}
+
+/* Loads the image captured in the umockdev test of @driver */
+static FpImage *
+test_capture_load (const char *driver)
+{
+  g_autofree char *path = NULL;
+  cairo_surface_t *png;
+  const guint8 *data;
+  FpImage *image;
+  gint width, height, stride;
+  gint x, y;
+
+  path = g_build_path (G_DIR_SEPARATOR_S, SOURCE_ROOT, "tests", driver,
+                       "capture.png", NULL);
+  png = cairo_image_surface_create_from_png (path);
+  g_assert_cmpint (cairo_surface_status (png), ==, CAIRO_STATUS_SUCCESS);
+  g_assert_cmpint (cairo_image_surface_get_format (png), ==, CAIRO_FORMAT_RGB24);
+
+  /* capture.py stores the gray value in all three colour channels */
+  data = cairo_image_surface_get_data (png);
+  stride = cairo_image_surface_get_stride (png);
+  width = cairo_image_surface_get_width (png);
+  height = cairo_image_surface_get_height (png);
+  image = fp_image_new (width, height);
+  for (y = 0; y < height; y++)
+    for (x = 0; x < width; x++)
+      image->data[y * width + x] = data[y * stride + x * 4 + 1];
+
+  cairo_surface_destroy (png);
+
+  return image;
+}
+
+static FpImage *
+make_striped_image (guint width, guint height, guint ridge_width)
+{
+  FpImage *image = fp_image_new (width, height);
+
+  /* Vertical stripes of ridges on the left, flat background elsewhere */
+  for (guint y = 0; y < height; y++)
+    for (guint x = 0; x < width; x++)
+      image->data[y * width + x] = x < ridge_width && x % 8 < 4 ? 40 : 200;
+
+  return image;
+}
+
+static void
+test_quality (void)
+{
+  g_autoptr(FpImage) blank = make_striped_image (64, 64, 0);
+  g_autoptr(FpImage) ridges = make_striped_image (64, 64, 64);
+  g_autoptr(FpImage) half = make_striped_image (64, 64, 32);
+  g_autoptr(FpImage) odd = make_striped_image (70, 37, 70);
+  g_autoptr(FpImage) odd_border = make_striped_image (70, 37, 0);
+  g_autoptr(FpImage) narrow = make_striped_image (7, 64, 7);
+
+  g_assert_cmpfloat (fpi_image_get_quality (blank), ==, 0.0);
+  g_assert_cmpfloat (fpi_image_get_quality (ridges), ==, 1.0);
+  g_assert_cmpfloat (fpi_image_get_quality (half), ==, 0.5);
+
+  /* Only complete blocks count, 8 by 4 of them here */
+  g_assert_cmpfloat (fpi_image_get_quality (odd), ==, 1.0);
+
+  /* Ridges in the partial blocks at the border are not seen */
+  for (guint y = 0; y < 37; y++)
+    for (guint x = 64; x < 70; x++)
+      odd_border->data[y * 70 + x] = x % 2 ? 0 : 255;
+  for (guint x = 0; x < 70; x++)
+    odd_border->data[36 * 70 + x] = x % 2 ? 0 : 255;
+  g_assert_cmpfloat (fpi_image_get_quality (odd_border), ==, 0.0);
+
+  /* Smaller than a single block */
+  g_assert_cmpfloat (fpi_image_get_quality (narrow), ==, 0.0);
+
+  /* The result is cached */
+  memset (ridges->data, 0, 64 * 64);
+  g_assert_cmpfloat (fpi_image_get_quality (ridges), ==, 1.0);
+}
+
+static void
+test_quality_gate (void)
+{
+  g_autoptr(FpiDeviceFakeImage) device = NULL;
+  g_autoptr(FpPrint) template = NULL;
+  g_autoptr(FpPrint) enrolled = NULL;
+  g_autoptr(FpImage) print = test_image_load ("whorl");
+  g_autoptr(GError) error = NULL;
+  gboolean match = FALSE;
+
+  device = g_object_new (fpi_device_fake_image_get_type (), NULL);
+  g_assert_true (fp_device_open_sync (FP_DEVICE (device), NULL, &error));
+  g_assert_no_error (error);
+
+  /* A good capture goes through to the minutiae detection */
+  g_assert_cmpfloat (fp_image_get_quality (print) * 100, >=, FAKE_MIN_QUALITY);
+  g_set_object (&device->image, print);
+  template = fp_print_new (FP_DEVICE (device));
+  enrolled = fp_device_enroll_sync (FP_DEVICE (device), g_object_ref (template),
+                                    NULL, NULL, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (enrolled);
+
+  g_assert_true (fp_device_verify_sync (FP_DEVICE (device), enrolled, NULL,
+                                        NULL, NULL, &match, NULL, &error));
+  g_assert_no_error (error);
+  g_assert_true (match);
+
+  /* A capture with ridges in only a few blocks is rejected before the
+   * detection, the user is asked to retry */
+  g_clear_object (&device->image);
+  device->image = make_striped_image (256, 240, 24);
+  g_assert_cmpfloat (fp_image_get_quality (device->image) * 100, <, FAKE_MIN_QUALITY);
+  match = TRUE;
+  g_assert_false (fp_device_verify_sync (FP_DEVICE (device), enrolled, NULL,
+                                         NULL, NULL, &match, NULL, &error));
+  g_assert_error (error, FP_DEVICE_RETRY, FP_DEVICE_RETRY_CENTER_FINGER);
+  g_assert_false (match);
+  g_clear_error (&error);
+
+  /* Capturing hands out every image */
+  g_clear_object (&device->image);
+  device->image = make_striped_image (256, 240, 0);
+  g_clear_object (&print);
+  print = fp_device_capture_sync (FP_DEVICE (device), TRUE, NULL, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (print);
+  g_assert_cmpfloat (fp_image_get_quality (print), ==, 0.0);
+
+  g_assert_true (fp_device_close_sync (FP_DEVICE (device), NULL, &error));
+  g_assert_no_error (error);
+}
+
+#if HAVE_DRIVER_VFS5011
+GType fpi_device_vfs5011_get_type (void);
+
+static void
+test_quality_gate_vfs5011 (void)
+{
+  g_autoptr(FpImage) capture = test_capture_load ("vfs5011");
+  g_autoptr(FpImage) blank = make_striped_image (capture->width, capture->height, 0);
+  FpImageDeviceClass *cls;
+
+  cls = g_type_class_ref (fpi_device_vfs5011_get_type ());
+
+  /* The recorded capture passes the gate with a wide margin */
+  g_assert_cmpint (cls->min_quality, >, 0);
+  g_assert_cmpfloat (fp_image_get_quality (capture) * 100, >=, 2 * cls->min_quality);
+  g_assert_cmpfloat (fp_image_get_quality (blank) * 100, <, cls->min_quality);
+
+  g_type_class_unref (cls);
+}
+#endif
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/image-device/quality", test_quality);
+  g_test_add_func ("/image-device/quality/gate", test_quality_gate);
+#if HAVE_DRIVER_VFS5011
+  g_test_add_func ("/image-device/quality/gate/vfs5011", test_quality_gate_vfs5011);
+#endif
+
+  return g_test_run ();
+}
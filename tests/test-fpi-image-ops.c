@@ -0,0 +1,273 @@
+/*
+ * Raw frame preprocessing unit tests
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include "fpi-compat.h"
+#include "fpi-image-ops.h"
+#include "fpi-image.h"
+
+static gint
+cmp_u16 (gconstpointer a, gconstpointer b)
+{
+  return (gint) * (const guint16 *) a - (gint) * (const guint16 *) b;
+}
+
+static void
+test_percentiles (void)
+{
+  g_autoptr(GRand) rand = g_rand_new_with_seed (0x1234);
+  const guint32 ranges[] = { 1, 3, 300, 4096, 16384, 65536 };
+
+  for (guint i = 0; i < 200; i++)
+    {
+      gsize len = g_rand_int_range (rand, 1, 10000);
+      guint32 range = ranges[i % G_N_ELEMENTS (ranges)];
+      guint32 base = g_rand_int_range (rand, 0, 65536 - range + 1);
+      g_autofree guint16 *data = g_new (guint16, len);
+      g_autofree guint16 *sorted = NULL;
+      const gsize ranks[] = { 0, len * 3 / 10, len / 2, len * 65 / 100, len - 1 };
+      guint16 values[G_N_ELEMENTS (ranks)];
+      guint16 min, max;
+
+      for (gsize j = 0; j < len; j++)
+        data[j] = base + g_rand_int_range (rand, 0, range);
+
+      sorted = g_memdup2 (data, len * sizeof (guint16));
+      qsort (sorted, len, sizeof (guint16), cmp_u16);
+
+      fpi_image_u16_percentiles (data, len, ranks, values, G_N_ELEMENTS (ranks));
+      for (guint r = 0; r < G_N_ELEMENTS (ranks); r++)
+        g_assert_cmpuint (values[r], ==, sorted[ranks[r]]);
+
+      fpi_image_u16_min_max (data, len, &min, &max);
+      g_assert_cmpuint (min, ==, sorted[0]);
+      g_assert_cmpuint (max, ==, sorted[len - 1]);
+    }
+}
+
+static void
+test_map_levels (void)
+{
+  static const guint8 values[] = { 0, 99, 155, 255 };
+  const guint16 levels[] = { 100, 200, 300, 400 };
+  guint16 data[] = { 0, 100, 150, 199, 200, 250, 300, 399, 400, 1000 };
+  guint8 out[G_N_ELEMENTS (data)];
+
+  fpi_image_u16_map_levels (data, out, G_N_ELEMENTS (data),
+                            levels, values, G_N_ELEMENTS (levels));
+
+  for (guint i = 0; i < G_N_ELEMENTS (data); i++)
+    {
+      guint px = CLAMP (data[i], levels[0], levels[3]);
+      guint expected;
+
+      if (px < levels[1])
+        expected = (px - levels[0]) * 99 / (levels[1] - levels[0]);
+      else if (px < levels[2])
+        expected = 99 + (px - levels[1]) * 56 / (levels[2] - levels[1]);
+      else
+        expected = 155 + (px - levels[2]) * 100 / (levels[3] - levels[2]);
+
+      g_assert_cmpuint (out[i], ==, expected);
+    }
+}
+
+static void
+test_map_levels_reuse (void)
+{
+  static const guint8 values[] = { 0, 0xff };
+  const guint16 wide[] = { 0, 1000 };
+  const guint16 narrow[] = { 10, 20 };
+  guint16 data[] = { 0, 10, 15, 20, 500, 1000 };
+  guint8 out[G_N_ELEMENTS (data)];
+
+  /* Switching between level sets rebuilds the table every time */
+  for (guint i = 0; i < 3; i++)
+    {
+      fpi_image_u16_map_levels (data, out, G_N_ELEMENTS (data),
+                                wide, values, G_N_ELEMENTS (wide));
+      for (guint j = 0; j < G_N_ELEMENTS (data); j++)
+        g_assert_cmpuint (out[j], ==, data[j] * 255 / 1000);
+
+      fpi_image_u16_map_levels (data, out, G_N_ELEMENTS (data),
+                                narrow, values, G_N_ELEMENTS (narrow));
+      for (guint j = 0; j < G_N_ELEMENTS (data); j++)
+        g_assert_cmpuint (out[j], ==, (CLAMP (data[j], 10, 20) - 10) * 255 / 10);
+    }
+}
+
+static void
+test_map_levels_descending (void)
+{
+  static const guint8 values[] = { 0, 99, 255 };
+  const guint16 levels[] = { 10, 30, 20 };
+  guint16 data[] = { 10, 20, 30 };
+  guint8 out[G_N_ELEMENTS (data)] = { 42, 42, 42 };
+
+  /* Rejected before anything is written */
+  g_test_expect_message (G_LOG_DOMAIN, G_LOG_LEVEL_CRITICAL,
+                         "*levels[k] <= levels[k + 1]*");
+  fpi_image_u16_map_levels (data, out, G_N_ELEMENTS (data),
+                            levels, values, G_N_ELEMENTS (levels));
+  g_test_assert_expected_messages ();
+
+  for (guint i = 0; i < G_N_ELEMENTS (out); i++)
+    g_assert_cmpuint (out[i], ==, 42);
+}
+
+static void
+test_stretch (void)
+{
+  guint16 data[] = { 1000, 1500, 2000, 1001 };
+  guint16 flat[] = { 42, 42, 42 };
+  guint8 out[G_N_ELEMENTS (data)];
+
+  fpi_image_u16_stretch (data, out, G_N_ELEMENTS (data));
+  g_assert_cmpuint (out[0], ==, 0);
+  g_assert_cmpuint (out[1], ==, 127);
+  g_assert_cmpuint (out[2], ==, 255);
+  g_assert_cmpuint (out[3], ==, 0);
+
+  fpi_image_u16_stretch (flat, out, G_N_ELEMENTS (flat));
+  g_assert_cmpuint (out[0], ==, 0);
+  g_assert_cmpuint (out[1], ==, 0);
+  g_assert_cmpuint (out[2], ==, 0);
+}
+
+static void
+test_subtract (void)
+{
+  guint16 frame[] = { 10, 20, 30, 40 };
+  const guint16 background[] = { 15, 20, 25, 0 };
+  guint8 frame8[] = { 10, 200, 100, 0 };
+  const guint8 background8[] = { 20, 100, 200, 10 };
+  gsize n_clamped;
+
+  g_assert_cmpuint (fpi_image_u16_subtract (frame, background,
+                                            G_N_ELEMENTS (frame),
+                                            &n_clamped), ==, 45);
+  g_assert_cmpuint (n_clamped, ==, 1);
+  g_assert_cmpuint (frame[0], ==, 0);
+  g_assert_cmpuint (frame[1], ==, 0);
+  g_assert_cmpuint (frame[2], ==, 5);
+  g_assert_cmpuint (frame[3], ==, 40);
+
+  frame[0] = 10;
+  g_assert_cmpuint (fpi_image_u16_absdiff (frame, background,
+                                           G_N_ELEMENTS (frame)), ==, 85);
+  g_assert_cmpuint (frame[0], ==, 5);
+  g_assert_cmpuint (frame[2], ==, 20);
+
+  g_assert_cmpuint (fpi_image_u8_subtract_from (frame8, background8,
+                                                G_N_ELEMENTS (frame8),
+                                                4), ==, 335);
+  g_assert_cmpuint (frame8[0], ==, 40);
+  g_assert_cmpuint (frame8[1], ==, 0);
+  g_assert_cmpuint (frame8[2], ==, 255);
+  g_assert_cmpuint (frame8[3], ==, 40);
+}
+
+static void
+test_normalize (void)
+{
+  g_autoptr(GRand) rand = g_rand_new_with_seed (0x5678);
+
+  for (guint i = 0; i < 64; i++)
+    {
+      guint width = g_rand_int_range (rand, 1, 70);
+      guint height = g_rand_int_range (rand, 1, 40);
+      gsize stride = width + g_rand_int_range (rand, 0, 20);
+      gboolean h_flip = i & 1, v_flip = i & 2, invert = i & 4;
+      g_autofree guint8 *src = g_malloc (stride * height);
+      g_autofree guint8 *out = g_malloc (width * height);
+
+      for (gsize j = 0; j < stride * height; j++)
+        src[j] = g_rand_int_range (rand, 0, 256);
+
+      fpi_image_u8_normalize (src, stride, out, width, height, h_flip, v_flip, invert);
+
+      for (guint y = 0; y < height; y++)
+        for (guint x = 0; x < width; x++)
+          {
+            guint sx = h_flip ? width - 1 - x : x;
+            guint sy = v_flip ? height - 1 - y : y;
+            guint8 expected = src[sy * stride + sx];
+
+            if (invert)
+              expected = 0xff - expected;
+            g_assert_cmpuint (out[y * width + x], ==, expected);
+          }
+    }
+}
+
+static void
+test_view (void)
+{
+  const guint width = 40, height = 24, stride = 64, offset = 3 * 64 + 5;
+  g_autoptr(GRand) rand = g_rand_new_with_seed (0x9abc);
+  g_autoptr(GBytes) buffer = NULL;
+  g_autoptr(FpImage) view = NULL;
+  g_autoptr(FpImage) packed = NULL;
+  guint8 *data = g_malloc (offset + height * stride);
+  const guint8 *pixels;
+  gsize view_stride, len;
+
+  for (gsize j = 0; j < offset + height * stride; j++)
+    data[j] = g_rand_int_range (rand, 0, 256);
+  buffer = g_bytes_new_take (data, offset + height * stride);
+
+  view = fpi_image_new_view (buffer, offset, stride, width, height,
+                             FPI_IMAGE_V_FLIPPED);
+  g_assert_cmpuint (view->width, ==, width);
+  g_assert_cmpuint (view->height, ==, height);
+  g_assert_cmpint (view->flags, ==, FPI_IMAGE_V_FLIPPED);
+
+  /* No copy until the data is asked for */
+  pixels = fpi_image_get_pixels (view, &view_stride);
+  g_assert_true (pixels == data + offset);
+  g_assert_cmpuint (view_stride, ==, stride);
+
+  packed = fp_image_new (width, height);
+  for (guint y = 0; y < height; y++)
+    memcpy (packed->data + y * width, data + offset + y * stride, width);
+  g_assert_cmpfloat (fpi_image_get_quality (view), ==, fpi_image_get_quality (packed));
+
+  /* Rows are packed but still in the captured orientation */
+  pixels = fp_image_get_data (view, &len);
+  g_assert_cmpmem (pixels, len, packed->data, width * height);
+  g_assert_true (fpi_image_get_pixels (view, &view_stride) == pixels);
+  g_assert_cmpuint (view_stride, ==, width);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/image-ops/percentiles", test_percentiles);
+  g_test_add_func ("/image-ops/map-levels", test_map_levels);
+  g_test_add_func ("/image-ops/map-levels/reuse", test_map_levels_reuse);
+  g_test_add_func ("/image-ops/map-levels/descending", test_map_levels_descending);
+  g_test_add_func ("/image-ops/stretch", test_stretch);
+  g_test_add_func ("/image-ops/subtract", test_subtract);
+  g_test_add_func ("/image-ops/normalize", test_normalize);
+  g_test_add_func ("/image-ops/view", test_view);
+
+  return g_test_run ();
+}
@@ -0,0 +1,354 @@
+/*
+ * FpiUsbRegSequence Unit tests
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+
+#include "fpi-usb-transfer.h"
+#include "test-device-fake.h"
+
+/* There is no USB device behind the fake device, so submitted transfers are
+ * queued here instead and completed by the tests. */
+static void mock_transfer_submit (FpiUsbTransfer        *transfer,
+                                  guint                  timeout_ms,
+                                  GCancellable          *cancellable,
+                                  FpiUsbTransferCallback callback,
+                                  gpointer               user_data);
+
+#define fpi_usb_transfer_submit mock_transfer_submit
+#include "fpi-usb-reg-sequence.c"
+#undef fpi_usb_transfer_submit
+
+static GQueue submitted = G_QUEUE_INIT;
+static guint max_queued;
+
+static void
+mock_transfer_submit (FpiUsbTransfer        *transfer,
+                      guint                  timeout_ms,
+                      GCancellable          *cancellable,
+                      FpiUsbTransferCallback callback,
+                      gpointer               user_data)
+{
+  g_assert_null (transfer->callback);
+
+  transfer->callback = callback;
+  transfer->user_data = user_data;
+
+  g_queue_push_tail (&submitted, transfer);
+  max_queued = MAX (max_queued, submitted.length);
+}
+
+/* Completes the nth queued transfer the same way fpi-usb-transfer.c does */
+static void
+mock_transfer_complete (guint nth, GError *error)
+{
+  FpiUsbTransfer *transfer = g_queue_pop_nth (&submitted, nth);
+  FpiUsbTransferCallback callback;
+
+  g_assert_nonnull (transfer);
+
+  transfer->actual_length = error ? 0 : transfer->length;
+  callback = transfer->callback;
+  transfer->callback = NULL;
+  callback (transfer, transfer->device, transfer->user_data, error);
+
+  fpi_usb_transfer_unref (transfer);
+}
+
+typedef struct
+{
+  gboolean called;
+  GError  *error;
+} WriteData;
+
+static void
+write_cb (FpiUsbRegSequence *sequence, FpDevice *dev,
+          gpointer user_data, GError *error)
+{
+  WriteData *data = user_data;
+
+  g_assert_false (data->called);
+  data->called = TRUE;
+  data->error = error;
+}
+
+static FpDevice *
+mock_setup (void)
+{
+  g_assert_true (g_queue_is_empty (&submitted));
+  max_queued = 0;
+
+  return g_object_new (FPI_TYPE_DEVICE_FAKE, NULL);
+}
+
+static void
+assert_bulk_transfer (FpiUsbTransfer *transfer, const guint8 *expected,
+                      gsize expected_len)
+{
+  g_assert_cmpint (transfer->type, ==, FP_TRANSFER_BULK);
+  g_assert_cmpuint (transfer->endpoint, ==, 0x02);
+  g_assert_true (transfer->short_is_error);
+  g_assert_cmpmem (transfer->buffer, transfer->length, expected, expected_len);
+}
+
+static void
+test_reg_sequence_bulk (void)
+{
+  g_autoptr(FpDevice) device = mock_setup ();
+  g_autoptr(FpiUsbRegSequence) sequence = NULL;
+  const guint8 packet0[] = { 0x10, 0x00, 0x11, 0x01 };
+  const guint8 packet1[] = { 0x12, 0x02, 0x13, 0x03, 0x14, 0x04 };
+  const guint8 packet2[] = { 0x15, 0x05, 0x16, 0x06 };
+  WriteData data = { 0 };
+  guint i;
+
+  sequence = fpi_usb_reg_sequence_new_bulk (0x02, 3);
+  fpi_usb_reg_sequence_add (sequence, 0x10, 0x00);
+  fpi_usb_reg_sequence_add (sequence, 0x11, 0x01);
+  fpi_usb_reg_sequence_add_break (sequence);
+  for (i = 2; i < 7; i++)
+    fpi_usb_reg_sequence_add (sequence, 0x10 + i, i);
+
+  /* The break starts a new transfer, which is then split at 3 registers */
+  g_assert_cmpuint (fpi_usb_reg_sequence_get_n_transfers (sequence), ==, 3);
+
+  fpi_usb_reg_sequence_write (sequence, device, 1000, NULL, write_cb, &data);
+
+  g_assert_cmpuint (submitted.length, ==, 1);
+  assert_bulk_transfer (g_queue_peek_head (&submitted), packet0, sizeof (packet0));
+  mock_transfer_complete (0, NULL);
+
+  g_assert_cmpuint (submitted.length, ==, 1);
+  assert_bulk_transfer (g_queue_peek_head (&submitted), packet1, sizeof (packet1));
+  mock_transfer_complete (0, NULL);
+
+  g_assert_cmpuint (submitted.length, ==, 1);
+  assert_bulk_transfer (g_queue_peek_head (&submitted), packet2, sizeof (packet2));
+  g_assert_false (data.called);
+  mock_transfer_complete (0, NULL);
+
+  g_assert_true (g_queue_is_empty (&submitted));
+  g_assert_true (data.called);
+  g_assert_no_error (data.error);
+  g_assert_cmpuint (max_queued, ==, 1);
+}
+
+static void
+test_reg_sequence_bulk_leading_break (void)
+{
+  g_autoptr(FpiUsbRegSequence) sequence = NULL;
+
+  /* Breaks never create empty transfers */
+  sequence = fpi_usb_reg_sequence_new_bulk (0x02, 16);
+  fpi_usb_reg_sequence_add_break (sequence);
+  fpi_usb_reg_sequence_add (sequence, 0x10, 0x00);
+  fpi_usb_reg_sequence_add_break (sequence);
+  fpi_usb_reg_sequence_add_break (sequence);
+  fpi_usb_reg_sequence_add (sequence, 0x11, 0x01);
+  fpi_usb_reg_sequence_add_break (sequence);
+
+  g_assert_cmpuint (fpi_usb_reg_sequence_get_n_transfers (sequence), ==, 2);
+}
+
+static void
+test_reg_sequence_control (void)
+{
+  g_autoptr(FpDevice) device = mock_setup ();
+  g_autoptr(FpiUsbRegSequence) sequence = NULL;
+  WriteData data = { 0 };
+  guint i;
+
+  sequence = fpi_usb_reg_sequence_new_control (G_USB_DEVICE_REQUEST_TYPE_VENDOR,
+                                               G_USB_DEVICE_RECIPIENT_DEVICE,
+                                               0x0c);
+  for (i = 0; i < 3; i++)
+    fpi_usb_reg_sequence_add (sequence, 0x20 + i, 0x80 + i);
+
+  g_assert_cmpuint (fpi_usb_reg_sequence_get_n_transfers (sequence), ==, 3);
+
+  fpi_usb_reg_sequence_write (sequence, device, 1000, NULL, write_cb, &data);
+
+  for (i = 0; i < 3; i++)
+    {
+      FpiUsbTransfer *transfer;
+
+      g_assert_cmpuint (submitted.length, ==, 1);
+      transfer = g_queue_peek_head (&submitted);
+
+      g_assert_cmpint (transfer->type, ==, FP_TRANSFER_CONTROL);
+      g_assert_cmpint (transfer->direction, ==, G_USB_DEVICE_DIRECTION_HOST_TO_DEVICE);
+      g_assert_cmpint (transfer->request_type, ==, G_USB_DEVICE_REQUEST_TYPE_VENDOR);
+      g_assert_cmpint (transfer->recipient, ==, G_USB_DEVICE_RECIPIENT_DEVICE);
+      g_assert_cmpuint (transfer->request, ==, 0x0c);
+      g_assert_cmpuint (transfer->value, ==, 0);
+      g_assert_cmpuint (transfer->idx, ==, 0x20 + i);
+      g_assert_cmpint (transfer->length, ==, 1);
+      g_assert_cmpuint (transfer->buffer[0], ==, 0x80 + i);
+
+      mock_transfer_complete (0, NULL);
+    }
+
+  g_assert_true (data.called);
+  g_assert_no_error (data.error);
+}
+
+static void
+test_reg_sequence_empty (void)
+{
+  g_autoptr(FpDevice) device = mock_setup ();
+  g_autoptr(FpiUsbRegSequence) sequence = NULL;
+  WriteData data = { 0 };
+
+  sequence = fpi_usb_reg_sequence_new_bulk (0x02, 16);
+  fpi_usb_reg_sequence_add_break (sequence);
+
+  fpi_usb_reg_sequence_write (sequence, device, 1000, NULL, write_cb, &data);
+
+  g_assert_true (data.called);
+  g_assert_no_error (data.error);
+  g_assert_true (g_queue_is_empty (&submitted));
+}
+
+static void
+test_reg_sequence_failure (void)
+{
+  g_autoptr(FpDevice) device = mock_setup ();
+  g_autoptr(FpiUsbRegSequence) sequence = NULL;
+  WriteData data = { 0 };
+
+  /* Transfers start at index 0, 3 (0x13), 6 (0x16) and 8 */
+  sequence = fpi_usb_reg_sequence_new_bulk (0x02, 2);
+  fpi_usb_reg_sequence_add (sequence, 0x10, 0x00);
+  fpi_usb_reg_sequence_add (sequence, 0x11, 0x01);
+  fpi_usb_reg_sequence_add_break (sequence);
+  fpi_usb_reg_sequence_add (sequence, 0x13, 0x03);
+  fpi_usb_reg_sequence_add (sequence, 0x14, 0x04);
+  fpi_usb_reg_sequence_add_break (sequence);
+  fpi_usb_reg_sequence_add (sequence, 0x16, 0x06);
+  fpi_usb_reg_sequence_add (sequence, 0x17, 0x07);
+  fpi_usb_reg_sequence_add (sequence, 0x18, 0x08);
+  g_assert_cmpuint (fpi_usb_reg_sequence_get_n_transfers (sequence), ==, 4);
+
+  fpi_usb_reg_sequence_write (sequence, device, 1000, NULL, write_cb, &data);
+
+  mock_transfer_complete (0, NULL);
+  g_assert_cmpuint (submitted.length, ==, 1);
+  g_assert_false (data.called);
+
+  /* The second transfer fails, the rest is not sent anymore */
+  mock_transfer_complete (0, g_error_new_literal (G_USB_DEVICE_ERROR,
+                                                  G_USB_DEVICE_ERROR_TIMED_OUT,
+                                                  "second"));
+  g_assert_true (g_queue_is_empty (&submitted));
+  g_assert_true (data.called);
+  g_assert_cmpuint (max_queued, ==, 1);
+
+  g_assert_error (data.error, G_USB_DEVICE_ERROR, G_USB_DEVICE_ERROR_TIMED_OUT);
+  g_assert_cmpstr (data.error->message, ==,
+                   "Writing register 3 (0x13) failed: second");
+  g_clear_error (&data.error);
+}
+
+typedef struct
+{
+  guint8 reg;
+  guint8 value;
+} TestRegWrite;
+
+static guint n_built;
+
+static FpiUsbRegSequence *
+build_test_sequence (gconstpointer table, guint n_entries)
+{
+  const TestRegWrite *regs = table;
+  FpiUsbRegSequence *sequence;
+  guint i;
+
+  n_built++;
+  sequence = fpi_usb_reg_sequence_new_bulk (0x02, 16);
+  for (i = 0; i < n_entries; i++)
+    fpi_usb_reg_sequence_add (sequence, regs[i].reg, regs[i].value);
+
+  return sequence;
+}
+
+static FpiUsbRegSequence *
+get_test_sequence (FpDevice *device, const TestRegWrite *regs, guint n_regs)
+{
+  return fpi_usb_reg_sequence_get_cached (device, regs, n_regs * sizeof (*regs),
+                                          build_test_sequence, n_regs);
+}
+
+static void
+test_reg_sequence_cached (void)
+{
+  g_autoptr(FpDevice) device = mock_setup ();
+  g_autoptr(FpDevice) other_device = mock_setup ();
+  g_autoptr(FpiUsbRegSequence) sequence = NULL;
+  g_autoptr(FpiUsbRegSequence) again = NULL;
+  g_autoptr(FpiUsbRegSequence) other = NULL;
+  g_autoptr(FpiUsbRegSequence) changed = NULL;
+  TestRegWrite regs[] = { { 0x10, 0x00 }, { 0x11, 0x01 }, { 0x12, 0x02 } };
+
+  n_built = 0;
+
+  /* A table is only built once per device */
+  sequence = get_test_sequence (device, regs, G_N_ELEMENTS (regs));
+  again = get_test_sequence (device, regs, G_N_ELEMENTS (regs));
+  g_assert_true (sequence == again);
+  g_assert_cmpuint (n_built, ==, 1);
+
+  other = get_test_sequence (other_device, regs, G_N_ELEMENTS (regs));
+  g_assert_true (other != sequence);
+  g_assert_cmpuint (n_built, ==, 2);
+
+  /* Changing the table, or only using a part of it, builds it again */
+  regs[1].value = 0xff;
+  changed = get_test_sequence (device, regs, G_N_ELEMENTS (regs));
+  g_assert_true (changed != sequence);
+  g_assert_cmpuint (sequence->n_entries, ==, 3);
+  g_assert_cmpuint (changed->data->data[3], ==, 0xff);
+  g_clear_pointer (&again, fpi_usb_reg_sequence_unref);
+  again = get_test_sequence (device, regs, 2);
+  g_assert_true (again != changed);
+  g_assert_cmpuint (again->n_entries, ==, 2);
+  g_assert_cmpuint (n_built, ==, 4);
+
+  /* The device drops its references when it is freed */
+  g_assert_cmpint (again->ref_count, ==, 2);
+  g_assert_cmpint (other->ref_count, ==, 2);
+  g_clear_object (&device);
+  g_clear_object (&other_device);
+  g_assert_cmpint (again->ref_count, ==, 1);
+  g_assert_cmpint (other->ref_count, ==, 1);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/usb-reg-sequence/bulk", test_reg_sequence_bulk);
+  g_test_add_func ("/usb-reg-sequence/bulk/leading-break", test_reg_sequence_bulk_leading_break);
+  g_test_add_func ("/usb-reg-sequence/control", test_reg_sequence_control);
+  g_test_add_func ("/usb-reg-sequence/empty", test_reg_sequence_empty);
+  g_test_add_func ("/usb-reg-sequence/failure", test_reg_sequence_failure);
+  g_test_add_func ("/usb-reg-sequence/cached", test_reg_sequence_cached);
+
+  return g_test_run ();
+}
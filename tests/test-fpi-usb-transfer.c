@@ -0,0 +1,168 @@
+/*
+ * FpiUsbTransfer Unit tests
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#include "fpi-usb-transfer.h"
+#include "test-device-fake.h"
+
+#define TRACE_RING_SIZE 8
+#define N_TRANSFERS 6
+#define IN_LENGTH 20
+
+static void
+transfer_cancelled_cb (FpiUsbTransfer *transfer, FpDevice *device,
+                       gpointer user_data, GError *error)
+{
+  gboolean *completed = user_data;
+
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_assert_cmpint (transfer->actual_length, ==, -1);
+  g_error_free (error);
+
+  *completed = TRUE;
+}
+
+static void
+submit_cancelled_transfer (FpDevice *device, GCancellable *cancellable, guint n)
+{
+  FpiUsbTransfer *transfer;
+  gboolean completed = FALSE;
+
+  transfer = fpi_usb_transfer_new (device);
+
+  if (n % 2 == 0)
+    {
+      guint8 *data = g_malloc (4 + n);
+      guint i;
+
+      for (i = 0; i < 4 + n; i++)
+        data[i] = n * 16 + i;
+
+      fpi_usb_transfer_fill_bulk_full (transfer, 0x01 + n, data, 4 + n, g_free);
+    }
+  else
+    {
+      fpi_usb_transfer_fill_bulk (transfer, FPI_USB_ENDPOINT_IN | n, IN_LENGTH);
+    }
+
+  fpi_usb_transfer_submit (transfer, 1000, cancellable,
+                           transfer_cancelled_cb, &completed);
+
+  while (!completed)
+    g_main_context_iteration (NULL, TRUE);
+}
+
+static void
+test_trace_ring_dump (void)
+{
+  g_autoptr(FpDevice) device = NULL;
+  g_autoptr(GCancellable) cancellable = NULL;
+  g_autofree gchar *dump = NULL;
+  g_auto(GStrv) lines = NULL;
+  gint64 last_time = 0;
+  guint i;
+
+  dump = fpi_usb_transfer_trace_dump ();
+  if (!dump)
+    {
+      g_test_skip ("Transfer tracing is not enabled in this build");
+      return;
+    }
+  g_assert_cmpstr (dump, ==, "");
+
+  device = g_object_new (FPI_TYPE_DEVICE_FAKE, NULL);
+  cancellable = g_cancellable_new ();
+  g_cancellable_cancel (cancellable);
+
+  for (i = 0; i < N_TRANSFERS; i++)
+    submit_cancelled_transfer (device, cancellable, i);
+
+  g_clear_pointer (&dump, g_free);
+  dump = fpi_usb_transfer_trace_dump ();
+  g_assert_true (g_str_has_suffix (dump, "\n"));
+  dump[strlen (dump) - 1] = '\0';
+  lines = g_strsplit (dump, "\n", -1);
+
+  /* Each transfer records a submit and a completion, so the ring wrapped
+   * around and only holds the last TRACE_RING_SIZE / 2 transfers. */
+  g_assert_cmpuint (g_strv_length (lines), ==, TRACE_RING_SIZE);
+
+  for (i = 0; i < TRACE_RING_SIZE; i++)
+    {
+      g_autoptr(GString) expected = NULL;
+      g_auto(GStrv) fields = NULL;
+      guint n = N_TRANSFERS - TRACE_RING_SIZE / 2 + i / 2;
+      gboolean submit = i % 2 == 0;
+      gboolean in = n % 2 == 1;
+      gint64 time;
+
+      fields = g_strsplit (lines[i], " ", 3);
+      g_assert_cmpuint (g_strv_length (fields), ==, 3);
+
+      time = g_ascii_strtoll (fields[0], NULL, 10);
+      g_assert_cmpint (time, >=, last_time);
+      last_time = time;
+
+      /* Submit and completion refer to the same transfer. */
+      if (!submit)
+        {
+          g_auto(GStrv) submit_fields = g_strsplit (lines[i - 1], " ", 3);
+
+          g_assert_cmpstr (fields[1], ==, submit_fields[1]);
+        }
+
+      expected = g_string_new (NULL);
+      g_string_append_printf (expected, "%s type %d endpoint 0x%02x length %d",
+                              submit ? "submit" : "complete",
+                              FP_TRANSFER_BULK,
+                              in ? FPI_USB_ENDPOINT_IN | n : 0x01 + n,
+                              submit ? (gint) (in ? IN_LENGTH : 4 + n) : -1);
+
+      if (!submit)
+        g_string_append_printf (expected, " error %s:%d",
+                                g_quark_to_string (G_IO_ERROR),
+                                G_IO_ERROR_CANCELLED);
+
+      if (submit && !in)
+        {
+          guint j;
+
+          g_string_append_c (expected, ':');
+          for (j = 0; j < 4 + n; j++)
+            g_string_append_printf (expected, " %02x", n * 16 + j);
+        }
+
+      g_assert_cmpstr (fields[2], ==, expected->str);
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  /* The ring configuration is read once, on the first transfer. */
+  g_setenv ("FP_DEBUG_TRANSFER_RING", G_STRINGIFY (TRACE_RING_SIZE), TRUE);
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/usb-transfer/trace-ring/dump", test_trace_ring_dump);
+
+  return g_test_run ();
+}
@@ -0,0 +1,434 @@
+/*
+ * Goodix protocol unit tests
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <cairo.h>
+#include <glib.h>
+
+#include "fpi-image-ops.h"
+#include "drivers/goodixtls/goodix_proto.h"
+#include "test-config.h"
+
+#define TRANSFER_SIZE 4096
+
+static gboolean
+points_into (const guint8 *ptr, const guint8 *buffer, gsize len)
+{
+  return ptr >= buffer && ptr < buffer + len;
+}
+
+/* Feeds data the way the device delivers it, split into bulk transfers.
+ * Returns the number of transfers it took until a pack was complete, the
+ * pack is returned as a copy because it may point into @data. */
+static guint
+feed_transfers (GoodixPackAssembler *assembler, guint8 *data, guint32 data_len,
+                guint8 *flags, GBytes **out, gboolean *in_assembler)
+{
+  gboolean valid_checksum;
+  guint8 *decoded = NULL;
+  guint16 decoded_len;
+  guint32 pos;
+  guint n_transfers = 0;
+
+  for (pos = 0; pos < data_len && !decoded; pos += TRANSFER_SIZE)
+    {
+      guint32 len = MIN (TRANSFER_SIZE, data_len - pos);
+
+      n_transfers++;
+      if (!goodix_pack_assembler_feed (assembler, data + pos, len, flags,
+                                       &decoded, &decoded_len, &valid_checksum))
+        decoded = NULL;
+    }
+
+  g_assert_nonnull (decoded);
+  g_assert_true (valid_checksum);
+  g_assert_cmpuint (pos, >=, data_len);
+
+  *in_assembler = points_into (decoded, assembler->data, GOODIX_PACK_MAX_SIZE);
+  /* Only the last pack is still needed, so data may go away */
+  if (n_transfers == 1)
+    g_assert_true (points_into (decoded, data, data_len));
+  *out = g_bytes_new (decoded, decoded_len);
+
+  return n_transfers;
+}
+
+/* Replays a pack padded to the endpoint size. Returns the number of
+ * transfers. */
+static guint
+replay_pack (GoodixPackAssembler *assembler, const guint8 *payload,
+             guint16 payload_len, gboolean *in_assembler)
+{
+  g_autofree guint8 *data = NULL;
+  g_autoptr(GBytes) decoded = NULL;
+  guint32 data_len;
+  guint8 flags;
+  guint n_transfers;
+
+  goodix_encode_pack (GOODIX_FLAGS_TLS_DATA, (guint8 *) payload, payload_len,
+                      TRUE, &data, &data_len);
+
+  n_transfers = feed_transfers (assembler, data, data_len, &flags, &decoded,
+                                in_assembler);
+
+  g_assert_cmpuint (flags, ==, GOODIX_FLAGS_TLS_DATA);
+  g_assert_cmpmem (g_bytes_get_data (decoded, NULL), g_bytes_get_size (decoded),
+                   payload, payload_len);
+
+  return n_transfers;
+}
+
+static void
+test_single_transfer (void)
+{
+  GoodixPackAssembler assembler;
+  const guint8 payload[] = { 0x17, 0x03, 0x03, 0x00, 0x01, 0x42 };
+  gboolean in_assembler;
+
+  goodix_pack_assembler_init (&assembler);
+
+  g_assert_cmpuint (replay_pack (&assembler, payload, sizeof (payload),
+                                 &in_assembler), ==, 1);
+  g_assert_false (in_assembler);
+  g_assert_cmpuint (assembler.length, ==, 0);
+
+  goodix_pack_assembler_clear (&assembler);
+  g_assert_null (assembler.data);
+}
+
+static void
+test_fragmented (void)
+{
+  g_autoptr(GRand) rand = g_rand_new_with_seed (0x55);
+  GoodixPackAssembler assembler;
+  const guint16 sizes[] = { 15000, 6, G_MAXUINT16, 12345, 100 };
+  guint8 *buffer;
+  guint i;
+
+  goodix_pack_assembler_init (&assembler);
+  buffer = assembler.data;
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+    {
+      g_autofree guint8 *payload = g_malloc (sizes[i]);
+      gboolean in_assembler;
+      guint j;
+
+      for (j = 0; j < sizes[i]; j++)
+        payload[j] = g_rand_int (rand);
+
+      if (replay_pack (&assembler, payload, sizes[i], &in_assembler) > 1)
+        g_assert_true (in_assembler);
+
+      /* The reassembly buffer is never reallocated */
+      g_assert_true (assembler.data == buffer);
+      g_assert_cmpuint (assembler.length, ==, 0);
+    }
+
+  goodix_pack_assembler_clear (&assembler);
+}
+
+static void
+test_resync (void)
+{
+  GoodixPackAssembler assembler;
+  const guint16 sizes[] = { 100, 5000 };
+  const guint prefixes[] = { 10, TRANSFER_SIZE, 3 * TRANSFER_SIZE + 7 };
+  /* Headers with a bad checksum, claiming a huge pack that would swallow
+   * the following ones, or a small one that fits into the transfer and
+   * would be decoded from the garbage. */
+  const guint8 garbage[] = { 0xff, 0x01 };
+  guint i, j, k;
+
+  goodix_pack_assembler_init (&assembler);
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+    for (j = 0; j < G_N_ELEMENTS (prefixes); j++)
+      for (k = 0; k < G_N_ELEMENTS (garbage); k++)
+        {
+          g_autofree guint8 *payload = g_malloc (sizes[i]);
+          g_autofree guint8 *pack = NULL;
+          g_autofree guint8 *data = NULL;
+          g_autoptr(GBytes) decoded = NULL;
+          gboolean in_assembler;
+          guint32 pack_len;
+          guint8 flags;
+
+          memset (payload, 0x5a + i, sizes[i]);
+          goodix_encode_pack (GOODIX_FLAGS_TLS_DATA, payload, sizes[i], TRUE,
+                              &pack, &pack_len);
+
+          data = g_malloc (prefixes[j] + pack_len);
+          memset (data, garbage[k], prefixes[j]);
+          memcpy (data + prefixes[j], pack, pack_len);
+
+          feed_transfers (&assembler, data, prefixes[j] + pack_len, &flags,
+                          &decoded, &in_assembler);
+
+          g_assert_true (in_assembler);
+          g_assert_cmpuint (flags, ==, GOODIX_FLAGS_TLS_DATA);
+          g_assert_cmpmem (g_bytes_get_data (decoded, NULL),
+                           g_bytes_get_size (decoded), payload, sizes[i]);
+          g_assert_cmpuint (assembler.length, ==, 0);
+        }
+
+  goodix_pack_assembler_clear (&assembler);
+}
+
+/* The separate unpack, crop, background and stretch steps the drivers used
+ * before, the fused decoder has to match them bit for bit. */
+static void
+reference_decode (const guint8 *raw, guint scan_width, guint width,
+                  guint height, const guint16 *background, guint8 *out)
+{
+  g_autofree guint16 *uncropped = g_new (guint16, scan_width * height);
+  g_autofree guint16 *frame = g_new (guint16, width * height);
+  guint16 *pix = uncropped;
+  guint i, x, y;
+
+  for (i = 0; i < scan_width * height / 4 * 6; i += 6)
+    {
+      const guint8 *chunk = raw + i;
+      *pix++ = ((chunk[0] & 0xf) << 8) + chunk[1];
+      *pix++ = (chunk[3] << 4) + (chunk[0] >> 4);
+      *pix++ = ((chunk[5] & 0xf) << 8) + chunk[2];
+      *pix++ = (chunk[4] << 4) + (chunk[5] >> 4);
+    }
+
+  for (y = 0; y < height; y++)
+    for (x = 0; x < width; x++)
+      frame[x + y * width] = uncropped[x + y * scan_width];
+
+  if (background)
+    fpi_image_u16_absdiff (frame, background, width * height);
+
+  fpi_image_u16_stretch (frame, out, width * height);
+}
+
+static void
+check_decode_frame (guint scan_width, gboolean with_background)
+{
+  static const guint8 values[] = { 0, 0xff };
+  g_autoptr(GRand) rand = g_rand_new_with_seed (scan_width);
+  const guint width = 64;
+  const guint height = 80;
+  const gsize raw_len = scan_width * height / 4 * 6;
+  g_autofree guint8 *raw = g_malloc (raw_len);
+  g_autofree guint16 *background = g_new (guint16, width * height);
+  g_autofree guint16 *frame = g_new (guint16, width * height);
+  g_autofree guint8 *expected = g_malloc (width * height);
+  g_autofree guint8 *out = g_malloc (width * height);
+  guint16 levels[2];
+  guint run;
+  gsize i;
+
+  for (run = 0; run < 10; run++)
+    {
+      guint64 expected_sum = 0;
+      guint64 sum;
+
+      for (i = 0; i < raw_len; i++)
+        raw[i] = g_rand_int (rand);
+      for (i = 0; i < width * height; i++)
+        background[i] = g_rand_int_range (rand, 0, 0x1000);
+
+      reference_decode (raw, scan_width, width, height,
+                        with_background ? background : NULL, expected);
+
+      sum = goodix_decode_frame (raw, scan_width, width, height,
+                                 with_background ? background : NULL,
+                                 frame, &levels[0], &levels[1]);
+      fpi_image_u16_map_levels (frame, out, width * height, levels, values,
+                                G_N_ELEMENTS (levels));
+
+      g_assert_cmpmem (out, width * height, expected, width * height);
+
+      for (i = 0; i < width * height; i++)
+        expected_sum += frame[i];
+      g_assert_cmpuint (sum, ==, expected_sum);
+    }
+}
+
+static void
+test_decode_frame_511 (void)
+{
+  check_decode_frame (88, FALSE);
+}
+
+static void
+test_decode_frame_55x4 (void)
+{
+  check_decode_frame (64, TRUE);
+}
+
+/* Packs 12 bit pixels the way the sensor sends them, the inverse of the
+ * unpacking in reference_decode(). */
+static void
+pack_pixels (const guint16 *pixels, gsize n_pixels, guint8 *raw)
+{
+  gsize i;
+
+  for (i = 0; i < n_pixels; i += 4, raw += 6)
+    {
+      const guint16 *p = pixels + i;
+
+      raw[0] = (p[0] >> 8) | ((p[1] & 0xf) << 4);
+      raw[1] = p[0] & 0xff;
+      raw[2] = p[2] & 0xff;
+      raw[3] = p[1] >> 4;
+      raw[4] = p[3] >> 4;
+      raw[5] = (p[2] >> 8) | ((p[3] & 0xf) << 4);
+    }
+}
+
+/* There is no goodix recording in the tree, so the frame is made from the
+ * centre of a recorded capture of a press sensor of similar resolution,
+ * widened to 12 bit like the goodix readings. */
+static void
+load_recorded_frame (guint width, guint height, guint16 *pixels)
+{
+  g_autofree char *path = NULL;
+  cairo_surface_t *png;
+  const guint8 *data;
+  gint stride, x0, y0;
+  guint x, y;
+
+  path = g_build_path (G_DIR_SEPARATOR_S, SOURCE_ROOT, "tests", "vfs7552",
+                       "capture.png", NULL);
+  png = cairo_image_surface_create_from_png (path);
+  g_assert_cmpint (cairo_surface_status (png), ==, CAIRO_STATUS_SUCCESS);
+  g_assert_cmpint (cairo_image_surface_get_format (png), ==, CAIRO_FORMAT_RGB24);
+  g_assert_cmpint (cairo_image_surface_get_width (png), >=, width);
+  g_assert_cmpint (cairo_image_surface_get_height (png), >=, height);
+
+  /* capture.py stores the gray value in all three colour channels */
+  data = cairo_image_surface_get_data (png);
+  stride = cairo_image_surface_get_stride (png);
+  x0 = (cairo_image_surface_get_width (png) - width) / 2;
+  y0 = (cairo_image_surface_get_height (png) - height) / 2;
+  for (y = 0; y < height; y++)
+    for (x = 0; x < width; x++)
+      {
+        guint8 v = data[(y0 + y) * stride + (x0 + x) * 4 + 1];
+
+        pixels[x + y * width] = (v << 4) | (v >> 4);
+      }
+
+  cairo_surface_destroy (png);
+}
+
+/* Decodes the recorded frame laid out like the device sends it, with
+ * @header_len bytes in front and the columns past @width filled with the
+ * unused readings of the sensor. */
+static void
+check_decode_recorded (guint scan_width, guint header_len,
+                       gboolean with_background)
+{
+  static const guint8 values[] = { 0, 0xff };
+  const guint width = 64;
+  const guint height = 80;
+  g_autofree guint16 *recorded = g_new (guint16, width * height);
+  g_autofree guint16 *scan = g_new (guint16, scan_width * height);
+  g_autofree guint16 *background = g_new (guint16, width * height);
+  g_autofree guint16 *frame = g_new (guint16, width * height);
+  g_autofree guint8 *raw = NULL;
+  g_autofree guint8 *expected = g_malloc (width * height);
+  g_autofree guint8 *out = g_malloc (width * height);
+  guint16 recorded_min = G_MAXUINT16, recorded_max = 0;
+  guint64 recorded_sum = 0;
+  guint16 levels[2];
+  guint64 sum;
+  guint x, y;
+
+  load_recorded_frame (width, height, recorded);
+
+  /* The background is a smooth gradient the finger reads above */
+  for (y = 0; y < height; y++)
+    for (x = 0; x < scan_width; x++)
+      {
+        guint16 bg = with_background ? 0x100 + 2 * x + y : 0;
+
+        if (x < width)
+          {
+            guint16 v = recorded[x + y * width];
+
+            background[x + y * width] = bg;
+            scan[x + y * scan_width] = bg + MIN (v, 0xfff - bg);
+            recorded[x + y * width] = MIN (v, 0xfff - bg);
+
+            recorded_min = MIN (recorded_min, recorded[x + y * width]);
+            recorded_max = MAX (recorded_max, recorded[x + y * width]);
+            recorded_sum += recorded[x + y * width];
+          }
+        else
+          {
+            scan[x + y * scan_width] = 0xfff;
+          }
+      }
+
+  raw = g_malloc0 (header_len + scan_width * height / 4 * 6);
+  memset (raw, 0xa5, header_len);
+  pack_pixels (scan, scan_width * height, raw + header_len);
+
+  sum = goodix_decode_frame (raw + header_len, scan_width, width, height,
+                             with_background ? background : NULL, frame,
+                             &levels[0], &levels[1]);
+
+  g_assert_cmpmem (frame, width * height * sizeof (guint16),
+                   recorded, width * height * sizeof (guint16));
+  g_assert_cmpuint (sum, ==, recorded_sum);
+  g_assert_cmpuint (levels[0], ==, recorded_min);
+  g_assert_cmpuint (levels[1], ==, recorded_max);
+  g_assert_cmpuint (levels[0], <, levels[1]);
+
+  reference_decode (raw + header_len, scan_width, width, height,
+                    with_background ? background : NULL, expected);
+  fpi_image_u16_map_levels (frame, out, width * height, levels, values,
+                            G_N_ELEMENTS (levels));
+  g_assert_cmpmem (out, width * height, expected, width * height);
+}
+
+static void
+test_decode_frame_recorded_511 (void)
+{
+  check_decode_recorded (88, 8, FALSE);
+}
+
+static void
+test_decode_frame_recorded_55x4 (void)
+{
+  check_decode_recorded (64, 0, TRUE);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/goodix-proto/single-transfer", test_single_transfer);
+  g_test_add_func ("/goodix-proto/fragmented", test_fragmented);
+  g_test_add_func ("/goodix-proto/resync", test_resync);
+  g_test_add_func ("/goodix-proto/decode-frame/511", test_decode_frame_511);
+  g_test_add_func ("/goodix-proto/decode-frame/55x4", test_decode_frame_55x4);
+  g_test_add_func ("/goodix-proto/decode-frame/recorded/511",
+                   test_decode_frame_recorded_511);
+  g_test_add_func ("/goodix-proto/decode-frame/recorded/55x4",
+                   test_decode_frame_recorded_55x4);
+
+  return g_test_run ();
+}
@@ -0,0 +1,237 @@
+/*
+ * Goodix TLS server unit tests
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include <openssl/ssl.h>
+
+#include "drivers/goodixtls/goodixtls.h"
+
+/* The sensor acts as TLS client, this emulates it in software. Records are
+ * moved between both ends by hand, the same way the driver proxies them
+ * through USB packets. */
+typedef struct
+{
+  GoodixTlsServer server;
+  SSL_CTX        *client_ctx;
+  SSL            *client;
+  BIO            *client_in;
+  BIO            *client_out;
+  guint           n_connected;
+  GError         *connection_error;
+} TlsTest;
+
+static unsigned int
+client_psk_cb (SSL *ssl, const char *hint, char *identity,
+               unsigned int max_identity_len, unsigned char *psk,
+               unsigned int max_psk_len)
+{
+  g_assert_cmpuint (max_psk_len, >=, 32);
+
+  g_strlcpy (identity, "Client_identity", max_identity_len);
+  memset (psk, 0, 32);
+
+  return 32;
+}
+
+static void
+on_connection (GoodixTlsServer *server, GError *error, gpointer user_data)
+{
+  TlsTest *test = user_data;
+
+  test->n_connected++;
+  if (error)
+    test->connection_error = g_error_copy (error);
+}
+
+static void
+tls_test_setup (TlsTest *test, gconstpointer data)
+{
+  g_autoptr(GError) error = NULL;
+
+  test->server.connection_callback = on_connection;
+  test->server.user_data = test;
+  g_assert_true (goodix_tls_server_init (&test->server, &error));
+  g_assert_no_error (error);
+
+  test->client_ctx = SSL_CTX_new (TLS_client_method ());
+  SSL_CTX_set_min_proto_version (test->client_ctx, TLS1_2_VERSION);
+  SSL_CTX_set_max_proto_version (test->client_ctx, TLS1_2_VERSION);
+  SSL_CTX_set_cipher_list (test->client_ctx, "PSK-AES128-GCM-SHA256");
+  SSL_CTX_set_psk_client_callback (test->client_ctx, client_psk_cb);
+
+  test->client = SSL_new (test->client_ctx);
+  test->client_in = BIO_new (BIO_s_mem ());
+  test->client_out = BIO_new (BIO_s_mem ());
+  SSL_set_bio (test->client, test->client_in, test->client_out);
+  SSL_set_connect_state (test->client);
+}
+
+static void
+tls_test_teardown (TlsTest *test, gconstpointer data)
+{
+  goodix_tls_server_deinit (&test->server, NULL);
+  SSL_free (test->client);
+  SSL_CTX_free (test->client_ctx);
+  g_clear_error (&test->connection_error);
+}
+
+/* Takes everything the client wants to send as one buffer */
+static GByteArray *
+client_flush (TlsTest *test)
+{
+  GByteArray *out = g_byte_array_new ();
+  guint8 buf[4096];
+  int len;
+
+  while ((len = BIO_read (test->client_out, buf, sizeof (buf))) > 0)
+    g_byte_array_append (out, buf, len);
+
+  return out;
+}
+
+/* Moves the pending server records to the client */
+static void
+server_to_client (TlsTest *test)
+{
+  guint8 buf[1024];
+  int len;
+
+  len = goodix_tls_client_recv (&test->server, buf, sizeof (buf));
+  g_assert_cmpint (len, >, 0);
+  g_assert_cmpint (BIO_write (test->client_in, buf, len), ==, len);
+
+  /* Everything fit into a single packet */
+  g_assert_cmpint (goodix_tls_client_recv (&test->server, buf, sizeof (buf)), <, 0);
+}
+
+static void
+do_handshake (TlsTest *test)
+{
+  g_autoptr(GByteArray) hello = NULL;
+  g_autoptr(GByteArray) flight = NULL;
+  gsize pos;
+
+  g_assert_cmpint (SSL_do_handshake (test->client), <=, 0);
+  hello = client_flush (test);
+  g_assert_cmpint (goodix_tls_client_send (&test->server, hello->data, hello->len), ==, hello->len);
+  server_to_client (test);
+
+  g_assert_cmpint (SSL_do_handshake (test->client), <=, 0);
+  flight = client_flush (test);
+
+  /* The device sends key exchange, change cipher spec and finished in
+   * separate packets, hand them over one record at a time. */
+  for (pos = 0; pos < flight->len;)
+    {
+      gsize len = 5 + (flight->data[pos + 3] << 8 | flight->data[pos + 4]);
+
+      g_assert_cmpuint (test->n_connected, ==, 0);
+      g_assert_cmpint (goodix_tls_client_send (&test->server, flight->data + pos, len), ==, len);
+      pos += len;
+    }
+  g_assert_cmpuint (pos, ==, flight->len);
+  g_assert_no_error (test->connection_error);
+  g_assert_cmpuint (test->n_connected, ==, 1);
+  g_assert_true (test->server.established);
+
+  server_to_client (test);
+  g_assert_cmpint (SSL_do_handshake (test->client), ==, 1);
+}
+
+static void
+test_handshake (TlsTest *test, gconstpointer data)
+{
+  do_handshake (test);
+
+  g_assert_cmpstr (SSL_get_cipher_name (test->server.ssl_layer), ==, "PSK-AES128-GCM-SHA256");
+}
+
+static void
+test_image (TlsTest *test, gconstpointer data)
+{
+  g_autoptr(GRand) rand = g_rand_new_with_seed (0x511);
+  g_autoptr(GByteArray) records = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autofree guint8 *image = NULL;
+  g_autofree guint8 *decoded = NULL;
+  /* Larger than a single TLS record */
+  const gsize image_len = 20000;
+  gsize i;
+  int len;
+
+  do_handshake (test);
+
+  image = g_malloc (image_len);
+  for (i = 0; i < image_len; i++)
+    image[i] = g_rand_int (rand);
+  decoded = g_malloc (G_MAXUINT16);
+
+  for (i = 0; i < 3; i++)
+    {
+      g_assert_cmpint (SSL_write (test->client, image, image_len), ==, image_len);
+      g_clear_pointer (&records, g_byte_array_unref);
+      records = client_flush (test);
+
+      g_assert_cmpint (goodix_tls_client_send (&test->server, records->data, records->len), ==, records->len);
+      len = goodix_tls_server_receive (&test->server, decoded, G_MAXUINT16, &error);
+      g_assert_no_error (error);
+      g_assert_cmpmem (decoded, len, image, image_len);
+    }
+
+  /* Nothing left to decrypt */
+  len = goodix_tls_server_receive (&test->server, decoded, G_MAXUINT16, &error);
+  g_assert_cmpint (len, <, 0);
+  g_assert_error (error, FP_DEVICE_ERROR, FP_DEVICE_ERROR_PROTO);
+}
+
+static void
+test_bad_handshake (TlsTest *test, gconstpointer data)
+{
+  /* A handshake record with a bogus message */
+  guint8 garbage[] = { 0x16, 0x03, 0x03, 0x00, 0x04, 0xff, 0x00, 0x00, 0x00 };
+
+  guint8 buf[1024];
+
+  goodix_tls_client_send (&test->server, garbage, sizeof (garbage));
+
+  g_assert_cmpuint (test->n_connected, ==, 1);
+  g_assert_error (test->connection_error, FP_DEVICE_ERROR, FP_DEVICE_ERROR_PROTO);
+  g_assert_false (test->server.established);
+
+  /* The failure is only reported once, whatever the device sends next */
+  goodix_tls_client_send (&test->server, garbage, sizeof (garbage));
+  goodix_tls_client_recv (&test->server, buf, sizeof (buf));
+  g_assert_cmpuint (test->n_connected, ==, 1);
+  g_assert_false (test->server.established);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/goodixtls/handshake", TlsTest, NULL,
+              tls_test_setup, test_handshake, tls_test_teardown);
+  g_test_add ("/goodixtls/image", TlsTest, NULL,
+              tls_test_setup, test_image, tls_test_teardown);
+  g_test_add ("/goodixtls/bad-handshake", TlsTest, NULL,
+              tls_test_setup, test_bad_handshake, tls_test_teardown);
+
+  return g_test_run ();
+}
@@ -0,0 +1,166 @@
+/*
+ * NBIS arena unit tests
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include <nbis.h>
+
+static void
+fill (gpointer mem, gsize size, guint8 value)
+{
+  memset (mem, value, size);
+}
+
+static void
+assert_filled (gconstpointer mem, gsize size, guint8 value)
+{
+  const guint8 *bytes = mem;
+  gsize i;
+
+  for (i = 0; i < size; i++)
+    g_assert_cmpuint (bytes[i], ==, value);
+}
+
+static void
+test_inactive (void)
+{
+  gpointer mem = nbis_malloc (64);
+
+  /* Plain heap memory outside of an extraction */
+  g_assert_true (nbis_arena_steal (mem) == mem);
+  mem = nbis_realloc (mem, 128);
+  fill (mem, 128, 0x11);
+  g_free (mem);
+
+  g_assert_null (nbis_malloc (0));
+  nbis_free (NULL);
+}
+
+static void
+test_blocks (void)
+{
+  g_autoptr(GPtrArray) stolen = g_ptr_array_new_with_free_func (g_free);
+  guint8 *blocks[100];
+  guint8 *last, *big, *moved;
+  guint i;
+
+  nbis_arena_begin ();
+
+  /* Enough to span several chunks */
+  for (i = 0; i < G_N_ELEMENTS (blocks); i++)
+    {
+      blocks[i] = nbis_malloc0 (i * 97 + 1);
+      assert_filled (blocks[i], i * 97 + 1, 0);
+      fill (blocks[i], i * 97 + 1, i);
+      g_assert_cmpuint (GPOINTER_TO_SIZE (blocks[i]) % sizeof (gdouble), ==, 0);
+    }
+
+  /* Freeing the latest block makes its space available again */
+  last = nbis_malloc (32);
+  nbis_free (last);
+  g_assert_true (nbis_malloc (16) == last);
+
+  /* The latest block grows in place, older ones move */
+  g_assert_true (nbis_realloc (last, 256) == last);
+  fill (last, 256, 0xaa);
+  moved = nbis_realloc (blocks[1], 2000);
+  assert_filled (moved, 98, 1);
+  assert_filled (last, 256, 0xaa);
+  blocks[1] = moved;
+
+  /* Large blocks are never served by the arena */
+  big = nbis_malloc (1024 * 1024);
+  g_assert_true (nbis_arena_steal (big) == big);
+  g_ptr_array_add (stolen, big);
+
+  for (i = 0; i < G_N_ELEMENTS (blocks); i += 7)
+    {
+      guint8 *copy = nbis_arena_steal (blocks[i]);
+
+      g_assert_true (copy != blocks[i]);
+      g_ptr_array_add (stolen, copy);
+    }
+
+  nbis_arena_end ();
+
+  /* Stolen blocks outlive the arena */
+  for (i = 0; i < G_N_ELEMENTS (blocks); i += 7)
+    assert_filled (g_ptr_array_index (stolen, i / 7 + 1), i * 97 + 1, i);
+}
+
+static void
+test_minutiae (void)
+{
+  MINUTIAE *minutiae;
+  guint8 *chunk;
+  int i, j;
+
+  /* Runs twice to also use the chunks kept from the previous extraction */
+  for (j = 0; j < 2; j++)
+    {
+      nbis_arena_begin ();
+
+      g_assert_cmpint (alloc_minutiae (&minutiae, 4), ==, 0);
+      for (i = 0; i < 10; i++)
+        {
+          MINUTIA *minutia;
+
+          g_assert_cmpint (create_minutia (&minutia, i, i + 1, i, i + 1, i,
+                                           0.5, BIFURCATION, APPEARING, 0), ==, 0);
+          if (minutiae->num >= minutiae->alloc)
+            g_assert_cmpint (realloc_minutiae (minutiae, 4), ==, 0);
+
+          minutia->num_nbrs = 2;
+          minutia->nbrs = nbis_malloc (2 * sizeof (int));
+          minutia->ridge_counts = nbis_malloc (2 * sizeof (int));
+          minutia->nbrs[0] = minutia->ridge_counts[0] = i;
+          minutia->nbrs[1] = minutia->ridge_counts[1] = -i;
+          minutiae->list[minutiae->num++] = minutia;
+        }
+
+      minutiae = nbis_arena_steal_minutiae (minutiae);
+
+      /* Garbage over whatever the arena handed out */
+      chunk = nbis_malloc (1024);
+      fill (chunk, 1024, 0xff);
+      nbis_arena_end ();
+
+      g_assert_cmpint (minutiae->num, ==, 10);
+      for (i = 0; i < minutiae->num; i++)
+        {
+          g_assert_cmpint (minutiae->list[i]->x, ==, i);
+          g_assert_cmpint (minutiae->list[i]->ey, ==, i + 1);
+          g_assert_cmpint (minutiae->list[i]->nbrs[1], ==, -i);
+          g_assert_cmpint (minutiae->list[i]->ridge_counts[0], ==, i);
+        }
+
+      free_minutiae (minutiae);
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/nbis/arena/inactive", test_inactive);
+  g_test_add_func ("/nbis/arena/blocks", test_blocks);
+  g_test_add_func ("/nbis/arena/minutiae", test_minutiae);
+
+  return g_test_run ();
+}
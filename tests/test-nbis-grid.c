@@ -0,0 +1,179 @@
+/*
+ * NBIS minutiae grid unit tests
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <cairo.h>
+#include <glib.h>
+#include <nbis.h>
+
+#include "fpi-compat.h"
+#include "test-config.h"
+
+/* The default resolution of 500 ppi */
+#define TEST_PPMM 19.685
+
+/* Loads the gray pixels of the image captured in the umockdev test of
+ * @driver, transposed if asked to. */
+static guint8 *
+load_capture (const char *driver, gboolean transpose, gint *width, gint *height)
+{
+  g_autofree char *path = NULL;
+  cairo_surface_t *png;
+  const guint8 *data;
+  guint8 *pixels;
+  gint w, h, stride;
+  gint x, y;
+
+  path = g_build_path (G_DIR_SEPARATOR_S, SOURCE_ROOT, "tests", driver,
+                       "capture.png", NULL);
+  png = cairo_image_surface_create_from_png (path);
+  g_assert_cmpint (cairo_surface_status (png), ==, CAIRO_STATUS_SUCCESS);
+  g_assert_cmpint (cairo_image_surface_get_format (png), ==, CAIRO_FORMAT_RGB24);
+
+  /* capture.py stores the gray value in all three colour channels */
+  data = cairo_image_surface_get_data (png);
+  stride = cairo_image_surface_get_stride (png);
+  w = cairo_image_surface_get_width (png);
+  h = cairo_image_surface_get_height (png);
+  pixels = g_malloc (w * h);
+  for (y = 0; y < h; y++)
+    for (x = 0; x < w; x++)
+      {
+        if (transpose)
+          pixels[x * h + y] = data[y * stride + x * 4 + 1];
+        else
+          pixels[y * w + x] = data[y * stride + x * 4 + 1];
+      }
+
+  *width = transpose ? h : w;
+  *height = transpose ? w : h;
+
+  cairo_surface_destroy (png);
+
+  return pixels;
+}
+
+static MINUTIAE *
+extract (guint8 *pixels, gint width, gint height, gboolean use_grid)
+{
+  LFSPARMS lfsparms = g_lfsparms_V2;
+  MINUTIAE *minutiae = NULL;
+
+  lfsparms.use_minutiae_grid = use_grid;
+  g_assert_cmpint (get_minutiae (&minutiae, NULL, NULL, NULL, NULL, NULL,
+                                 NULL, NULL, NULL, NULL, NULL, NULL,
+                                 pixels, width, height, 8, TEST_PPMM,
+                                 &lfsparms), ==, 0);
+  g_assert_nonnull (minutiae);
+
+  return minutiae;
+}
+
+static void
+assert_same_minutiae (MINUTIAE *minutiae, MINUTIAE *reference)
+{
+  gint i, j;
+
+  g_assert_cmpint (minutiae->num, ==, reference->num);
+  for (i = 0; i < minutiae->num; i++)
+    {
+      MINUTIA *m = minutiae->list[i];
+      MINUTIA *r = reference->list[i];
+
+      g_assert_cmpint (m->x, ==, r->x);
+      g_assert_cmpint (m->y, ==, r->y);
+      g_assert_cmpint (m->ex, ==, r->ex);
+      g_assert_cmpint (m->ey, ==, r->ey);
+      g_assert_cmpint (m->direction, ==, r->direction);
+      g_assert_cmpfloat (m->reliability, ==, r->reliability);
+      g_assert_cmpint (m->type, ==, r->type);
+      g_assert_cmpint (m->appearing, ==, r->appearing);
+      g_assert_cmpint (m->feature_id, ==, r->feature_id);
+
+      g_assert_cmpint (m->num_nbrs, ==, r->num_nbrs);
+      for (j = 0; j < m->num_nbrs; j++)
+        {
+          g_assert_cmpint (m->nbrs[j], ==, r->nbrs[j]);
+          g_assert_cmpint (m->ridge_counts[j], ==, r->ridge_counts[j]);
+        }
+    }
+}
+
+/* Neighbours are only looked up in the grid if the list is ordered on x
+ * then y, see count_minutiae_ridges(). */
+static gboolean
+ridges_use_grid (MINUTIAE *minutiae, gint width)
+{
+  gint i;
+
+  for (i = 0; i < minutiae->num; i++)
+    if (minutiae->list[i]->y >= width)
+      return FALSE;
+
+  return minutiae->num > 1;
+}
+
+static void
+test_grid_captures (void)
+{
+  const char *drivers[] = {
+    "aes2501", "aes3500", "egis0570", "elan-cobo", "elan", "elanspi",
+    "nb1010", "upektc_img-tcs1s", "upektc_img", "uru4000-4500",
+    "uru4000-msv2", "vfs0050", "vfs301", "vfs5011", "vfs7552",
+  };
+  guint n_ridge_grid = 0;
+  guint i, transpose;
+
+  /* Transposing makes the tall captures wide, so that the ridge counting
+   * uses the grid for them as well. */
+  for (i = 0; i < G_N_ELEMENTS (drivers); i++)
+    for (transpose = 0; transpose < 2; transpose++)
+      {
+        g_autofree guint8 *pixels = NULL;
+        MINUTIAE *minutiae;
+        MINUTIAE *reference;
+        gint width, height;
+
+        pixels = load_capture (drivers[i], transpose, &width, &height);
+        minutiae = extract (pixels, width, height, TRUE);
+        reference = extract (pixels, width, height, FALSE);
+
+        g_test_message ("%s%s: %d minutiae", drivers[i],
+                        transpose ? " (transposed)" : "", minutiae->num);
+        g_assert_cmpint (minutiae->num, >, 0);
+        assert_same_minutiae (minutiae, reference);
+
+        if (ridges_use_grid (minutiae, width))
+          n_ridge_grid++;
+
+        free_minutiae (minutiae);
+        free_minutiae (reference);
+      }
+
+  g_assert_cmpuint (n_ridge_grid, >=, G_N_ELEMENTS (drivers));
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/nbis/grid/captures", test_grid_captures);
+
+  return g_test_run ();
+}
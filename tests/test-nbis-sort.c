@@ -0,0 +1,234 @@
+/*
+ * NBIS sorting unit tests
+ * Copyright (C) 2026 The libfprint authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <glib.h>
+#include <nbis.h>
+
+#include "fpi-compat.h"
+
+/* Minutiae offsets (y * iw + x) as sorted by sort_minutiae_y_x() for the
+ * vfs5011 capture, in detection order. */
+static const int recorded_offsets[] = {
+  1290, 1300, 1315, 1331, 1347, 1361, 1373, 1386, 1398, 1410, 1745, 1743,
+  2093, 2409, 2514, 3849, 4656, 4818, 4951, 4978, 6410, 8151, 10089, 11831,
+  13449, 15167, 15831, 16649, 19262, 19369, 19511, 23049, 24151, 24456,
+  25898, 27529, 28311, 32649, 33270, 38089, 39190, 39496, 39816, 41450,
+  41612, 42367, 42525, 44489, 46409, 46391, 47529, 47671, 48649, 48631,
+  49214, 49267, 49427, 50215, 50855, 51343, 51338, 52099, 52134, 7048,
+  11916, 51916, 11438, 38007, 37527, 51767, 43807, 42848, 51652, 16139,
+  49899, 15499, 49420, 49902, 48944, 51826, 37111,
+};
+
+/* Normalized DFT wave powers as sorted by sort_dft_waves() */
+static const double recorded_powers[][3] = {
+  { 6959087.3499799715, 4850226.493064777, 2243939.6299007768 },
+  { 344658.41725033289, 254773.5410708109, 57998.301093767623 },
+  { 3448864.9534778185, 4360604.9887636676, 2091299.8612122189 },
+};
+
+/* Neighbor angles as sorted by sort_neighbors() */
+static const double recorded_thetas[][5] = {
+  { 2.6590793585673165, 1.8490959858000089, 1.0390722595360913,
+    2.1193457292454241, 1.5608956602069082 },
+  { 1.2882413743253096, 1.8429422173260832, 0.66510268646949378,
+    1.3310532179244401, 1.6926387638148137 },
+};
+
+/* The bubble sorts NBIS originally shipped with, the replacements have to
+ * order ties the same way. */
+static void
+reference_sort_int_inc_2 (int *ranks, int *items, int len)
+{
+  gboolean done = FALSE;
+
+  while (!done)
+    {
+      done = TRUE;
+      for (int i = 1; i < len; i++)
+        {
+          if (ranks[i - 1] > ranks[i])
+            {
+              int t = ranks[i];
+              ranks[i] = ranks[i - 1];
+              ranks[i - 1] = t;
+              if (items)
+                {
+                  t = items[i];
+                  items[i] = items[i - 1];
+                  items[i - 1] = t;
+                }
+              done = FALSE;
+            }
+        }
+      len--;
+    }
+}
+
+static void
+reference_sort_double_2 (double *ranks, int *items, int len, gboolean decreasing)
+{
+  gboolean done = FALSE;
+
+  while (!done)
+    {
+      done = TRUE;
+      for (int i = 1; i < len; i++)
+        {
+          if (decreasing ? ranks[i - 1] < ranks[i] : ranks[i - 1] > ranks[i])
+            {
+              double trank = ranks[i];
+              int titem = items[i];
+
+              ranks[i] = ranks[i - 1];
+              ranks[i - 1] = trank;
+              items[i] = items[i - 1];
+              items[i - 1] = titem;
+              done = FALSE;
+            }
+        }
+      len--;
+    }
+}
+
+static void
+check_int (const int *ranks, int len)
+{
+  g_autofree int *expected_ranks = g_memdup2 (ranks, len * sizeof (int));
+  g_autofree int *expected_items = g_new (int, len);
+  g_autofree int *sorted_ranks = g_memdup2 (ranks, len * sizeof (int));
+  g_autofree int *sorted_items = g_new (int, len);
+  g_autofree int *sorted_only = g_memdup2 (ranks, len * sizeof (int));
+  int *order = NULL;
+  int i;
+
+  for (i = 0; i < len; i++)
+    expected_items[i] = sorted_items[i] = i;
+
+  reference_sort_int_inc_2 (expected_ranks, expected_items, len);
+
+  stable_sort_int_inc_2 (sorted_ranks, sorted_items, len);
+  g_assert_cmpmem (sorted_ranks, len * sizeof (int),
+                   expected_ranks, len * sizeof (int));
+  g_assert_cmpmem (sorted_items, len * sizeof (int),
+                   expected_items, len * sizeof (int));
+
+  stable_sort_int_inc (sorted_only, len);
+  g_assert_cmpmem (sorted_only, len * sizeof (int),
+                   expected_ranks, len * sizeof (int));
+
+  /* Used to sort minutiae */
+  memcpy (sorted_ranks, ranks, len * sizeof (int));
+  g_assert_cmpint (sort_indices_int_inc (&order, sorted_ranks, len), ==, 0);
+  g_assert_cmpmem (order, len * sizeof (int),
+                   expected_items, len * sizeof (int));
+  g_free (order);
+}
+
+static void
+check_double (const double *ranks, int len, gboolean decreasing)
+{
+  g_autofree double *expected_ranks = g_memdup2 (ranks, len * sizeof (double));
+  g_autofree int *expected_items = g_new (int, len);
+  g_autofree double *sorted_ranks = g_memdup2 (ranks, len * sizeof (double));
+  g_autofree int *sorted_items = g_new (int, len);
+  int i;
+
+  for (i = 0; i < len; i++)
+    expected_items[i] = sorted_items[i] = i;
+
+  reference_sort_double_2 (expected_ranks, expected_items, len, decreasing);
+
+  if (decreasing)
+    stable_sort_double_dec_2 (sorted_ranks, sorted_items, len);
+  else
+    stable_sort_double_inc_2 (sorted_ranks, sorted_items, len);
+
+  g_assert_cmpmem (sorted_ranks, len * sizeof (double),
+                   expected_ranks, len * sizeof (double));
+  g_assert_cmpmem (sorted_items, len * sizeof (int),
+                   expected_items, len * sizeof (int));
+}
+
+static void
+test_recorded (void)
+{
+  guint i;
+
+  check_int (recorded_offsets, G_N_ELEMENTS (recorded_offsets));
+
+  for (i = 0; i < G_N_ELEMENTS (recorded_powers); i++)
+    check_double (recorded_powers[i], G_N_ELEMENTS (recorded_powers[i]), TRUE);
+
+  for (i = 0; i < G_N_ELEMENTS (recorded_thetas); i++)
+    check_double (recorded_thetas[i], G_N_ELEMENTS (recorded_thetas[i]), FALSE);
+}
+
+static void
+test_random (void)
+{
+  g_autoptr(GRand) rand = g_rand_new_with_seed (0x5027);
+  /* Around the insertion block and merge boundaries */
+  const int lengths[] = { 0, 1, 2, 19, 20, 21, 39, 40, 41, 80, 81, 161, 1000, 2049 };
+  /* Small ranges give lots of ties */
+  const int ranges[] = { 1, 2, 10, 1000, G_MAXINT };
+  guint i, j;
+  int k;
+
+  for (i = 0; i < G_N_ELEMENTS (lengths); i++)
+    {
+      for (j = 0; j < G_N_ELEMENTS (ranges); j++)
+        {
+          int len = lengths[i];
+          g_autofree int *iranks = g_new (int, len);
+          g_autofree double *dranks = g_new (double, len);
+
+          for (k = 0; k < len; k++)
+            {
+              iranks[k] = g_rand_int_range (rand, 0, ranges[j]);
+              dranks[k] = iranks[k] / 7.0 - ranges[j] / 14.0;
+            }
+
+          check_int (iranks, len);
+          check_double (dranks, len, FALSE);
+          check_double (dranks, len, TRUE);
+
+          /* Presorted and reversed input */
+          stable_sort_int_inc (iranks, len);
+          check_int (iranks, len);
+          for (k = 0; k < len / 2; k++)
+            {
+              int t = iranks[k];
+              iranks[k] = iranks[len - 1 - k];
+              iranks[len - 1 - k] = t;
+            }
+          check_int (iranks, len);
+        }
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/nbis/sort/recorded", test_recorded);
+  g_test_add_func ("/nbis/sort/random", test_random);
+
+  return g_test_run ();
+}
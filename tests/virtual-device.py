@@ -1188,6 +1188,22 @@ class VirtualDeviceStorage(VirtualDevice):
         self.check_verify(lt, 'right-thumb', identify=True, match=False)
         self.check_verify(rt, 'left-thumb', identify=True, match=False)
 
+    def test_identify_large_storage(self):
+        for i in range(200):
+            self.send_command('INSERT', 'p{}'.format(i))
+        rt = self.enroll_print('right-thumb', FPrint.Finger.RIGHT_THUMB)
+        lt = self.enroll_print('left-thumb', FPrint.Finger.LEFT_THUMB)
+
+        stored = self.dev.list_prints_sync()
+        self.assertEqual(len(stored), 202)
+
+        self.check_verify(stored, 'p150', identify=True, match=True)
+        self.check_verify([rt, lt], 'p150', identify=True, match=False)
+        self.check_verify(stored, 'left-thumb', identify=True, match=True)
+
+        self.send_command('REMOVE', 'p150')
+        self.check_verify(stored, 'p150', identify=True, match=False)
+
     def test_identify_retry(self):
         with self.assertRaises(GLib.GError) as error:
             self.check_verify(FPrint.Print.new(self.dev),